@@ -4,7 +4,23 @@ include $(CLEAR_VARS)
 LOCAL_CFLAGS += -DANDROID_BUILD
 LOCAL_CFLAGS += -Wall
 
-LOCAL_SRC_FILES += host/main.c
+LOCAL_SRC_FILES += host/main.c \
+		   host/commandline.c \
+		   host/storage.c \
+		   host/seal.c \
+		   host/sign.c \
+		   host/generate.c \
+		   host/rng.c \
+		   host/rewrap.c \
+		   host/archive.c \
+		   host/sync.c \
+		   host/provision.c \
+		   host/codec.c \
+		   host/bench.c \
+		   host/stats.c \
+		   host/trace.c \
+		   host/metrics.c \
+		   host/util.c
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/ta/include
 
@@ -14,4 +30,26 @@ LOCAL_VENDOR_MODULE := true
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_EXECUTABLE)
 
+include $(CLEAR_VARS)
+LOCAL_CFLAGS += -DANDROID_BUILD
+LOCAL_CFLAGS += -Wall
+
+LOCAL_SRC_FILES += host/bench_main.c \
+		   host/suite.c \
+		   host/workload.c \
+		   host/stress.c \
+		   host/storage.c \
+		   host/codec.c \
+		   host/trace.c \
+		   host/metrics.c \
+		   host/util.c
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/ta/include
+
+LOCAL_SHARED_LIBRARIES := libteec
+LOCAL_MODULE := seal-key-bench
+LOCAL_VENDOR_MODULE := true
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
+
 include $(LOCAL_PATH)/ta/Android.mk
@@ -0,0 +1,198 @@
+#include "archive.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ARCHIVE_MAX_CHUNK                                                      \
+  (TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE + TA_SEAL_KEY_AE_TAG_SIZE)
+// bytes of the id list handed to the TA per chunk, more than a chunk holds
+#define ARCHIVE_IDS_SIZE (16 * 1024)
+
+// the number of ids in the first len bytes of a list of ids
+static size_t count_ids(const uint8_t *ids, size_t len) {
+    size_t count = 0;
+
+    for (size_t pos = 0; pos < len; pos += 1 + ids[pos])
+        count++;
+    return count;
+}
+
+static void report_progress(const char *what, struct archive_stats *stats,
+                            double start, double *report) {
+    if (now_seconds() - *report < 1)
+        return;
+    *report = now_seconds();
+    INFO("%s %zu keys in %zu chunks (%.0f keys/s)", what, stats->objects,
+         stats->chunks, stats->objects / (*report - start));
+}
+
+/*
+ * Write the objects listed in ids, or every object of the store when ids is
+ * NULL, to out_fd as one archive sealed with the AES key stored under id.
+ * The TA serializes and seals the objects a chunk at a time, so the memory
+ * used does not depend on the size of the store.
+ */
+static TEEC_Result export_archive(struct test_ctx *ctx, char *id,
+                                  uint8_t *ids, size_t ids_len, int out_fd,
+                                  struct archive_stats *stats) {
+    uint8_t header[ARCHIVE_HEADER_LEN];
+    uint8_t len[4];
+    TEEC_SharedMemory out;
+    TEEC_Result res;
+    double start = now_seconds();
+    double report = start;
+    int last = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    memcpy(header, ARCHIVE_MAGIC, ARCHIVE_MAGIC_LEN);
+    header[ARCHIVE_MAGIC_LEN] = ARCHIVE_VERSION;
+    res = init_secure_archive(ctx, id, TA_SEAL_KEY_MODE_ENCRYPT, 0,
+                              header + ARCHIVE_MAGIC_LEN + 1,
+                              TA_SEAL_KEY_CHUNK_PREFIX_SIZE);
+    if (res != TEEC_SUCCESS)
+        return res;
+    if (write_full(out_fd, header, sizeof(header)) < 0) {
+        ERRO("Failed to write the archive header");
+        return TEEC_ERROR_GENERIC;
+    }
+    stats->bytes = sizeof(header);
+
+    res = alloc_shared_memory(ctx, &out, ARCHIVE_MAX_CHUNK, TEEC_MEM_OUTPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    while (!last) {
+        size_t out_len;
+        uint32_t count;
+
+        if (ids == NULL) {
+            res = export_secure_chunk(ctx, &out, &out_len, &last, &count);
+        } else {
+            size_t slice = ids_len < ARCHIVE_IDS_SIZE ? ids_len
+                                                      : ARCHIVE_IDS_SIZE;
+            size_t consumed;
+
+            res = export_secure_ids(ctx, &out, &out_len, ids, slice,
+                                    slice == ids_len, &last, &consumed);
+            count = count_ids(ids, consumed);
+            ids += consumed;
+            ids_len -= consumed;
+        }
+        if (res != TEEC_SUCCESS)
+            break;
+        put_be32(len, out_len | (last ? ARCHIVE_LAST_CHUNK : 0));
+        if (write_full(out_fd, len, sizeof(len)) < 0 ||
+            write_full(out_fd, out.buffer, out_len) < 0) {
+            ERRO("Failed to write the archive");
+            res = TEEC_ERROR_GENERIC;
+            break;
+        }
+        stats->chunks++;
+        stats->objects += count;
+        stats->bytes += sizeof(len) + out_len;
+        report_progress("exported", stats, start, &report);
+    }
+
+    TEEC_ReleaseSharedMemory(&out);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+TEEC_Result export_store(struct test_ctx *ctx, char *id, int out_fd,
+                         struct archive_stats *stats) {
+    return export_archive(ctx, id, NULL, 0, out_fd, stats);
+}
+
+// ids is a list of storage ids, each a length byte and the id
+TEEC_Result export_ids(struct test_ctx *ctx, char *id, uint8_t *ids,
+                       size_t ids_len, int out_fd,
+                       struct archive_stats *stats) {
+    return export_archive(ctx, id, ids, ids_len, out_fd, stats);
+}
+
+/*
+ * Read an archive written by export_store from in_fd and store its objects.
+ * The TA authenticates every chunk before it stores anything of it. Existing
+ * keys are kept and counted as skipped unless overwrite is set. Nothing
+ * after the last chunk is read, so in_fd can carry more data.
+ */
+TEEC_Result import_archive(struct test_ctx *ctx, char *id, int in_fd,
+                           int overwrite, struct archive_stats *stats) {
+    uint8_t header[ARCHIVE_HEADER_LEN];
+    uint8_t len[4];
+    TEEC_SharedMemory in;
+    TEEC_Result res;
+    double start = now_seconds();
+    double report = start;
+    int last = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (read_full(in_fd, header, sizeof(header)) != sizeof(header) ||
+        memcmp(header, ARCHIVE_MAGIC, ARCHIVE_MAGIC_LEN) != 0) {
+        ERRO("Input is not a key archive");
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    if (header[ARCHIVE_MAGIC_LEN] != ARCHIVE_VERSION) {
+        ERRO("Unsupported archive version %u", header[ARCHIVE_MAGIC_LEN]);
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    stats->bytes = sizeof(header);
+
+    res = init_secure_archive(ctx, id, TA_SEAL_KEY_MODE_DECRYPT,
+                              overwrite ? TA_SEAL_KEY_ARCHIVE_OVERWRITE : 0,
+                              header + ARCHIVE_MAGIC_LEN + 1,
+                              TA_SEAL_KEY_CHUNK_PREFIX_SIZE);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    res = alloc_shared_memory(ctx, &in, ARCHIVE_MAX_CHUNK, TEEC_MEM_INPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    while (!last) {
+        uint32_t in_len;
+        uint32_t stored;
+        uint32_t skipped;
+
+        if (read_full(in_fd, len, sizeof(len)) != sizeof(len)) {
+            ERRO("Truncated archive, the last chunk is missing");
+            res = TEEC_ERROR_BAD_FORMAT;
+            break;
+        }
+        in_len = get_be32(len);
+        last = (in_len & ARCHIVE_LAST_CHUNK) != 0;
+        in_len &= ~ARCHIVE_LAST_CHUNK;
+        if (in_len > ARCHIVE_MAX_CHUNK ||
+            read_full(in_fd, in.buffer, in_len) != (ssize_t)in_len) {
+            ERRO("Truncated archive in chunk %zu", stats->chunks);
+            res = TEEC_ERROR_BAD_FORMAT;
+            break;
+        }
+        res = import_secure_chunk(ctx, &in, in_len, last, &stored, &skipped);
+        if (res != TEEC_SUCCESS)
+            break;
+        stats->chunks++;
+        stats->objects += stored;
+        stats->skipped += skipped;
+        stats->bytes += sizeof(len) + in_len;
+        report_progress("imported", stats, start, &report);
+    }
+
+    TEEC_ReleaseSharedMemory(&in);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+// import_archive for a file that holds nothing but the archive
+TEEC_Result import_store(struct test_ctx *ctx, char *id, int in_fd,
+                         int overwrite, struct archive_stats *stats) {
+    TEEC_Result res = import_archive(ctx, id, in_fd, overwrite, stats);
+    uint8_t c;
+
+    if (res == TEEC_SUCCESS && read_full(in_fd, &c, 1) != 0) {
+        ERRO("Unexpected data after the last chunk of the archive");
+        res = TEEC_ERROR_BAD_FORMAT;
+    }
+    return res;
+}
@@ -0,0 +1,49 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "storage.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* TA API: UUID and command IDs */
+#include <seal-key_ta.h>
+
+/*
+ * Archive layout, all integers are big endian:
+ *
+ * magic      4 bytes  "SKAR"
+ * version    1 byte   ARCHIVE_VERSION
+ * prefix     TA_SEAL_KEY_CHUNK_PREFIX_SIZE bytes, the nonce prefix
+ * chunks
+ *
+ * Every chunk is a 4 byte length followed by the ciphertext and the tag of
+ * TA_SEAL_KEY_CMD_ARCHIVE_EXPORT. The top bit of the length marks the last
+ * chunk. The TA binds the index and the last flag of a chunk to its nonce,
+ * so reordered, dropped or appended chunks fail authentication.
+ */
+#define ARCHIVE_MAGIC "SKAR"
+#define ARCHIVE_MAGIC_LEN 4
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_LEN                                                     \
+  (ARCHIVE_MAGIC_LEN + 1 + TA_SEAL_KEY_CHUNK_PREFIX_SIZE)
+#define ARCHIVE_LAST_CHUNK 0x80000000u
+
+struct archive_stats {
+    size_t chunks;
+    size_t objects;
+    size_t skipped;
+    size_t bytes;
+    double seconds;
+};
+
+TEEC_Result export_store(struct test_ctx *ctx, char *id, int out_fd,
+                         struct archive_stats *stats);
+TEEC_Result export_ids(struct test_ctx *ctx, char *id, uint8_t *ids,
+                       size_t ids_len, int out_fd,
+                       struct archive_stats *stats);
+TEEC_Result import_archive(struct test_ctx *ctx, char *id, int in_fd,
+                           int overwrite, struct archive_stats *stats);
+TEEC_Result import_store(struct test_ctx *ctx, char *id, int in_fd,
+                         int overwrite, struct archive_stats *stats);
+
+#endif // !ARCHIVE_H
@@ -0,0 +1,106 @@
+#include "bench.h"
+#include "codec.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MB/s of raw bytes for rounds passes of encoding or decoding size bytes
+static double bench_bulk(int encoding, int decode, const uint8_t *raw,
+                         char *text, uint8_t *out, size_t size, long rounds) {
+    size_t text_len = codec_encoded_len(encoding, size);
+    double start = now_seconds();
+
+    for (long r = 0; r < rounds; r++) {
+        if (decode)
+            codec_decode(encoding, text, text_len, out);
+        else
+            codec_encode(encoding, raw, size, text);
+    }
+    return size * rounds / (now_seconds() - start) / 1e6;
+}
+
+// single keys encoded and decoded again per second, as get-key and set-key
+static double bench_keys(int encoding, const uint8_t *raw) {
+    char text[2 * CODEC_BENCH_KEY_SIZE];
+    uint8_t out[CODEC_BENCH_KEY_SIZE + 2];
+    double start = now_seconds();
+
+    for (long k = 0; k < CODEC_BENCH_KEYS; k++) {
+        size_t len = codec_encode(encoding, raw + k % 64,
+                                  CODEC_BENCH_KEY_SIZE, text);
+
+        codec_decode(encoding, text, len, out);
+    }
+    return CODEC_BENCH_KEYS / (now_seconds() - start);
+}
+
+/*
+ * Measure every encoding with the scalar and the vector code and print a
+ * table to stdout. With id the key stored under it is read from the TA as
+ * well, for the rate the codecs have to keep up with.
+ */
+TEEC_Result codec_bench(struct test_ctx *ctx, char *id, size_t size,
+                        long rounds) {
+    size_t text_size = codec_encoded_len(CODEC_HEX, size);
+    uint8_t *raw = malloc(size + 64);
+    char *text = malloc(text_size);
+    uint8_t *out = malloc(size + 2);
+    const char *simd = codec_simd_name();
+    TEEC_Result res = TEEC_SUCCESS;
+
+    if (raw == NULL || text == NULL || out == NULL) {
+        res = TEEC_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
+    for (size_t i = 0; i < size + 64; i++)
+        raw[i] = rand();
+
+    printf("%-10s %-7s %12s %12s %12s\n", "encoding", "code", "encode MB/s",
+           "decode MB/s", "keys/s");
+    for (int encoding = CODEC_HEX; encoding <= CODEC_BASE64URL; encoding++) {
+        for (int vector = 0; vector <= 1; vector++) {
+            double enc, dec;
+
+            if (vector && strcmp(simd, "scalar") == 0)
+                break;
+            codec_use_simd(vector);
+            enc = bench_bulk(encoding, 0, raw, text, out, size, rounds);
+            dec = bench_bulk(encoding, 1, raw, text, out, size, rounds);
+
+            if (memcmp(out, raw, size) != 0) {
+                ERRO("%s does not decode what it encoded",
+                     codec_name(encoding));
+                res = TEEC_ERROR_GENERIC;
+                goto out;
+            }
+            printf("%-10s %-7s %12.0f %12.0f %12.0f\n", codec_name(encoding),
+                   vector ? simd : "scalar", enc, dec,
+                   bench_keys(encoding, raw));
+        }
+    }
+    codec_use_simd(1);
+
+    if (id != NULL) {
+        char key[MAX_KEY_LEN];
+        size_t key_len;
+        double start = now_seconds();
+
+        for (int r = 0; r < CODEC_BENCH_READS; r++) {
+            key_len = sizeof(key);
+            res = read_secure_object(ctx, id, key, &key_len);
+            if (res != TEEC_SUCCESS)
+                goto out;
+        }
+        wipe(key, sizeof(key));
+        printf("%-10s %-7s %12s %12s %12.0f\n", "get-key", "TA", "-", "-",
+               CODEC_BENCH_READS / (now_seconds() - start));
+    }
+out:
+    free(out);
+    free(text);
+    free(raw);
+    return res;
+}
@@ -0,0 +1,18 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "storage.h"
+#include <stddef.h>
+
+// bytes run through the codecs per round and keys coded one by one
+#define CODEC_BENCH_SIZE (1024 * 1024)
+#define CODEC_BENCH_ROUNDS 100
+#define CODEC_BENCH_KEYS 1000000
+// size of the keys coded one by one and reads of the key given with -k
+#define CODEC_BENCH_KEY_SIZE 32
+#define CODEC_BENCH_READS 1000
+
+TEEC_Result codec_bench(struct test_ctx *ctx, char *id, size_t size,
+                        long rounds);
+
+#endif // !BENCH_H
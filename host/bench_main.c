@@ -0,0 +1,257 @@
+#include "storage.h"
+#include "stress.h"
+#include "suite.h"
+#include "workload.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// payload sizes swept by default, 16 bytes to 1 MiB
+static const size_t default_sizes[] = {
+    16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576,
+};
+
+static void usage(const char *prog_name) {
+    printf("Usage: %s [OPTION] ...\n", prog_name);
+    printf("Measure the latency and throughput of the TA commands, or of a "
+           "workload with -W\n");
+    printf("OPTIONS:\n");
+    printf("-t ops\tcomma separated ops out of open, close, ping, write, "
+           "read, stat, delete, all by default\n");
+    printf("-s sizes\tcomma separated payload sizes, K and M for KiB and "
+           "MiB, 16 to 1M by default\n");
+    printf("-c counts\tcomma separated numbers of objects in the store, 1 by "
+           "default\n");
+    printf("-n iterations\tmeasured calls per row, %d by default\n",
+           SUITE_ITERATIONS);
+    printf("-w warmup\tcalls before measuring, %d by default\n",
+           SUITE_WARMUP);
+    printf("-f format\ttext, csv or json, text by default\n");
+    printf("-o file\twrite the results to file instead of stdout\n");
+    printf("-l label\tnamed in the results, e.g. the firmware version\n");
+    printf("-W spec\trun the workload described in the file spec instead\n");
+    printf("-S workers\tcomma separated numbers of concurrent workers, run a "
+           "stress test with each instead, -n calls of -s bytes per worker\n");
+    printf("-m mode\tprocess or thread, how the workers of -S run, process "
+           "by default\n");
+    printf("-x mix\tread,write,delete proportions of -S, 70,20,10 by "
+           "default\n");
+    printf("-k ids\tshared,own ids of -S, touched by every worker and by one "
+           "worker only, 4,4 by default\n");
+    printf("-h\tshow this help message\n");
+}
+
+// a number with an optional K or M suffix, 0 when it is not one
+static size_t parse_size(const char *s) {
+    char *end;
+    unsigned long n = strtoul(s, &end, 10);
+
+    if (end == s)
+        return 0;
+    if (*end == 'K' || *end == 'k')
+        n *= 1024, end++;
+    else if (*end == 'M' || *end == 'm')
+        n *= 1024 * 1024, end++;
+    return *end == '\0' ? n : 0;
+}
+
+// split a comma separated list of sizes into list, the number of entries
+static size_t parse_sizes(char *arg, size_t *list, size_t max,
+                          const char *what) {
+    size_t n = 0;
+
+    for (char *s = strtok(arg, ","); s != NULL; s = strtok(NULL, ",")) {
+        if (n == max)
+            errx(1, "at most %zu %s", max, what);
+        list[n] = parse_size(s);
+        if (list[n] == 0)
+            errx(1, "bad %s: %s", what, s);
+        n++;
+    }
+    if (n == 0)
+        errx(1, "no %s given", what);
+    return n;
+}
+
+// split a comma separated list of numbers, 0 included, into list
+static size_t parse_numbers(char *arg, double *list, size_t max,
+                            const char *what) {
+    size_t n = 0;
+
+    for (char *s = strtok(arg, ","); s != NULL; s = strtok(NULL, ",")) {
+        char *end;
+
+        if (n == max)
+            errx(1, "at most %zu %s", max, what);
+        list[n] = strtod(s, &end);
+        if (end == s || *end != '\0' || list[n] < 0)
+            errx(1, "bad %s: %s", what, s);
+        n++;
+    }
+    if (n != max)
+        errx(1, "%zu %s expected", max, what);
+    return n;
+}
+
+static unsigned int parse_ops(char *arg) {
+    unsigned int ops = 0;
+
+    for (char *s = strtok(arg, ","); s != NULL; s = strtok(NULL, ",")) {
+        int op = strcmp(s, "all") == 0 ? -2 : suite_parse_op(s);
+
+        if (op == -1)
+            errx(1, "unknown op: %s", s);
+        ops |= op == -2 ? SUITE_ALL_OPS : 1u << op;
+    }
+    return ops;
+}
+
+int main(int argc, char *argv[]) {
+    struct test_ctx ctx;
+    struct suite_options o;
+    struct workload w;
+    struct stress_options so;
+    size_t steps[STRESS_MAX_STEPS];
+    double ids[2];
+    const char *out_file = NULL, *spec = NULL;
+    TEEC_Result res;
+    int opt, stress = 0, size_set = 0;
+
+    memset(&o, 0, sizeof(o));
+    o.ops = SUITE_ALL_OPS;
+    o.nsizes = sizeof(default_sizes) / sizeof(*default_sizes);
+    memcpy(o.sizes, default_sizes, sizeof(default_sizes));
+    o.counts[0] = 1;
+    o.ncounts = 1;
+    o.warmup = SUITE_WARMUP;
+    o.iterations = SUITE_ITERATIONS;
+    o.format = SUITE_FORMAT_TEXT;
+    o.label = "";
+    o.out = stdout;
+    stress_defaults(&so);
+
+    while ((opt = getopt(argc, argv, "t:s:c:n:w:f:o:l:W:S:m:x:k:h")) != -1) {
+        switch (opt) {
+        case 't':
+            o.ops = parse_ops(optarg);
+            break;
+        case 's':
+            o.nsizes = parse_sizes(optarg, o.sizes, SUITE_MAX_SIZES, "sizes");
+            size_set = 1;
+            break;
+        case 'c':
+            o.ncounts =
+                parse_sizes(optarg, o.counts, SUITE_MAX_COUNTS, "counts");
+            break;
+        case 'n':
+            o.iterations = atol(optarg);
+            if (o.iterations < 1)
+                errx(1, "-n must be at least 1");
+            break;
+        case 'w':
+            o.warmup = atol(optarg);
+            if (o.warmup < 0)
+                errx(1, "-w must not be negative");
+            break;
+        case 'f':
+            if (strcmp(optarg, "text") == 0)
+                o.format = SUITE_FORMAT_TEXT;
+            else if (strcmp(optarg, "csv") == 0)
+                o.format = SUITE_FORMAT_CSV;
+            else if (strcmp(optarg, "json") == 0)
+                o.format = SUITE_FORMAT_JSON;
+            else
+                errx(1, "unknown format: %s", optarg);
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'l':
+            o.label = optarg;
+            break;
+        case 'W':
+            spec = optarg;
+            break;
+        case 'S':
+            so.nsteps =
+                parse_sizes(optarg, steps, STRESS_MAX_STEPS, "worker counts");
+            for (size_t i = 0; i < so.nsteps; i++) {
+                if (steps[i] > STRESS_MAX_WORKERS)
+                    errx(1, "at most %d workers", STRESS_MAX_WORKERS);
+                so.workers[i] = steps[i];
+            }
+            stress = 1;
+            break;
+        case 'm':
+            if (strcmp(optarg, "process") == 0)
+                so.processes = 1;
+            else if (strcmp(optarg, "thread") == 0)
+                so.processes = 0;
+            else
+                errx(1, "unknown mode: %s", optarg);
+            break;
+        case 'x':
+            parse_numbers(optarg, so.mix, WORKLOAD_MIX_OPS, "proportions");
+            if (so.mix[0] + so.mix[1] + so.mix[2] <= 0)
+                errx(1, "-x needs a proportion above 0");
+            break;
+        case 'k':
+            parse_numbers(optarg, ids, 2, "id counts");
+            if (ids[0] > STRESS_MAX_IDS || ids[1] > STRESS_MAX_IDS ||
+                ids[0] + ids[1] < 1)
+                errx(1, "-k takes 0 to %d ids each, at least 1 in all",
+                     STRESS_MAX_IDS);
+            so.shared_ids = ids[0];
+            so.own_ids = ids[1];
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    workload_defaults(&w);
+    if (spec != NULL && workload_parse(spec, &w) < 0)
+        return 1;
+    if (stress && spec != NULL)
+        errx(1, "-S and -W do not go together");
+    if (stress && size_set) {
+        if (o.sizes[0] < STRESS_MIN_SIZE || o.sizes[0] > WORKLOAD_MAX_SIZE)
+            errx(1, "-s must be %d to %d bytes with -S", STRESS_MIN_SIZE,
+                 WORKLOAD_MAX_SIZE);
+        so.size = o.sizes[0];
+    }
+    if (out_file != NULL) {
+        o.out = fopen(out_file, "w");
+        if (o.out == NULL)
+            err(1, "Failed to open %s", out_file);
+    }
+
+    prepare_tee_session(&ctx);
+    if (stress) {
+        so.ops = o.iterations;
+        so.format = o.format;
+        so.label = o.label;
+        so.out = o.out;
+        res = stress_run(&ctx, &so);
+    } else if (spec != NULL) {
+        res = workload_run(&ctx, &w, o.out, o.format, o.label);
+    } else {
+        res = suite_run(&ctx, &o);
+    }
+    terminate_tee_session(&ctx);
+    if (fclose(o.out) != 0)
+        err(1, "Failed to write the results");
+    if (res != TEEC_SUCCESS)
+        errx(1, "The benchmark failed with 0x%x", res);
+    return 0;
+}
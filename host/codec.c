@@ -0,0 +1,743 @@
+#include "codec.h"
+#include <string.h>
+
+/*
+ * Hex, base64 and base64url with vector loops for the bulk of the input:
+ * SSSE3 and AVX2 on x86, picked at run time, and NEON on aarch64. The
+ * scalar code handles what is left and is used everywhere else. Decoding is
+ * strict: no whitespace, no missing or extra padding and no stray bits in
+ * the last character.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CODEC_X86 1
+#include <immintrin.h>
+#define SSSE3 __attribute__((target("ssse3")))
+#define AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CODEC_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+ * The vector decoders classify a character by its nibbles: it is valid
+ * when lut_lo[low nibble] & lut_hi[high nibble] is 0. Adding roll[high
+ * nibble] turns it into its 6 bit value, only the character special needs
+ * special_roll instead.
+ */
+struct b64_alphabet {
+    char chars[65];
+    int8_t lut_lo[16];
+    int8_t lut_hi[16];
+    int8_t roll[16];
+    char special;
+    int8_t special_roll;
+    int padded;
+};
+
+static const struct b64_alphabet base64 = {
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+    {0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+     0x1b, 0x1b, 0x1b, 0x1a},
+    {0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+     0x10, 0x10, 0x10, 0x10},
+    {0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0},
+    '/',
+    16,
+    1,
+};
+
+// '-' and '_' instead of '+' and '/', 0x7? gets a bit of its own for '_'
+static const struct b64_alphabet base64url = {
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_",
+    {0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x3b,
+     0x3b, 0x3a, 0x3b, 0x33},
+    {0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x20, 0x10, 0x10, 0x10, 0x10,
+     0x10, 0x10, 0x10, 0x10},
+    {0, 0, 17, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0},
+    '_',
+    -32,
+    0,
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int use_simd = 1;
+
+int codec_parse(const char *name) {
+    if (strcmp(name, "raw") == 0)
+        return CODEC_RAW;
+    if (strcmp(name, "hex") == 0)
+        return CODEC_HEX;
+    if (strcmp(name, "base64") == 0)
+        return CODEC_BASE64;
+    if (strcmp(name, "base64url") == 0)
+        return CODEC_BASE64URL;
+    return -1;
+}
+
+const char *codec_name(int encoding) {
+    static const char *names[] = {"raw", "hex", "base64", "base64url"};
+
+    return names[encoding];
+}
+
+size_t codec_encoded_len(int encoding, size_t len) {
+    switch (encoding) {
+    case CODEC_HEX:
+        return 2 * len;
+    case CODEC_BASE64:
+        return (len + 2) / 3 * 4;
+    case CODEC_BASE64URL:
+        return len / 3 * 4 + (len % 3 ? len % 3 + 1 : 0);
+    default:
+        return len;
+    }
+}
+
+size_t codec_decoded_max(int encoding, size_t len) {
+    switch (encoding) {
+    case CODEC_HEX:
+        return len / 2;
+    case CODEC_BASE64:
+    case CODEC_BASE64URL:
+        return len / 4 * 3 + 2;
+    default:
+        return len;
+    }
+}
+
+// turn vector code on or off, to compare it with the scalar code
+void codec_use_simd(int on) { use_simd = on; }
+
+#ifdef CODEC_X86
+static int simd_level(void) {
+    if (!use_simd)
+        return 0;
+    if (__builtin_cpu_supports("avx2"))
+        return 2;
+    if (__builtin_cpu_supports("ssse3"))
+        return 1;
+    return 0;
+}
+
+const char *codec_simd_name(void) {
+    static const char *names[] = {"scalar", "ssse3", "avx2"};
+
+    return names[simd_level()];
+}
+
+static SSSE3 size_t hex_encode_ssse3(const uint8_t *in, size_t len,
+                                     char *out) {
+    const __m128i lut = _mm_loadu_si128((const __m128i *)hex_digits);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+
+        hi = _mm_shuffle_epi8(lut, hi);
+        lo = _mm_shuffle_epi8(lut, lo);
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 16),
+                         _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+static AVX2 size_t hex_encode_avx2(const uint8_t *in, size_t len, char *out) {
+    const __m256i lut = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)hex_digits));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+        __m256i lo = _mm256_and_si256(v, mask);
+        __m256i a, b;
+
+        hi = _mm256_shuffle_epi8(lut, hi);
+        lo = _mm256_shuffle_epi8(lut, lo);
+        // the unpacks work per 128 bit lane, put the lanes back in order
+        a = _mm256_unpacklo_epi8(hi, lo);
+        b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(out + 2 * i),
+                            _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 2 * i + 32),
+                            _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i;
+}
+
+// the values of 16 hex digits, *ok is cleared for every invalid one
+static inline SSSE3 __m128i hex_values_ssse3(__m128i v, __m128i *ok) {
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                             _mm_set1_epi8('a'));
+    __m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i is_l = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+    *ok = _mm_and_si128(*ok, _mm_or_si128(is_d, is_l));
+    l = _mm_add_epi8(l, _mm_set1_epi8(10));
+    return _mm_or_si128(_mm_and_si128(is_d, d), _mm_and_si128(is_l, l));
+}
+
+static SSSE3 size_t hex_decode_ssse3(const char *in, size_t len,
+                                     uint8_t *out) {
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m128i ok = _mm_set1_epi8(-1);
+        __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 16));
+
+        a = hex_values_ssse3(a, &ok);
+        b = hex_values_ssse3(b, &ok);
+        // the scalar code finds the invalid digit
+        if (_mm_movemask_epi8(ok) != 0xffff)
+            break;
+        // high nibble * 16 + low nibble
+        a = _mm_maddubs_epi16(a, weights);
+        b = _mm_maddubs_epi16(b, weights);
+        _mm_storeu_si128((__m128i *)(out + i / 2), _mm_packus_epi16(a, b));
+    }
+    return i;
+}
+
+static inline AVX2 __m256i hex_values_avx2(__m256i v, __m256i *ok) {
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i l = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+                                _mm256_set1_epi8('a'));
+    __m256i is_d =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    __m256i is_l =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+
+    *ok = _mm256_and_si256(*ok, _mm256_or_si256(is_d, is_l));
+    l = _mm256_add_epi8(l, _mm256_set1_epi8(10));
+    return _mm256_or_si256(_mm256_and_si256(is_d, d),
+                           _mm256_and_si256(is_l, l));
+}
+
+static AVX2 size_t hex_decode_avx2(const char *in, size_t len, uint8_t *out) {
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        __m256i ok = _mm256_set1_epi8(-1);
+        __m256i a = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(in + i + 32));
+
+        a = hex_values_avx2(a, &ok);
+        b = hex_values_avx2(b, &ok);
+        if (_mm256_movemask_epi8(ok) != -1)
+            break;
+        a = _mm256_maddubs_epi16(a, weights);
+        b = _mm256_maddubs_epi16(b, weights);
+        // packus works per lane, restore the order of the 64 bit pieces
+        a = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i *)(out + i / 2), a);
+    }
+    return i;
+}
+
+/*
+ * 12 bytes in each 128 bit lane to 16 indices into the alphabet: every 4
+ * byte word gets the bytes 1, 0, 2, 1 of its 3 bytes and the multiplies
+ * shift the four 6 bit fields into bytes of their own.
+ */
+static inline SSSE3 __m128i b64_indices_ssse3(__m128i v) {
+    __m128i t0, t1;
+
+    v = _mm_shuffle_epi8(
+        v, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    t0 = _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00));
+    t0 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    t1 = _mm_and_si128(v, _mm_set1_epi32(0x003f03f0));
+    t1 = _mm_mullo_epi16(t1, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+// the offset from each index to its character, picked by its range
+static inline SSSE3 __m128i b64_chars_ssse3(__m128i idx,
+                                            const struct b64_alphabet *a) {
+    const __m128i shift = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, a->chars[62] - 62,
+        a->chars[63] - 63, 'A', 0, 0);
+    // 0..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12, then 0..25 -> 13
+    __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+
+    r = _mm_or_si128(r, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, r), idx);
+}
+
+static SSSE3 size_t b64_encode_ssse3(const uint8_t *in, size_t len, char *out,
+                                     const struct b64_alphabet *a) {
+    size_t i, o;
+
+    // 16 bytes are loaded for the 12 that are used
+    for (i = 0, o = 0; i + 16 <= len; i += 12, o += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+
+        v = b64_chars_ssse3(b64_indices_ssse3(v), a);
+        _mm_storeu_si128((__m128i *)(out + o), v);
+    }
+    return i;
+}
+
+static AVX2 size_t b64_encode_avx2(const uint8_t *in, size_t len, char *out,
+                                   const struct b64_alphabet *a) {
+    const __m256i shuffle = _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3,
+        5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, a->chars[62] - 62,
+        a->chars[63] - 63, 'A', 0, 0));
+    size_t i, o;
+
+    // bytes 0..11 go to the low lane and 12..23 to the high one
+    for (i = 0, o = 0; i + 28 <= len; i += 24, o += 32) {
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i *)(in + i))),
+            _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        __m256i t0, t1, r, upper;
+
+        v = _mm256_shuffle_epi8(v, shuffle);
+        t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+        t0 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        t1 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+        t1 = _mm256_mullo_epi16(t1, _mm256_set1_epi32(0x01000010));
+        v = _mm256_or_si256(t0, t1);
+
+        r = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+        upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), v);
+        r = _mm256_or_si256(r, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+        v = _mm256_add_epi8(_mm256_shuffle_epi8(shift, r), v);
+        _mm256_storeu_si256((__m256i *)(out + o), v);
+    }
+    return i;
+}
+
+// the 6 bit values of 16 characters, *ok is cleared for invalid ones
+static inline SSSE3 __m128i b64_values_ssse3(__m128i v, __m128i *ok,
+                                             const struct b64_alphabet *a) {
+    const __m128i lut_lo = _mm_loadu_si128((const __m128i *)a->lut_lo);
+    const __m128i lut_hi = _mm_loadu_si128((const __m128i *)a->lut_hi);
+    const __m128i roll = _mm_loadu_si128((const __m128i *)a->roll);
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0f));
+    __m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+    __m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo),
+                                _mm_shuffle_epi8(lut_hi, hi));
+    __m128i special = _mm_cmpeq_epi8(v, _mm_set1_epi8(a->special));
+    __m128i r = _mm_shuffle_epi8(roll, hi);
+
+    *ok = _mm_and_si128(*ok, _mm_cmpeq_epi8(bad, _mm_setzero_si128()));
+    r = _mm_or_si128(_mm_andnot_si128(special, r),
+                     _mm_and_si128(special, _mm_set1_epi8(a->special_roll)));
+    return _mm_add_epi8(v, r);
+}
+
+// four 6 bit values in each word to 3 bytes, 12 bytes per 128 bit lane
+static inline SSSE3 __m128i b64_pack_ssse3(__m128i v) {
+    v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                             13, 12, -1, -1, -1, -1));
+}
+
+static SSSE3 size_t b64_decode_ssse3(const char *in, size_t len, uint8_t *out,
+                                     const struct b64_alphabet *a) {
+    uint8_t tmp[16];
+    size_t i, o;
+
+    for (i = 0, o = 0; i + 16 <= len; i += 16, o += 12) {
+        __m128i ok = _mm_set1_epi8(-1);
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+
+        v = b64_values_ssse3(v, &ok, a);
+        if (_mm_movemask_epi8(ok) != 0xffff)
+            break;
+        _mm_storeu_si128((__m128i *)tmp, b64_pack_ssse3(v));
+        memcpy(out + o, tmp, 12);
+    }
+    return i;
+}
+
+static AVX2 size_t b64_decode_avx2(const char *in, size_t len, uint8_t *out,
+                                   const struct b64_alphabet *a) {
+    const __m256i lut_lo = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)a->lut_lo));
+    const __m256i lut_hi = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)a->lut_hi));
+    const __m256i roll =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)a->roll));
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5,
+        4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    uint8_t tmp[32];
+    size_t i, o;
+
+    for (i = 0, o = 0; i + 32 <= len; i += 32, o += 24) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i hi =
+            _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+        __m256i lo = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+        __m256i ok = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo),
+                                      _mm256_shuffle_epi8(lut_hi, hi));
+        __m256i special = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(a->special));
+        __m256i r = _mm256_shuffle_epi8(roll, hi);
+
+        ok = _mm256_cmpeq_epi8(ok, _mm256_setzero_si256());
+        if (_mm256_movemask_epi8(ok) != -1)
+            break;
+        r = _mm256_blendv_epi8(r, _mm256_set1_epi8(a->special_roll), special);
+        v = _mm256_add_epi8(v, r);
+
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        // 12 bytes at the start of each lane, move them together
+        v = _mm256_permutevar8x32_epi32(
+            v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256((__m256i *)tmp, v);
+        memcpy(out + o, tmp, 24);
+    }
+    return i;
+}
+
+static size_t hex_encode_simd(const uint8_t *in, size_t len, char *out) {
+    switch (simd_level()) {
+    case 2:
+        return hex_encode_avx2(in, len, out);
+    case 1:
+        return hex_encode_ssse3(in, len, out);
+    default:
+        return 0;
+    }
+}
+
+static size_t hex_decode_simd(const char *in, size_t len, uint8_t *out) {
+    switch (simd_level()) {
+    case 2:
+        return hex_decode_avx2(in, len, out);
+    case 1:
+        return hex_decode_ssse3(in, len, out);
+    default:
+        return 0;
+    }
+}
+
+static size_t b64_encode_simd(const uint8_t *in, size_t len, char *out,
+                              const struct b64_alphabet *a) {
+    switch (simd_level()) {
+    case 2:
+        return b64_encode_avx2(in, len, out, a);
+    case 1:
+        return b64_encode_ssse3(in, len, out, a);
+    default:
+        return 0;
+    }
+}
+
+static size_t b64_decode_simd(const char *in, size_t len, uint8_t *out,
+                              const struct b64_alphabet *a) {
+    switch (simd_level()) {
+    case 2:
+        return b64_decode_avx2(in, len, out, a);
+    case 1:
+        return b64_decode_ssse3(in, len, out, a);
+    default:
+        return 0;
+    }
+}
+#elif defined(CODEC_NEON)
+const char *codec_simd_name(void) { return use_simd ? "neon" : "scalar"; }
+
+static size_t hex_encode_simd(const uint8_t *in, size_t len, char *out) {
+    const uint8x16_t lut = vld1q_u8((const uint8_t *)hex_digits);
+    size_t i;
+
+    if (!use_simd)
+        return 0;
+    for (i = 0; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        uint8x16x2_t c;
+
+        c.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(v, 4));
+        c.val[1] = vqtbl1q_u8(lut, vandq_u8(v, vdupq_n_u8(0x0f)));
+        vst2q_u8((uint8_t *)out + 2 * i, c);
+    }
+    return i;
+}
+
+static inline uint8x16_t hex_values_neon(uint8x16_t v, uint8x16_t *ok) {
+    uint8x16_t d = vsubq_u8(v, vdupq_n_u8('0'));
+    uint8x16_t l = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_d = vcleq_u8(d, vdupq_n_u8(9));
+    uint8x16_t is_l = vcleq_u8(l, vdupq_n_u8(5));
+
+    *ok = vandq_u8(*ok, vorrq_u8(is_d, is_l));
+    return vbslq_u8(is_d, d, vaddq_u8(l, vdupq_n_u8(10)));
+}
+
+static size_t hex_decode_simd(const char *in, size_t len, uint8_t *out) {
+    size_t i;
+
+    if (!use_simd)
+        return 0;
+    for (i = 0; i + 32 <= len; i += 32) {
+        // the high digits in val[0], the low ones in val[1]
+        uint8x16x2_t c = vld2q_u8((const uint8_t *)in + i);
+        uint8x16_t ok = vdupq_n_u8(0xff);
+        uint8x16_t hi = hex_values_neon(c.val[0], &ok);
+        uint8x16_t lo = hex_values_neon(c.val[1], &ok);
+
+        if (vminvq_u8(ok) != 0xff)
+            break;
+        vst1q_u8(out + i / 2, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+    return i;
+}
+
+static size_t b64_encode_simd(const uint8_t *in, size_t len, char *out,
+                              const struct b64_alphabet *a) {
+    const uint8_t *chars = (const uint8_t *)a->chars;
+    const uint8x16x4_t table = {{vld1q_u8(chars), vld1q_u8(chars + 16),
+                                 vld1q_u8(chars + 32), vld1q_u8(chars + 48)}};
+    size_t i, o;
+
+    if (!use_simd)
+        return 0;
+    for (i = 0, o = 0; i + 48 <= len; i += 48, o += 64) {
+        uint8x16x3_t v = vld3q_u8(in + i);
+        uint8x16x4_t c;
+
+        c.val[0] = vshrq_n_u8(v.val[0], 2);
+        c.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(v.val[0], vdupq_n_u8(3)), 4),
+                            vshrq_n_u8(v.val[1], 4));
+        c.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(v.val[1], vdupq_n_u8(15)), 2),
+                            vshrq_n_u8(v.val[2], 6));
+        c.val[3] = vandq_u8(v.val[2], vdupq_n_u8(63));
+        for (int k = 0; k < 4; k++)
+            c.val[k] = vqtbl4q_u8(table, c.val[k]);
+        vst4q_u8((uint8_t *)out + o, c);
+    }
+    return i;
+}
+
+static inline uint8x16_t b64_values_neon(uint8x16_t v, uint8x16_t *bad,
+                                         const struct b64_alphabet *a) {
+    const uint8x16_t lut_lo = vld1q_u8((const uint8_t *)a->lut_lo);
+    const uint8x16_t lut_hi = vld1q_u8((const uint8_t *)a->lut_hi);
+    const uint8x16_t roll = vld1q_u8((const uint8_t *)a->roll);
+    uint8x16_t hi = vshrq_n_u8(v, 4);
+    uint8x16_t lo = vandq_u8(v, vdupq_n_u8(0x0f));
+    uint8x16_t special = vceqq_u8(v, vdupq_n_u8((uint8_t)a->special));
+    uint8x16_t r = vqtbl1q_u8(roll, hi);
+
+    *bad = vorrq_u8(*bad, vtstq_u8(vqtbl1q_u8(lut_lo, lo),
+                                   vqtbl1q_u8(lut_hi, hi)));
+    r = vbslq_u8(special, vdupq_n_u8((uint8_t)a->special_roll), r);
+    return vaddq_u8(v, r);
+}
+
+static size_t b64_decode_simd(const char *in, size_t len, uint8_t *out,
+                              const struct b64_alphabet *a) {
+    size_t i, o;
+
+    if (!use_simd)
+        return 0;
+    for (i = 0, o = 0; i + 64 <= len; i += 64, o += 48) {
+        // character k of every group of 4 in val[k]
+        uint8x16x4_t c = vld4q_u8((const uint8_t *)in + i);
+        uint8x16_t bad = vdupq_n_u8(0);
+        uint8x16x3_t v;
+
+        for (int k = 0; k < 4; k++)
+            c.val[k] = b64_values_neon(c.val[k], &bad, a);
+        if (vmaxvq_u8(bad) != 0)
+            break;
+        v.val[0] = vorrq_u8(vshlq_n_u8(c.val[0], 2), vshrq_n_u8(c.val[1], 4));
+        v.val[1] = vorrq_u8(vshlq_n_u8(c.val[1], 4), vshrq_n_u8(c.val[2], 2));
+        v.val[2] = vorrq_u8(vshlq_n_u8(c.val[2], 6), c.val[3]);
+        vst3q_u8(out + o, v);
+    }
+    return i;
+}
+#else
+const char *codec_simd_name(void) { return "scalar"; }
+
+static size_t hex_encode_simd(const uint8_t *in, size_t len, char *out) {
+    return 0;
+}
+
+static size_t hex_decode_simd(const char *in, size_t len, uint8_t *out) {
+    return 0;
+}
+
+static size_t b64_encode_simd(const uint8_t *in, size_t len, char *out,
+                              const struct b64_alphabet *a) {
+    return 0;
+}
+
+static size_t b64_decode_simd(const char *in, size_t len, uint8_t *out,
+                              const struct b64_alphabet *a) {
+    return 0;
+}
+#endif
+
+static int hex_value(unsigned char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static int b64_value(unsigned char c, const struct b64_alphabet *a) {
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == (unsigned char)a->chars[62])
+        return 62;
+    if (c == (unsigned char)a->chars[63])
+        return 63;
+    return -1;
+}
+
+static size_t hex_encode(const uint8_t *in, size_t len, char *out) {
+    size_t i = hex_encode_simd(in, len, out);
+
+    for (; i < len; i++) {
+        out[2 * i] = hex_digits[in[i] >> 4];
+        out[2 * i + 1] = hex_digits[in[i] & 0xf];
+    }
+    return 2 * len;
+}
+
+static ssize_t hex_decode(const char *in, size_t len, uint8_t *out) {
+    size_t i;
+
+    if (len % 2)
+        return -1;
+    for (i = hex_decode_simd(in, len, out); i < len; i += 2) {
+        int hi = hex_value(in[i]);
+        int lo = hex_value(in[i + 1]);
+
+        if (hi < 0 || lo < 0)
+            return -1;
+        out[i / 2] = hi << 4 | lo;
+    }
+    return len / 2;
+}
+
+static size_t b64_encode(const uint8_t *in, size_t len, char *out,
+                         const struct b64_alphabet *a) {
+    size_t i = b64_encode_simd(in, len, out, a);
+    size_t o = i / 3 * 4;
+    uint32_t v;
+
+    for (; i + 3 <= len; i += 3, o += 4) {
+        v = (uint32_t)in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+        out[o] = a->chars[v >> 18];
+        out[o + 1] = a->chars[v >> 12 & 63];
+        out[o + 2] = a->chars[v >> 6 & 63];
+        out[o + 3] = a->chars[v & 63];
+    }
+    if (i < len) {
+        v = (uint32_t)in[i] << 16 | (i + 1 < len ? in[i + 1] << 8 : 0);
+        out[o++] = a->chars[v >> 18];
+        out[o++] = a->chars[v >> 12 & 63];
+        if (i + 1 < len)
+            out[o++] = a->chars[v >> 6 & 63];
+        else if (a->padded)
+            out[o++] = '=';
+        if (a->padded)
+            out[o++] = '=';
+    }
+    return o;
+}
+
+static ssize_t b64_decode(const char *in, size_t len, uint8_t *out,
+                          const struct b64_alphabet *a) {
+    size_t i, o, rest;
+    int v[4];
+
+    // padding is required by base64 and not allowed in base64url
+    if (a->padded) {
+        if (len % 4)
+            return -1;
+        if (len > 0 && in[len - 1] == '=')
+            len--;
+        if (len > 0 && in[len - 1] == '=')
+            len--;
+    }
+    rest = len % 4;
+    if (rest == 1)
+        return -1;
+    i = b64_decode_simd(in, len - rest, out, a);
+    for (o = i / 4 * 3; i < len; i += 4) {
+        size_t n = len - i < 4 ? len - i : 4;
+
+        for (size_t k = 0; k < 4; k++) {
+            v[k] = k < n ? b64_value(in[i + k], a) : 0;
+            if (v[k] < 0)
+                return -1;
+        }
+        out[o++] = v[0] << 2 | v[1] >> 4;
+        if (n == 2 && (v[1] & 15))
+            return -1;
+        if (n > 2)
+            out[o++] = v[1] << 4 | v[2] >> 2;
+        if (n == 3 && (v[2] & 3))
+            return -1;
+        if (n > 3)
+            out[o++] = v[2] << 6 | v[3];
+    }
+    return o;
+}
+
+// out has to hold codec_encoded_len() characters, it is not terminated
+size_t codec_encode(int encoding, const uint8_t *in, size_t len, char *out) {
+    switch (encoding) {
+    case CODEC_HEX:
+        return hex_encode(in, len, out);
+    case CODEC_BASE64:
+        return b64_encode(in, len, out, &base64);
+    case CODEC_BASE64URL:
+        return b64_encode(in, len, out, &base64url);
+    default:
+        memcpy(out, in, len);
+        return len;
+    }
+}
+
+/*
+ * out has to hold codec_decoded_max() bytes, returns the number of bytes
+ * decoded or -1 if in is not valid. out may be partly written then.
+ */
+ssize_t codec_decode(int encoding, const char *in, size_t len, uint8_t *out) {
+    switch (encoding) {
+    case CODEC_HEX:
+        return hex_decode(in, len, out);
+    case CODEC_BASE64:
+        return b64_decode(in, len, out, &base64);
+    case CODEC_BASE64URL:
+        return b64_decode(in, len, out, &base64url);
+    default:
+        memcpy(out, in, len);
+        return len;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// how keys are written on the command line, in files and on stdout
+#define CODEC_RAW 0
+#define CODEC_HEX 1
+#define CODEC_BASE64 2    // RFC 4648 base64, padded with =
+#define CODEC_BASE64URL 3 // RFC 4648 base64url, without padding
+
+int codec_parse(const char *name);
+const char *codec_name(int encoding);
+size_t codec_encoded_len(int encoding, size_t len);
+size_t codec_decoded_max(int encoding, size_t len);
+size_t codec_encode(int encoding, const uint8_t *in, size_t len, char *out);
+ssize_t codec_decode(int encoding, const char *in, size_t len, uint8_t *out);
+const char *codec_simd_name(void);
+void codec_use_simd(int on);
+
+#endif // !CODEC_H
@@ -1,6 +1,13 @@
 #include "commandline.h"
+#include "bench.h"
+#include "codec.h"
 #include "constants.h"
 #include "debugmacros.h"
+#include "provision.h"
+#include "util.h"
+#include <limits.h>
+#include <seal-key_ta.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,12 +32,32 @@ void usage(const char *prog_name) {
            "storage utilities\n");
     printf("ds, decrypt-unseal\tdecrypt the key and unseal it with the optee "
            "storage utilities\n");
+    printf("m, mac\tMAC or sign data inside the TA with a stored key\n");
+    printf("v, verify\tcheck a MAC or signature inside the TA with a stored "
+           "key\n");
+    printf("derive\tderive a key from a stored key inside the TA\n");
+    printf("generate\tgenerate a range of keys inside the TA\n");
+    printf("rand\tread random bytes from the TEE\n");
+    printf("rewrap\twrap all stored keys with another key inside the TA\n");
+    printf("export\twrite all stored keys to an encrypted archive\n");
+    printf("import\tstore the keys of an encrypted archive\n");
+    printf("sync\tcopy the keys that differ from another store\n");
+    printf("sync-serve\tanswer sync on stdin and stdout\n");
+    printf("import-dir\tstore every file of a directory as a key\n");
+    printf("codec-bench\tmeasure the key encodings\n");
+    printf("stats\tshow the counters the TA keeps per command\n");
+    printf("hot-keys\tshow the keys read and written the most\n");
     printf("-h, --help\tshow this help message\n");
 }
 
 void usage_get_key() {
     printf("Usage: get-key [OPTION] ...\n");
     printf("OPTIONS:\n");
+    printf("-s\tsize of the key\n");
+    printf("--out-fd\twrite the key as it is stored to this open file "
+           "descriptor, nothing else is printed to stdout\n");
+    printf("--out-file\twrite the key as it is stored to this file\n");
+    printf("--encoding\traw (default), hex, base64 or base64url\n");
 }
 
 void usage_set_key() {
@@ -38,16 +65,727 @@ void usage_set_key() {
     printf("OPTIONS:\n");
     printf("-k\tthe key to set in the secure storage\n");
     printf("-f\tthe file to read the key from\n");
+    printf("--encoding\thow the key is given: raw (default), hex, base64 or "
+           "base64url\n");
 }
 
 void usage_encrypt_seal() {
-    printf("Usage: encrypt-seal [OPTION] ...\n");
-    printf("TODO...\n");
+    printf("Usage: encrypt-seal <name> [OPTION] ...\n");
+    printf("encrypt data inside the TA with the AES key stored under <name>\n");
+    printf("OPTIONS:\n");
+    printf("-i\tthe file to seal (default: stdin)\n");
+    printf("-o\tthe file to write the sealed data to (default: stdout)\n");
+    printf("-j\tseal independent chunks with this many TA sessions in "
+           "parallel\n");
+    printf("-r\tseal every line as a record of its own, this many records "
+           "per call to the TA\n");
 }
 
 void usage_decrypt_unseal() {
-    printf("Usage: decrypt-unseal [OPTION] ...\n");
-    printf("TODO...\n");
+    printf("Usage: decrypt-unseal <name> [OPTION] ...\n");
+    printf("decrypt data sealed by encrypt-seal with the key stored under "
+           "<name>\n");
+    printf("OPTIONS:\n");
+    printf("-i\tthe file to unseal (default: stdin)\n");
+    printf("-o\tthe file to write the data to, replaced only once the data "
+           "was authenticated (default: stdout, not for data sealed "
+           "without -j)\n");
+    printf("-j\tunseal chunked data with this many TA sessions in parallel "
+           "(default: 1)\n");
+    printf("-n\tonly unseal the chunk with this index, needs a seekable "
+           "input\n");
+    printf("-r\tunseal records with this many records per call to the TA "
+           "(default: %d)\n",
+           SEAL_BATCH_RECORDS);
+}
+
+void usage_mac() {
+    printf("Usage: mac <name> [OPTION] ...\n");
+    printf("MAC or sign data with the key stored under <name>, the key never "
+           "leaves the TA\n");
+    printf("OPTIONS:\n");
+    printf("-a\thmac (HMAC-SHA256, default) or ecdsa (ECDSA P-256)\n");
+    printf("-i\tthe file to MAC (default: stdin)\n");
+    printf("-o\tthe file to write the hex encoded MAC to (default: stdout)\n");
+    printf("-r\tMAC every line on its own, this many lines per call to the "
+           "TA\n");
+}
+
+void usage_verify() {
+    printf("Usage: verify <name> [OPTION] ...\n");
+    printf("check a MAC or signature with the key stored under <name>\n");
+    printf("OPTIONS:\n");
+    printf("-a\thmac (HMAC-SHA256, default) or ecdsa (ECDSA P-256)\n");
+    printf("-i\tthe file to check (default: stdin)\n");
+    printf("-o\tthe file to write the results of -r to (default: stdout)\n");
+    printf("-m\tthe hex encoded MAC or signature of the input\n");
+    printf("-r\tcheck every line on its own, a line is the hex MAC, a space "
+           "and the message, this many lines per call to the TA\n");
+}
+
+void usage_derive() {
+    printf("Usage: derive <name>/<label> [OPTION] ...\n");
+    printf("derive a key for <label> from the key stored under <name> with "
+           "HKDF-SHA256\n");
+    printf("<name>/<label> can be used as the name of a key by the other "
+           "subcommands\n");
+    printf("OPTIONS:\n");
+    printf("-p\tstore the derived key under this name as well\n");
+    printf("-s\tsize of the stored key (default: %d)\n",
+           TA_SEAL_KEY_DERIVE_KEY_SIZE);
+}
+
+void usage_generate() {
+    printf("Usage: generate <first> -n <count> [OPTION] ...\n");
+    printf("generate the keys <first> to <first> + <count> - 1 inside the "
+           "TA, the secret keys never leave the TA\n");
+    printf("OPTIONS:\n");
+    printf("-t\taes (default), hmac or ecdsa (ECDSA P-256)\n");
+    printf("-s\tsize of aes and hmac keys in bytes (default: %d)\n",
+           TA_SEAL_KEY_DERIVE_KEY_SIZE);
+    printf("-r\tthis many keys per call to the TA (default: %d)\n",
+           GENERATE_BATCH_KEYS);
+    printf("-o\tthe file to write the ecdsa public keys to (default: "
+           "stdout)\n");
+}
+
+void usage_rand() {
+    printf("Usage: rand <bytes> [OPTION] ...\n");
+    printf("read random bytes from the TEE through a buffer that is refilled "
+           "in the background\n");
+    printf("OPTIONS:\n");
+    printf("-s\tbytes per request (default: %d)\n", RAND_REQUEST_SIZE);
+    printf("-b\tbytes fetched from the TA per call (default: %d, at most "
+           "%d)\n",
+           RAND_BLOCK_SIZE, TA_SEAL_KEY_RANDOM_MAX_SIZE);
+    printf("-o\tthe file to write the random bytes to (default: stdout)\n");
+}
+
+void usage_rewrap() {
+    printf("Usage: rewrap <new kek> [OPTION] ...\n");
+    printf("wrap the stored keys with the AES key stored under <new kek> "
+           "inside the TA, plain stores them unwrapped\n");
+    printf("OPTIONS:\n");
+    printf("-f\tthe key the keys are wrapped with now (default: plain, keys "
+           "that are not wrapped)\n");
+    printf("-r\tthis many objects per call to the TA (default: %d)\n",
+           REWRAP_BATCH_OBJECTS);
+    printf("-c\tkeep the progress in this file and resume from it\n");
+}
+
+void usage_export() {
+    printf("Usage: export <name> [OPTION] ...\n");
+    printf("write every object of the secure storage to one archive "
+           "encrypted inside the TA with the AES key stored under <name>\n");
+    printf("OPTIONS:\n");
+    printf("-o\tthe file to write the archive to (default: stdout)\n");
+}
+
+void usage_import() {
+    printf("Usage: import <name> [OPTION] ...\n");
+    printf("store the objects of an archive written by export, it is "
+           "decrypted and checked inside the TA with the AES key stored "
+           "under <name>\n");
+    printf("OPTIONS:\n");
+    printf("-i\tthe file to read the archive from (default: stdin)\n");
+    printf("-w\toverwrite keys that exist, they are skipped by default\n");
+}
+
+void usage_sync() {
+    printf("Usage: sync <name> -e <command> | -i <in> -o <out>\n");
+    printf("make the secure storage a copy of the one of a peer running "
+           "sync-serve <name>, only the keys that differ are copied, "
+           "encrypted with the AES key stored under <name> on both sides\n");
+    printf("OPTIONS:\n");
+    printf("-e\trun this shell command as the peer, for example "
+           "\"ssh primary seal-key sync-serve 1\"\n");
+    printf("-i\tread the answers of the peer from this file or fifo\n");
+    printf("-o\twrite the requests to the peer to this file or fifo\n");
+}
+
+void usage_sync_serve() {
+    printf("Usage: sync-serve <name> [OPTION] ...\n");
+    printf("answer the requests of sync <name> with this secure storage\n");
+    printf("OPTIONS:\n");
+    printf("-i\tread the requests from this file or fifo (default: stdin)\n");
+    printf("-o\twrite the answers to this file or fifo (default: stdout)\n");
+}
+
+void usage_import_dir() {
+    printf("Usage: import-dir <dir> [OPTION] ...\n");
+    printf("store every file of <dir> as a key like set-key -f, the files "
+           "are spread over TA sessions on several threads\n");
+    printf("OPTIONS:\n");
+    printf("-j\tthis many TA sessions in parallel (default: one per CPU, at "
+           "most %d)\n",
+           MAX_WORKERS);
+    printf("-n\thow the key name is taken from the file name: number (the "
+           "digits before the first dot, default), stem (the name without "
+           "its extension) or name (the whole name)\n");
+    printf("-o\tthe file to write the status of every file to (default: "
+           "stdout)\n");
+    printf("--encoding\thow the keys in the files are encoded: raw "
+           "(default), hex, base64 or base64url\n");
+}
+
+void usage_codec_bench() {
+    printf("Usage: codec-bench [OPTION] ...\n");
+    printf("measure the key encodings with the scalar and the vector code\n");
+    printf("OPTIONS:\n");
+    printf("-s\tbytes encoded and decoded per round (default: %d)\n",
+           CODEC_BENCH_SIZE);
+    printf("-n\tnumber of rounds (default: %d)\n", CODEC_BENCH_ROUNDS);
+    printf("-k\tread this key from the TA as well to compare with\n");
+}
+
+void usage_stats() {
+    printf("Usage: stats [OPTION] ...\n");
+    printf("show the calls, errors, bytes and milliseconds the TA counted per "
+           "command since it was loaded or the counters were reset\n");
+    printf("OPTIONS:\n");
+    printf("--reset\tzero the counters after showing them\n");
+}
+
+void usage_hot_keys() {
+    printf("Usage: hot-keys [OPTION] ...\n");
+    printf("show the storage ids the TA read and wrote the most, with an "
+           "estimate of how often, older accesses count less\n");
+    printf("OPTIONS:\n");
+    printf("--reset\tforget all accesses after showing them\n");
+}
+
+// the storage id of a key encryption key, plain is the empty id
+static char *kek_name(char *name) {
+    char *kek = calloc(1, MAX_NAME_LEN);
+
+    if (kek == NULL)
+        errx(1, "error allocating memory on the heap");
+    if (strcmp(name, "plain") == 0)
+        return kek;
+    if (check_name(name))
+        exit(1);
+    snprintf(kek, MAX_NAME_LEN, "%s%d", PREFIX, atoi(name));
+    return kek;
+}
+
+void set_name(char *name, options_t *options) {
+    // <name>/<label> is the key derived from <name> for <label>
+    char *label = strchr(name, '/');
+    int len = snprintf(options->name, MAX_NAME_LEN, "%s%d%s", PREFIX,
+                       atoi(name), label ? label : "");
+    if (len >= MAX_NAME_LEN)
+        errx(1, "The name %s is too long", name);
+}
+
+static int parse_encoding(const char *name) {
+    int encoding = codec_parse(name);
+
+    if (encoding < 0)
+        errx(1, "Unknown encoding %s", name);
+    return encoding;
+}
+
+// take --encoding <encoding> out of argv, the rest is parsed by position
+static void take_encoding(int *argc, char *argv[], options_t *options) {
+    for (int i = 3; i < *argc; i++) {
+        if (strcmp(argv[i], "--encoding") != 0)
+            continue;
+        if (i + 1 >= *argc)
+            errx(1, "--encoding needs raw, hex, base64 or base64url");
+        options->encoding = parse_encoding(argv[i + 1]);
+        memmove(argv + i, argv + i + 2, (*argc - i - 2) * sizeof(*argv));
+        *argc -= 2;
+        return;
+    }
+}
+
+// decode the key given to set-key, the encoded form is wiped
+static void decode_key(options_t *options) {
+    size_t max = codec_decoded_max(options->encoding, options->key_len);
+    char *key = malloc(max > 0 ? max : 1);
+    ssize_t len;
+
+    if (key == NULL)
+        errx(1, "error allocating memory on the heap");
+    len = codec_decode(options->encoding, options->key, options->key_len,
+                       (uint8_t *)key);
+    wipe(options->key, options->key_len);
+    free(options->key);
+    if (len <= 0)
+        errx(1, "The key is not valid %s", codec_name(options->encoding));
+    options->key = key;
+    options->key_len = len;
+}
+
+void parse_get_key(int argc, char *argv[], options_t *options) {
+    char *end;
+
+    if (argc < 3) {
+        usage_get_key();
+        exit(1);
+    }
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_get_key();
+            exit(1);
+        }
+        if (strcmp(argv[i], "--out-fd") == 0) {
+            options->out_fd = strtol(argv[i + 1], &end, 10);
+            if (*end != '\0' || options->out_fd < 0 ||
+                fcntl(options->out_fd, F_GETFD) < 0)
+                errx(1, "%s is not an open file descriptor", argv[i + 1]);
+        } else if (strcmp(argv[i], "--out-file") == 0) {
+            options->out_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--encoding") == 0) {
+            options->encoding = parse_encoding(argv[i + 1]);
+        } else {
+            usage_get_key();
+            exit(1);
+        }
+    }
+    if (options->out_fd >= 0 && options->out_file != NULL)
+        errx(1, "--out-fd and --out-file cannot be combined");
+}
+void parse_set_key(int argc, char *argv[], options_t *options) {
+    take_encoding(&argc, argv, options);
+    if (argc < 3) {
+        usage_set_key();
+        exit(1);
+    } else if (argc == 5) {
+        if (strcmp(argv[3], "-f") == 0) {
+            options->file = argv[4];
+
+            options->key_len = get_file_size(options->file);
+            if (options->key_len < 0) {
+                ERRO("Failed to get the size of %s", options->file);
+                exit(1);
+            }
+            if (options->key_len > MAX_KEY_LEN) {
+                ERRO("The file contents are too long");
+                exit(1);
+            }
+            char *buf;
+            buf = malloc(options->key_len * sizeof(char));
+            if (buf == NULL) {
+                errx(1, "error allocating memory on the heap");
+            }
+            options->key = buf;
+            read_key_file(options);
+            // cut the trailing newline, binary keys are taken as they are
+            if (options->key_len > 0 &&
+                options->key[options->key_len - 1] == '\n')
+                options->key_len--;
+        } else if (strcmp(argv[3], "-k") == 0) {
+            options->key_len = strlen(argv[4]);
+            if (options->key_len > MAX_KEY_LEN) {
+                ERRO("Warning: key length is to big max is: %zu bytes\n",
+                     MAX_KEY_LEN);
+                exit(1);
+            }
+            char *buf = malloc(options->key_len * sizeof(char));
+            if (buf == NULL) {
+                errx(1, "there was an error allocating memory for the key");
+            }
+            options->key = buf;
+            // this cuts of the \0 bytes but this is ok
+            strncpy(options->key, argv[4], options->key_len);
+        }
+    } else if (argc == 4 && (strcmp(argv[3], "-k") == 0)) {
+        // ask for stdin
+        printf("Enter the key (the key is cut at %zu):\n", MAX_KEY_LEN);
+        char buf[MAX_KEY_LEN];
+        // Read at most n bytes
+        // again the need to use base64 this was very stupid
+        char *res = fgets(buf, MAX_KEY_LEN, stdin);
+        size_t len = strlen(buf);
+        // ditch the \0 byte
+        len--;
+        if (res != NULL) {
+            printf("Read %zu bytes\n", len);
+            options->key_len = len;
+            options->key = malloc(options->key_len * sizeof(char));
+            if (options->key == NULL) {
+                errx(1, "error allocating memory on the heap");
+            }
+            strncpy(options->key, buf, options->key_len);
+        } else {
+            printf("Error reading input\n");
+        }
+    } else {
+        usage_set_key();
+        exit(1);
+    }
+}
+
+void parse_seal(int argc, char *argv[], options_t *options) {
+    void (*usage_seal)() = options->subcommand == SUBCOMMAND_ENCRYPT_SEAL
+                               ? usage_encrypt_seal
+                               : usage_decrypt_unseal;
+
+    if (argc < 3) {
+        usage_seal();
+        exit(1);
+    }
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_seal();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-i") == 0) {
+            options->in_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options->out_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            options->workers = atoi(argv[i + 1]);
+            if (options->workers < 1 || options->workers > MAX_WORKERS)
+                errx(1, "-j must be between 1 and %d", MAX_WORKERS);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            options->batch = atoi(argv[i + 1]);
+            if (options->batch < 1 || options->batch > SEAL_MAX_BATCH_RECORDS)
+                errx(1, "-r must be between 1 and %d", SEAL_MAX_BATCH_RECORDS);
+        } else if (strcmp(argv[i], "-n") == 0 &&
+                   options->subcommand == SUBCOMMAND_DECRYPT_UNSEAL) {
+            options->chunk_index = atol(argv[i + 1]);
+            if (options->chunk_index < 0 || options->chunk_index > UINT32_MAX)
+                errx(1, "Invalid chunk index %s", argv[i + 1]);
+        } else {
+            usage_seal();
+            exit(1);
+        }
+    }
+    if (options->subcommand == SUBCOMMAND_ENCRYPT_SEAL && options->workers &&
+        options->batch)
+        errx(1, "-j and -r cannot be combined");
+}
+
+void parse_sign(int argc, char *argv[], options_t *options) {
+    void (*usage_sign)() =
+        options->subcommand == SUBCOMMAND_MAC ? usage_mac : usage_verify;
+
+    if (argc < 3) {
+        usage_sign();
+        exit(1);
+    }
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_sign();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-i") == 0) {
+            options->in_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options->out_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            if (strcmp(argv[i + 1], "hmac") == 0)
+                options->alg = TA_SEAL_KEY_ALG_HMAC_SHA256;
+            else if (strcmp(argv[i + 1], "ecdsa") == 0)
+                options->alg = TA_SEAL_KEY_ALG_ECDSA_P256;
+            else
+                errx(1, "Unknown algorithm %s", argv[i + 1]);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            options->batch = atoi(argv[i + 1]);
+            if (options->batch < 1 || options->batch > SEAL_MAX_BATCH_RECORDS)
+                errx(1, "-r must be between 1 and %d", SEAL_MAX_BATCH_RECORDS);
+        } else if (strcmp(argv[i], "-m") == 0 &&
+                   options->subcommand == SUBCOMMAND_VERIFY) {
+            options->mac = argv[i + 1];
+        } else {
+            usage_sign();
+            exit(1);
+        }
+    }
+    if (options->subcommand == SUBCOMMAND_VERIFY &&
+        (options->mac == NULL) == (options->batch == 0))
+        errx(1, "verify needs either -m or -r");
+}
+
+void parse_derive(int argc, char *argv[], options_t *options) {
+    if (argc < 3 || !strchr(argv[2], '/')) {
+        usage_derive();
+        exit(1);
+    }
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_derive();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-p") == 0) {
+            if (check_name(argv[i + 1]))
+                exit(1);
+            options->target = malloc(MAX_NAME_LEN);
+            if (options->target == NULL)
+                errx(1, "error allocating memory on the heap");
+            snprintf(options->target, MAX_NAME_LEN, "%s%d", PREFIX,
+                     atoi(argv[i + 1]));
+        } else if (strcmp(argv[i], "-s") == 0) {
+            options->key_size = atoi(argv[i + 1]);
+            if (options->key_size < TA_SEAL_KEY_DERIVE_MIN_SIZE ||
+                options->key_size > TA_SEAL_KEY_DERIVE_MAX_SIZE)
+                errx(1, "-s must be between %d and %d",
+                     TA_SEAL_KEY_DERIVE_MIN_SIZE, TA_SEAL_KEY_DERIVE_MAX_SIZE);
+        } else {
+            usage_derive();
+            exit(1);
+        }
+    }
+}
+
+void parse_generate(int argc, char *argv[], options_t *options) {
+    if (argc < 3 || check_name(argv[2])) {
+        usage_generate();
+        exit(1);
+    }
+    options->first = atol(argv[2]);
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_generate();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-n") == 0) {
+            options->count = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            if (strcmp(argv[i + 1], "aes") == 0)
+                options->key_type = TA_SEAL_KEY_TYPE_AES;
+            else if (strcmp(argv[i + 1], "hmac") == 0)
+                options->key_type = TA_SEAL_KEY_TYPE_HMAC_SHA256;
+            else if (strcmp(argv[i + 1], "ecdsa") == 0)
+                options->key_type = TA_SEAL_KEY_TYPE_ECDSA_P256;
+            else
+                errx(1, "Unknown key type %s", argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            options->key_size = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            options->batch = atoi(argv[i + 1]);
+            if (options->batch < 1 ||
+                options->batch > TA_SEAL_KEY_GENERATE_MAX_KEYS)
+                errx(1, "-r must be between 1 and %d",
+                     TA_SEAL_KEY_GENERATE_MAX_KEYS);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options->out_file = argv[i + 1];
+        } else {
+            usage_generate();
+            exit(1);
+        }
+    }
+    // key names are built with %d, the whole range has to fit
+    if (options->count < 1 || options->count - 1 > INT_MAX - options->first)
+        errx(1, "-n must be at least 1 and the keys must end before %d",
+             INT_MAX);
+}
+
+void parse_rand(int argc, char *argv[], options_t *options) {
+    char *end;
+
+    if (argc < 3) {
+        usage_rand();
+        exit(1);
+    }
+    options->count = strtol(argv[2], &end, 10);
+    if (*end != '\0' || options->count < 1)
+        errx(1, "Invalid number of bytes %s", argv[2]);
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_rand();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-s") == 0) {
+            options->request_size = atol(argv[i + 1]);
+            if (options->request_size < 1 ||
+                options->request_size > RAND_OUTPUT_SIZE)
+                errx(1, "-s must be between 1 and %d", RAND_OUTPUT_SIZE);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            options->block_size = atol(argv[i + 1]);
+            if (options->block_size < 1 ||
+                options->block_size > TA_SEAL_KEY_RANDOM_MAX_SIZE)
+                errx(1, "-b must be between 1 and %d",
+                     TA_SEAL_KEY_RANDOM_MAX_SIZE);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options->out_file = argv[i + 1];
+        } else {
+            usage_rand();
+            exit(1);
+        }
+    }
+}
+
+void parse_rewrap(int argc, char *argv[], options_t *options) {
+    if (argc < 3) {
+        usage_rewrap();
+        exit(1);
+    }
+    strcpy(options->name, kek_name(argv[2]));
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_rewrap();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-f") == 0) {
+            options->kek = kek_name(argv[i + 1]);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            options->batch = atoi(argv[i + 1]);
+            if (options->batch < 1 ||
+                options->batch > TA_SEAL_KEY_REWRAP_MAX_BATCH)
+                errx(1, "-r must be between 1 and %d",
+                     TA_SEAL_KEY_REWRAP_MAX_BATCH);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            options->cursor_file = argv[i + 1];
+        } else {
+            usage_rewrap();
+            exit(1);
+        }
+    }
+    if (options->kek == NULL)
+        options->kek = kek_name("plain");
+    if (strcmp(options->kek, options->name) == 0)
+        errx(1, "The old and the new key must differ");
+}
+
+void parse_archive(int argc, char *argv[], options_t *options) {
+    int import = options->subcommand == SUBCOMMAND_IMPORT;
+    void (*usage_archive)() = import ? usage_import : usage_export;
+
+    if (argc < 3) {
+        usage_archive();
+        exit(1);
+    }
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && import) {
+            options->overwrite = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage_archive();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-i") == 0 && import) {
+            options->in_file = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && !import) {
+            options->out_file = argv[++i];
+        } else {
+            usage_archive();
+            exit(1);
+        }
+    }
+}
+
+void parse_sync(int argc, char *argv[], options_t *options) {
+    int serve = options->subcommand == SUBCOMMAND_SYNC_SERVE;
+    void (*usage_sync_cmd)() = serve ? usage_sync_serve : usage_sync;
+
+    if (argc < 3) {
+        usage_sync_cmd();
+        exit(1);
+    }
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_sync_cmd();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-e") == 0 && !serve) {
+            options->command = argv[i + 1];
+        } else if (strcmp(argv[i], "-i") == 0) {
+            options->in_file = argv[i + 1];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options->out_file = argv[i + 1];
+        } else {
+            usage_sync_cmd();
+            exit(1);
+        }
+    }
+    if (!serve && options->command != NULL &&
+        (options->in_file != NULL || options->out_file != NULL))
+        errx(1, "-e cannot be combined with -i and -o");
+    if (!serve && options->command == NULL &&
+        (options->in_file == NULL || options->out_file == NULL))
+        errx(1, "Give either -e or both -i and -o");
+}
+
+void parse_import_dir(int argc, char *argv[], options_t *options) {
+    if (argc < 3) {
+        usage_import_dir();
+        exit(1);
+    }
+    options->dir = argv[2];
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_import_dir();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-j") == 0) {
+            options->workers = atoi(argv[i + 1]);
+            if (options->workers < 1 || options->workers > MAX_WORKERS)
+                errx(1, "-j must be between 1 and %d", MAX_WORKERS);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            if (strcmp(argv[i + 1], "number") == 0)
+                options->id_rule = PROVISION_ID_NUMBER;
+            else if (strcmp(argv[i + 1], "stem") == 0)
+                options->id_rule = PROVISION_ID_STEM;
+            else if (strcmp(argv[i + 1], "name") == 0)
+                options->id_rule = PROVISION_ID_NAME;
+            else
+                errx(1, "Unknown naming rule %s", argv[i + 1]);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options->out_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--encoding") == 0) {
+            options->encoding = parse_encoding(argv[i + 1]);
+        } else {
+            usage_import_dir();
+            exit(1);
+        }
+    }
+}
+
+void parse_codec_bench(int argc, char *argv[], options_t *options) {
+    options->block_size = CODEC_BENCH_SIZE;
+    options->count = CODEC_BENCH_ROUNDS;
+    for (int i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage_codec_bench();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-s") == 0) {
+            options->block_size = atol(argv[i + 1]);
+            if (options->block_size < 1)
+                errx(1, "-s must be at least 1");
+        } else if (strcmp(argv[i], "-n") == 0) {
+            options->count = atol(argv[i + 1]);
+            if (options->count < 1)
+                errx(1, "-n must be at least 1");
+        } else if (strcmp(argv[i], "-k") == 0) {
+            if (check_name(argv[i + 1]))
+                exit(1);
+            options->target = malloc(MAX_NAME_LEN);
+            if (options->target == NULL)
+                errx(1, "error allocating memory on the heap");
+            snprintf(options->target, MAX_NAME_LEN, "%s%d", PREFIX,
+                     atoi(argv[i + 1]));
+        } else {
+            usage_codec_bench();
+            exit(1);
+        }
+    }
+}
+
+void parse_stats(int argc, char *argv[], options_t *options) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--reset") == 0) {
+            options->reset = 1;
+        } else {
+            usage_stats();
+            exit(1);
+        }
+    }
+}
+
+void parse_hot_keys(int argc, char *argv[], options_t *options) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--reset") == 0) {
+            options->reset = 1;
+        } else {
+            usage_hot_keys();
+            exit(1);
+        }
+    }
 }
 
 void parse_args(int argc, char *argv[], options_t *options) {
@@ -57,49 +795,82 @@ void parse_args(int argc, char *argv[], options_t *options) {
     }
     if (strcmp(argv[1], "get-key") == 0 || strcmp(argv[1], "g") == 0) {
         options->subcommand = SUBCOMMAND_GET_KEY;
-        // options->name = argv[2];
+        set_name(argv[2], options);
+        parse_get_key(argc, argv, options);
     } else if (strcmp(argv[1], "set-key") == 0 || strcmp(argv[1], "s") == 0) {
         options->subcommand = SUBCOMMAND_SET_KEY;
-        // options->name = argv[2];
-        if (argc < 3) {
-            usage_set_key();
-        } else if (argc == 5) {
-            if (strcmp(argv[3], "-f") == 0) {
-                options->file = argv[4];
-            } else if (strcmp(argv[3], "-k") == 0) {
-                // subtract the \0
-                options->key_len = strlen(argv[4]);
-                if (options->key_len > MAX_KEY_LEN) {
-                    ERRO("Warning: key length is to big max is: %d bytes\n",
-                         MAX_KEY_LEN);
-                    exit(1);
-                }
-                char *buf = malloc(options->key_len * sizeof(char));
-                options->key = buf;
-                // this cuts of the \0 bytes but this is ok
-                strncpy(options->key, argv[4], options->key_len);
-            } else {
-                usage_set_key();
-            }
-        }
+        set_name(argv[2], options);
+        parse_set_key(argc, argv, options);
+        if (options->encoding != CODEC_RAW)
+            decode_key(options);
     } else if (strcmp(argv[1], "del-key") == 0 || strcmp(argv[1], "d") == 0) {
         options->subcommand = SUBCOMMAND_DEL_KEY;
-        // options->name = argv[2];
+        set_name(argv[2], options);
     } else if (strcmp(argv[1], "encrypt-seal") == 0 ||
                strcmp(argv[1], "e") == 0) {
         options->subcommand = SUBCOMMAND_ENCRYPT_SEAL;
-        // options->name = argv[2];
-        usage_encrypt_seal();
+        set_name(argv[2], options);
+        parse_seal(argc, argv, options);
     } else if (strcmp(argv[1], "decrypt-unseal") == 0 ||
                strcmp(argv[1], "ds") == 0) {
         options->subcommand = SUBCOMMAND_DECRYPT_UNSEAL;
-        // options->name = argv[2];
-        usage_decrypt_unseal();
+        set_name(argv[2], options);
+        parse_seal(argc, argv, options);
+    } else if (strcmp(argv[1], "mac") == 0 || strcmp(argv[1], "m") == 0) {
+        options->subcommand = SUBCOMMAND_MAC;
+        set_name(argv[2], options);
+        parse_sign(argc, argv, options);
+    } else if (strcmp(argv[1], "verify") == 0 || strcmp(argv[1], "v") == 0) {
+        options->subcommand = SUBCOMMAND_VERIFY;
+        set_name(argv[2], options);
+        parse_sign(argc, argv, options);
+    } else if (strcmp(argv[1], "derive") == 0) {
+        options->subcommand = SUBCOMMAND_DERIVE;
+        parse_derive(argc, argv, options);
+        set_name(argv[2], options);
+    } else if (strcmp(argv[1], "generate") == 0) {
+        options->subcommand = SUBCOMMAND_GENERATE;
+        parse_generate(argc, argv, options);
+    } else if (strcmp(argv[1], "rand") == 0) {
+        options->subcommand = SUBCOMMAND_RAND;
+        parse_rand(argc, argv, options);
+    } else if (strcmp(argv[1], "rewrap") == 0) {
+        options->subcommand = SUBCOMMAND_REWRAP;
+        parse_rewrap(argc, argv, options);
+    } else if (strcmp(argv[1], "export") == 0) {
+        options->subcommand = SUBCOMMAND_EXPORT;
+        parse_archive(argc, argv, options);
+        set_name(argv[2], options);
+    } else if (strcmp(argv[1], "import") == 0) {
+        options->subcommand = SUBCOMMAND_IMPORT;
+        parse_archive(argc, argv, options);
+        set_name(argv[2], options);
+    } else if (strcmp(argv[1], "sync") == 0) {
+        options->subcommand = SUBCOMMAND_SYNC;
+        parse_sync(argc, argv, options);
+        set_name(argv[2], options);
+    } else if (strcmp(argv[1], "sync-serve") == 0) {
+        options->subcommand = SUBCOMMAND_SYNC_SERVE;
+        parse_sync(argc, argv, options);
+        set_name(argv[2], options);
+    } else if (strcmp(argv[1], "import-dir") == 0) {
+        options->subcommand = SUBCOMMAND_IMPORT_DIR;
+        parse_import_dir(argc, argv, options);
+    } else if (strcmp(argv[1], "codec-bench") == 0) {
+        options->subcommand = SUBCOMMAND_CODEC_BENCH;
+        parse_codec_bench(argc, argv, options);
+    } else if (strcmp(argv[1], "stats") == 0) {
+        options->subcommand = SUBCOMMAND_STATS;
+        parse_stats(argc, argv, options);
+    } else if (strcmp(argv[1], "hot-keys") == 0) {
+        options->subcommand = SUBCOMMAND_HOT_KEYS;
+        parse_hot_keys(argc, argv, options);
     } else {
         usage(argv[0]);
         exit(1);
     }
 }
+
 long get_file_size(char *file) {
     FILE *f;
     f = fopen(file, "rb");
@@ -139,3 +910,17 @@ void read_key_file(options_t *opts) {
         exit(1);
     }
 }
+
+int check_name(char *name) {
+    if (strlen(name) > sizeof(name)) {
+        ERRO("The name is too long");
+        return 1;
+    }
+    for (int i = 0; i < strlen(name); i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            ERRO("The name contains invalid characters");
+            return 1;
+        }
+    }
+    return 0;
+}
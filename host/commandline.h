@@ -11,16 +11,68 @@ typedef struct options {
     char *key;
     char *file;
     size_t key_len;
+    char *in_file;
+    char *out_file;
+    int workers;
+    int batch;
+    int alg;
+    char *mac;
+    char *target;
+    size_t key_size;
+    int key_type;
+    long first;
+    long count;
+    size_t request_size;
+    size_t block_size;
+    char *kek;
+    char *cursor_file;
+    long chunk_index;
+    int overwrite;
+    char *command;
+    char *dir;
+    int id_rule;
+    int out_fd;
+    int encoding;
+    int reset;
 } options_t;
 
 void usage(const char *prog_name);
 void usage_get_key();
+void usage_set_key();
 void usage_encrypt_seal();
 void usage_decrypt_unseal();
+void usage_mac();
+void usage_verify();
+void usage_derive();
+void usage_generate();
+void usage_rand();
+void usage_rewrap();
+void usage_export();
+void usage_import();
+void usage_sync();
+void usage_sync_serve();
+void usage_import_dir();
+void usage_codec_bench();
+void usage_stats();
+void usage_hot_keys();
 void parse_args(int argc, char *argv[], options_t *options);
 long get_file_size(char *file);
 void read_key_file(options_t *opts);
 void parse_get_key(int argc, char *argv[], options_t *options);
 void parse_set_key(int argc, char *argv[], options_t *options);
+void parse_seal(int argc, char *argv[], options_t *options);
+void parse_sign(int argc, char *argv[], options_t *options);
+void parse_derive(int argc, char *argv[], options_t *options);
+void parse_generate(int argc, char *argv[], options_t *options);
+void parse_rand(int argc, char *argv[], options_t *options);
+void parse_rewrap(int argc, char *argv[], options_t *options);
+void parse_archive(int argc, char *argv[], options_t *options);
+void parse_sync(int argc, char *argv[], options_t *options);
+void parse_import_dir(int argc, char *argv[], options_t *options);
+void parse_codec_bench(int argc, char *argv[], options_t *options);
+void parse_stats(int argc, char *argv[], options_t *options);
+void parse_hot_keys(int argc, char *argv[], options_t *options);
+void set_name(char *name, options_t *options);
+int check_name(char *name);
 
 #endif // !COMMANDLINE_H
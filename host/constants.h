@@ -2,12 +2,66 @@
 #define CONSTANTS_H
 #include <stdlib.h>
 
-const size_t MAX_KEY_LEN = 1024;
+static const size_t MAX_KEY_LEN = 1024;
 #define PREFIX "key#"
+// longest storage id, PREFIX, the key number and the label of derived keys
+#define MAX_NAME_LEN 64
 #define SUBCOMMAND_GET_KEY 1
 #define SUBCOMMAND_SET_KEY 2
 #define SUBCOMMAND_DEL_KEY 3
 #define SUBCOMMAND_ENCRYPT_SEAL 4
 #define SUBCOMMAND_DECRYPT_UNSEAL 5
+#define SUBCOMMAND_MAC 6
+#define SUBCOMMAND_VERIFY 7
+#define SUBCOMMAND_DERIVE 8
+#define SUBCOMMAND_GENERATE 9
+#define SUBCOMMAND_RAND 10
+#define SUBCOMMAND_REWRAP 11
+#define SUBCOMMAND_EXPORT 12
+#define SUBCOMMAND_IMPORT 13
+#define SUBCOMMAND_SYNC 14
+#define SUBCOMMAND_SYNC_SERVE 15
+#define SUBCOMMAND_IMPORT_DIR 16
+#define SUBCOMMAND_CODEC_BENCH 17
+#define SUBCOMMAND_STATS 18
+#define SUBCOMMAND_HOT_KEYS 19
+
+// size of the chunks streamed through the TA by encrypt-seal/decrypt-unseal
+#define SEAL_CHUNK_SIZE (64 * 1024)
+// size of the independently sealed chunks of encrypt-seal -j
+#define SEAL_PARALLEL_CHUNK_SIZE (1024 * 1024)
+// largest chunk accepted when unsealing
+#define SEAL_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+// upper bound for the number of TA sessions used in parallel
+#define MAX_WORKERS 64
+// records sealed per SEAL_BATCH call by default and at most
+#define SEAL_BATCH_RECORDS 256
+#define SEAL_MAX_BATCH_RECORDS 4096
+// shared buffer holding the records of one batch
+#define SEAL_BATCH_BUFFER_SIZE (256 * 1024)
+// longest line accepted as a record
+#define SEAL_MAX_RECORD_SIZE (64 * 1024)
+// keys generated per call to the TA by default
+#define GENERATE_BATCH_KEYS 256
+// random bytes per rand request and fetched from the TA per call by default
+#define RAND_REQUEST_SIZE 32
+#define RAND_BLOCK_SIZE (256 * 1024)
+// random bytes collected before they are written out by rand
+#define RAND_OUTPUT_SIZE (64 * 1024)
+// objects visited per REWRAP_ALL call by default
+#define REWRAP_BATCH_OBJECTS 256
+// locked buffer get-key --out-fd reads the key into, grows for larger keys
+#define GET_KEY_BUFFER_SIZE (16 * 1024)
+// largest message mac and verify send to the TA in one piece
+#define SIGN_MAX_MESSAGE_SIZE (1024 * 1024)
+
+// returned by the TA when a tag or signature does not match, not part of the
+// client API
+#ifndef TEEC_ERROR_MAC_INVALID
+#define TEEC_ERROR_MAC_INVALID 0xFFFF3071
+#endif
+#ifndef TEEC_ERROR_SIGNATURE_INVALID
+#define TEEC_ERROR_SIGNATURE_INVALID 0xFFFF3072
+#endif
 
 #endif // !CONSTANTS_H
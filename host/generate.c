@@ -0,0 +1,74 @@
+#include "generate.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* TA API: UUID and command IDs */
+#include <seal-key_ta.h>
+
+// the key number, a space and the uncompressed hex encoded public key
+#define GENERATE_LINE_SIZE (12 + 2 * (1 + TA_SEAL_KEY_ECDSA_P256_SIZE) + 1)
+
+// write the public key of every ECDSA key of a batch, one line per key
+static int write_public_keys(int out_fd, uint32_t first, uint32_t count,
+                             const uint8_t *pub) {
+    char line[GENERATE_LINE_SIZE];
+
+    for (uint32_t n = 0; n < count; n++) {
+        int len = snprintf(line, sizeof(line), "%u 04", first + n);
+
+        hex_encode(pub + n * TA_SEAL_KEY_ECDSA_P256_SIZE,
+                   TA_SEAL_KEY_ECDSA_P256_SIZE, line + len);
+        len += 2 * TA_SEAL_KEY_ECDSA_P256_SIZE;
+        line[len++] = '\n';
+        if (write_full(out_fd, line, len) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Generate the keys first to first + count - 1 inside the TA, batch keys
+ * per call. Only the public keys of ECDSA keys come back, they are written
+ * to out_fd. stats->records counts the keys that were generated.
+ */
+TEEC_Result generate_keys(struct test_ctx *ctx, uint32_t first,
+                          uint32_t count, uint32_t type, size_t size,
+                          unsigned int batch, int out_fd,
+                          struct seal_stats *stats) {
+    size_t pub_size = type == TA_SEAL_KEY_TYPE_ECDSA_P256
+                          ? batch * TA_SEAL_KEY_ECDSA_P256_SIZE
+                          : 0;
+    TEEC_Result res = TEEC_SUCCESS;
+    uint8_t *pub = NULL;
+    uint32_t done = 0;
+    double start = now_seconds();
+
+    memset(stats, 0, sizeof(*stats));
+    if (pub_size) {
+        pub = malloc(pub_size);
+        if (pub == NULL)
+            return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    while (done < count) {
+        uint32_t n = count - done < batch ? count - done : batch;
+        size_t pub_len = pub_size;
+
+        res = generate_secure_objects(ctx, PREFIX, first + done, &n, type,
+                                      size, pub, &pub_len);
+        stats->records += n;
+        if (pub && write_public_keys(out_fd, first + done, n, pub) < 0)
+            res = TEEC_ERROR_GENERIC;
+        if (res != TEEC_SUCCESS)
+            break;
+        done += n;
+    }
+
+    stats->seconds = now_seconds() - start;
+    free(pub);
+    return res;
+}
@@ -0,0 +1,13 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include "seal.h"
+#include "storage.h"
+#include <stdint.h>
+
+TEEC_Result generate_keys(struct test_ctx *ctx, uint32_t first,
+                          uint32_t count, uint32_t type, size_t size,
+                          unsigned int batch, int out_fd,
+                          struct seal_stats *stats);
+
+#endif // !GENERATE_H
@@ -25,16 +25,30 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "archive.h"
+#include "bench.h"
+#include "codec.h"
 #include "commandline.h"
 #include "constants.h"
 #include "debugmacros.h"
+#include "generate.h"
+#include "provision.h"
+#include "rewrap.h"
+#include "rng.h"
+#include "seal.h"
+#include "sign.h"
+#include "stats.h"
 #include "storage.h"
+#include "sync.h"
+#include "util.h"
 
 #include <err.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 /* OP-TEE TEE client API (built by optee_client) */
 #include <tee_client_api.h>
@@ -42,353 +56,68 @@
 /* TA API: UUID and command IDs */
 #include <seal-key_ta.h>
 
-// storage.c
-void prepare_tee_session(struct test_ctx *ctx) {
-    TEEC_UUID uuid = TA_SEAL_KEY_UUID;
-    uint32_t origin;
-    TEEC_Result res;
-
-    /* Initialize a context connecting us to the TEE */
-    res = TEEC_InitializeContext(NULL, &ctx->ctx);
-    if (res != TEEC_SUCCESS)
-        errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
-
-    /* Open a session with the TA */
-    res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid, TEEC_LOGIN_PUBLIC,
-                           NULL, NULL, &origin);
-    if (res != TEEC_SUCCESS)
-        errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x", res,
-             origin);
-}
-
-void terminate_tee_session(struct test_ctx *ctx) {
-    TEEC_CloseSession(&ctx->sess);
-    TEEC_FinalizeContext(&ctx->ctx);
-}
-
-// todo: this is a function we can use our object here is the key in this case
-// of a seal key application
-TEEC_Result read_secure_object(struct test_ctx *ctx, char *id, char *data,
-                               size_t *data_len) {
-    TEEC_Operation op;
-    uint32_t origin;
-    TEEC_Result res;
-    size_t id_len = strlen(id);
-
-    memset(&op, 0, sizeof(op));
-    op.paramTypes = TEEC_PARAM_TYPES(
-        TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
-
-    op.params[0].tmpref.buffer = id;
-    op.params[0].tmpref.size = id_len;
-
-    op.params[1].tmpref.buffer = data;
-    op.params[1].tmpref.size = *data_len;
-
-    res =
-        TEEC_InvokeCommand(&ctx->sess, TA_SEAL_KEY_CMD_READ_RAW, &op, &origin);
-    switch (res) {
-    case TEEC_SUCCESS:
-        *data_len = op.params[1].tmpref.size;
-        break;
-    case TEEC_ERROR_SHORT_BUFFER:
-        printf("Buffer too short\n");
-    case TEEC_ERROR_ITEM_NOT_FOUND:
-        printf("Item not found\n");
-        break;
-    default:
-        printf("Command READ_RAW failed: 0x%x / %u\n", res, origin);
+// open -i and -o, stdin and stdout are used when they are not given
+static void open_files(struct options *o, int *in_fd, int *out_fd) {
+    if (o->in_file != NULL) {
+        *in_fd = open(o->in_file, O_RDONLY);
+        if (*in_fd < 0)
+            err(1, "Failed to open %s", o->in_file);
     }
-
-    return res;
-}
-
-// here we write the key to the optee secure storage
-// it gets sealed from the optee and stored securely
-// todo: ?do we trust this or do we want to encrypt it before sending it to
-// the optee?
-TEEC_Result write_secure_object(struct test_ctx *ctx, char *id, char *data,
-                                size_t data_len) {
-    TEEC_Operation op;
-    uint32_t origin;
-    TEEC_Result res;
-    size_t id_len = strlen(id);
-
-    memset(&op, 0, sizeof(op));
-    op.paramTypes = TEEC_PARAM_TYPES(
-        TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
-
-    op.params[0].tmpref.buffer = id;
-    op.params[0].tmpref.size = id_len;
-
-    op.params[1].tmpref.buffer = data;
-    op.params[1].tmpref.size = data_len;
-
-    res =
-        TEEC_InvokeCommand(&ctx->sess, TA_SEAL_KEY_CMD_WRITE_RAW, &op, &origin);
-    if (res != TEEC_SUCCESS)
-        printf("Command WRITE_RAW failed: 0x%x / %u\n", res, origin);
-
-    switch (res) {
-    case TEEC_SUCCESS:
-        break;
-    default:
-        printf("Command WRITE_RAW failed: 0x%x / %u\n", res, origin);
+    if (o->out_file != NULL) {
+        *out_fd = open(o->out_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (*out_fd < 0)
+            err(1, "Failed to open %s", o->out_file);
     }
-
-    return res;
-}
-
-TEEC_Result delete_secure_object(struct test_ctx *ctx, char *id) {
-    TEEC_Operation op;
-    uint32_t origin;
-    TEEC_Result res;
-    size_t id_len = strlen(id);
-
-    memset(&op, 0, sizeof(op));
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
-                                     TEEC_NONE, TEEC_NONE);
-
-    op.params[0].tmpref.buffer = id;
-    op.params[0].tmpref.size = id_len;
-
-    res = TEEC_InvokeCommand(&ctx->sess, TA_SEAL_KEY_CMD_DELETE, &op, &origin);
-
-    switch (res) {
-    case TEEC_SUCCESS:
-        break;
-    case TEEC_ERROR_ITEM_NOT_FOUND:
-        printf("Command DELETE failed: 0x%x / %u\n", res, origin);
-        break;
-    default:
-        printf("Command DELETE failed: 0x%x / %u\n", res, origin);
-    }
-
-    return res;
 }
 
-// commandline.c
-/**
- * @brief usage of the app
- *
- * this function is called when the app is called with wrong parameters
- * it shows how to use the app in the console using Linux style
+/*
+ * Unsealed data goes to a file next to -o first and only replaces it once
+ * it was authenticated, so a forged or truncated input never shows up
+ * there. Returns the descriptor of the staging file, its name in path.
  */
-void usage(const char *prog_name) {
-    printf("Usage: %s [SUBCOMMAND] <name> [OPTION] ...\n", prog_name);
-    printf("The size of the key is 32 bytes by default and can be changed via "
-           "the environment variable KEY_SIZE\n");
-    printf("SUBCOMMANDS:\n");
-    printf(
-        "g, get-key\tget the key from the secure storage by its storage id\n");
-    printf("s, set-key\tset the key in the secure storage by its storage id\n");
-    printf("d, del-key\tdelete the key from the secure storage by its storage "
-           "id\n");
-    printf("e, encrypt-seal\tencrypt the key before sealing it with the optee "
-           "storage utilities\n");
-    printf("ds, decrypt-unseal\tdecrypt the key and unseal it with the optee "
-           "storage utilities\n");
-    printf("-h, --help\tshow this help message\n");
-}
-
-void usage_get_key() {
-    printf("Usage: get-key [OPTION] ...\n");
-    printf("OPTIONS:\n");
-    printf("-s\tsize of the key\n");
-}
-
-void usage_set_key() {
-    printf("Usage: set-key [OPTION] ...\n");
-    printf("OPTIONS:\n");
-    printf("-k\tthe key to set in the secure storage\n");
-    printf("-f\tthe file to read the key from\n");
-}
-
-void usage_encrypt_seal() {
-    printf("Usage: encrypt-seal [OPTION] ...\n");
-    printf("TODO...\n");
-}
-
-void usage_decrypt_unseal() {
-    printf("Usage: decrypt-unseal [OPTION] ...\n");
-    printf("TODO...\n");
-}
-
-void set_name(char *name, options_t *options) {
-    char buf[8];
-    snprintf(buf, sizeof(buf), "%s%d", PREFIX, atoi(name));
-    strncpy(options->name, buf, sizeof(buf));
-}
-
-void parse_get_key(int argc, char *argv[], options_t *options) {
-    if (argc < 3) {
-        usage_get_key();
-        exit(1);
-    }
-}
-void parse_set_key(int argc, char *argv[], options_t *options) {
-    if (argc < 3) {
-        usage_set_key();
-        exit(1);
-    } else if (argc == 5) {
-        if (strcmp(argv[3], "-f") == 0) {
-            options->file = argv[4];
-
-            options->key_len = get_file_size(options->file);
-            if (options->key_len < 0) {
-                ERRO("Failed to get the size of %s", options->file);
-                exit(1);
-            }
-            if (options->key_len > MAX_KEY_LEN) {
-                ERRO("The file contents are too long");
-                exit(1);
-            }
-            // cut the \0
-            options->key_len--;
-            char *buf;
-            buf = malloc(options->key_len * sizeof(char));
-            if (buf == NULL) {
-                errx(1, "error allocating memory on the heap");
-            }
-            options->key = buf;
-            read_key_file(options);
-        } else if (strcmp(argv[3], "-k") == 0) {
-            options->key_len = strlen(argv[4]);
-            if (options->key_len > MAX_KEY_LEN) {
-                ERRO("Warning: key length is to big max is: %zu bytes\n",
-                     MAX_KEY_LEN);
-                exit(1);
-            }
-            char *buf = malloc(options->key_len * sizeof(char));
-            if (buf == NULL) {
-                errx(1, "there was an error allocating memory for the key");
-            }
-            options->key = buf;
-            // this cuts of the \0 bytes but this is ok
-            strncpy(options->key, argv[4], options->key_len);
-        }
-    } else if (argc == 4 && (strcmp(argv[3], "-k") == 0)) {
-        // ask for stdin
-        printf("Enter the key (the key is cut at %zu):\n", MAX_KEY_LEN);
-        char buf[MAX_KEY_LEN];
-        // Read at most n bytes
-        // again the need to use base64 this was very stupid
-        char *res = fgets(buf, MAX_KEY_LEN, stdin);
-        size_t len = strlen(buf);
-        // ditch the \0 byte
-        len--;
-        if (res != NULL) {
-            printf("Read %zu bytes\n", len);
-            options->key_len = len;
-            options->key = malloc(options->key_len * sizeof(char));
-            if (options->key == NULL) {
-                errx(1, "error allocating memory on the heap");
-            }
-            strncpy(options->key, buf, options->key_len);
-        } else {
-            printf("Error reading input\n");
-        }
-    } else {
-        usage_set_key();
-        exit(1);
-    }
-}
-
-void parse_args(int argc, char *argv[], options_t *options) {
-    if (argc < 2) {
-        usage(argv[0]);
-        exit(1);
-    }
-    if (strcmp(argv[1], "get-key") == 0 || strcmp(argv[1], "g") == 0) {
-        options->subcommand = SUBCOMMAND_GET_KEY;
-        set_name(argv[2], options);
-        parse_get_key(argc, argv, options);
-    } else if (strcmp(argv[1], "set-key") == 0 || strcmp(argv[1], "s") == 0) {
-        options->subcommand = SUBCOMMAND_SET_KEY;
-        set_name(argv[2], options);
-        parse_set_key(argc, argv, options);
-    } else if (strcmp(argv[1], "del-key") == 0 || strcmp(argv[1], "d") == 0) {
-        options->subcommand = SUBCOMMAND_DEL_KEY;
-        set_name(argv[2], options);
-    } else if (strcmp(argv[1], "encrypt-seal") == 0 ||
-               strcmp(argv[1], "e") == 0) {
-        options->subcommand = SUBCOMMAND_ENCRYPT_SEAL;
-        set_name(argv[2], options);
-        usage_encrypt_seal();
-    } else if (strcmp(argv[1], "decrypt-unseal") == 0 ||
-               strcmp(argv[1], "ds") == 0) {
-        options->subcommand = SUBCOMMAND_DECRYPT_UNSEAL;
-        set_name(argv[2], options);
-        usage_decrypt_unseal();
-    } else {
-        usage(argv[0]);
-        exit(1);
-    }
-}
-
-long get_file_size(char *file) {
-    FILE *f;
-    f = fopen(file, "rb");
-    if (f == NULL) {
-        printf("Error opening file %s\n", file);
-        exit(1);
-    }
-    if (fseek(f, 0, SEEK_END) < 0) {
-        fclose(f);
-        ERRO("Failed to get the size of %s", file);
-        exit(1);
-    }
-    // todo: is this save from an integer overflow?
-    long size = ftell(f);
-    if (size < 0) {
-        fclose(f);
-        ERRO("Failed to get the size of %s", file);
-        exit(1);
-    }
-    rewind(f);
-    fclose(f);
-    return size;
-}
-
-void read_key_file(options_t *opts) {
-    FILE *f;
-    f = fopen(opts->file, "rb");
-    int res = fread(opts->key, 1, opts->key_len, f);
-    if (res != opts->key_len) {
-        printf("Error reading file %s is the key as long as you say it is?\n",
-               opts->file);
-        exit(1);
-    }
-    int fcres = fclose(f);
-    if (fcres != 0) {
-        printf("Error closing file %s\n", opts->file);
-        exit(1);
-    }
-}
-
-int check_name(char *name) {
-    if (strlen(name) > sizeof(name)) {
-        ERRO("The name is too long");
-        return 1;
-    }
-    for (int i = 0; i < strlen(name); i++) {
-        if (name[i] < '0' || name[i] > '9') {
-            ERRO("The name contains invalid characters");
-            return 1;
-        }
-    }
-    return 0;
+static int open_staged(const char *out_file, char *path, size_t size) {
+    int fd;
+
+    if ((size_t)snprintf(path, size, "%s.XXXXXX", out_file) >= size)
+        errx(1, "Output path %s is too long", out_file);
+    fd = mkstemp(path);
+    if (fd < 0)
+        err(1, "Failed to create a file next to %s", out_file);
+    return fd;
 }
 
 int main(int argc, char *argv[]) {
     struct test_ctx ctx;
     struct options o;
-    char buf[8];
+    char buf[MAX_NAME_LEN];
     o.subcommand = 0;
     o.name = buf;
     o.key = NULL;
     o.file = NULL;
     o.key_len = 0;
+    o.in_file = NULL;
+    o.out_file = NULL;
+    o.workers = 0;
+    o.batch = 0;
+    o.alg = TA_SEAL_KEY_ALG_HMAC_SHA256;
+    o.mac = NULL;
+    o.chunk_index = -1;
+    o.target = NULL;
+    o.key_size = TA_SEAL_KEY_DERIVE_KEY_SIZE;
+    o.key_type = TA_SEAL_KEY_TYPE_AES;
+    o.first = 0;
+    o.count = 0;
+    o.request_size = RAND_REQUEST_SIZE;
+    o.block_size = RAND_BLOCK_SIZE;
+    o.kek = NULL;
+    o.cursor_file = NULL;
+    o.overwrite = 0;
+    o.command = NULL;
+    o.dir = NULL;
+    o.id_rule = PROVISION_ID_NUMBER;
+    o.out_fd = -1;
+    o.encoding = CODEC_RAW;
+    o.reset = 0;
 
     parse_args(argc, argv, &o);
 
@@ -401,6 +130,17 @@ int main(int argc, char *argv[]) {
     // save printing of the key
     char read_data[MAX_KEY_LEN];
     size_t read_data_len = MAX_KEY_LEN;
+    struct seal_stats stats;
+    struct rng_stats rng_stats;
+    struct rewrap_stats rewrap_stats;
+    struct archive_stats archive_stats;
+    struct sync_stats sync_stats;
+    struct sync_peer peer;
+    struct provision_stats provision_stats;
+    int in_fd = STDIN_FILENO;
+    int out_fd = STDOUT_FILENO;
+    char staged[PATH_MAX];
+    const char *target = NULL;
     // test this after
     switch (o.subcommand) {
     case SUBCOMMAND_SET_KEY:
@@ -411,8 +151,8 @@ int main(int argc, char *argv[]) {
         }
         INFO("- Create and load key in the TA secure storage\n");
 
-        strncpy(key_data, o.key, o.key_len);
-        DEBG("key before write %s len: %zu", key_data, o.key_len);
+        memcpy(key_data, o.key, o.key_len);
+        DEBG("key before write len: %zu", o.key_len);
         res = write_secure_object(&ctx, o.name, key_data, sizeof(key_data));
         if (res != TEEC_SUCCESS) {
             errx(1, "Failed to create an object in the secure storage");
@@ -429,7 +169,26 @@ int main(int argc, char *argv[]) {
         }
         DEBG("Read back the object - len, %zu\n", o.key_len);
 
+        if (o.out_fd >= 0 || o.out_file != NULL) {
+            open_files(&o, &in_fd, &out_fd);
+            if (o.out_fd >= 0)
+                out_fd = o.out_fd;
+            res = output_secure_object(&ctx, o.name, o.encoding, out_fd,
+                                       &read_data_len);
+            if (res != TEEC_SUCCESS) {
+                // do not leave a partial key behind
+                if (o.out_file != NULL)
+                    unlink(o.out_file);
+                errx(1, "Failed to read an object from the secure storage");
+            }
+            if (o.out_file != NULL && close(out_fd) != 0)
+                err(1, "Failed to close %s", o.out_file);
+            INFO("Wrote %zu bytes of the key", read_data_len);
+            break;
+        }
         res = read_secure_object(&ctx, o.name, read_data, &read_data_len);
+        if (res == TEEC_ERROR_ITEM_NOT_FOUND)
+            errx(1, "No key is stored under %s", o.name);
         if (res != TEEC_SUCCESS)
             errx(1, "Failed to read an object from the secure storage");
 
@@ -441,10 +200,265 @@ int main(int argc, char *argv[]) {
         }
         INFO("- Delete the key\n");
         res = delete_secure_object(&ctx, o.name);
+        if (res == TEEC_ERROR_ITEM_NOT_FOUND)
+            errx(1, "No key is stored under %s", o.name);
         if (res != TEEC_SUCCESS)
             errx(1, "Failed to delete the object: 0x%x", res);
 
         break;
+    case SUBCOMMAND_ENCRYPT_SEAL:
+    case SUBCOMMAND_DECRYPT_UNSEAL:
+        if (o.subcommand == SUBCOMMAND_DECRYPT_UNSEAL && o.out_file != NULL) {
+            target = o.out_file;
+            o.out_file = NULL;
+        }
+        open_files(&o, &in_fd, &out_fd);
+        if (target != NULL)
+            out_fd = open_staged(target, staged, sizeof(staged));
+        if (o.subcommand == SUBCOMMAND_ENCRYPT_SEAL && o.batch > 0) {
+            INFO("Seal records with the key %s\n", o.name);
+            res = seal_records(&ctx, o.name, in_fd, out_fd, o.batch, &stats);
+        } else if (o.subcommand == SUBCOMMAND_ENCRYPT_SEAL && o.workers > 0) {
+            INFO("Seal data with the key %s in %d sessions\n", o.name,
+                 o.workers);
+            res = seal_chunks(&ctx, o.name, in_fd, out_fd, o.workers, &stats);
+        } else if (o.subcommand == SUBCOMMAND_ENCRYPT_SEAL) {
+            INFO("Seal data with the key %s\n", o.name);
+            res = seal_stream(&ctx, o.name, in_fd, out_fd, &stats);
+        } else if (o.chunk_index >= 0) {
+            INFO("Unseal chunk %ld with the key %s\n", o.chunk_index, o.name);
+            res = unseal_chunk(&ctx, o.name, in_fd, out_fd, o.chunk_index,
+                               &stats);
+        } else {
+            INFO("Unseal data with the key %s\n", o.name);
+            res = unseal_stream(&ctx, o.name, in_fd, out_fd, target != NULL,
+                                o.workers, o.batch, &stats);
+        }
+        if (res != TEEC_SUCCESS) {
+            // never leave unauthenticated or partial output behind
+            if (o.out_file != NULL)
+                unlink(o.out_file);
+            if (target != NULL)
+                unlink(staged);
+            errx(1, "Failed to process the data: 0x%x", res);
+        }
+        if (o.out_file != NULL && close(out_fd) != 0)
+            err(1, "Failed to close %s", o.out_file);
+        if (target != NULL) {
+            if (close(out_fd) != 0 || rename(staged, target) != 0) {
+                unlink(staged);
+                err(1, "Failed to write %s", target);
+            }
+        }
+        INFO("%zu bytes in, %zu bytes out in %.3f s (%.1f MB/s)",
+             stats.in_bytes, stats.out_bytes, stats.seconds,
+             stats.seconds > 0 ? stats.in_bytes / stats.seconds / 1e6 : 0.0);
+        if (stats.records > 0)
+            INFO("%zu records, %zu failed (%.0f records/s)", stats.records,
+                 stats.failed,
+                 stats.seconds > 0 ? stats.records / stats.seconds : 0.0);
+        // the records that went through are kept, but say some did not
+        if (stats.failed > 0)
+            errx(1, "%zu records could not be processed", stats.failed);
+        break;
+    case SUBCOMMAND_MAC:
+    case SUBCOMMAND_VERIFY:
+        open_files(&o, &in_fd, &out_fd);
+        if (o.subcommand == SUBCOMMAND_MAC && o.batch > 0)
+            res = mac_records(&ctx, o.name, o.alg, in_fd, out_fd, o.batch,
+                              &stats);
+        else if (o.subcommand == SUBCOMMAND_MAC)
+            res = mac_message(&ctx, o.name, o.alg, in_fd, out_fd, &stats);
+        else if (o.batch > 0)
+            res = verify_records(&ctx, o.name, o.alg, in_fd, out_fd, o.batch,
+                                 &stats);
+        else
+            res = verify_message(&ctx, o.name, o.alg, in_fd, o.mac, &stats);
+        if (res == TEEC_ERROR_MAC_INVALID ||
+            res == TEEC_ERROR_SIGNATURE_INVALID)
+            errx(1, "Verification failed");
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to process the data: 0x%x", res);
+        if (o.out_file != NULL && close(out_fd) != 0)
+            err(1, "Failed to close %s", o.out_file);
+        INFO("%zu messages, %zu failed in %.3f s (%.0f messages/s)",
+             stats.records, stats.failed, stats.seconds,
+             stats.seconds > 0 ? stats.records / stats.seconds : 0.0);
+        if (stats.failed > 0)
+            errx(1, "%zu messages did not verify", stats.failed);
+        break;
+    case SUBCOMMAND_DERIVE: {
+        double start = now_seconds();
+        int hit = 0;
+
+        res = derive_secure_object(&ctx, o.name, o.target, o.key_size,
+                                   &hit);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to derive the key %s: 0x%x", o.name, res);
+        INFO("Derived %s (%s) in %.1f us", o.name,
+             hit ? "cache hit" : "cache miss",
+             (now_seconds() - start) * 1e6);
+        if (o.target != NULL)
+            INFO("Stored %zu bytes of it as %s", o.key_size, o.target);
+        break;
+    }
+    case SUBCOMMAND_GENERATE:
+        open_files(&o, &in_fd, &out_fd);
+        INFO("Generate the keys %ld to %ld\n", o.first, o.first + o.count - 1);
+        res = generate_keys(&ctx, o.first, o.count, o.key_type, o.key_size,
+                            o.batch > 0 ? o.batch : GENERATE_BATCH_KEYS,
+                            out_fd, &stats);
+        INFO("%zu keys generated in %.3f s (%.0f keys/s)", stats.records,
+             stats.seconds,
+             stats.seconds > 0 ? stats.records / stats.seconds : 0.0);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to generate key %ld: 0x%x",
+                 o.first + (long)stats.records, res);
+        if (o.out_file != NULL && close(out_fd) != 0)
+            err(1, "Failed to close %s", o.out_file);
+        break;
+    case SUBCOMMAND_RAND:
+        open_files(&o, &in_fd, &out_fd);
+        res = rng_stream(o.count, o.request_size, o.block_size, out_fd,
+                         &rng_stats);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to read random bytes: 0x%x", res);
+        if (o.out_file != NULL && close(out_fd) != 0)
+            err(1, "Failed to close %s", o.out_file);
+        INFO("%zu bytes in %.3f s (%.1f MB/s), %zu calls to the TA",
+             rng_stats.bytes, rng_stats.seconds,
+             rng_stats.seconds > 0 ? rng_stats.bytes / rng_stats.seconds / 1e6
+                                   : 0.0,
+             rng_stats.refills);
+        INFO("%zu requests of %zu bytes, latency %.3f us average, %.3f us "
+             "max",
+             rng_stats.requests, o.request_size,
+             rng_stats.requests > 0
+                 ? rng_stats.latency / rng_stats.requests * 1e6
+                 : 0.0,
+             rng_stats.max_latency * 1e6);
+        INFO("%zu requests waited for the TEE", rng_stats.waits);
+        break;
+    case SUBCOMMAND_REWRAP:
+        INFO("Rewrap the keys from %s to %s\n", *o.kek ? o.kek : "plain",
+             *o.name ? o.name : "plain");
+        res = rewrap_store(&ctx, o.kek, o.name,
+                           o.batch > 0 ? o.batch : REWRAP_BATCH_OBJECTS,
+                           o.cursor_file, &rewrap_stats);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to rewrap the keys: 0x%x", res);
+        INFO("%zu keys rewrapped in %.3f s (%.0f keys/s), %d passes over "
+             "%zu objects in %.3f s",
+             rewrap_stats.rewrapped, rewrap_stats.first_pass_seconds,
+             rewrap_stats.first_pass_seconds > 0
+                 ? rewrap_stats.rewrapped / rewrap_stats.first_pass_seconds
+                 : 0.0,
+             rewrap_stats.passes, rewrap_stats.visited, rewrap_stats.seconds);
+        if (rewrap_stats.failed > 0)
+            errx(1, "%zu keys could not be rewrapped", rewrap_stats.failed);
+        break;
+    case SUBCOMMAND_EXPORT:
+    case SUBCOMMAND_IMPORT:
+        open_files(&o, &in_fd, &out_fd);
+        if (o.subcommand == SUBCOMMAND_EXPORT) {
+            INFO("Export the keys with the key %s\n", o.name);
+            res = export_store(&ctx, o.name, out_fd, &archive_stats);
+        } else {
+            INFO("Import the keys with the key %s\n", o.name);
+            res = import_store(&ctx, o.name, in_fd, o.overwrite,
+                               &archive_stats);
+        }
+        if (res != TEEC_SUCCESS) {
+            // a partial archive cannot be imported, do not leave it behind
+            if (o.out_file != NULL)
+                unlink(o.out_file);
+            errx(1, "Failed to %s the keys: 0x%x",
+                 o.subcommand == SUBCOMMAND_EXPORT ? "export" : "import",
+                 res);
+        }
+        if (o.out_file != NULL && close(out_fd) != 0)
+            err(1, "Failed to close %s", o.out_file);
+        INFO("%zu keys, %zu skipped, in %zu chunks, %zu bytes in %.3f s "
+             "(%.0f keys/s, %.1f MB/s)",
+             archive_stats.objects, archive_stats.skipped,
+             archive_stats.chunks, archive_stats.bytes, archive_stats.seconds,
+             archive_stats.seconds > 0
+                 ? archive_stats.objects / archive_stats.seconds
+                 : 0.0,
+             archive_stats.seconds > 0
+                 ? archive_stats.bytes / archive_stats.seconds / 1e6
+                 : 0.0);
+        break;
+    case SUBCOMMAND_SYNC:
+        if (o.command != NULL) {
+            if (sync_spawn_peer(o.command, &peer) < 0)
+                err(1, "Failed to run %s", o.command);
+        } else {
+            memset(&peer, 0, sizeof(peer));
+            // the peer opens its input first, open in the same order
+            peer.out_fd = open(o.out_file, O_WRONLY);
+            if (peer.out_fd < 0)
+                err(1, "Failed to open %s", o.out_file);
+            peer.in_fd = open(o.in_file, O_RDONLY);
+            if (peer.in_fd < 0)
+                err(1, "Failed to open %s", o.in_file);
+        }
+        INFO("Sync the keys with the key %s\n", o.name);
+        res = sync_pull(&ctx, o.name, &peer, &sync_stats);
+        if (sync_close_peer(&peer) != 0 && res == TEEC_SUCCESS)
+            res = TEEC_ERROR_COMMUNICATION;
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to sync the keys: 0x%x", res);
+        INFO("%zu leaves differ, %zu objects listed, %zu keys copied, %zu "
+             "deleted, %zu bytes sent, %zu received in %.3f s",
+             sync_stats.leaves, sync_stats.listed, sync_stats.copied,
+             sync_stats.deleted, sync_stats.sent, sync_stats.received,
+             sync_stats.seconds);
+        if (!sync_stats.in_sync)
+            errx(1, "The stores still differ, were they written during the "
+                    "sync?");
+        break;
+    case SUBCOMMAND_SYNC_SERVE:
+        open_files(&o, &in_fd, &out_fd);
+        res = sync_serve(&ctx, o.name, in_fd, out_fd);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to serve the sync: 0x%x", res);
+        break;
+    case SUBCOMMAND_IMPORT_DIR:
+        open_files(&o, &in_fd, &out_fd);
+        INFO("Import the keys in %s\n", o.dir);
+        res = import_dir(&ctx, o.dir, o.id_rule, o.encoding, o.workers,
+                         out_fd, &provision_stats);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to import %s: 0x%x", o.dir, res);
+        if (o.out_file != NULL && close(out_fd) != 0)
+            err(1, "Failed to close %s", o.out_file);
+        INFO("%zu files, %zu keys stored, %zu skipped, %zu failed, %zu bytes "
+             "in %.3f s (%.0f keys/s)",
+             provision_stats.files, provision_stats.stored,
+             provision_stats.skipped, provision_stats.failed,
+             provision_stats.bytes, provision_stats.seconds,
+             provision_stats.seconds > 0
+                 ? provision_stats.stored / provision_stats.seconds
+                 : 0.0);
+        if (provision_stats.failed > 0)
+            errx(1, "%zu files could not be stored", provision_stats.failed);
+        break;
+    case SUBCOMMAND_CODEC_BENCH:
+        res = codec_bench(&ctx, o.target, o.block_size, o.count);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to run the benchmark: 0x%x", res);
+        break;
+    case SUBCOMMAND_STATS:
+        res = show_ta_stats(&ctx, o.reset, stdout);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to read the TA statistics: 0x%x", res);
+        break;
+    case SUBCOMMAND_HOT_KEYS:
+        res = show_hot_keys(&ctx, o.reset, stdout);
+        if (res != TEEC_SUCCESS)
+            errx(1, "Failed to read the hot keys: 0x%x", res);
+        break;
     default:
         WARN("Subcommand not implemented!\n");
         exit(1);
@@ -452,21 +466,29 @@ int main(int argc, char *argv[]) {
         break;
     }
 
-    if (o.subcommand == SUBCOMMAND_SET_KEY) {
-        char read_buf[read_data_len + 1];
-        read_buf[read_data_len] = '\0';
-        memcpy(read_buf, read_data, read_data_len);
-        // this should be base64
-        DEBG("test read :: key after read: %s", read_buf);
-    }
-    if (o.subcommand == SUBCOMMAND_GET_KEY) {
+    // key material is never logged, only its length
+    if (o.subcommand == SUBCOMMAND_SET_KEY)
+        DEBG("test read :: %zu bytes after read", read_data_len);
+    if (o.subcommand == SUBCOMMAND_GET_KEY && o.out_fd < 0 &&
+        o.out_file == NULL && o.encoding != CODEC_RAW) {
+        char text[codec_encoded_len(o.encoding, read_data_len) + 1];
+        size_t len = codec_encode(o.encoding, (uint8_t *)read_data,
+                                  read_data_len, text);
+
+        text[len] = '\n';
+        if (write_full(STDOUT_FILENO, text, len + 1) < 0)
+            err(1, "Failed to write the key");
+        wipe(text, sizeof(text));
+    } else if (o.subcommand == SUBCOMMAND_GET_KEY && o.out_fd < 0 &&
+               o.out_file == NULL) {
         char read_buf[read_data_len + 1];
         read_buf[read_data_len] = '\0';
         memcpy(read_buf, read_data, read_data_len);
         // this should be base64
-        DEBG("key after read: %s", read_buf);
         printf("%s\n", read_buf);
+        wipe(read_buf, sizeof(read_buf));
     }
+    wipe(read_data, sizeof(read_data));
 
 cleanup:
     INFO("\nWe're done, close and release TEE resources\n");
@@ -0,0 +1,394 @@
+#include "metrics.h"
+#include "debugmacros.h"
+#include "storage.h"
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_SUB (1 << METRICS_SUB_BITS)
+#define METRICS_SOCKET_PREFIX "unix:"
+
+struct histogram {
+    uint64_t count[METRICS_BUCKETS];
+    uint64_t sum; // ns
+    uint64_t errors;
+    uint64_t started;
+    uint64_t finished;
+};
+
+/*
+ * The counters of one thread. Only the owner writes them, without locks or
+ * atomic read-modify-writes, the exporter reads them with relaxed loads and
+ * adds up all threads. A block outlives its thread and is handed to the next
+ * thread that starts, so the counts only ever grow.
+ */
+struct metrics_thread {
+    struct histogram hist[METRICS_COMMANDS];
+    struct metrics_thread *next;
+    int free;
+};
+
+int metrics_enabled;
+
+static const char *metrics_target;
+static unsigned int metrics_interval = METRICS_INTERVAL;
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_key;
+static struct metrics_thread *threads;
+static __thread struct metrics_thread *self;
+static uint64_t sessions;
+// the sum over all threads, only used by the exporter under export_lock
+static struct histogram merged[METRICS_COMMANDS];
+
+// upper bounds of the exported buckets in seconds, the rest is in the
+// quantiles
+static const double bucket_bounds[] = {
+    1e-6,   2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4,
+    5e-4,   1e-3,   2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1,
+    0.25,   0.5,    1,    2.5,  5,      10,
+};
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+#define NQUANTILES (sizeof(quantiles) / sizeof(*quantiles))
+
+static inline void bump(uint64_t *p, uint64_t n) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + n,
+                     __ATOMIC_RELAXED);
+}
+
+static inline size_t bucket_index(uint64_t v) {
+    int e;
+
+    if (v < METRICS_SUB)
+        return v;
+    e = 63 - __builtin_clzll(v);
+    if (e >= METRICS_MAX_BITS)
+        return METRICS_BUCKETS - 1;
+    return (size_t)(e - METRICS_SUB_BITS + 1) * METRICS_SUB +
+           (v >> (e - METRICS_SUB_BITS)) - METRICS_SUB;
+}
+
+// the largest value that lands in bucket i
+static uint64_t bucket_high(size_t i) {
+    size_t group = i / METRICS_SUB;
+    int shift;
+
+    if (group == 0)
+        return i;
+    shift = group - 1;
+    return ((uint64_t)(METRICS_SUB + i % METRICS_SUB + 1) << shift) - 1;
+}
+
+static void release_thread(void *block) {
+    struct metrics_thread *t = block;
+
+    pthread_mutex_lock(&threads_lock);
+    t->free = 1;
+    pthread_mutex_unlock(&threads_lock);
+}
+
+// take a free block or allocate one, once per thread
+static struct metrics_thread *claim_thread(void) {
+    struct metrics_thread *t;
+
+    pthread_mutex_lock(&threads_lock);
+    for (t = threads; t != NULL && !t->free; t = t->next)
+        ;
+    if (t != NULL) {
+        t->free = 0;
+    } else {
+        t = calloc(1, sizeof(*t));
+        if (t == NULL)
+            errx(1, "error allocating memory on the heap");
+        t->next = threads;
+        threads = t;
+    }
+    pthread_mutex_unlock(&threads_lock);
+    pthread_setspecific(thread_key, t);
+    self = t;
+    return t;
+}
+
+static void merge(void) {
+    memset(merged, 0, sizeof(merged));
+    pthread_mutex_lock(&threads_lock);
+    for (struct metrics_thread *t = threads; t != NULL; t = t->next) {
+        for (size_t c = 0; c < METRICS_COMMANDS; c++) {
+            struct histogram *h = &t->hist[c], *m = &merged[c];
+
+            if (__atomic_load_n(&h->started, __ATOMIC_RELAXED) == 0)
+                continue;
+            for (size_t i = 0; i < METRICS_BUCKETS; i++)
+                m->count[i] += __atomic_load_n(&h->count[i], __ATOMIC_RELAXED);
+            m->sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+            m->errors += __atomic_load_n(&h->errors, __ATOMIC_RELAXED);
+            m->started += __atomic_load_n(&h->started, __ATOMIC_RELAXED);
+            m->finished += __atomic_load_n(&h->finished, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&threads_lock);
+}
+
+static uint64_t total(const struct histogram *h) {
+    uint64_t n = 0;
+
+    for (size_t i = 0; i < METRICS_BUCKETS; i++)
+        n += h->count[i];
+    return n;
+}
+
+// the value below which q of the calls stayed, in ns
+static uint64_t quantile(const struct histogram *h, uint64_t n, double q) {
+    uint64_t rank = q * n, seen = 0;
+
+    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+        seen += h->count[i];
+        if (seen > rank)
+            return bucket_high(i);
+    }
+    return bucket_high(METRICS_BUCKETS - 1);
+}
+
+static void write_histogram(FILE *f, const char *name,
+                            const struct histogram *h, uint64_t n) {
+    uint64_t below = 0;
+    size_t i = 0;
+
+    for (size_t b = 0; b < sizeof(bucket_bounds) / sizeof(*bucket_bounds);
+         b++) {
+        for (; i < METRICS_BUCKETS && bucket_high(i) <= bucket_bounds[b] * 1e9;
+             i++)
+            below += h->count[i];
+        fprintf(f,
+                "seal_key_command_duration_seconds_bucket{command=\"%s\","
+                "le=\"%g\"} %llu\n",
+                name, bucket_bounds[b], (unsigned long long)below);
+    }
+    fprintf(f,
+            "seal_key_command_duration_seconds_bucket{command=\"%s\","
+            "le=\"+Inf\"} %llu\n",
+            name, (unsigned long long)n);
+    fprintf(f, "seal_key_command_duration_seconds_sum{command=\"%s\"} %.9f\n",
+            name, h->sum / 1e9);
+    fprintf(f, "seal_key_command_duration_seconds_count{command=\"%s\"} %llu\n",
+            name, (unsigned long long)n);
+}
+
+// the Prometheus text format of everything recorded so far
+static void write_metrics(FILE *f) {
+    uint64_t n[METRICS_COMMANDS];
+
+    merge();
+    for (size_t c = 0; c < METRICS_COMMANDS; c++)
+        n[c] = total(&merged[c]);
+
+    fprintf(f, "# HELP seal_key_command_duration_seconds Time of the calls "
+               "into the TA.\n");
+    fprintf(f, "# TYPE seal_key_command_duration_seconds histogram\n");
+    for (size_t c = 0; c < METRICS_COMMANDS; c++)
+        if (n[c] > 0)
+            write_histogram(f, command_name(c), &merged[c], n[c]);
+
+    fprintf(f, "# HELP seal_key_command_duration_quantile_seconds Quantiles "
+               "of the time of the calls into the TA, within 3.2%%.\n");
+    fprintf(f, "# TYPE seal_key_command_duration_quantile_seconds gauge\n");
+    for (size_t c = 0; c < METRICS_COMMANDS; c++)
+        for (size_t q = 0; n[c] > 0 && q < NQUANTILES; q++)
+            fprintf(f,
+                    "seal_key_command_duration_quantile_seconds{command=\"%s\","
+                    "quantile=\"%g\"} %.9f\n",
+                    command_name(c), quantiles[q],
+                    quantile(&merged[c], n[c], quantiles[q]) / 1e9);
+
+    fprintf(f, "# HELP seal_key_command_errors_total Calls into the TA that "
+               "failed.\n");
+    fprintf(f, "# TYPE seal_key_command_errors_total counter\n");
+    for (size_t c = 0; c < METRICS_COMMANDS; c++)
+        if (merged[c].started > 0)
+            fprintf(f, "seal_key_command_errors_total{command=\"%s\"} %llu\n",
+                    command_name(c), (unsigned long long)merged[c].errors);
+
+    fprintf(f, "# HELP seal_key_commands_in_flight Calls into the TA that did "
+               "not return yet.\n");
+    fprintf(f, "# TYPE seal_key_commands_in_flight gauge\n");
+    for (size_t c = 0; c < METRICS_COMMANDS; c++)
+        if (merged[c].started > 0)
+            fprintf(f, "seal_key_commands_in_flight{command=\"%s\"} %lld\n",
+                    command_name(c),
+                    (long long)(merged[c].started - merged[c].finished));
+
+    fprintf(f, "# HELP seal_key_sessions_open TA sessions open.\n");
+    fprintf(f, "# TYPE seal_key_sessions_open gauge\n");
+    fprintf(f, "seal_key_sessions_open %llu\n",
+            (unsigned long long)__atomic_load_n(&sessions, __ATOMIC_RELAXED));
+}
+
+// replace the textfile at once, so a collector never reads half of it
+static void write_textfile(void) {
+    char tmp[strlen(metrics_target) + 5];
+    FILE *f;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", metrics_target);
+    pthread_mutex_lock(&export_lock);
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        WARN("Failed to open %s: %s", tmp, strerror(errno));
+    } else {
+        write_metrics(f);
+        if (fclose(f) != 0 || rename(tmp, metrics_target) != 0)
+            WARN("Failed to write %s: %s", metrics_target, strerror(errno));
+    }
+    pthread_mutex_unlock(&export_lock);
+}
+
+static void *textfile_loop(void *arg) {
+    (void)arg;
+    for (;;) {
+        sleep(metrics_interval);
+        write_textfile();
+    }
+    return NULL;
+}
+
+// a client that hangs up early must not kill us with SIGPIPE
+static void send_all(int fd, const char *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void *socket_loop(void *arg) {
+    int sock = *(int *)arg;
+    char *buf;
+    size_t len;
+    FILE *f;
+    int fd;
+
+    for (;;) {
+        fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            WARN("Failed to accept a metrics connection: %s",
+                 strerror(errno));
+            return NULL;
+        }
+        f = open_memstream(&buf, &len);
+        if (f != NULL) {
+            pthread_mutex_lock(&export_lock);
+            write_metrics(f);
+            pthread_mutex_unlock(&export_lock);
+            if (fclose(f) == 0)
+                send_all(fd, buf, len);
+            free(buf);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static void remove_socket(void) {
+    unlink(metrics_target + strlen(METRICS_SOCKET_PREFIX));
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un addr;
+    int sock;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        errx(1, "The metrics socket path %s is too long", path);
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        err(1, "Failed to create the metrics socket");
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(sock, 8) < 0)
+        err(1, "Failed to listen on %s", path);
+    return sock;
+}
+
+static void metrics_setup(void) {
+    static int sock;
+    const char *interval = getenv(METRICS_INTERVAL_ENV);
+    pthread_t thread;
+    int res;
+
+    metrics_target = getenv(METRICS_ENV);
+    if (metrics_target == NULL || *metrics_target == '\0')
+        return;
+    if (interval != NULL && atoi(interval) > 0)
+        metrics_interval = atoi(interval);
+    if (pthread_key_create(&thread_key, release_thread) != 0)
+        errx(1, "Failed to set up the metrics");
+
+    if (strncmp(metrics_target, METRICS_SOCKET_PREFIX,
+                strlen(METRICS_SOCKET_PREFIX)) == 0) {
+        sock = open_socket(metrics_target + strlen(METRICS_SOCKET_PREFIX));
+        atexit(remove_socket);
+        res = pthread_create(&thread, NULL, socket_loop, &sock);
+    } else {
+        // the last state is written at exit as well
+        atexit(write_textfile);
+        res = pthread_create(&thread, NULL, textfile_loop, NULL);
+    }
+    if (res != 0)
+        errx(1, "Failed to start the metrics exporter");
+    pthread_detach(thread);
+    metrics_enabled = 1;
+}
+
+// start exporting when METRICS_ENV is set, only the first call counts
+void metrics_init(void) {
+    pthread_once(&metrics_once, metrics_setup);
+    if (metrics_enabled && self == NULL)
+        claim_thread();
+}
+
+void metrics_session(int opened) {
+    if (!metrics_enabled)
+        return;
+    if (opened)
+        __atomic_add_fetch(&sessions, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_sub_fetch(&sessions, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_begin(uint32_t cmd) {
+    struct metrics_thread *t = self ? self : claim_thread();
+
+    if (cmd < METRICS_COMMANDS)
+        bump(&t->hist[cmd].started, 1);
+}
+
+void metrics_end(uint32_t cmd, uint32_t res, uint64_t ns) {
+    struct histogram *h;
+
+    if (cmd >= METRICS_COMMANDS)
+        return;
+    h = &self->hist[cmd];
+    bump(&h->count[bucket_index(ns)], 1);
+    bump(&h->sum, ns);
+    if (res != TEEC_SUCCESS)
+        bump(&h->errors, 1);
+    bump(&h->finished, 1);
+}
@@ -0,0 +1,369 @@
+#include "provision.h"
+#include "codec.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// largest key file import-dir stores, the TA copies the key into its heap
+#define PROVISION_MAX_KEY_SIZE (16 * 1024)
+// report lines collected before they are written out
+#define PROVISION_REPORT_SIZE (64 * 1024)
+
+#define FILE_PENDING 0
+#define FILE_STORED 1
+#define FILE_SKIPPED 2 // not a regular file
+#define FILE_BAD_NAME 3
+#define FILE_EMPTY 4
+#define FILE_TOO_LARGE 5
+#define FILE_UNREADABLE 6
+#define FILE_FAILED 7 // the TA did not store it
+#define FILE_BAD_ENCODING 8
+#define FILE_DUPLICATE_ID 9 // an earlier file has the same storage id
+
+static const char *file_status[] = {
+    "pending", "stored",     "skipped", "bad name",     "empty",
+    "too large", "unreadable", "failed", "bad encoding", "duplicate id",
+};
+
+struct provision_file {
+    const char *name;
+    char id[MAX_NAME_LEN];
+    int status;
+    TEEC_Result res;
+};
+
+/*
+ * The files are handed out in order to a pool of workers, each with its own
+ * TA session. A worker maps its file, stores it and records the outcome in
+ * its entry of files, the report is written once all workers are done.
+ */
+struct provision_pool {
+    pthread_mutex_t lock;
+    int dir_fd;
+    int id_rule;
+    int encoding;
+    struct provision_file *files;
+    size_t count;
+    size_t next;
+};
+
+struct provision_worker {
+    struct provision_pool *p;
+    struct test_ctx *ctx;
+    struct test_ctx own_ctx;
+    size_t bytes;
+    pthread_t thread;
+};
+
+// the storage id of the key in the file name, -1 when there is none
+static int file_id(const char *name, int rule, char *id) {
+    const char *dot;
+    size_t len = strlen(name);
+    char *end;
+    long number;
+    int n;
+
+    switch (rule) {
+    case PROVISION_ID_NUMBER:
+        number = strtol(name, &end, 10);
+        if (end == name || (*end != '\0' && *end != '.') || *name < '0' ||
+            *name > '9' || number > INT_MAX)
+            return -1;
+        n = snprintf(id, MAX_NAME_LEN, "%s%ld", PREFIX, number);
+        break;
+    case PROVISION_ID_STEM:
+        dot = strrchr(name, '.');
+        if (dot != NULL && dot != name)
+            len = dot - name;
+        /* fall through */
+    default:
+        n = snprintf(id, MAX_NAME_LEN, "%s%.*s", PREFIX, (int)len, name);
+    }
+    return n < MAX_NAME_LEN ? 0 : -1;
+}
+
+// map the file and store it as the key f->id, like set-key -f does
+static void store_file(struct provision_worker *w, struct provision_file *f) {
+    uint8_t decoded[PROVISION_MAX_KEY_SIZE];
+    struct stat st;
+    uint8_t *data, *key;
+    ssize_t n;
+    size_t len;
+    int fd;
+
+    // O_NONBLOCK keeps a fifo in the directory from blocking the worker
+    fd = openat(w->p->dir_fd, f->name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        f->status = FILE_UNREADABLE;
+        goto out;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        f->status = FILE_SKIPPED;
+        goto out;
+    }
+    if (f->id[0] == '\0') {
+        f->status = FILE_BAD_NAME;
+        goto out;
+    }
+    if (st.st_size > PROVISION_MAX_KEY_SIZE) {
+        f->status = FILE_TOO_LARGE;
+        goto out;
+    }
+    len = st.st_size;
+    if (len == 0) {
+        f->status = FILE_EMPTY;
+        goto out;
+    }
+    data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        f->status = FILE_UNREADABLE;
+        goto out;
+    }
+    // cut the trailing newline, binary keys are taken as they are
+    if (data[len - 1] == '\n')
+        len--;
+    // raw keys are stored straight from the mapping
+    key = data;
+    n = len;
+    if (w->p->encoding != CODEC_RAW) {
+        key = decoded;
+        n = codec_decode(w->p->encoding, (char *)data, len, key);
+    }
+    if (n < 0) {
+        f->status = FILE_BAD_ENCODING;
+    } else if (n == 0) {
+        f->status = FILE_EMPTY;
+    } else {
+        f->res = write_secure_object(w->ctx, f->id, (char *)key, n);
+        f->status = f->res == TEEC_SUCCESS ? FILE_STORED : FILE_FAILED;
+        if (f->res == TEEC_SUCCESS)
+            w->bytes += n;
+    }
+    // a failed decode may have written part of the key as well
+    if (key == decoded)
+        wipe(decoded, codec_decoded_max(w->p->encoding, len));
+    munmap(data, st.st_size);
+out:
+    if (fd >= 0)
+        close(fd);
+}
+
+static void *provision_worker_run(void *arg) {
+    struct provision_worker *w = arg;
+    struct provision_pool *p = w->p;
+    size_t i;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        i = p->next++;
+        pthread_mutex_unlock(&p->lock);
+        if (i >= p->count)
+            break;
+        if (p->files[i].status == FILE_PENDING)
+            store_file(w, p->files + i);
+    }
+    return NULL;
+}
+
+// by storage id, files with the same id in the order of the listing
+static int cmp_file_id(const void *a, const void *b) {
+    const struct provision_file *fa = *(const struct provision_file **)a;
+    const struct provision_file *fb = *(const struct provision_file **)b;
+    int c = strcmp(fa->id, fb->id);
+
+    return c ? c : (fa > fb) - (fa < fb);
+}
+
+/*
+ * Derive the storage id of every file before any is stored. Names such as
+ * 007.key and 7.key give the same id, the first file in the listing keeps
+ * it and the others are not stored, else the workers would race on the id
+ * and the key that is left would depend on which of them came last.
+ */
+static int assign_ids(struct provision_file *files, size_t count,
+                      int dir_fd, int id_rule) {
+    struct provision_file **sorted;
+    struct stat st;
+
+    sorted = malloc((count ? count : 1) * sizeof(*sorted));
+    if (sorted == NULL)
+        return -1;
+    for (size_t i = 0; i < count; i++) {
+        sorted[i] = files + i;
+        // a subdirectory does not take the id of the key file beside it
+        if (fstatat(dir_fd, files[i].name, &st, 0) == 0 &&
+            !S_ISREG(st.st_mode))
+            files[i].status = FILE_SKIPPED;
+        else if (file_id(files[i].name, id_rule, files[i].id) < 0)
+            files[i].id[0] = '\0';
+    }
+    qsort(sorted, count, sizeof(*sorted), cmp_file_id);
+    for (size_t i = 1; i < count; i++) {
+        if (sorted[i]->id[0] != '\0' &&
+            strcmp(sorted[i]->id, sorted[i - 1]->id) == 0)
+            sorted[i]->status = FILE_DUPLICATE_ID;
+    }
+    free(sorted);
+    return 0;
+}
+
+// hidden files, . and .. are not keys
+static int visible_file(const struct dirent *d) { return d->d_name[0] != '.'; }
+
+// one line per file, the name, the storage id and what happened to it
+static int write_report(int out_fd, struct provision_file *files,
+                        size_t count) {
+    char *buf = malloc(PROVISION_REPORT_SIZE);
+    size_t len = 0;
+    int res = 0;
+
+    if (buf == NULL)
+        return -1;
+    for (size_t i = 0; i < count && res == 0; i++) {
+        struct provision_file *f = files + i;
+        size_t max = PROVISION_REPORT_SIZE - len;
+        int n;
+
+        if (f->status == FILE_FAILED)
+            n = snprintf(buf + len, max, "%s\t%s\t%s 0x%x\n", f->name,
+                         f->id, file_status[f->status], f->res);
+        else
+            n = snprintf(buf + len, max, "%s\t%s\t%s\n", f->name,
+                         f->id[0] ? f->id : "-",
+                         file_status[f->status]);
+        if ((size_t)n >= max) {
+            // does not fit anymore, write out what is there and retry
+            res = write_full(out_fd, buf, len);
+            len = 0;
+            i--;
+            continue;
+        }
+        len += n;
+    }
+    if (res == 0)
+        res = write_full(out_fd, buf, len);
+    free(buf);
+    return res;
+}
+
+/*
+ * Store every visible file of dir as a key, the storage id is derived from
+ * the file name by id_rule and the contents are decoded with encoding. The
+ * files are spread over workers TA sessions, 0 uses one per online CPU. A
+ * line per file goes to out_fd at the end.
+ * Files that are not stored are counted as failed, they do not stop the
+ * others. That includes files whose id an earlier file already has.
+ */
+TEEC_Result import_dir(struct test_ctx *ctx, const char *dir, int id_rule,
+                       int encoding, unsigned int workers, int out_fd,
+                       struct provision_stats *stats) {
+    struct provision_pool p;
+    struct provision_worker *w = NULL;
+    struct dirent **list = NULL;
+    TEEC_Result res = TEEC_SUCCESS;
+    double start = now_seconds();
+    int n;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&p, 0, sizeof(p));
+    p.id_rule = id_rule;
+    p.encoding = encoding;
+    p.dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (p.dir_fd < 0) {
+        ERRO("Failed to open the directory %s", dir);
+        return TEEC_ERROR_ITEM_NOT_FOUND;
+    }
+    n = scandir(dir, &list, visible_file, alphasort);
+    if (n < 0) {
+        ERRO("Failed to list the directory %s", dir);
+        close(p.dir_fd);
+        return TEEC_ERROR_GENERIC;
+    }
+    p.count = n;
+    p.files = calloc(p.count ? p.count : 1, sizeof(*p.files));
+    if (p.files == NULL) {
+        res = TEEC_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
+    for (size_t i = 0; i < p.count; i++)
+        p.files[i].name = list[i]->d_name;
+    if (assign_ids(p.files, p.count, p.dir_fd, id_rule) < 0) {
+        res = TEEC_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
+
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        workers = cpus < 1 ? 1 : cpus > MAX_WORKERS ? MAX_WORKERS : cpus;
+    }
+    if (workers > p.count)
+        workers = p.count ? p.count : 1;
+    w = calloc(workers, sizeof(*w));
+    if (w == NULL) {
+        res = TEEC_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    for (unsigned int i = 0; i < workers; i++) {
+        w[i].p = &p;
+        if (i == 0) {
+            w[i].ctx = ctx;
+        } else {
+            prepare_tee_session(&w[i].own_ctx);
+            w[i].ctx = &w[i].own_ctx;
+        }
+    }
+    // the caller is worker 0, the others run on threads of their own
+    for (unsigned int i = 1; i < workers; i++) {
+        if (pthread_create(&w[i].thread, NULL, provision_worker_run, w + i)) {
+            // the workers that run take over the files of the others
+            ERRO("Failed to start worker %u", i);
+            for (unsigned int j = i; j < workers; j++)
+                terminate_tee_session(&w[j].own_ctx);
+            workers = i;
+            break;
+        }
+    }
+    provision_worker_run(w);
+    stats->bytes = w[0].bytes;
+    for (unsigned int i = 1; i < workers; i++) {
+        pthread_join(w[i].thread, NULL);
+        stats->bytes += w[i].bytes;
+        terminate_tee_session(&w[i].own_ctx);
+    }
+    pthread_mutex_destroy(&p.lock);
+    stats->seconds = now_seconds() - start;
+
+    for (size_t i = 0; i < p.count; i++) {
+        if (p.files[i].status == FILE_STORED)
+            stats->stored++;
+        else if (p.files[i].status == FILE_SKIPPED)
+            stats->skipped++;
+        else
+            stats->failed++;
+    }
+    stats->files = p.count;
+    if (write_report(out_fd, p.files, p.count) < 0) {
+        ERRO("Failed to write the report");
+        res = TEEC_ERROR_GENERIC;
+    }
+out:
+    free(w);
+    free(p.files);
+    for (int i = 0; i < n; i++)
+        free(list[i]);
+    free(list);
+    close(p.dir_fd);
+    return res;
+}
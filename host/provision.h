@@ -0,0 +1,25 @@
+#ifndef PROVISION_H
+#define PROVISION_H
+
+#include "storage.h"
+#include <stddef.h>
+
+// how import-dir turns a file name into a storage id, always after PREFIX
+#define PROVISION_ID_NUMBER 1 // the digits before the first dot, 17.key
+#define PROVISION_ID_STEM 2   // the name without its last extension
+#define PROVISION_ID_NAME 3   // the whole file name
+
+struct provision_stats {
+    size_t files;
+    size_t stored;
+    size_t skipped;
+    size_t failed;
+    size_t bytes;
+    double seconds;
+};
+
+TEEC_Result import_dir(struct test_ctx *ctx, const char *dir, int id_rule,
+                       int encoding, unsigned int workers, int out_fd,
+                       struct provision_stats *stats);
+
+#endif // !PROVISION_H
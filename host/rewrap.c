@@ -0,0 +1,107 @@
+#include "rewrap.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// the cursor of an interrupted job, 0 when there is none
+static uint32_t read_cursor(const char *cursor_file) {
+    unsigned long cursor = 0;
+    FILE *f;
+
+    if (cursor_file == NULL || (f = fopen(cursor_file, "r")) == NULL)
+        return 0;
+    if (fscanf(f, "%lu", &cursor) != 1 || cursor > UINT32_MAX)
+        cursor = 0;
+    fclose(f);
+    return cursor;
+}
+
+// replace the cursor file so a crash leaves either the old or the new one
+static int write_cursor(const char *cursor_file, uint32_t cursor) {
+    char tmp[PATH_MAX];
+    FILE *f;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cursor_file);
+    f = fopen(tmp, "w");
+    if (f == NULL)
+        return -1;
+    if (fprintf(f, "%u\n", cursor) < 0 || fflush(f) != 0 ||
+        fsync(fileno(f)) != 0) {
+        fclose(f);
+        return -1;
+    }
+    if (fclose(f) != 0)
+        return -1;
+    return rename(tmp, cursor_file);
+}
+
+/*
+ * Move every key wrapped with old_kek to new_kek inside the TA, batch
+ * objects per call. With a cursor file an interrupted job continues where
+ * it stopped. The store is visited again until a pass finds nothing left
+ * to rewrap, as objects rewritten during a pass may be enumerated in a
+ * different place. stats->failed counts the keys of the last pass that
+ * could not be rewrapped.
+ */
+TEEC_Result rewrap_store(struct test_ctx *ctx, char *old_kek, char *new_kek,
+                         unsigned int batch, const char *cursor_file,
+                         struct rewrap_stats *stats) {
+    uint32_t cursor = read_cursor(cursor_file);
+    TEEC_Result res = TEEC_SUCCESS;
+    double start = now_seconds();
+    double report = start;
+    size_t pass_rewrapped;
+
+    memset(stats, 0, sizeof(*stats));
+    if (cursor > 0)
+        INFO("Resume at object %u\n", cursor);
+
+    do {
+        int end = 0;
+
+        pass_rewrapped = 0;
+        // keys that cannot be rewrapped are counted again in every pass
+        stats->failed = 0;
+        stats->passes++;
+        while (!end) {
+            uint32_t from = cursor;
+            uint32_t rewrapped;
+            uint32_t failed;
+
+            res = rewrap_secure_objects(ctx, old_kek, new_kek, &cursor,
+                                        batch, &end, &rewrapped, &failed);
+            if (res != TEEC_SUCCESS)
+                return res;
+            stats->visited += cursor - from;
+            stats->rewrapped += rewrapped;
+            stats->failed += failed;
+            pass_rewrapped += rewrapped;
+            if (cursor_file != NULL &&
+                write_cursor(cursor_file, end ? 0 : cursor) < 0) {
+                ERRO("Failed to write the cursor to %s", cursor_file);
+                return TEEC_ERROR_GENERIC;
+            }
+            if (now_seconds() - report >= 1) {
+                report = now_seconds();
+                INFO("pass %d at object %u: %zu rewrapped, %zu failed (%.0f "
+                     "objects/s)",
+                     stats->passes, cursor, stats->rewrapped, stats->failed,
+                     stats->visited / (report - start));
+            }
+        }
+        cursor = 0;
+        if (stats->passes == 1)
+            stats->first_pass_seconds = now_seconds() - start;
+    } while (pass_rewrapped > 0);
+
+    if (cursor_file != NULL)
+        unlink(cursor_file);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
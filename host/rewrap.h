@@ -0,0 +1,21 @@
+#ifndef REWRAP_H
+#define REWRAP_H
+
+#include "storage.h"
+#include <stddef.h>
+
+struct rewrap_stats {
+    size_t visited;
+    size_t rewrapped;
+    size_t failed;
+    int passes;
+    // time of the first pass over the store, which does the actual work
+    double first_pass_seconds;
+    double seconds;
+};
+
+TEEC_Result rewrap_store(struct test_ctx *ctx, char *old_kek, char *new_kek,
+                         unsigned int batch, const char *cursor_file,
+                         struct rewrap_stats *stats);
+
+#endif // !REWRAP_H
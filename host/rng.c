@@ -0,0 +1,210 @@
+#include "rng.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static void *rng_refill(void *arg) {
+    struct rng *r = arg;
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop) {
+        struct rng_block *spare = r->block + !r->active;
+        TEEC_Result res;
+
+        if (r->spare_full) {
+            pthread_cond_wait(&r->cond, &r->lock);
+            continue;
+        }
+        // the spare block is not touched by readers until it is full
+        pthread_mutex_unlock(&r->lock);
+        res = random_secure_block(&r->ctx, &spare->shm, r->block_size);
+        pthread_mutex_lock(&r->lock);
+        if (res != TEEC_SUCCESS) {
+            r->res = res;
+            pthread_cond_broadcast(&r->cond);
+            break;
+        }
+        spare->pos = 0;
+        spare->len = r->block_size;
+        r->spare_full = 1;
+        r->refills++;
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static void rng_release(struct rng *r) {
+    for (int i = 0; i < 2; i++) {
+        struct rng_block *b = r->block + i;
+
+        if (b->shm.buffer == NULL)
+            continue;
+        wipe(b->shm.buffer, r->block_size);
+        munlock(b->shm.buffer, r->block_size);
+        TEEC_ReleaseSharedMemory(&b->shm);
+    }
+    terminate_tee_session(&r->ctx);
+}
+
+/*
+ * Open a TA session of its own for r, fill the first block and start the
+ * refill thread. block_size bytes are fetched per call to the TA.
+ */
+TEEC_Result rng_open(struct rng *r, size_t block_size) {
+    TEEC_Result res;
+
+    memset(r, 0, sizeof(*r));
+    r->block_size = block_size;
+    prepare_tee_session(&r->ctx);
+    for (int i = 0; i < 2; i++) {
+        struct rng_block *b = r->block + i;
+
+        res = alloc_shared_memory(&r->ctx, &b->shm, block_size,
+                                  TEEC_MEM_OUTPUT);
+        if (res != TEEC_SUCCESS)
+            goto err;
+        // random bytes must not end up in swap
+        if (mlock(b->shm.buffer, block_size) != 0) {
+            ERRO("Failed to lock %zu bytes of memory, try a smaller block",
+                 block_size);
+            TEEC_ReleaseSharedMemory(&b->shm);
+            b->shm.buffer = NULL;
+            res = TEEC_ERROR_OUT_OF_MEMORY;
+            goto err;
+        }
+    }
+
+    res = random_secure_block(&r->ctx, &r->block[0].shm, block_size);
+    if (res != TEEC_SUCCESS)
+        goto err;
+    r->block[0].len = block_size;
+    r->refills = 1;
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->thread, NULL, rng_refill, r)) {
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        res = TEEC_ERROR_GENERIC;
+        goto err;
+    }
+    return TEEC_SUCCESS;
+err:
+    rng_release(r);
+    return res;
+}
+
+// copy len random bytes to buf, safe to call from several threads
+TEEC_Result rng_read(struct rng *r, void *buf, size_t len) {
+    uint8_t *out = buf;
+    int waited = 0;
+
+    pthread_mutex_lock(&r->lock);
+    r->requests++;
+    while (len > 0) {
+        struct rng_block *b = r->block + r->active;
+        size_t n;
+
+        if (b->pos == b->len) {
+            while (!r->spare_full && r->res == TEEC_SUCCESS) {
+                waited = 1;
+                pthread_cond_wait(&r->cond, &r->lock);
+            }
+            if (!r->spare_full) {
+                TEEC_Result res = r->res;
+
+                pthread_mutex_unlock(&r->lock);
+                wipe(buf, out - (uint8_t *)buf);
+                return res;
+            }
+            // swap the blocks, the drained one gets refilled
+            r->active = !r->active;
+            r->spare_full = 0;
+            pthread_cond_broadcast(&r->cond);
+            continue;
+        }
+
+        n = b->len - b->pos < len ? b->len - b->pos : len;
+        memcpy(out, (uint8_t *)b->shm.buffer + b->pos, n);
+        wipe((uint8_t *)b->shm.buffer + b->pos, n);
+        b->pos += n;
+        out += n;
+        len -= n;
+    }
+    r->waits += waited;
+    pthread_mutex_unlock(&r->lock);
+    return TEEC_SUCCESS;
+}
+
+// stop the refill thread and wipe what is left of the random bytes
+void rng_close(struct rng *r) {
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    rng_release(r);
+}
+
+/*
+ * Write len random bytes to out_fd, fetched with rng_read() in requests of
+ * request_size bytes as a service would, each request is timed.
+ */
+TEEC_Result rng_stream(size_t len, size_t request_size, size_t block_size,
+                       int out_fd, struct rng_stats *stats) {
+    struct rng r;
+    TEEC_Result res;
+    uint8_t *out;
+    size_t out_len = 0;
+    size_t out_size = RAND_OUTPUT_SIZE - RAND_OUTPUT_SIZE % request_size;
+    double start = now_seconds();
+
+    memset(stats, 0, sizeof(*stats));
+    out = malloc(out_size);
+    if (out == NULL)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    res = rng_open(&r, block_size);
+    if (res != TEEC_SUCCESS) {
+        free(out);
+        return res;
+    }
+
+    while (stats->bytes < len) {
+        size_t n = len - stats->bytes < request_size ? len - stats->bytes
+                                                      : request_size;
+        double t = now_seconds();
+
+        res = rng_read(&r, out + out_len, n);
+        t = now_seconds() - t;
+        if (res != TEEC_SUCCESS)
+            break;
+        stats->latency += t;
+        if (t > stats->max_latency)
+            stats->max_latency = t;
+        stats->bytes += n;
+        out_len += n;
+        if (out_len == out_size || stats->bytes == len) {
+            if (write_full(out_fd, out, out_len) < 0) {
+                res = TEEC_ERROR_GENERIC;
+                break;
+            }
+            wipe(out, out_len);
+            out_len = 0;
+        }
+    }
+
+    stats->requests = r.requests;
+    stats->waits = r.waits;
+    rng_close(&r);
+    stats->refills = r.refills;
+    stats->seconds = now_seconds() - start;
+    wipe(out, out_size);
+    free(out);
+    return res;
+}
@@ -0,0 +1,55 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include "storage.h"
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ * Random bytes from the TEE, served from two mlock'd shared memory blocks.
+ * Requests are served from the active block while a thread refills the
+ * spare one with a single invocation of the TA, so small requests only
+ * wait for the TEE when they drain both blocks faster than it refills them.
+ * Bytes are wiped from the blocks as soon as they are handed out.
+ */
+struct rng_block {
+    TEEC_SharedMemory shm;
+    size_t pos;
+    size_t len;
+};
+
+struct rng {
+    struct test_ctx ctx;
+    struct rng_block block[2];
+    size_t block_size;
+    int active;
+    int spare_full;
+    int stop;
+    TEEC_Result res;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    // number of requests, requests that waited for a refill and refills
+    size_t requests;
+    size_t waits;
+    size_t refills;
+};
+
+struct rng_stats {
+    size_t bytes;
+    size_t requests;
+    size_t waits;
+    size_t refills;
+    double seconds;
+    // time spent in rng_read(), in seconds
+    double latency;
+    double max_latency;
+};
+
+TEEC_Result rng_open(struct rng *r, size_t block_size);
+TEEC_Result rng_read(struct rng *r, void *buf, size_t len);
+void rng_close(struct rng *r);
+TEEC_Result rng_stream(size_t len, size_t request_size, size_t block_size,
+                       int out_fd, struct rng_stats *stats);
+
+#endif // !RNG_H
@@ -0,0 +1,903 @@
+#include "seal.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* TA API: UUID and command IDs */
+#include <seal-key_ta.h>
+
+#if MAX_WORKERS > TA_SEAL_KEY_CHUNK_MAX_SESSIONS
+#error "The TA cannot seal a file over MAX_WORKERS sessions"
+#endif
+
+static size_t nonce_bytes(const struct seal_header *h) {
+    return (size_t)h->nonces * h->nonce_len;
+}
+
+// serialize everything up to the nonce, this part is the AAD
+static size_t header_encode(const struct seal_header *h, uint8_t *buf) {
+    size_t id_len = strlen(h->id);
+
+    memcpy(buf, SEAL_MAGIC, SEAL_MAGIC_LEN);
+    buf[4] = h->version;
+    buf[5] = h->format;
+    buf[6] = h->nonce_len;
+    buf[7] = h->tag_len;
+    put_be32(buf + 8, h->chunk_size);
+    buf[12] = id_len;
+    memcpy(buf + SEAL_FIXED_HEADER_LEN, h->id, id_len);
+    buf[SEAL_FIXED_HEADER_LEN + id_len] = h->nonces;
+    return SEAL_FIXED_HEADER_LEN + id_len + 1;
+}
+
+// read and check the header, buf receives the raw AAD bytes
+static TEEC_Result header_read(int fd, struct seal_header *h, uint8_t *buf,
+                               size_t *aad_len) {
+    size_t id_len;
+
+    if (read_full(fd, buf, SEAL_FIXED_HEADER_LEN) != SEAL_FIXED_HEADER_LEN ||
+        memcmp(buf, SEAL_MAGIC, SEAL_MAGIC_LEN) != 0) {
+        ERRO("Input is not sealed data");
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    h->version = buf[4];
+    h->format = buf[5];
+    h->nonce_len = buf[6];
+    h->tag_len = buf[7];
+    h->chunk_size = get_be32(buf + 8);
+    id_len = buf[12];
+    if (h->version < 1 || h->version > SEAL_VERSION ||
+        id_len > SEAL_MAX_ID_LEN || h->tag_len != TA_SEAL_KEY_AE_TAG_SIZE) {
+        ERRO("Unsupported sealed data version %u", h->version);
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    *aad_len = SEAL_FIXED_HEADER_LEN + id_len;
+    // version 1 has no count, just one nonce
+    h->nonces = h->nonce_len ? 1 : 0;
+    if (read_full(fd, buf + SEAL_FIXED_HEADER_LEN, id_len) != id_len ||
+        (h->version > 1 &&
+         read_full(fd, &h->nonces, sizeof(h->nonces)) != sizeof(h->nonces))) {
+        ERRO("Truncated sealed data header");
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    if (h->version > 1)
+        buf[(*aad_len)++] = h->nonces;
+    if (nonce_bytes(h) > sizeof(h->nonce)) {
+        ERRO("Sealed data has too many nonces");
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    if (read_full(fd, h->nonce, nonce_bytes(h)) != (ssize_t)nonce_bytes(h)) {
+        ERRO("Truncated sealed data header");
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    memcpy(h->id, buf + SEAL_FIXED_HEADER_LEN, id_len);
+    h->id[id_len] = '\0';
+    return TEEC_SUCCESS;
+}
+
+/*
+ * Stream in_fd through the TA in SEAL_CHUNK_SIZE chunks. The key used is the
+ * one stored under id, it never leaves the secure storage.
+ */
+TEEC_Result seal_stream(struct test_ctx *ctx, char *id, int in_fd, int out_fd,
+                        struct seal_stats *stats) {
+    struct seal_header h;
+    uint8_t header[SEAL_MAX_HEADER_LEN];
+    uint8_t tag[TA_SEAL_KEY_AE_TAG_SIZE];
+    TEEC_SharedMemory in, out;
+    TEEC_Result res;
+    size_t aad_len, out_len;
+    ssize_t n;
+    double start = now_seconds();
+
+    if (strlen(id) > SEAL_MAX_ID_LEN)
+        return TEEC_ERROR_BAD_PARAMETERS;
+
+    memset(&h, 0, sizeof(h));
+    memset(stats, 0, sizeof(*stats));
+    h.version = SEAL_VERSION;
+    h.format = SEAL_FORMAT_STREAM;
+    h.nonce_len = TA_SEAL_KEY_AE_NONCE_SIZE;
+    h.nonces = 1;
+    h.tag_len = TA_SEAL_KEY_AE_TAG_SIZE;
+    strcpy(h.id, id);
+    aad_len = header_encode(&h, header);
+
+    res = init_secure_stream(ctx, id, TA_SEAL_KEY_MODE_ENCRYPT, h.nonce,
+                             h.nonce_len, header, aad_len);
+    if (res != TEEC_SUCCESS)
+        return res;
+    memcpy(header + aad_len, h.nonce, h.nonce_len);
+    if (write_full(out_fd, header, aad_len + h.nonce_len) < 0) {
+        ERRO("Failed to write the sealed data header");
+        return TEEC_ERROR_GENERIC;
+    }
+    stats->out_bytes = aad_len + h.nonce_len;
+
+    res = alloc_shared_memory(ctx, &in, SEAL_CHUNK_SIZE, TEEC_MEM_INPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+    res = alloc_shared_memory(ctx, &out,
+                              SEAL_CHUNK_SIZE + TA_SEAL_KEY_AE_TAG_SIZE,
+                              TEEC_MEM_OUTPUT);
+    if (res != TEEC_SUCCESS)
+        goto free_in;
+
+    for (;;) {
+        n = read_full(in_fd, in.buffer, SEAL_CHUNK_SIZE);
+        if (n < 0) {
+            ERRO("Failed to read the input");
+            res = TEEC_ERROR_GENERIC;
+            break;
+        }
+        stats->in_bytes += n;
+        // a short read means this was the last chunk
+        if (n < SEAL_CHUNK_SIZE)
+            res = final_secure_stream(ctx, TA_SEAL_KEY_MODE_ENCRYPT, &in, n,
+                                      &out, &out_len, tag, sizeof(tag));
+        else
+            res = update_secure_stream(ctx, &in, n, &out, &out_len);
+        if (res != TEEC_SUCCESS)
+            break;
+        if (write_full(out_fd, out.buffer, out_len) < 0) {
+            ERRO("Failed to write the sealed data");
+            res = TEEC_ERROR_GENERIC;
+            break;
+        }
+        stats->out_bytes += out_len;
+        if (n < SEAL_CHUNK_SIZE) {
+            if (write_full(out_fd, tag, sizeof(tag)) < 0) {
+                ERRO("Failed to write the tag");
+                res = TEEC_ERROR_GENERIC;
+            }
+            stats->out_bytes += sizeof(tag);
+            break;
+        }
+    }
+
+    TEEC_ReleaseSharedMemory(&out);
+free_in:
+    TEEC_ReleaseSharedMemory(&in);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+/*
+ * Reverse of seal_stream(). The tag trails the ciphertext, so the last
+ * TA_SEAL_KEY_AE_TAG_SIZE bytes read are always held back until we know
+ * whether more input follows.
+ *
+ * Plaintext is written as it is decrypted, before the tag is checked, so
+ * out_fd must be a staging file the caller drops unless this succeeds.
+ */
+static TEEC_Result unseal_gcm_stream(struct test_ctx *ctx,
+                                     struct seal_header *h, uint8_t *header,
+                                     size_t aad_len, int in_fd, int out_fd,
+                                     struct seal_stats *stats) {
+    uint8_t tag[TA_SEAL_KEY_AE_TAG_SIZE];
+    TEEC_SharedMemory in, out;
+    TEEC_Result res;
+    size_t out_len, fill;
+    ssize_t n;
+
+    if (h->nonce_len != TA_SEAL_KEY_AE_NONCE_SIZE || h->nonces != 1)
+        return TEEC_ERROR_BAD_FORMAT;
+    res = init_secure_stream(ctx, h->id, TA_SEAL_KEY_MODE_DECRYPT, h->nonce,
+                             h->nonce_len, header, aad_len);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    res = alloc_shared_memory(ctx, &in, SEAL_CHUNK_SIZE + sizeof(tag),
+                              TEEC_MEM_INPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+    res = alloc_shared_memory(ctx, &out, SEAL_CHUNK_SIZE + sizeof(tag),
+                              TEEC_MEM_OUTPUT);
+    if (res != TEEC_SUCCESS)
+        goto free_in;
+
+    fill = 0;
+    for (;;) {
+        n = read_full(in_fd, (uint8_t *)in.buffer + fill, in.size - fill);
+        if (n < 0) {
+            ERRO("Failed to read the input");
+            res = TEEC_ERROR_GENERIC;
+            break;
+        }
+        stats->in_bytes += n;
+        fill += n;
+        if (fill < in.size) {
+            if (fill < sizeof(tag)) {
+                ERRO("Truncated sealed data");
+                res = TEEC_ERROR_BAD_FORMAT;
+                break;
+            }
+            fill -= sizeof(tag);
+            memcpy(tag, (uint8_t *)in.buffer + fill, sizeof(tag));
+            res = final_secure_stream(ctx, TA_SEAL_KEY_MODE_DECRYPT, &in,
+                                      fill, &out, &out_len, tag, sizeof(tag));
+        } else {
+            res = update_secure_stream(ctx, &in, SEAL_CHUNK_SIZE, &out,
+                                       &out_len);
+        }
+        if (res != TEEC_SUCCESS)
+            break;
+        if (write_full(out_fd, out.buffer, out_len) < 0) {
+            ERRO("Failed to write the unsealed data");
+            res = TEEC_ERROR_GENERIC;
+            break;
+        }
+        stats->out_bytes += out_len;
+        if (fill < SEAL_CHUNK_SIZE)
+            break;
+        // keep what may be the tag for the next round
+        memmove(in.buffer, (uint8_t *)in.buffer + SEAL_CHUNK_SIZE,
+                sizeof(tag));
+        fill = sizeof(tag);
+    }
+
+    TEEC_ReleaseSharedMemory(&out);
+free_in:
+    TEEC_ReleaseSharedMemory(&in);
+    return res;
+}
+
+/*
+ * SEAL_FORMAT_CHUNKED is processed by a pool of workers, each with its own
+ * TA session. Worker w handles chunks w, w + workers, w + 2 * workers, ...
+ * Reading and writing take turns in chunk order so the input may be a pipe
+ * and the output comes out in order, only the TA calls run in parallel.
+ * When sealing, worker w is session w of the header and seals with its own
+ * nonce prefix.
+ */
+struct chunk_pipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    int in_fd;
+    int out_fd;
+    size_t in_size;
+    uint32_t mode;
+    const struct seal_header *h;
+    uint32_t read_turn;
+    uint32_t write_turn;
+    int eof;
+    TEEC_Result res;
+    struct seal_stats *stats;
+};
+
+struct chunk_worker {
+    struct chunk_pipeline *p;
+    struct test_ctx *ctx;
+    struct test_ctx own_ctx;
+    unsigned int index;
+    unsigned int workers;
+    TEEC_SharedMemory in;
+    TEEC_SharedMemory out;
+    pthread_t thread;
+};
+
+static void chunk_fail(struct chunk_pipeline *p, TEEC_Result res) {
+    pthread_mutex_lock(&p->lock);
+    if (p->res == TEEC_SUCCESS)
+        p->res = res;
+    pthread_cond_broadcast(&p->turn);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *chunk_worker_run(void *arg) {
+    struct chunk_worker *w = arg;
+    struct chunk_pipeline *p = w->p;
+    TEEC_Result res;
+    size_t out_len;
+    ssize_t n;
+    int last;
+
+    for (uint32_t i = w->index;; i += w->workers) {
+        pthread_mutex_lock(&p->lock);
+        while (!p->eof && p->res == TEEC_SUCCESS && p->read_turn != i)
+            pthread_cond_wait(&p->turn, &p->lock);
+        if (p->eof || p->res != TEEC_SUCCESS) {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        n = read_full(p->in_fd, w->in.buffer, p->in_size);
+        if (n < 0) {
+            ERRO("Failed to read the input");
+            chunk_fail(p, TEEC_ERROR_GENERIC);
+            break;
+        }
+        // the last chunk always carries at least a tag
+        if (p->mode == TA_SEAL_KEY_MODE_DECRYPT &&
+            n < TA_SEAL_KEY_AE_TAG_SIZE) {
+            ERRO("Truncated sealed data");
+            chunk_fail(p, TEEC_ERROR_BAD_FORMAT);
+            break;
+        }
+        last = (size_t)n < p->in_size;
+
+        pthread_mutex_lock(&p->lock);
+        p->read_turn++;
+        p->eof = last;
+        p->stats->in_bytes += n;
+        pthread_cond_broadcast(&p->turn);
+        pthread_mutex_unlock(&p->lock);
+
+        res = process_secure_chunk(
+            w->ctx, i, last,
+            p->mode == TA_SEAL_KEY_MODE_DECRYPT
+                ? p->h->nonce + i % p->h->nonces * p->h->nonce_len
+                : NULL,
+            &w->in, n, &w->out, &out_len);
+        if (res != TEEC_SUCCESS) {
+            chunk_fail(p, res);
+            break;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        while (p->res == TEEC_SUCCESS && p->write_turn != i)
+            pthread_cond_wait(&p->turn, &p->lock);
+        if (p->res != TEEC_SUCCESS) {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        if (write_full(p->out_fd, w->out.buffer, out_len) < 0) {
+            ERRO("Failed to write the output");
+            chunk_fail(p, TEEC_ERROR_GENERIC);
+            break;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        p->write_turn++;
+        p->stats->out_bytes += out_len;
+        pthread_cond_broadcast(&p->turn);
+        pthread_mutex_unlock(&p->lock);
+        if (last)
+            break;
+    }
+    return NULL;
+}
+
+/*
+ * Open one session per worker, the first worker reuses the session of the
+ * caller. When sealing, each session puts its nonce prefix into the header.
+ */
+static TEEC_Result chunk_workers_start(struct test_ctx *ctx,
+                                       struct chunk_worker *w,
+                                       unsigned int workers,
+                                       struct chunk_pipeline *p,
+                                       struct seal_header *h, char *id,
+                                       uint8_t *header, size_t aad_len,
+                                       size_t out_size) {
+    TEEC_Result res;
+
+    for (unsigned int i = 0; i < workers; i++) {
+        uint8_t *prefix = h->nonce;
+
+        w[i].p = p;
+        w[i].index = i;
+        w[i].workers = workers;
+        if (i == 0) {
+            w[i].ctx = ctx;
+        } else {
+            prepare_tee_session(&w[i].own_ctx);
+            w[i].ctx = &w[i].own_ctx;
+        }
+        if (p->mode == TA_SEAL_KEY_MODE_ENCRYPT)
+            prefix += i * h->nonce_len;
+        res = init_secure_chunks(w[i].ctx, id, p->mode, workers, i, prefix,
+                                 h->nonce_len, header, aad_len);
+        if (res == TEEC_SUCCESS)
+            res = alloc_shared_memory(w[i].ctx, &w[i].in, p->in_size,
+                                      TEEC_MEM_INPUT);
+        if (res == TEEC_SUCCESS)
+            res = alloc_shared_memory(w[i].ctx, &w[i].out, out_size,
+                                      TEEC_MEM_OUTPUT);
+        if (res != TEEC_SUCCESS)
+            return res;
+    }
+    return TEEC_SUCCESS;
+}
+
+static void chunk_workers_stop(struct chunk_worker *w, unsigned int workers) {
+    for (unsigned int i = 0; i < workers; i++) {
+        if (w[i].ctx == NULL)
+            continue;
+        TEEC_ReleaseSharedMemory(&w[i].out);
+        TEEC_ReleaseSharedMemory(&w[i].in);
+        if (w[i].ctx == &w[i].own_ctx)
+            terminate_tee_session(&w[i].own_ctx);
+    }
+}
+
+static TEEC_Result run_chunk_pipeline(struct test_ctx *ctx, char *id,
+                                      struct seal_header *h, uint8_t *header,
+                                      size_t aad_len, int in_fd, int out_fd,
+                                      uint32_t mode, unsigned int workers,
+                                      struct seal_stats *stats) {
+    struct chunk_pipeline p;
+    struct chunk_worker *w;
+    TEEC_Result res;
+    size_t in_size = h->chunk_size;
+    size_t out_size = h->chunk_size;
+
+    if (mode == TA_SEAL_KEY_MODE_ENCRYPT)
+        out_size += h->tag_len;
+    else
+        in_size += h->tag_len;
+
+    memset(&p, 0, sizeof(p));
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.turn, NULL);
+    p.in_fd = in_fd;
+    p.out_fd = out_fd;
+    p.in_size = in_size;
+    p.mode = mode;
+    p.h = h;
+    p.stats = stats;
+
+    w = calloc(workers, sizeof(*w));
+    if (w == NULL)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+
+    res = chunk_workers_start(ctx, w, workers, &p, h, id, header, aad_len,
+                              out_size);
+    if (res != TEEC_SUCCESS)
+        goto out;
+
+    // the header goes out before the first chunk
+    if (mode == TA_SEAL_KEY_MODE_ENCRYPT) {
+        memcpy(header + aad_len, h->nonce, nonce_bytes(h));
+        if (write_full(out_fd, header, aad_len + nonce_bytes(h)) < 0) {
+            ERRO("Failed to write the sealed data header");
+            res = TEEC_ERROR_GENERIC;
+            goto out;
+        }
+        stats->out_bytes += aad_len + nonce_bytes(h);
+    }
+
+    for (unsigned int i = 0; i < workers; i++) {
+        if (pthread_create(&w[i].thread, NULL, chunk_worker_run, w + i)) {
+            ERRO("Failed to start worker %u", i);
+            chunk_fail(&p, TEEC_ERROR_OUT_OF_MEMORY);
+            workers = i;
+            break;
+        }
+    }
+    for (unsigned int i = 0; i < workers; i++)
+        pthread_join(w[i].thread, NULL);
+    res = p.res;
+    if (res == TEEC_SUCCESS && !p.eof) {
+        ERRO("Truncated sealed data");
+        res = TEEC_ERROR_BAD_FORMAT;
+    }
+out:
+    chunk_workers_stop(w, workers);
+    free(w);
+    pthread_cond_destroy(&p.turn);
+    pthread_mutex_destroy(&p.lock);
+    return res;
+}
+
+/*
+ * Seal in_fd as independently authenticated chunks spread over workers TA
+ * sessions, which may run in parallel in the TA as they share nothing.
+ */
+TEEC_Result seal_chunks(struct test_ctx *ctx, char *id, int in_fd, int out_fd,
+                        unsigned int workers, struct seal_stats *stats) {
+    struct seal_header h;
+    uint8_t header[SEAL_MAX_HEADER_LEN];
+    TEEC_Result res;
+    size_t aad_len;
+    double start = now_seconds();
+
+    if (strlen(id) > SEAL_MAX_ID_LEN || workers == 0 ||
+        workers > TA_SEAL_KEY_CHUNK_MAX_SESSIONS)
+        return TEEC_ERROR_BAD_PARAMETERS;
+
+    memset(&h, 0, sizeof(h));
+    memset(stats, 0, sizeof(*stats));
+    h.version = SEAL_VERSION;
+    h.format = SEAL_FORMAT_CHUNKED;
+    h.nonce_len = TA_SEAL_KEY_CHUNK_PREFIX_SIZE;
+    h.nonces = workers;
+    h.tag_len = TA_SEAL_KEY_AE_TAG_SIZE;
+    h.chunk_size = SEAL_PARALLEL_CHUNK_SIZE;
+    strcpy(h.id, id);
+    aad_len = header_encode(&h, header);
+
+    res = run_chunk_pipeline(ctx, id, &h, header, aad_len, in_fd, out_fd,
+                             TA_SEAL_KEY_MODE_ENCRYPT, workers, stats);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+static TEEC_Result check_chunked_header(struct seal_header *h) {
+    if (h->nonce_len != TA_SEAL_KEY_CHUNK_PREFIX_SIZE || h->nonces == 0 ||
+        h->chunk_size == 0 || h->chunk_size > SEAL_MAX_CHUNK_SIZE) {
+        ERRO("Invalid chunk layout");
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    return TEEC_SUCCESS;
+}
+
+/*
+ * SEAL_FORMAT_RECORDS packs many small records into one SEAL_BATCH or
+ * UNSEAL_BATCH call. A batch is flushed when it holds batch records or
+ * when the next record would not fit into the shared buffer.
+ */
+struct record_batch {
+    TEEC_SharedMemory in;
+    TEEC_SharedMemory out;
+    size_t in_len;
+    uint32_t count;
+    uint32_t max_count;
+};
+
+static TEEC_Result record_batch_alloc(struct test_ctx *ctx,
+                                      struct record_batch *b,
+                                      unsigned int batch) {
+    TEEC_Result res;
+
+    memset(b, 0, sizeof(*b));
+    b->max_count = batch;
+    res = alloc_shared_memory(ctx, &b->in, SEAL_BATCH_BUFFER_SIZE,
+                              TEEC_MEM_INPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+    res = alloc_shared_memory(ctx, &b->out,
+                              SEAL_BATCH_BUFFER_SIZE +
+                                  (size_t)batch * TA_SEAL_KEY_BATCH_OVERHEAD,
+                              TEEC_MEM_OUTPUT);
+    if (res != TEEC_SUCCESS)
+        TEEC_ReleaseSharedMemory(&b->in);
+    return res;
+}
+
+static void record_batch_free(struct record_batch *b) {
+    TEEC_ReleaseSharedMemory(&b->out);
+    TEEC_ReleaseSharedMemory(&b->in);
+}
+
+static int record_batch_fits(struct record_batch *b, size_t len) {
+    return b->count < b->max_count &&
+           b->in_len + TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + len <= b->in.size;
+}
+
+// reserve room for the next record, the caller fills in the data
+static uint8_t *record_batch_add(struct record_batch *b, const void *aad,
+                                 size_t aad_len, size_t len) {
+    uint8_t *p = (uint8_t *)b->in.buffer + b->in_len;
+
+    put_be32(p, aad_len);
+    put_be32(p + 4, len);
+    memcpy(p + TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE, aad, aad_len);
+    b->in_len += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + aad_len + len;
+    b->count++;
+    return p + TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + aad_len;
+}
+
+/*
+ * Send the batch to the TA and write out the records that succeeded. When
+ * sealing each record is written length prefixed, when unsealing each
+ * plaintext is followed by a newline. Failed records are reported and
+ * skipped.
+ */
+static TEEC_Result record_batch_flush(struct test_ctx *ctx, char *id,
+                                      uint32_t mode, struct record_batch *b,
+                                      int out_fd, struct seal_stats *stats) {
+    TEEC_Result res;
+    size_t out_len, pos = 0;
+    uint32_t failed;
+    uint8_t *out = b->out.buffer;
+
+    if (b->count == 0)
+        return TEEC_SUCCESS;
+
+    res = process_secure_batch(ctx, id, mode, &b->in, b->in_len, b->count,
+                               &b->out, &out_len, &failed);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    for (uint32_t i = 0; i < b->count; i++, stats->records++) {
+        uint32_t status, len;
+
+        if (out_len - pos < TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE)
+            return TEEC_ERROR_BAD_FORMAT;
+        status = get_be32(out + pos);
+        len = get_be32(out + pos + 4);
+        pos += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE;
+        if (len > out_len - pos)
+            return TEEC_ERROR_BAD_FORMAT;
+        if (status != TEEC_SUCCESS) {
+            ERRO("Record %zu failed: 0x%x", stats->records, status);
+            stats->failed++;
+            continue;
+        }
+        if (mode == TA_SEAL_KEY_MODE_ENCRYPT) {
+            uint8_t prefix[4];
+
+            put_be32(prefix, len);
+            if (write_full(out_fd, prefix, sizeof(prefix)) < 0)
+                return TEEC_ERROR_GENERIC;
+            stats->out_bytes += sizeof(prefix);
+        }
+        if (write_full(out_fd, out + pos, len) < 0 ||
+            (mode == TA_SEAL_KEY_MODE_DECRYPT &&
+             write_full(out_fd, "\n", 1) < 0))
+            return TEEC_ERROR_GENERIC;
+        stats->out_bytes += len + (mode == TA_SEAL_KEY_MODE_DECRYPT);
+        pos += len;
+    }
+    b->in_len = 0;
+    b->count = 0;
+    return TEEC_SUCCESS;
+}
+
+/*
+ * Seal every line of in_fd as a record of its own, batch records are sent
+ * to the TA at once. The sealed data header is bound to every record.
+ */
+TEEC_Result seal_records(struct test_ctx *ctx, char *id, int in_fd,
+                         int out_fd, unsigned int batch,
+                         struct seal_stats *stats) {
+    struct seal_header h;
+    struct record_batch b;
+    uint8_t header[SEAL_MAX_HEADER_LEN];
+    TEEC_Result res;
+    size_t aad_len, cap = 0;
+    char *line = NULL;
+    ssize_t len;
+    FILE *in;
+    double start = now_seconds();
+
+    if (strlen(id) > SEAL_MAX_ID_LEN || batch == 0)
+        return TEEC_ERROR_BAD_PARAMETERS;
+
+    memset(&h, 0, sizeof(h));
+    memset(stats, 0, sizeof(*stats));
+    h.version = SEAL_VERSION;
+    h.format = SEAL_FORMAT_RECORDS;
+    h.tag_len = TA_SEAL_KEY_AE_TAG_SIZE;
+    strcpy(h.id, id);
+    aad_len = header_encode(&h, header);
+
+    in = fdopen(dup(in_fd), "r");
+    if (in == NULL) {
+        ERRO("Failed to open the input");
+        return TEEC_ERROR_GENERIC;
+    }
+    res = record_batch_alloc(ctx, &b, batch);
+    if (res != TEEC_SUCCESS)
+        goto close_in;
+
+    if (write_full(out_fd, header, aad_len) < 0) {
+        res = TEEC_ERROR_GENERIC;
+        goto free_batch;
+    }
+    stats->out_bytes = aad_len;
+
+    while ((len = getline(&line, &cap, in)) > 0) {
+        stats->in_bytes += len;
+        if (line[len - 1] == '\n')
+            len--;
+        if (len > SEAL_MAX_RECORD_SIZE) {
+            ERRO("Record %zu is longer than %d bytes", stats->records,
+                 SEAL_MAX_RECORD_SIZE);
+            res = TEEC_ERROR_BAD_PARAMETERS;
+            break;
+        }
+        if (!record_batch_fits(&b, aad_len + len)) {
+            res = record_batch_flush(ctx, id, TA_SEAL_KEY_MODE_ENCRYPT, &b,
+                                     out_fd, stats);
+            if (res != TEEC_SUCCESS)
+                break;
+        }
+        memcpy(record_batch_add(&b, header, aad_len, len), line, len);
+    }
+    if (res == TEEC_SUCCESS && ferror(in)) {
+        ERRO("Failed to read the input");
+        res = TEEC_ERROR_GENERIC;
+    }
+    if (res == TEEC_SUCCESS)
+        res = record_batch_flush(ctx, id, TA_SEAL_KEY_MODE_ENCRYPT, &b, out_fd,
+                                 stats);
+    free(line);
+free_batch:
+    record_batch_free(&b);
+close_in:
+    fclose(in);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+static TEEC_Result unseal_records(struct test_ctx *ctx, char *id,
+                                  uint8_t *header, size_t aad_len, int in_fd,
+                                  int out_fd, unsigned int batch,
+                                  struct seal_stats *stats) {
+    struct record_batch b;
+    TEEC_Result res;
+    uint8_t prefix[4];
+    uint32_t len;
+    ssize_t n;
+
+    res = record_batch_alloc(ctx, &b, batch);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    while ((n = read_full(in_fd, prefix, sizeof(prefix))) == sizeof(prefix)) {
+        len = get_be32(prefix);
+        if (len > SEAL_MAX_RECORD_SIZE + TA_SEAL_KEY_BATCH_OVERHEAD) {
+            ERRO("Record %zu is too long", stats->records + b.count);
+            res = TEEC_ERROR_BAD_FORMAT;
+            break;
+        }
+        if (!record_batch_fits(&b, aad_len + len)) {
+            res = record_batch_flush(ctx, id, TA_SEAL_KEY_MODE_DECRYPT, &b,
+                                     out_fd, stats);
+            if (res != TEEC_SUCCESS)
+                break;
+        }
+        if (read_full(in_fd, record_batch_add(&b, header, aad_len, len),
+                      len) != len) {
+            ERRO("Truncated sealed data");
+            res = TEEC_ERROR_BAD_FORMAT;
+            break;
+        }
+        stats->in_bytes += sizeof(prefix) + len;
+    }
+    if (res == TEEC_SUCCESS && n != 0) {
+        ERRO("Truncated sealed data");
+        res = TEEC_ERROR_BAD_FORMAT;
+    }
+    if (res == TEEC_SUCCESS)
+        res = record_batch_flush(ctx, id, TA_SEAL_KEY_MODE_DECRYPT, &b, out_fd,
+                                 stats);
+    record_batch_free(&b);
+    return res;
+}
+
+/*
+ * Unseal data written by seal_stream(), seal_chunks() or seal_records(), the
+ * format is taken from the header. Chunked data is unsealed by workers TA
+ * sessions, records are unsealed batch at a time. Data sealed as a single
+ * stream is only unsealed when staged says out_fd is dropped on failure.
+ */
+TEEC_Result unseal_stream(struct test_ctx *ctx, char *id, int in_fd,
+                          int out_fd, int staged, unsigned int workers,
+                          unsigned int batch, struct seal_stats *stats) {
+    struct seal_header h;
+    uint8_t header[SEAL_MAX_HEADER_LEN];
+    TEEC_Result res;
+    size_t aad_len;
+    double start = now_seconds();
+
+    memset(stats, 0, sizeof(*stats));
+    res = header_read(in_fd, &h, header, &aad_len);
+    if (res != TEEC_SUCCESS)
+        return res;
+    if (strcmp(h.id, id) != 0) {
+        ERRO("Data was sealed with %s not with %s", h.id, id);
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+    stats->in_bytes = aad_len + nonce_bytes(&h);
+
+    switch (h.format) {
+    case SEAL_FORMAT_STREAM:
+        // the whole stream has a single tag, checked after the last byte
+        if (!staged) {
+            ERRO("Data sealed as one stream is only authenticated at its "
+                 "end, unseal it into a file with -o or seal it with -j");
+            res = TEEC_ERROR_BAD_PARAMETERS;
+            break;
+        }
+        res = unseal_gcm_stream(ctx, &h, header, aad_len, in_fd, out_fd,
+                                stats);
+        break;
+    case SEAL_FORMAT_CHUNKED:
+        res = check_chunked_header(&h);
+        if (res != TEEC_SUCCESS)
+            break;
+        res = run_chunk_pipeline(ctx, id, &h, header, aad_len, in_fd, out_fd,
+                                 TA_SEAL_KEY_MODE_DECRYPT,
+                                 workers ? workers : 1, stats);
+        break;
+    case SEAL_FORMAT_RECORDS:
+        res = unseal_records(ctx, id, header, aad_len, in_fd, out_fd,
+                             batch ? batch : SEAL_BATCH_RECORDS, stats);
+        break;
+    default:
+        ERRO("Unsupported sealed data format %u", h.format);
+        res = TEEC_ERROR_BAD_FORMAT;
+    }
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+/*
+ * Unseal only chunk index of chunked sealed data, in_fd must be seekable.
+ */
+TEEC_Result unseal_chunk(struct test_ctx *ctx, char *id, int in_fd,
+                         int out_fd, uint32_t index,
+                         struct seal_stats *stats) {
+    struct seal_header h;
+    uint8_t header[SEAL_MAX_HEADER_LEN];
+    TEEC_SharedMemory in, out;
+    TEEC_Result res;
+    size_t aad_len, in_size, out_len;
+    off_t offset;
+    ssize_t n;
+    double start = now_seconds();
+
+    memset(stats, 0, sizeof(*stats));
+    res = header_read(in_fd, &h, header, &aad_len);
+    if (res != TEEC_SUCCESS)
+        return res;
+    if (h.format != SEAL_FORMAT_CHUNKED) {
+        ERRO("Only chunked sealed data can be read by chunk");
+        return TEEC_ERROR_BAD_FORMAT;
+    }
+    if (strcmp(h.id, id) != 0) {
+        ERRO("Data was sealed with %s not with %s", h.id, id);
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+    res = check_chunked_header(&h);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    in_size = h.chunk_size + h.tag_len;
+    offset = aad_len + nonce_bytes(&h) + (off_t)index * in_size;
+
+    res = init_secure_chunks(ctx, id, TA_SEAL_KEY_MODE_DECRYPT, 0, 0, h.nonce,
+                             h.nonce_len, header, aad_len);
+    if (res != TEEC_SUCCESS)
+        return res;
+    res = alloc_shared_memory(ctx, &in, in_size, TEEC_MEM_INPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+    res = alloc_shared_memory(ctx, &out, h.chunk_size, TEEC_MEM_OUTPUT);
+    if (res != TEEC_SUCCESS)
+        goto free_in;
+
+    n = pread(in_fd, in.buffer, in_size, offset);
+    if (n < 0) {
+        ERRO("Failed to read chunk %u, is the input seekable?", index);
+        res = TEEC_ERROR_GENERIC;
+        goto free_out;
+    }
+    if (n < h.tag_len) {
+        ERRO("There is no chunk %u", index);
+        res = TEEC_ERROR_ITEM_NOT_FOUND;
+        goto free_out;
+    }
+    stats->in_bytes = n;
+
+    // only the last chunk is shorter than a full one
+    res = process_secure_chunk(ctx, index, (size_t)n < in_size,
+                               h.nonce + index % h.nonces * h.nonce_len, &in,
+                               n, &out, &out_len);
+    if (res != TEEC_SUCCESS)
+        goto free_out;
+    if (write_full(out_fd, out.buffer, out_len) < 0) {
+        ERRO("Failed to write the output");
+        res = TEEC_ERROR_GENERIC;
+        goto free_out;
+    }
+    stats->out_bytes = out_len;
+
+free_out:
+    TEEC_ReleaseSharedMemory(&out);
+free_in:
+    TEEC_ReleaseSharedMemory(&in);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
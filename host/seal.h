@@ -0,0 +1,83 @@
+#ifndef SEAL_H
+#define SEAL_H
+
+#include "storage.h"
+#include <stdint.h>
+
+#include <seal-key_ta.h>
+
+/*
+ * Sealed file layout, all integers are big endian:
+ *
+ * magic      4 bytes  "SKSL"
+ * version    1 byte   SEAL_VERSION
+ * format     1 byte   SEAL_FORMAT_*
+ * nonce_len  1 byte
+ * tag_len    1 byte
+ * chunk_size 4 bytes  plaintext bytes per chunk, 0 for SEAL_FORMAT_STREAM
+ * id_len     1 byte
+ * id         id_len bytes, storage id of the sealing key
+ * nonces     1 byte   number of nonces, not there in version 1 which has one
+ *                     nonce, or none when nonce_len is 0
+ * nonce      nonces times nonce_len bytes
+ * payload
+ *
+ * Everything before the nonce is authenticated as additional data.
+ * SEAL_FORMAT_STREAM: the payload is the ciphertext followed by the tag.
+ * SEAL_FORMAT_CHUNKED: the payload is a sequence of chunks, each one the
+ * ciphertext of chunk_size bytes followed by its tag. Only the last chunk
+ * is shorter, it may be empty. Every chunk is authenticated on its own so
+ * chunks can be sealed, unsealed and read back independently. The data is
+ * sealed by nonces TA sessions, each with a nonce prefix of its own, and
+ * chunk i by session i % nonces.
+ * SEAL_FORMAT_RECORDS: the payload is a sequence of records, each one a
+ * 4 byte length followed by the nonce, the ciphertext and the tag. Every
+ * record is sealed on its own, nonce_len and chunk_size are 0.
+ */
+#define SEAL_MAGIC "SKSL"
+#define SEAL_MAGIC_LEN 4
+#define SEAL_VERSION 2
+#define SEAL_FORMAT_STREAM 1
+#define SEAL_FORMAT_CHUNKED 2
+#define SEAL_FORMAT_RECORDS 3
+#define SEAL_FIXED_HEADER_LEN 13
+#define SEAL_MAX_ID_LEN 64
+#define SEAL_MAX_NONCE_LEN                                                     \
+  (TA_SEAL_KEY_CHUNK_MAX_SESSIONS * TA_SEAL_KEY_CHUNK_PREFIX_SIZE)
+#define SEAL_MAX_HEADER_LEN                                                    \
+  (SEAL_FIXED_HEADER_LEN + SEAL_MAX_ID_LEN + 1 + SEAL_MAX_NONCE_LEN)
+
+struct seal_header {
+    uint8_t version;
+    uint8_t format;
+    uint8_t nonce_len;
+    uint8_t tag_len;
+    uint32_t chunk_size;
+    char id[SEAL_MAX_ID_LEN + 1];
+    uint8_t nonces;
+    uint8_t nonce[SEAL_MAX_NONCE_LEN];
+};
+
+struct seal_stats {
+    size_t in_bytes;
+    size_t out_bytes;
+    double seconds;
+    size_t records;
+    size_t failed;
+};
+
+TEEC_Result seal_stream(struct test_ctx *ctx, char *id, int in_fd, int out_fd,
+                        struct seal_stats *stats);
+TEEC_Result seal_chunks(struct test_ctx *ctx, char *id, int in_fd, int out_fd,
+                        unsigned int workers, struct seal_stats *stats);
+TEEC_Result seal_records(struct test_ctx *ctx, char *id, int in_fd,
+                         int out_fd, unsigned int batch,
+                         struct seal_stats *stats);
+TEEC_Result unseal_stream(struct test_ctx *ctx, char *id, int in_fd,
+                          int out_fd, int staged, unsigned int workers,
+                          unsigned int batch, struct seal_stats *stats);
+TEEC_Result unseal_chunk(struct test_ctx *ctx, char *id, int in_fd,
+                         int out_fd, uint32_t index,
+                         struct seal_stats *stats);
+
+#endif // !SEAL_H
@@ -0,0 +1,300 @@
+#include "sign.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* TA API: UUID and command IDs */
+#include <seal-key_ta.h>
+
+// read the whole input, messages are sent to the TA in one piece
+static ssize_t read_message(int in_fd, uint8_t **msg) {
+    ssize_t len;
+
+    *msg = malloc(SIGN_MAX_MESSAGE_SIZE + 1);
+    if (*msg == NULL)
+        return -1;
+    len = read_full(in_fd, *msg, SIGN_MAX_MESSAGE_SIZE + 1);
+    if (len > SIGN_MAX_MESSAGE_SIZE) {
+        ERRO("The message is longer than %d bytes", SIGN_MAX_MESSAGE_SIZE);
+        len = -1;
+    }
+    if (len < 0) {
+        free(*msg);
+        *msg = NULL;
+    }
+    return len;
+}
+
+/*
+ * MAC or sign everything read from in_fd with the key stored under id, the
+ * result is written hex encoded to out_fd.
+ */
+TEEC_Result mac_message(struct test_ctx *ctx, char *id, uint32_t alg,
+                        int in_fd, int out_fd, struct seal_stats *stats) {
+    uint8_t mac[TA_SEAL_KEY_MAX_MAC_SIZE];
+    char hex[2 * TA_SEAL_KEY_MAX_MAC_SIZE + 1];
+    size_t mac_len = sizeof(mac);
+    TEEC_Result res;
+    uint8_t *msg;
+    ssize_t len;
+    double start = now_seconds();
+
+    memset(stats, 0, sizeof(*stats));
+    len = read_message(in_fd, &msg);
+    if (len < 0)
+        return TEEC_ERROR_BAD_PARAMETERS;
+
+    res = mac_secure_object(ctx, id, alg, msg, len, mac, &mac_len);
+    free(msg);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    hex_encode(mac, mac_len, hex);
+    hex[2 * mac_len] = '\n';
+    if (write_full(out_fd, hex, 2 * mac_len + 1) < 0)
+        return TEEC_ERROR_GENERIC;
+
+    stats->in_bytes = len;
+    stats->out_bytes = 2 * mac_len + 1;
+    stats->records = 1;
+    stats->seconds = now_seconds() - start;
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result verify_message(struct test_ctx *ctx, char *id, uint32_t alg,
+                           int in_fd, const char *mac_hex,
+                           struct seal_stats *stats) {
+    uint8_t mac[TA_SEAL_KEY_MAX_MAC_SIZE];
+    TEEC_Result res;
+    ssize_t mac_len;
+    uint8_t *msg;
+    ssize_t len;
+    double start = now_seconds();
+
+    memset(stats, 0, sizeof(*stats));
+    mac_len = hex_decode(mac_hex, strlen(mac_hex), mac, sizeof(mac));
+    if (mac_len < 0) {
+        ERRO("The MAC is not hex encoded");
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+    len = read_message(in_fd, &msg);
+    if (len < 0)
+        return TEEC_ERROR_BAD_PARAMETERS;
+
+    res = verify_secure_object(ctx, id, alg, msg, len, mac, mac_len);
+    free(msg);
+
+    stats->in_bytes = len;
+    stats->records = 1;
+    stats->failed = res != TEEC_SUCCESS;
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+/*
+ * Messages are packed into one shared buffer and handed to the TA batch at
+ * a time, see TA_SEAL_KEY_CMD_MAC_BATCH.
+ */
+struct mac_batch {
+    TEEC_SharedMemory in;
+    TEEC_SharedMemory out;
+    size_t in_len;
+    uint32_t count;
+    uint32_t max_count;
+    int verify;
+};
+
+static TEEC_Result mac_batch_alloc(struct test_ctx *ctx, struct mac_batch *b,
+                                   unsigned int batch, int verify) {
+    size_t out_size =
+        (size_t)batch * (verify ? 4
+                                : TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE +
+                                      TA_SEAL_KEY_MAX_MAC_SIZE);
+    TEEC_Result res;
+
+    memset(b, 0, sizeof(*b));
+    b->max_count = batch;
+    b->verify = verify;
+    res = alloc_shared_memory(ctx, &b->in, SEAL_BATCH_BUFFER_SIZE,
+                              TEEC_MEM_INPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+    res = alloc_shared_memory(ctx, &b->out, out_size, TEEC_MEM_OUTPUT);
+    if (res != TEEC_SUCCESS)
+        TEEC_ReleaseSharedMemory(&b->in);
+    return res;
+}
+
+static void mac_batch_free(struct mac_batch *b) {
+    TEEC_ReleaseSharedMemory(&b->out);
+    TEEC_ReleaseSharedMemory(&b->in);
+}
+
+static int mac_batch_fits(struct mac_batch *b, size_t len) {
+    return b->count < b->max_count &&
+           b->in_len + TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + len <= b->in.size;
+}
+
+static void mac_batch_add(struct mac_batch *b, const void *msg, size_t len,
+                          const void *mac, size_t mac_len) {
+    uint8_t *p = (uint8_t *)b->in.buffer + b->in_len;
+
+    put_be32(p, len);
+    p += 4;
+    if (b->verify) {
+        put_be32(p, mac_len);
+        p += 4;
+    }
+    memcpy(p, msg, len);
+    memcpy(p + len, mac, mac_len);
+    b->in_len = p + len + mac_len - (uint8_t *)b->in.buffer;
+    b->count++;
+}
+
+/*
+ * Write one line per message: the hex encoded MAC, or ok / fail when
+ * verifying. A message that could not be processed gives an empty line so
+ * the output lines up with the input.
+ */
+static TEEC_Result mac_batch_flush(struct test_ctx *ctx, char *id,
+                                   uint32_t alg, struct mac_batch *b,
+                                   int out_fd, struct seal_stats *stats) {
+    char line[2 * TA_SEAL_KEY_MAX_MAC_SIZE + 1];
+    uint8_t *out = b->out.buffer;
+    size_t out_len, pos = 0;
+    TEEC_Result res;
+    uint32_t failed;
+
+    if (b->count == 0)
+        return TEEC_SUCCESS;
+
+    res = mac_secure_batch(ctx, id, alg, b->verify, &b->in, b->in_len,
+                           b->count, &b->out, &out_len, &failed);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    for (uint32_t i = 0; i < b->count; i++, stats->records++) {
+        uint32_t status, len = 0;
+        size_t line_len;
+
+        if (out_len - pos < (b->verify ? 4 : TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE))
+            return TEEC_ERROR_BAD_FORMAT;
+        status = get_be32(out + pos);
+        pos += 4;
+        if (!b->verify) {
+            len = get_be32(out + pos);
+            pos += 4;
+            if (len > out_len - pos || len > TA_SEAL_KEY_MAX_MAC_SIZE)
+                return TEEC_ERROR_BAD_FORMAT;
+        }
+
+        if (status != TEEC_SUCCESS)
+            stats->failed++;
+        if (b->verify) {
+            line_len = sprintf(line, "%s", status ? "fail" : "ok");
+        } else {
+            if (status != TEEC_SUCCESS)
+                ERRO("Message %zu failed: 0x%x", stats->records, status);
+            hex_encode(out + pos, len, line);
+            line_len = 2 * len;
+            pos += len;
+        }
+        line[line_len++] = '\n';
+        if (write_full(out_fd, line, line_len) < 0)
+            return TEEC_ERROR_GENERIC;
+        stats->out_bytes += line_len;
+    }
+    b->in_len = 0;
+    b->count = 0;
+    return TEEC_SUCCESS;
+}
+
+/*
+ * Every line of in_fd is a message. When verifying a line is the hex
+ * encoded MAC, a space and the message.
+ */
+static TEEC_Result mac_lines(struct test_ctx *ctx, char *id, uint32_t alg,
+                             int verify, int in_fd, int out_fd,
+                             unsigned int batch, struct seal_stats *stats) {
+    uint8_t mac[TA_SEAL_KEY_MAX_MAC_SIZE];
+    struct mac_batch b;
+    TEEC_Result res;
+    size_t cap = 0;
+    char *line = NULL;
+    char *msg;
+    ssize_t len, mac_len = 0;
+    FILE *in;
+    double start = now_seconds();
+
+    memset(stats, 0, sizeof(*stats));
+    if (batch == 0)
+        return TEEC_ERROR_BAD_PARAMETERS;
+
+    in = fdopen(dup(in_fd), "r");
+    if (in == NULL) {
+        ERRO("Failed to open the input");
+        return TEEC_ERROR_GENERIC;
+    }
+    res = mac_batch_alloc(ctx, &b, batch, verify);
+    if (res != TEEC_SUCCESS)
+        goto close_in;
+
+    while ((len = getline(&line, &cap, in)) > 0) {
+        stats->in_bytes += len;
+        if (line[len - 1] == '\n')
+            line[--len] = '\0';
+        msg = line;
+        if (verify) {
+            msg = strchr(line, ' ');
+            mac_len = msg ? hex_decode(line, msg - line, mac, sizeof(mac)) : -1;
+            if (mac_len < 0) {
+                ERRO("Line %zu is not a hex MAC and a message",
+                     stats->records + b.count + 1);
+                res = TEEC_ERROR_BAD_FORMAT;
+                break;
+            }
+            msg++;
+            len -= msg - line;
+        }
+        if (len > SEAL_MAX_RECORD_SIZE) {
+            ERRO("Message %zu is longer than %d bytes",
+                 stats->records + b.count + 1, SEAL_MAX_RECORD_SIZE);
+            res = TEEC_ERROR_BAD_PARAMETERS;
+            break;
+        }
+        if (!mac_batch_fits(&b, len + mac_len)) {
+            res = mac_batch_flush(ctx, id, alg, &b, out_fd, stats);
+            if (res != TEEC_SUCCESS)
+                break;
+        }
+        mac_batch_add(&b, msg, len, mac, mac_len);
+    }
+    if (res == TEEC_SUCCESS && ferror(in)) {
+        ERRO("Failed to read the input");
+        res = TEEC_ERROR_GENERIC;
+    }
+    if (res == TEEC_SUCCESS)
+        res = mac_batch_flush(ctx, id, alg, &b, out_fd, stats);
+    free(line);
+    mac_batch_free(&b);
+close_in:
+    fclose(in);
+    stats->seconds = now_seconds() - start;
+    return res;
+}
+
+TEEC_Result mac_records(struct test_ctx *ctx, char *id, uint32_t alg,
+                        int in_fd, int out_fd, unsigned int batch,
+                        struct seal_stats *stats) {
+    return mac_lines(ctx, id, alg, 0, in_fd, out_fd, batch, stats);
+}
+
+TEEC_Result verify_records(struct test_ctx *ctx, char *id, uint32_t alg,
+                           int in_fd, int out_fd, unsigned int batch,
+                           struct seal_stats *stats) {
+    return mac_lines(ctx, id, alg, 1, in_fd, out_fd, batch, stats);
+}
@@ -0,0 +1,20 @@
+#ifndef SIGN_H
+#define SIGN_H
+
+#include "seal.h"
+#include "storage.h"
+#include <stdint.h>
+
+TEEC_Result mac_message(struct test_ctx *ctx, char *id, uint32_t alg,
+                        int in_fd, int out_fd, struct seal_stats *stats);
+TEEC_Result verify_message(struct test_ctx *ctx, char *id, uint32_t alg,
+                           int in_fd, const char *mac_hex,
+                           struct seal_stats *stats);
+TEEC_Result mac_records(struct test_ctx *ctx, char *id, uint32_t alg,
+                        int in_fd, int out_fd, unsigned int batch,
+                        struct seal_stats *stats);
+TEEC_Result verify_records(struct test_ctx *ctx, char *id, uint32_t alg,
+                           int in_fd, int out_fd, unsigned int batch,
+                           struct seal_stats *stats);
+
+#endif // !SIGN_H
@@ -0,0 +1,123 @@
+#include "stats.h"
+#include "debugmacros.h"
+#include "util.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <seal-key_ta.h>
+
+static void print_command(FILE *out, uint32_t id,
+                          const struct ta_seal_key_command_stats *c) {
+    fprintf(out,
+            "%-18s %9" PRIu64 " %7" PRIu64 " %11" PRIu64 " %11" PRIu64
+            " %9" PRIu64 " %8.3f %7" PRIu32 " %8" PRIu64 " %8" PRIu64
+            " %8" PRIu64 "\n",
+            command_name(id), c->calls, c->errors, c->bytes_in, c->bytes_out,
+            c->time_ms, (double)c->time_ms / c->calls, c->max_ms,
+            c->phase_ms[TA_SEAL_KEY_PHASE_OPEN],
+            c->phase_ms[TA_SEAL_KEY_PHASE_IO],
+            c->phase_ms[TA_SEAL_KEY_PHASE_COPY]);
+    for (size_t i = 0; i < TA_SEAL_KEY_STATS_CODES && c->codes[i].count; i++)
+        fprintf(out, "    0x%08" PRIx32 " %9" PRIu32 "\n", c->codes[i].code,
+                c->codes[i].count);
+    if (c->other_errors)
+        fprintf(out, "    other      %9" PRIu32 "\n", c->other_errors);
+}
+
+// print the counters the TA keeps per command, the commands never run are left
+// out
+TEEC_Result show_ta_stats(struct test_ctx *ctx, int reset, FILE *out) {
+    struct ta_seal_key_stats stats;
+    TEEC_Result res;
+    uint32_t commands;
+
+    memset(&stats, 0, sizeof(stats));
+    res = stats_secure_session(ctx, &stats, reset);
+    if (res != TEEC_SUCCESS)
+        return res;
+    if (stats.version != TA_SEAL_KEY_STATS_VERSION) {
+        ERRO("The TA sent statistics of version %" PRIu32 ", expected %d",
+             stats.version, TA_SEAL_KEY_STATS_VERSION);
+        return TEEC_ERROR_NOT_SUPPORTED;
+    }
+    commands = stats.commands < TA_SEAL_KEY_STATS_COMMANDS
+                   ? stats.commands
+                   : TA_SEAL_KEY_STATS_COMMANDS;
+
+    fprintf(out, "TA commands of the last %" PRIu32 " s, times in ms\n",
+            stats.now - stats.since);
+    fprintf(out, "%-18s %9s %7s %11s %11s %9s %8s %7s %8s %8s %8s\n",
+            "command", "calls", "errors", "bytes in", "bytes out", "total",
+            "mean", "max", "open", "io", "copy");
+    for (uint32_t id = 0; id < commands; id++)
+        if (stats.command[id].calls > 0)
+            print_command(out, id, &stats.command[id]);
+    if (reset)
+        fprintf(out, "The counters were reset\n");
+    return TEEC_SUCCESS;
+}
+
+// ids are printed as they are when they are printable, in hex otherwise
+static void print_id(FILE *out, const uint8_t *id, uint32_t size) {
+    char hex[2 * TA_SEAL_KEY_HOT_KEYS_ID_SIZE + 1];
+
+    for (uint32_t i = 0; i < size; i++) {
+        if (!isprint(id[i])) {
+            hex_encode(id, size, hex);
+            hex[2 * size] = '\0';
+            fprintf(out, "0x%-40s", hex);
+            return;
+        }
+    }
+    fprintf(out, "%-42.*s", (int)size, (const char *)id);
+}
+
+// print the ids the TA read and wrote the most, with their estimated counts
+TEEC_Result show_hot_keys(struct test_ctx *ctx, int reset, FILE *out) {
+    struct ta_seal_key_hot_keys *hot;
+    struct ta_seal_key_hot_key *e;
+    size_t len = sizeof(*hot) + 16 * sizeof(*e);
+    TEEC_Result res;
+
+    // the TA tells how much it needs when its top is larger
+    for (;;) {
+        hot = malloc(len);
+        if (hot == NULL)
+            errx(1, "error allocating memory on the heap");
+        res = hot_keys_secure_session(ctx, hot, &len, reset);
+        if (res != TEEC_ERROR_SHORT_BUFFER)
+            break;
+        free(hot);
+    }
+    if (res != TEEC_SUCCESS)
+        goto out;
+    if (len < sizeof(*hot) || hot->version != TA_SEAL_KEY_HOT_KEYS_VERSION ||
+        len < sizeof(*hot) + hot->entries * sizeof(*e)) {
+        ERRO("The TA sent hot keys this version does not know");
+        res = TEEC_ERROR_NOT_SUPPORTED;
+        goto out;
+    }
+
+    fprintf(out,
+            "%" PRIu32 " reads and writes, counts halved every %" PRIu32
+            " s, sketch of %" PRIu32 "x%" PRIu32 "\n",
+            hot->accesses, hot->half_life, hot->depth, hot->width);
+    fprintf(out, "%4s %-42s %10s %7s\n", "rank", "id", "count", "share");
+    e = (struct ta_seal_key_hot_key *)(hot + 1);
+    for (uint32_t i = 0; i < hot->entries; i++, e++) {
+        fprintf(out, "%4" PRIu32 " ", i + 1);
+        print_id(out, e->id, e->id_size < sizeof(e->id) ? e->id_size
+                                                         : sizeof(e->id));
+        fprintf(out, " %10" PRIu32 " %6.2f%%\n", e->count,
+                hot->accesses ? 100.0 * e->count / hot->accesses : 0.0);
+    }
+    if (reset)
+        fprintf(out, "The counts were reset\n");
+out:
+    free(hot);
+    return res;
+}
@@ -0,0 +1,10 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "storage.h"
+#include <stdio.h>
+
+TEEC_Result show_ta_stats(struct test_ctx *ctx, int reset, FILE *out);
+TEEC_Result show_hot_keys(struct test_ctx *ctx, int reset, FILE *out);
+
+#endif // !STATS_H
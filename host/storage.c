@@ -1,9 +1,17 @@
 #include "storage.h"
+#include "codec.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "metrics.h"
+#include "trace.h"
+#include "util.h"
 #include <err.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 /* OP-TEE TEE client API (built by optee_client) */
 #include <tee_client_api.h>
@@ -11,33 +19,153 @@
 /* TA API: UUID and command IDs */
 #include <seal-key_ta.h>
 
+// indexed by command ID
+static const char *const command_names[] = {
+    [TA_SEAL_KEY_CMD_READ_RAW] = "read",
+    [TA_SEAL_KEY_CMD_WRITE_RAW] = "write",
+    [TA_SEAL_KEY_CMD_DELETE] = "delete",
+    [TA_SEAL_KEY_CMD_AE_INIT] = "ae-init",
+    [TA_SEAL_KEY_CMD_AE_UPDATE] = "ae-update",
+    [TA_SEAL_KEY_CMD_AE_FINAL] = "ae-final",
+    [TA_SEAL_KEY_CMD_CHUNK_INIT] = "chunk-init",
+    [TA_SEAL_KEY_CMD_CHUNK] = "chunk",
+    [TA_SEAL_KEY_CMD_SEAL_BATCH] = "seal-batch",
+    [TA_SEAL_KEY_CMD_UNSEAL_BATCH] = "unseal-batch",
+    [TA_SEAL_KEY_CMD_MAC] = "mac",
+    [TA_SEAL_KEY_CMD_VERIFY] = "verify",
+    [TA_SEAL_KEY_CMD_MAC_BATCH] = "mac-batch",
+    [TA_SEAL_KEY_CMD_VERIFY_BATCH] = "verify-batch",
+    [TA_SEAL_KEY_CMD_DERIVE] = "derive",
+    [TA_SEAL_KEY_CMD_GENERATE] = "generate",
+    [TA_SEAL_KEY_CMD_RANDOM] = "random",
+    [TA_SEAL_KEY_CMD_REWRAP_ALL] = "rewrap-all",
+    [TA_SEAL_KEY_CMD_ARCHIVE_INIT] = "archive-init",
+    [TA_SEAL_KEY_CMD_ARCHIVE_EXPORT] = "archive-export",
+    [TA_SEAL_KEY_CMD_ARCHIVE_IMPORT] = "archive-import",
+    [TA_SEAL_KEY_CMD_SYNC_TREE] = "sync-tree",
+    [TA_SEAL_KEY_CMD_SYNC_LIST] = "sync-list",
+    [TA_SEAL_KEY_CMD_ARCHIVE_EXPORT_IDS] = "archive-export-ids",
+    [TA_SEAL_KEY_CMD_PING] = "ping",
+    [TA_SEAL_KEY_CMD_STAT] = "stat",
+    [TA_SEAL_KEY_CMD_STATS] = "stats",
+    [TA_SEAL_KEY_CMD_TRACE] = "trace",
+    [TA_SEAL_KEY_CMD_HOT_KEYS] = "hot-keys",
+};
+
+// a printable name of the TA command cmd
+const char *command_name(uint32_t cmd) {
+    static __thread char unknown[16];
+
+    if (cmd < sizeof(command_names) / sizeof(*command_names) &&
+        command_names[cmd] != NULL)
+        return command_names[cmd];
+    snprintf(unknown, sizeof(unknown), "0x%x", cmd);
+    return unknown;
+}
+
+// switch tracing of the session on or off and get the trace of its last call
+static TEEC_Result trace_session(struct test_ctx *ctx,
+                                 struct ta_seal_key_trace *trace, int on) {
+    TEEC_Operation op;
+    uint32_t origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_VALUE_INPUT,
+                                     TEEC_NONE, TEEC_NONE);
+
+    op.params[0].tmpref.buffer = trace;
+    op.params[0].tmpref.size = sizeof(*trace);
+    op.params[1].value.a = on ? TA_SEAL_KEY_TRACE_ON : 0;
+
+    return TEEC_InvokeCommand(&ctx->sess, TA_SEAL_KEY_CMD_TRACE, &op, &origin);
+}
+
+// every call into the TA, timed when tracing or metrics are on
+static TEEC_Result invoke(struct test_ctx *ctx, uint32_t cmd,
+                          TEEC_Operation *op, uint32_t *origin) {
+    struct ta_seal_key_trace trace;
+    uint64_t start, end;
+    TEEC_Result res;
+
+    if (!trace_enabled && !metrics_enabled)
+        return TEEC_InvokeCommand(&ctx->sess, cmd, op, origin);
+
+    if (metrics_enabled)
+        metrics_begin(cmd);
+    start = trace_now();
+    res = TEEC_InvokeCommand(&ctx->sess, cmd, op, origin);
+    end = trace_now();
+    if (metrics_enabled)
+        metrics_end(cmd, res, end - start);
+    if (!trace_enabled)
+        return res;
+    if (trace_session(ctx, &trace, 1) != TEEC_SUCCESS)
+        trace_command(command_name(cmd), start, end, NULL);
+    else
+        trace_command(command_name(cmd), start, end, &trace);
+    return res;
+}
+
 void prepare_tee_session(struct test_ctx *ctx) {
     TEEC_UUID uuid = TA_SEAL_KEY_UUID;
+    struct ta_seal_key_trace trace;
     uint32_t origin;
     TEEC_Result res;
+    uint64_t start;
+
+    trace_init();
+    metrics_init();
 
     /* Initialize a context connecting us to the TEE */
+    start = trace_start();
     res = TEEC_InitializeContext(NULL, &ctx->ctx);
     if (res != TEEC_SUCCESS)
         errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+    trace_end("initialize context", start);
 
     /* Open a session with the TA */
+    start = trace_start();
     res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid, TEEC_LOGIN_PUBLIC,
                            NULL, NULL, &origin);
     if (res != TEEC_SUCCESS)
         errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x", res,
              origin);
+    trace_end("open session", start);
+    metrics_session(1);
+
+    /* A TA without TRACE is traced from the host side only */
+    if (trace_enabled)
+        trace_session(ctx, &trace, 1);
 }
 
 void terminate_tee_session(struct test_ctx *ctx) {
+    uint64_t start = trace_start();
+
     TEEC_CloseSession(&ctx->sess);
+    trace_end("close session", start);
+    metrics_session(0);
+    start = trace_start();
     TEEC_FinalizeContext(&ctx->ctx);
+    trace_end("finalize context", start);
+}
+
+TEEC_Result alloc_shared_memory(struct test_ctx *ctx, TEEC_SharedMemory *shm,
+                                size_t size, uint32_t flags) {
+    TEEC_Result res;
+
+    memset(shm, 0, sizeof(*shm));
+    shm->size = size;
+    shm->flags = flags;
+    res = TEEC_AllocateSharedMemory(&ctx->ctx, shm);
+    if (res != TEEC_SUCCESS)
+        ERRO("TEEC_AllocateSharedMemory failed with code 0x%x", res);
+    return res;
 }
 
 // todo: this is a function we can use our object here is the key in this case
 // of a seal key application
 TEEC_Result read_secure_object(struct test_ctx *ctx, char *id, char *data,
-                               size_t data_len) {
+                               size_t *data_len) {
     TEEC_Operation op;
     uint32_t origin;
     TEEC_Result res;
@@ -51,22 +179,109 @@ TEEC_Result read_secure_object(struct test_ctx *ctx, char *id, char *data,
     op.params[0].tmpref.size = id_len;
 
     op.params[1].tmpref.buffer = data;
-    op.params[1].tmpref.size = data_len;
+    op.params[1].tmpref.size = *data_len;
 
-    res =
-        TEEC_InvokeCommand(&ctx->sess, TA_SEAL_KEY_CMD_READ_RAW, &op, &origin);
+    res = invoke(ctx, TA_SEAL_KEY_CMD_READ_RAW, &op, &origin);
+    // a missing key is left to the caller, it is not always an error
     switch (res) {
     case TEEC_SUCCESS:
+        *data_len = op.params[1].tmpref.size;
+        break;
     case TEEC_ERROR_SHORT_BUFFER:
+        ERRO("Buffer too short, the key has %zu bytes",
+             op.params[1].tmpref.size);
+        break;
     case TEEC_ERROR_ITEM_NOT_FOUND:
         break;
     default:
-        printf("Command READ_RAW failed: 0x%x / %u\n", res, origin);
+        ERRO("Command READ_RAW failed: 0x%x / %u", res, origin);
     }
 
     return res;
 }
 
+/*
+ * Read the key stored under id into one locked buffer registered as shared
+ * memory and write it to out_fd from there, encoded with encoding. The
+ * encoded key goes to the same locked mapping, behind the registered part.
+ * The mapping is kept out of swap and core dumps and wiped before it is
+ * released, the key is not copied or logged anywhere else on the way.
+ */
+TEEC_Result output_secure_object(struct test_ctx *ctx, char *id, int encoding,
+                                 int out_fd, size_t *data_len) {
+    TEEC_SharedMemory shm;
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = GET_KEY_BUFFER_SIZE;
+    size_t map, len;
+    uint8_t *buf;
+
+    for (;;) {
+        map = size;
+        if (encoding != CODEC_RAW)
+            map += codec_encoded_len(encoding, size);
+        buf = mmap(NULL, map, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED)
+            return TEEC_ERROR_OUT_OF_MEMORY;
+        if (mlock(buf, map) != 0) {
+            ERRO("Failed to lock the key buffer, is ulimit -l too low?");
+            munmap(buf, map);
+            return TEEC_ERROR_OUT_OF_MEMORY;
+        }
+#ifdef MADV_DONTDUMP
+        madvise(buf, map, MADV_DONTDUMP);
+#endif
+        memset(&shm, 0, sizeof(shm));
+        shm.buffer = buf;
+        shm.size = size;
+        shm.flags = TEEC_MEM_OUTPUT;
+        res = TEEC_RegisterSharedMemory(&ctx->ctx, &shm);
+        if (res != TEEC_SUCCESS) {
+            ERRO("TEEC_RegisterSharedMemory failed with code 0x%x", res);
+            goto out;
+        }
+
+        memset(&op, 0, sizeof(op));
+        op.paramTypes =
+            TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+                             TEEC_NONE, TEEC_NONE);
+        op.params[0].tmpref.buffer = id;
+        op.params[0].tmpref.size = strlen(id);
+        op.params[1].memref.parent = &shm;
+        op.params[1].memref.size = size;
+        res = invoke(ctx, TA_SEAL_KEY_CMD_READ_RAW, &op, &origin);
+        // the TA tells how much it needs, retry with a buffer that large
+        if (res != TEEC_ERROR_SHORT_BUFFER || op.params[1].memref.size <= size)
+            break;
+        TEEC_ReleaseSharedMemory(&shm);
+        munlock(buf, map);
+        munmap(buf, map);
+        size = (op.params[1].memref.size + page - 1) / page * page;
+    }
+    if (res != TEEC_SUCCESS) {
+        ERRO("Command READ_RAW failed: 0x%x / %u", res, origin);
+    } else {
+        *data_len = op.params[1].memref.size;
+        len = *data_len;
+        if (encoding != CODEC_RAW)
+            len = codec_encode(encoding, buf, len, (char *)buf + size);
+        if (write_full(out_fd, encoding != CODEC_RAW ? buf + size : buf,
+                       len) < 0) {
+            ERRO("Failed to write the key");
+            res = TEEC_ERROR_GENERIC;
+        }
+    }
+    TEEC_ReleaseSharedMemory(&shm);
+out:
+    wipe(buf, map);
+    munlock(buf, map);
+    munmap(buf, map);
+    return res;
+}
+
 // here we write the key to the optee secure storage
 // it gets sealed from the optee and stored securely
 // todo: ?do we trust this or do we want to encrypt it before sending it to
@@ -88,42 +303,847 @@ TEEC_Result write_secure_object(struct test_ctx *ctx, char *id, char *data,
     op.params[1].tmpref.buffer = data;
     op.params[1].tmpref.size = data_len;
 
-    res =
-        TEEC_InvokeCommand(&ctx->sess, TA_SEAL_KEY_CMD_WRITE_RAW, &op, &origin);
+    res = invoke(ctx, TA_SEAL_KEY_CMD_WRITE_RAW, &op, &origin);
+    if (res == TEEC_ERROR_BAD_FORMAT && origin == TEEC_ORIGIN_TRUSTED_APP)
+        ERRO("A key must not start with \\0SKW, the mark of wrapped keys");
+    else if (res != TEEC_SUCCESS)
+        ERRO("Command WRITE_RAW failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+TEEC_Result delete_secure_object(struct test_ctx *ctx, char *id) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t id_len = strlen(id);
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+                                     TEEC_NONE, TEEC_NONE);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = id_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_DELETE, &op, &origin);
+
+    if (res != TEEC_SUCCESS && res != TEEC_ERROR_ITEM_NOT_FOUND)
+        ERRO("Command DELETE failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+// call into the TA without doing anything there
+TEEC_Result ping_secure_session(struct test_ctx *ctx) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_PING, &op, &origin);
+    if (res != TEEC_SUCCESS)
+        ERRO("Command PING failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+// the size of the object stored under id, without reading it
+TEEC_Result stat_secure_object(struct test_ctx *ctx, char *id, size_t *size) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_OUTPUT,
+                                     TEEC_NONE, TEEC_NONE);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = strlen(id);
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_STAT, &op, &origin);
+    if (res == TEEC_SUCCESS)
+        *size = op.params[1].value.a;
+    else if (res != TEEC_ERROR_ITEM_NOT_FOUND)
+        ERRO("Command STAT failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+// copy the command counters of the TA into stats, zero them after with reset
+TEEC_Result stats_secure_session(struct test_ctx *ctx,
+                                 struct ta_seal_key_stats *stats, int reset) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_VALUE_INPUT,
+                                     TEEC_NONE, TEEC_NONE);
+
+    op.params[0].tmpref.buffer = stats;
+    op.params[0].tmpref.size = sizeof(*stats);
+    op.params[1].value.a = reset ? TA_SEAL_KEY_STATS_RESET : 0;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_STATS, &op, &origin);
     if (res != TEEC_SUCCESS)
-        printf("Command WRITE_RAW failed: 0x%x / %u\n", res, origin);
+        ERRO("Command STATS failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+// copy the hot keys of the TA into buf, with the size needed on short buffer
+TEEC_Result hot_keys_secure_session(struct test_ctx *ctx, void *buf,
+                                    size_t *len, int reset) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_VALUE_INPUT,
+                                     TEEC_NONE, TEEC_NONE);
+
+    op.params[0].tmpref.buffer = buf;
+    op.params[0].tmpref.size = *len;
+    op.params[1].value.a = reset ? TA_SEAL_KEY_HOT_KEYS_RESET : 0;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_HOT_KEYS, &op, &origin);
+    *len = op.params[0].tmpref.size;
+    if (res != TEEC_SUCCESS && res != TEEC_ERROR_SHORT_BUFFER)
+        ERRO("Command HOT_KEYS failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+// start a streaming AES-GCM operation in the TA with the key stored under id
+// on encryption the TA picks the nonce and returns it in nonce
+TEEC_Result init_secure_stream(struct test_ctx *ctx, char *id, uint32_t mode,
+                               void *nonce, size_t nonce_len, void *aad,
+                               size_t aad_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t id_len = strlen(id);
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT,
+                         TEEC_MEMREF_TEMP_INOUT, TEEC_MEMREF_TEMP_INPUT);
 
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = id_len;
+
+    op.params[1].value.a = mode;
+
+    op.params[2].tmpref.buffer = nonce;
+    op.params[2].tmpref.size = nonce_len;
+
+    op.params[3].tmpref.buffer = aad;
+    op.params[3].tmpref.size = aad_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_AE_INIT, &op, &origin);
     switch (res) {
     case TEEC_SUCCESS:
         break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Item not found");
+        break;
     default:
-        printf("Command WRITE_RAW failed: 0x%x / %u\n", res, origin);
+        ERRO("Command AE_INIT failed: 0x%x / %u", res, origin);
     }
 
     return res;
 }
 
-TEEC_Result delete_secure_object(struct test_ctx *ctx, char *id) {
+// the chunks live in shared memory so they are not copied on every call
+TEEC_Result update_secure_stream(struct test_ctx *ctx,
+                                 TEEC_SharedMemory *in, size_t in_len,
+                                 TEEC_SharedMemory *out, size_t *out_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+                         TEEC_NONE, TEEC_NONE);
+
+    op.params[0].memref.parent = in;
+    op.params[0].memref.size = in_len;
+
+    op.params[1].memref.parent = out;
+    op.params[1].memref.size = out->size;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_AE_UPDATE, &op, &origin);
+    if (res == TEEC_SUCCESS)
+        *out_len = op.params[1].memref.size;
+    else
+        ERRO("Command AE_UPDATE failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+// the tag is written to tag when encrypting and checked against it when
+// decrypting
+TEEC_Result final_secure_stream(struct test_ctx *ctx, uint32_t mode,
+                                TEEC_SharedMemory *in, size_t in_len,
+                                TEEC_SharedMemory *out, size_t *out_len,
+                                void *tag, size_t tag_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    uint32_t tag_type = mode == TA_SEAL_KEY_MODE_ENCRYPT
+                            ? TEEC_MEMREF_TEMP_OUTPUT
+                            : TEEC_MEMREF_TEMP_INPUT;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+                         tag_type, TEEC_NONE);
+
+    op.params[0].memref.parent = in;
+    op.params[0].memref.size = in_len;
+
+    op.params[1].memref.parent = out;
+    op.params[1].memref.size = out->size;
+
+    op.params[2].tmpref.buffer = tag;
+    op.params[2].tmpref.size = tag_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_AE_FINAL, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *out_len = op.params[1].memref.size;
+        break;
+    case TEEC_ERROR_MAC_INVALID:
+        ERRO("Authentication of the sealed data failed");
+        break;
+    default:
+        ERRO("Command AE_FINAL failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// prepare the session for chunk sealing, when encrypting it is session lane
+// of sessions sealing the same data and the TA returns its nonce prefix
+TEEC_Result init_secure_chunks(struct test_ctx *ctx, char *id, uint32_t mode,
+                               uint32_t sessions, uint32_t lane, void *prefix,
+                               size_t prefix_len, void *aad, size_t aad_len) {
     TEEC_Operation op;
     uint32_t origin;
     TEEC_Result res;
     size_t id_len = strlen(id);
 
     memset(&op, 0, sizeof(op));
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
-                                     TEEC_NONE, TEEC_NONE);
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INOUT,
+                         TEEC_MEMREF_TEMP_INOUT, TEEC_MEMREF_TEMP_INPUT);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = id_len;
+
+    op.params[1].value.a = mode;
+    op.params[1].value.b = sessions << 16 | lane;
+
+    op.params[2].tmpref.buffer = prefix;
+    op.params[2].tmpref.size = prefix_len;
+
+    op.params[3].tmpref.buffer = aad;
+    op.params[3].tmpref.size = aad_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_CHUNK_INIT, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Item not found");
+        break;
+    default:
+        ERRO("Command CHUNK_INIT failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// prefix is the one of the session that sealed the chunk, NULL to seal it
+TEEC_Result process_secure_chunk(struct test_ctx *ctx, uint32_t index,
+                                 int last, const void *prefix,
+                                 TEEC_SharedMemory *in, size_t in_len,
+                                 TEEC_SharedMemory *out, size_t *out_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(
+        TEEC_VALUE_INPUT, TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+        prefix ? TEEC_MEMREF_TEMP_INPUT : TEEC_NONE);
+
+    op.params[0].value.a = index;
+    op.params[0].value.b = last;
+
+    op.params[1].memref.parent = in;
+    op.params[1].memref.size = in_len;
+
+    op.params[2].memref.parent = out;
+    op.params[2].memref.size = out->size;
+
+    op.params[3].tmpref.buffer = (void *)prefix;
+    op.params[3].tmpref.size = TA_SEAL_KEY_CHUNK_PREFIX_SIZE;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_CHUNK, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *out_len = op.params[2].memref.size;
+        break;
+    case TEEC_ERROR_MAC_INVALID:
+        ERRO("Authentication of chunk %u failed", index);
+        break;
+    default:
+        ERRO("Command CHUNK failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// seal or unseal count records packed in in, see TA_SEAL_KEY_CMD_SEAL_BATCH
+// for the layout, failed is the number of records the TA could not process
+TEEC_Result process_secure_batch(struct test_ctx *ctx, char *id, uint32_t mode,
+                                 TEEC_SharedMemory *in, size_t in_len,
+                                 uint32_t count, TEEC_SharedMemory *out,
+                                 size_t *out_len, uint32_t *failed) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t id_len = strlen(id);
+    uint32_t cmd = mode == TA_SEAL_KEY_MODE_ENCRYPT
+                       ? TA_SEAL_KEY_CMD_SEAL_BATCH
+                       : TA_SEAL_KEY_CMD_UNSEAL_BATCH;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+                         TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_VALUE_INOUT);
 
     op.params[0].tmpref.buffer = id;
     op.params[0].tmpref.size = id_len;
 
-    res = TEEC_InvokeCommand(&ctx->sess, TA_SEAL_KEY_CMD_DELETE, &op, &origin);
+    op.params[1].memref.parent = in;
+    op.params[1].memref.size = in_len;
 
+    op.params[2].memref.parent = out;
+    op.params[2].memref.size = out->size;
+
+    op.params[3].value.a = count;
+
+    res = invoke(ctx, cmd, &op, &origin);
     switch (res) {
     case TEEC_SUCCESS:
+        *out_len = op.params[2].memref.size;
+        *failed = op.params[3].value.b;
+        break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Item not found");
+        break;
+    default:
+        ERRO("Command %s failed: 0x%x / %u",
+             mode == TA_SEAL_KEY_MODE_ENCRYPT ? "SEAL_BATCH" : "UNSEAL_BATCH",
+             res, origin);
+    }
+
+    return res;
+}
+
+TEEC_Result init_secure_archive(struct test_ctx *ctx, char *id, uint32_t mode,
+                                uint32_t flags, void *prefix,
+                                size_t prefix_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT,
+                         TEEC_MEMREF_TEMP_INOUT, TEEC_NONE);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = strlen(id);
+
+    op.params[1].value.a = mode;
+    op.params[1].value.b = flags;
+
+    op.params[2].tmpref.buffer = prefix;
+    op.params[2].tmpref.size = prefix_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_ARCHIVE_INIT, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Archive key not found");
+        break;
+    default:
+        ERRO("Command ARCHIVE_INIT failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// the next chunk of the archive, count is the number of objects in it
+TEEC_Result export_secure_chunk(struct test_ctx *ctx, TEEC_SharedMemory *out,
+                                size_t *out_len, int *last, uint32_t *count) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT,
+                                     TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE);
+
+    op.params[0].memref.parent = out;
+    op.params[0].memref.size = out->size;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_ARCHIVE_EXPORT, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *out_len = op.params[0].memref.size;
+        *last = op.params[1].value.a;
+        *count = op.params[1].value.b;
+        break;
+    default:
+        ERRO("Command ARCHIVE_EXPORT failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// store the objects of the next chunk, skipped counts the ones that exist
+TEEC_Result import_secure_chunk(struct test_ctx *ctx, TEEC_SharedMemory *in,
+                                size_t in_len, int last, uint32_t *stored,
+                                uint32_t *skipped) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+                                     TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT,
+                                     TEEC_NONE);
+
+    op.params[0].memref.parent = in;
+    op.params[0].memref.size = in_len;
+
+    op.params[1].value.a = last;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_ARCHIVE_IMPORT, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *stored = op.params[2].value.a;
+        *skipped = op.params[2].value.b;
+        break;
+    case TEEC_ERROR_MAC_INVALID:
+        ERRO("Authentication of the archive failed");
+        break;
+    default:
+        ERRO("Command ARCHIVE_IMPORT failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// mac is the HMAC or the ECDSA signature r || s, depending on alg
+// seal the next chunk of the objects in ids, consumed is the number of
+// bytes of ids the chunk covers
+TEEC_Result export_secure_ids(struct test_ctx *ctx, TEEC_SharedMemory *out,
+                              size_t *out_len, void *ids, size_t ids_len,
+                              int last_ids, int *last, size_t *consumed) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_VALUE_INOUT,
+                         TEEC_MEMREF_TEMP_INPUT, TEEC_NONE);
+
+    op.params[0].memref.parent = out;
+    op.params[0].memref.size = out->size;
+
+    op.params[1].value.a = last_ids;
+
+    op.params[2].tmpref.buffer = ids;
+    op.params[2].tmpref.size = ids_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_ARCHIVE_EXPORT_IDS, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *out_len = op.params[0].memref.size;
+        *last = op.params[1].value.a;
+        *consumed = op.params[1].value.b;
+        break;
+    default:
+        ERRO("Command ARCHIVE_EXPORT_IDS failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// node hashes of one level of the store summary starting at first, in a
+// tree of *depth levels or the one the TA picks when it is 0
+TEEC_Result tree_secure_nodes(struct test_ctx *ctx, uint32_t level,
+                              uint32_t first, uint32_t *depth,
+                              uint32_t *generation, void *nodes,
+                              size_t *nodes_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_VALUE_INOUT, TEEC_NONE);
+
+    op.params[0].value.a = level;
+    op.params[0].value.b = first;
+
+    op.params[1].tmpref.buffer = nodes;
+    op.params[1].tmpref.size = *nodes_len;
+
+    op.params[2].value.a = *depth;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_SYNC_TREE, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *nodes_len = op.params[1].tmpref.size;
+        *depth = op.params[2].value.a;
+        *generation = op.params[2].value.b;
+        break;
+    default:
+        ERRO("Command SYNC_TREE failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// the next objects of the leaves, see TA_SEAL_KEY_CMD_SYNC_LIST
+TEEC_Result list_secure_objects(struct test_ctx *ctx, void *leaves,
+                                size_t leaves_len, uint32_t depth,
+                                uint32_t *leaf, uint32_t *done,
+                                uint32_t *generation, TEEC_SharedMemory *out,
+                                size_t *out_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INOUT,
+                         TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_VALUE_INOUT);
+
+    op.params[0].tmpref.buffer = leaves;
+    op.params[0].tmpref.size = leaves_len;
+
+    op.params[1].value.a = *leaf;
+    op.params[1].value.b = *done;
+
+    op.params[2].memref.parent = out;
+    op.params[2].memref.size = out->size;
+
+    op.params[3].value.a = depth;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_SYNC_LIST, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *leaf = op.params[1].value.a;
+        *done = op.params[1].value.b;
+        *generation = op.params[3].value.b;
+        *out_len = op.params[2].memref.size;
+        break;
+    default:
+        ERRO("Command SYNC_LIST failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+TEEC_Result mac_secure_object(struct test_ctx *ctx, char *id, uint32_t alg,
+                              void *msg, size_t msg_len, void *mac,
+                              size_t *mac_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t id_len = strlen(id);
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT,
+                         TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = id_len;
+
+    op.params[1].value.a = alg;
+
+    op.params[2].tmpref.buffer = msg;
+    op.params[2].tmpref.size = msg_len;
+
+    op.params[3].tmpref.buffer = mac;
+    op.params[3].tmpref.size = *mac_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_MAC, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *mac_len = op.params[3].tmpref.size;
+        break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Item not found");
+        break;
+    default:
+        ERRO("Command MAC failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+TEEC_Result verify_secure_object(struct test_ctx *ctx, char *id, uint32_t alg,
+                                 void *msg, size_t msg_len, void *mac,
+                                 size_t mac_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t id_len = strlen(id);
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT,
+                         TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = id_len;
+
+    op.params[1].value.a = alg;
+
+    op.params[2].tmpref.buffer = msg;
+    op.params[2].tmpref.size = msg_len;
+
+    op.params[3].tmpref.buffer = mac;
+    op.params[3].tmpref.size = mac_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_VERIFY, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+    case TEEC_ERROR_MAC_INVALID:
+    case TEEC_ERROR_SIGNATURE_INVALID:
+        break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Item not found");
+        break;
+    default:
+        ERRO("Command VERIFY failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// see TA_SEAL_KEY_CMD_MAC_BATCH and TA_SEAL_KEY_CMD_VERIFY_BATCH for the
+// layout of in and out, failed is the number of messages that failed
+TEEC_Result mac_secure_batch(struct test_ctx *ctx, char *id, uint32_t alg,
+                             int verify, TEEC_SharedMemory *in, size_t in_len,
+                             uint32_t count, TEEC_SharedMemory *out,
+                             size_t *out_len, uint32_t *failed) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t id_len = strlen(id);
+    uint32_t cmd =
+        verify ? TA_SEAL_KEY_CMD_VERIFY_BATCH : TA_SEAL_KEY_CMD_MAC_BATCH;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INOUT,
+                         TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = id_len;
+
+    op.params[1].value.a = alg;
+    op.params[1].value.b = count;
+
+    op.params[2].memref.parent = in;
+    op.params[2].memref.size = in_len;
+
+    op.params[3].memref.parent = out;
+    op.params[3].memref.size = out->size;
+
+    res = invoke(ctx, cmd, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *out_len = op.params[3].memref.size;
+        *failed = op.params[1].value.b;
+        break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Item not found");
+        break;
+    default:
+        ERRO("Command %s failed: 0x%x / %u",
+             verify ? "VERIFY_BATCH" : "MAC_BATCH", res, origin);
+    }
+
+    return res;
+}
+
+/*
+ * Derive the key @id, "root/label", inside the TA. With @target the first
+ * @size bytes of the derived key are stored as the key @target as well.
+ * @hit is set when the TA had the key in its derived key cache.
+ */
+TEEC_Result derive_secure_object(struct test_ctx *ctx, char *id, char *target,
+                                 size_t size, int *hit) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+    size_t id_len = strlen(id);
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INOUT,
+                         TEEC_MEMREF_TEMP_INPUT, TEEC_NONE);
+
+    op.params[0].tmpref.buffer = id;
+    op.params[0].tmpref.size = id_len;
+
+    op.params[1].value.a = target ? TA_SEAL_KEY_DERIVE_PERSIST : 0;
+    op.params[1].value.b = size;
+
+    op.params[2].tmpref.buffer = target;
+    op.params[2].tmpref.size = target ? strlen(target) : 0;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_DERIVE, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *hit = op.params[1].value.a;
+        break;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Root key not found");
+        break;
+    default:
+        ERRO("Command DERIVE failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+/*
+ * Generate the keys prefix + first to prefix + first + *count - 1 inside the
+ * TA. *count returns the number of keys generated, even on failure. The
+ * public parts of ECDSA keys are returned in pub.
+ */
+TEEC_Result generate_secure_objects(struct test_ctx *ctx, char *prefix,
+                                    uint32_t first, uint32_t *count,
+                                    uint32_t type, size_t size, void *pub,
+                                    size_t *pub_len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INOUT,
+                         TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT);
+
+    op.params[0].tmpref.buffer = prefix;
+    op.params[0].tmpref.size = strlen(prefix);
+
+    op.params[1].value.a = first;
+    op.params[1].value.b = *count;
+
+    op.params[2].value.a = type;
+    op.params[2].value.b = size;
+
+    op.params[3].tmpref.buffer = pub;
+    op.params[3].tmpref.size = *pub_len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_GENERATE, &op, &origin);
+    *count = res == TEEC_SUCCESS || origin == TEEC_ORIGIN_TRUSTED_APP
+                 ? op.params[1].value.b
+                 : 0;
+    *pub_len = op.params[3].tmpref.size;
+    switch (res) {
+    case TEEC_SUCCESS:
+        break;
+    case TEEC_ERROR_ACCESS_CONFLICT:
+        ERRO("Key %u already exists", first + *count);
+        break;
+    default:
+        ERRO("Command GENERATE failed: 0x%x / %u", res, origin);
+    }
+
+    return res;
+}
+
+// fill the first len bytes of shm with random bytes from the TEE
+TEEC_Result random_secure_block(struct test_ctx *ctx, TEEC_SharedMemory *shm,
+                                size_t len) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE,
+                                     TEEC_NONE, TEEC_NONE);
+
+    op.params[0].memref.parent = shm;
+    op.params[0].memref.size = len;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_RANDOM, &op, &origin);
+    if (res != TEEC_SUCCESS)
+        ERRO("Command RANDOM failed: 0x%x / %u", res, origin);
+
+    return res;
+}
+
+/*
+ * Visit up to batch objects of the store from *cursor on and move the keys
+ * wrapped with old_kek to new_kek, an empty id stands for unwrapped keys.
+ * *cursor is advanced and *end set once the whole store has been visited.
+ */
+TEEC_Result rewrap_secure_objects(struct test_ctx *ctx, char *old_kek,
+                                  char *new_kek, uint32_t *cursor,
+                                  uint32_t batch, int *end,
+                                  uint32_t *rewrapped, uint32_t *failed) {
+    TEEC_Operation op;
+    uint32_t origin;
+    TEEC_Result res;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes =
+        TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
+                         TEEC_VALUE_INOUT, TEEC_VALUE_OUTPUT);
+
+    op.params[0].tmpref.buffer = old_kek;
+    op.params[0].tmpref.size = strlen(old_kek);
+
+    op.params[1].tmpref.buffer = new_kek;
+    op.params[1].tmpref.size = strlen(new_kek);
+
+    op.params[2].value.a = *cursor;
+    op.params[2].value.b = batch;
+
+    res = invoke(ctx, TA_SEAL_KEY_CMD_REWRAP_ALL, &op, &origin);
+    switch (res) {
+    case TEEC_SUCCESS:
+        *cursor = op.params[2].value.a;
+        *end = op.params[2].value.b;
+        *rewrapped = op.params[3].value.a;
+        *failed = op.params[3].value.b;
+        break;
     case TEEC_ERROR_ITEM_NOT_FOUND:
+        ERRO("Key encryption key not found");
         break;
     default:
-        printf("Command DELETE failed: 0x%x / %u\n", res, origin);
+        ERRO("Command REWRAP_ALL failed: 0x%x / %u", res, origin);
     }
 
     return res;
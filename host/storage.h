@@ -12,12 +12,88 @@ struct test_ctx {
     TEEC_Session sess;
 };
 
+struct ta_seal_key_stats;
+
 void prepare_tee_session(struct test_ctx *ctx);
+const char *command_name(uint32_t cmd);
 void terminate_tee_session(struct test_ctx *ctx);
+TEEC_Result alloc_shared_memory(struct test_ctx *ctx, TEEC_SharedMemory *shm,
+                                size_t size, uint32_t flags);
 TEEC_Result read_secure_object(struct test_ctx *ctx, char *id, char *data,
                                size_t *data_len);
+TEEC_Result output_secure_object(struct test_ctx *ctx, char *id, int encoding,
+                                 int out_fd, size_t *data_len);
 TEEC_Result write_secure_object(struct test_ctx *ctx, char *id, char *data,
                                 size_t data_len);
 TEEC_Result delete_secure_object(struct test_ctx *ctx, char *id);
+TEEC_Result ping_secure_session(struct test_ctx *ctx);
+TEEC_Result stat_secure_object(struct test_ctx *ctx, char *id, size_t *size);
+TEEC_Result stats_secure_session(struct test_ctx *ctx,
+                                 struct ta_seal_key_stats *stats, int reset);
+TEEC_Result hot_keys_secure_session(struct test_ctx *ctx, void *buf,
+                                    size_t *len, int reset);
+TEEC_Result init_secure_stream(struct test_ctx *ctx, char *id, uint32_t mode,
+                               void *nonce, size_t nonce_len, void *aad,
+                               size_t aad_len);
+TEEC_Result update_secure_stream(struct test_ctx *ctx,
+                                 TEEC_SharedMemory *in, size_t in_len,
+                                 TEEC_SharedMemory *out, size_t *out_len);
+TEEC_Result final_secure_stream(struct test_ctx *ctx, uint32_t mode,
+                                TEEC_SharedMemory *in, size_t in_len,
+                                TEEC_SharedMemory *out, size_t *out_len,
+                                void *tag, size_t tag_len);
+TEEC_Result init_secure_chunks(struct test_ctx *ctx, char *id, uint32_t mode,
+                               uint32_t sessions, uint32_t lane, void *prefix,
+                               size_t prefix_len, void *aad, size_t aad_len);
+TEEC_Result process_secure_chunk(struct test_ctx *ctx, uint32_t index,
+                                 int last, const void *prefix,
+                                 TEEC_SharedMemory *in, size_t in_len,
+                                 TEEC_SharedMemory *out, size_t *out_len);
+TEEC_Result process_secure_batch(struct test_ctx *ctx, char *id, uint32_t mode,
+                                 TEEC_SharedMemory *in, size_t in_len,
+                                 uint32_t count, TEEC_SharedMemory *out,
+                                 size_t *out_len, uint32_t *failed);
+TEEC_Result derive_secure_object(struct test_ctx *ctx, char *id, char *target,
+                                 size_t size, int *hit);
+TEEC_Result generate_secure_objects(struct test_ctx *ctx, char *prefix,
+                                    uint32_t first, uint32_t *count,
+                                    uint32_t type, size_t size, void *pub,
+                                    size_t *pub_len);
+TEEC_Result random_secure_block(struct test_ctx *ctx, TEEC_SharedMemory *shm,
+                                size_t len);
+TEEC_Result rewrap_secure_objects(struct test_ctx *ctx, char *old_kek,
+                                  char *new_kek, uint32_t *cursor,
+                                  uint32_t batch, int *end,
+                                  uint32_t *rewrapped, uint32_t *failed);
+TEEC_Result init_secure_archive(struct test_ctx *ctx, char *id, uint32_t mode,
+                                uint32_t flags, void *prefix,
+                                size_t prefix_len);
+TEEC_Result export_secure_chunk(struct test_ctx *ctx, TEEC_SharedMemory *out,
+                                size_t *out_len, int *last, uint32_t *count);
+TEEC_Result import_secure_chunk(struct test_ctx *ctx, TEEC_SharedMemory *in,
+                                size_t in_len, int last, uint32_t *stored,
+                                uint32_t *skipped);
+TEEC_Result export_secure_ids(struct test_ctx *ctx, TEEC_SharedMemory *out,
+                              size_t *out_len, void *ids, size_t ids_len,
+                              int last_ids, int *last, size_t *consumed);
+TEEC_Result tree_secure_nodes(struct test_ctx *ctx, uint32_t level,
+                              uint32_t first, uint32_t *depth,
+                              uint32_t *generation, void *nodes,
+                              size_t *nodes_len);
+TEEC_Result list_secure_objects(struct test_ctx *ctx, void *leaves,
+                                size_t leaves_len, uint32_t depth,
+                                uint32_t *leaf, uint32_t *done,
+                                uint32_t *generation, TEEC_SharedMemory *out,
+                                size_t *out_len);
+TEEC_Result mac_secure_object(struct test_ctx *ctx, char *id, uint32_t alg,
+                              void *msg, size_t msg_len, void *mac,
+                              size_t *mac_len);
+TEEC_Result verify_secure_object(struct test_ctx *ctx, char *id, uint32_t alg,
+                                 void *msg, size_t msg_len, void *mac,
+                                 size_t mac_len);
+TEEC_Result mac_secure_batch(struct test_ctx *ctx, char *id, uint32_t alg,
+                             int verify, TEEC_SharedMemory *in, size_t in_len,
+                             uint32_t count, TEEC_SharedMemory *out,
+                             size_t *out_len, uint32_t *failed);
 
 #endif // !STORAGE_H
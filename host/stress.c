@@ -0,0 +1,759 @@
+#include "stress.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "suite.h"
+#include "util.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <seal-key_ta.h>
+
+#define VALUE_MAGIC 0x5ea1c0deu
+// the writer of the values stored before a run
+#define LOADER UINT32_MAX
+
+// what a worker expects under one of its own ids, else the last sequence
+#define ID_ABSENT -1
+#define ID_UNKNOWN -2 // after a failed call, any value of the worker will do
+
+// seconds the workers may take to open their sessions
+#define READY_TIMEOUT 30
+
+static const char *op_names[WORKLOAD_MIX_OPS] = {"read", "write", "delete"};
+
+// the start of every value, the rest follows from it
+struct value_header {
+    uint32_t magic;
+    uint32_t writer;
+    uint64_t seq;
+};
+
+/*
+ * What a worker reports, in memory shared with the parent so that forked
+ * workers fill it in just like threads. Only the worker writes its slot,
+ * max_seq is read by the other workers as well while the run goes on.
+ */
+struct stress_slot {
+    long calls[WORKLOAD_MIX_OPS];
+    long errors[WORKLOAD_MIX_OPS];
+    long misses[WORKLOAD_MIX_OPS];
+    long conflicts; // calls answered with TEEC_ERROR_ACCESS_CONFLICT
+    long retries;
+    long gave_up; // still in conflict after STRESS_RETRIES retries
+    long corrupt; // reads that did not return what was written
+    TEEC_Result error;
+    int ready;
+    uint64_t max_seq; // of the last value written
+    int64_t own_seq[STRESS_MAX_IDS];
+    long samples;
+    double end;
+};
+
+// the start signal, shared like the slots
+struct stress_shared {
+    int go;
+    double start;
+};
+
+struct stress_run {
+    const struct stress_options *o;
+    unsigned int workers;
+    double cdf[WORKLOAD_MIX_OPS];
+    struct stress_shared *shared;
+    struct stress_slot *slots;
+    double *samples; // o->ops latencies per worker, in seconds
+    size_t map_size;
+};
+
+struct stress_worker {
+    struct stress_run *r;
+    struct stress_slot *slot;
+    unsigned int index;
+    pthread_t thread;
+    pid_t pid;
+    struct test_ctx ctx;
+    uint64_t random;
+    char *buf; // the value written, then room for the one read
+};
+
+struct stress_row {
+    unsigned int workers;
+    long calls;
+    long errors;
+    long misses;
+    long conflicts;
+    long retries;
+    long gave_up;
+    long corrupt;
+    TEEC_Result error;
+    double ops; // calls per second
+    double speedup;
+    double service; // mean time of a call in the TA in us, -1 when unknown
+    double wait;    // the rest of the mean latency, queueing and switching
+    struct suite_latency l;
+};
+
+void stress_defaults(struct stress_options *o) {
+    memset(o, 0, sizeof(*o));
+    o->workers[0] = 1;
+    o->nsteps = 1;
+    o->processes = 1;
+    o->mix[WORKLOAD_READ] = 0.7;
+    o->mix[WORKLOAD_WRITE] = 0.2;
+    o->mix[WORKLOAD_DELETE] = 0.1;
+    o->shared_ids = 4;
+    o->own_ids = 4;
+    o->ops = SUITE_ITERATIONS;
+    o->size = STRESS_SIZE;
+    o->format = SUITE_FORMAT_TEXT;
+    o->label = "";
+    o->out = stdout;
+}
+
+// xorshift64*, picks the calls and fills the values
+static uint64_t next_random(uint64_t *s) {
+    uint64_t x = *s;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static double random_unit(uint64_t *s) {
+    return (next_random(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void pause_us(long us) {
+    struct timespec ts = {us / 1000000, us % 1000000 * 1000};
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static void sleep_until(double t) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR)
+        ;
+}
+
+// the bytes after the header, never 0 as xorshift needs
+static uint64_t value_seed(uint32_t writer, uint64_t seq) {
+    return ((writer + 1ULL) * 0x9e3779b97f4a7c15ULL) ^
+           ((seq + 1) * 0xbf58476d1ce4e5b9ULL) ^ 1;
+}
+
+static void fill_value(char *buf, size_t size, uint32_t writer,
+                       uint64_t seq) {
+    struct value_header h = {VALUE_MAGIC, writer, seq};
+    uint64_t s = value_seed(writer, seq);
+
+    memcpy(buf, &h, sizeof(h));
+    for (size_t i = sizeof(h); i < size; i++)
+        buf[i] = next_random(&s);
+}
+
+// 0 when buf holds a whole value, with its writer and sequence in h
+static int check_value(const char *buf, size_t len, size_t size,
+                       struct value_header *h) {
+    uint64_t s;
+
+    if (len != size)
+        return -1;
+    memcpy(h, buf, sizeof(*h));
+    if (h->magic != VALUE_MAGIC)
+        return -1;
+    s = value_seed(h->writer, h->seq);
+    for (size_t i = sizeof(*h); i < size; i++)
+        if (buf[i] != (char)next_random(&s))
+            return -1;
+    return 0;
+}
+
+/*
+ * 1 when a value read is corrupt. It has to be whole and written by a worker
+ * of the run with a sequence number that worker already took. An own id,
+ * with expected set, holds the last value its worker wrote there.
+ */
+static long check_read(struct stress_run *r, const char *buf, size_t len,
+                       unsigned int worker, const int64_t *expected) {
+    struct value_header h;
+
+    if (check_value(buf, len, r->o->size, &h) < 0)
+        return 1;
+    if (expected != NULL)
+        return h.writer != worker || *expected == ID_ABSENT ||
+               (*expected >= 0 && h.seq != (uint64_t)*expected);
+    if (h.writer == LOADER)
+        return h.seq != 0;
+    return h.writer >= r->workers ||
+           h.seq > __atomic_load_n(&r->slots[h.writer].max_seq,
+                                   __ATOMIC_ACQUIRE);
+}
+
+/*
+ * What a worker expects under one of its own ids after a call. A value
+ * that is missing but should be there, or the other way round, is corrupt.
+ */
+static int64_t own_state(int64_t expected, int op, TEEC_Result res,
+                         uint64_t seq, long *corrupt) {
+    if (res == TEEC_ERROR_ITEM_NOT_FOUND) {
+        if (expected >= 0)
+            (*corrupt)++;
+        return ID_ABSENT;
+    }
+    if (res != TEEC_SUCCESS)
+        return op == WORKLOAD_READ ? expected : ID_UNKNOWN;
+    if (op == WORKLOAD_WRITE)
+        return seq;
+    if (op == WORKLOAD_DELETE) {
+        if (expected == ID_ABSENT)
+            (*corrupt)++;
+        return ID_ABSENT;
+    }
+    return expected;
+}
+
+static void shared_id(char *id, size_t key) {
+    snprintf(id, MAX_NAME_LEN, "%ss%zu", STRESS_PREFIX, key);
+}
+
+static void own_id(char *id, unsigned int worker, size_t key) {
+    snprintf(id, MAX_NAME_LEN, "%sw%u.%zu", STRESS_PREFIX, worker, key);
+}
+
+/*
+ * A call of the mix, made again after a growing, jittered pause as long as
+ * the TA answers TEEC_ERROR_ACCESS_CONFLICT, another session holding the
+ * object open in a way that excludes this call.
+ */
+static TEEC_Result call(struct stress_worker *wk, int op, char *id,
+                        size_t *len) {
+    size_t size = wk->r->o->size;
+    TEEC_Result res;
+
+    for (int attempt = 0;; attempt++) {
+        if (op == WORKLOAD_READ) {
+            *len = 2 * size;
+            res = read_secure_object(&wk->ctx, id, wk->buf + size, len);
+        } else if (op == WORKLOAD_DELETE) {
+            res = delete_secure_object(&wk->ctx, id);
+        } else {
+            res = write_secure_object(&wk->ctx, id, wk->buf, size);
+        }
+        if (res != TEEC_ERROR_ACCESS_CONFLICT)
+            return res;
+        wk->slot->conflicts++;
+        if (attempt == STRESS_RETRIES) {
+            wk->slot->gave_up++;
+            return res;
+        }
+        wk->slot->retries++;
+        pause_us((50L << attempt) +
+                 next_random(&wk->random) % (50L << attempt));
+    }
+}
+
+static void run_calls(struct stress_worker *wk) {
+    struct stress_run *r = wk->r;
+    const struct stress_options *o = r->o;
+    struct stress_slot *s = wk->slot;
+    double *samples = r->samples + (size_t)wk->index * o->ops;
+    size_t ids = o->shared_ids + o->own_ids;
+    char id[MAX_NAME_LEN];
+
+    for (long k = 0; k < o->ops; k++) {
+        double u = random_unit(&wk->random), begin;
+        int op = u < r->cdf[0]   ? WORKLOAD_READ
+                 : u < r->cdf[1] ? WORKLOAD_WRITE
+                                 : WORKLOAD_DELETE;
+        size_t key = next_random(&wk->random) % ids;
+        int64_t *expected = NULL;
+        uint64_t seq = 0;
+        size_t len = 0;
+        TEEC_Result res;
+
+        if (key < o->shared_ids) {
+            shared_id(id, key);
+        } else {
+            key -= o->shared_ids;
+            own_id(id, wk->index, key);
+            expected = s->own_seq + key;
+        }
+        if (op == WORKLOAD_WRITE) {
+            // taken before the write, no reader sees a newer one
+            seq = s->max_seq + 1;
+            __atomic_store_n(&s->max_seq, seq, __ATOMIC_RELEASE);
+            fill_value(wk->buf, o->size, wk->index, seq);
+        }
+
+        begin = now_seconds();
+        res = call(wk, op, id, &len);
+        samples[s->samples++] = now_seconds() - begin;
+
+        s->calls[op]++;
+        if (res == TEEC_ERROR_ITEM_NOT_FOUND && op != WORKLOAD_WRITE) {
+            s->misses[op]++;
+        } else if (res != TEEC_SUCCESS) {
+            if (s->error == TEEC_SUCCESS)
+                s->error = res;
+            s->errors[op]++;
+        }
+        if (op == WORKLOAD_READ && res == TEEC_SUCCESS)
+            s->corrupt += check_read(r, wk->buf + o->size, len, wk->index,
+                                     expected);
+        if (expected != NULL)
+            *expected = own_state(*expected, op, res, seq, &s->corrupt);
+    }
+    s->end = now_seconds();
+}
+
+// a worker opens its own session, waits for the others and runs its calls
+static void *worker_run(void *arg) {
+    struct stress_worker *wk = arg;
+    struct stress_run *r = wk->r;
+
+    wk->random = 0x9e3779b97f4a7c15ULL * (wk->index + 1);
+    wk->buf = malloc(3 * r->o->size);
+    if (wk->buf == NULL) {
+        wk->slot->error = TEEC_ERROR_OUT_OF_MEMORY;
+        __atomic_store_n(&wk->slot->ready, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    prepare_tee_session(&wk->ctx);
+    __atomic_store_n(&wk->slot->ready, 1, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&r->shared->go, __ATOMIC_ACQUIRE))
+        pause_us(100);
+    sleep_until(r->shared->start);
+    run_calls(wk);
+    terminate_tee_session(&wk->ctx);
+    free(wk->buf);
+    return NULL;
+}
+
+/*
+ * Start the workers, as processes each with its own TEE context or as
+ * threads each with its own session, let them go at once when all are up
+ * and wait for them. A forked worker leaves by _exit so the stdio buffers
+ * and atexit handlers of the parent are not run twice.
+ */
+static TEEC_Result run_workers(struct stress_run *r,
+                               struct stress_worker *wk) {
+    const struct stress_options *o = r->o;
+    double deadline = now_seconds() + READY_TIMEOUT;
+    TEEC_Result res = TEEC_SUCCESS;
+    unsigned int started, i;
+    int status;
+
+    fflush(NULL);
+    for (started = 0; started < r->workers; started++) {
+        wk[started].r = r;
+        wk[started].slot = r->slots + started;
+        wk[started].index = started;
+        if (o->processes) {
+            wk[started].pid = fork();
+            if (wk[started].pid == 0) {
+                worker_run(wk + started);
+                _exit(0);
+            }
+            if (wk[started].pid > 0)
+                continue;
+        } else if (pthread_create(&wk[started].thread, NULL, worker_run,
+                                  wk + started) == 0) {
+            continue;
+        }
+        ERRO("Failed to start worker %u", started);
+        res = TEEC_ERROR_GENERIC;
+        break;
+    }
+
+    for (i = 0; i < started; i++) {
+        while (!__atomic_load_n(&r->slots[i].ready, __ATOMIC_ACQUIRE)) {
+            if (o->processes &&
+                waitpid(wk[i].pid, &status, WNOHANG) == wk[i].pid) {
+                wk[i].pid = 0;
+                break;
+            }
+            if (now_seconds() > deadline)
+                break;
+            pause_us(1000);
+        }
+        if (!r->slots[i].ready) {
+            ERRO("Worker %u did not open a session", i);
+            res = TEEC_ERROR_GENERIC;
+        }
+    }
+    r->shared->start = now_seconds() + 0.001;
+    __atomic_store_n(&r->shared->go, 1, __ATOMIC_RELEASE);
+
+    for (i = 0; i < started; i++) {
+        if (!o->processes) {
+            pthread_join(wk[i].thread, NULL);
+        } else if (wk[i].pid > 0 && (waitpid(wk[i].pid, &status, 0) < 0 ||
+                                     !WIFEXITED(status) ||
+                                     WEXITSTATUS(status) != 0)) {
+            ERRO("Worker %u failed", i);
+            res = TEEC_ERROR_GENERIC;
+        }
+        if (r->slots[i].error == TEEC_ERROR_OUT_OF_MEMORY) {
+            ERRO("Worker %u ran out of memory", i);
+            res = TEEC_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    return res;
+}
+
+// store the first value of every id, from the loader or the owner
+static TEEC_Result load_ids(struct test_ctx *ctx, struct stress_run *r,
+                            char *buf) {
+    const struct stress_options *o = r->o;
+    char id[MAX_NAME_LEN];
+    TEEC_Result res;
+
+    for (size_t k = 0; k < o->shared_ids; k++) {
+        shared_id(id, k);
+        fill_value(buf, o->size, LOADER, 0);
+        res = write_secure_object(ctx, id, buf, o->size);
+        if (res != TEEC_SUCCESS)
+            return res;
+    }
+    for (unsigned int w = 0; w < r->workers; w++) {
+        for (size_t k = 0; k < o->own_ids; k++) {
+            own_id(id, w, k);
+            fill_value(buf, o->size, w, 0);
+            res = write_secure_object(ctx, id, buf, o->size);
+            if (res != TEEC_SUCCESS)
+                return res;
+            r->slots[w].own_seq[k] = 0;
+        }
+    }
+    return TEEC_SUCCESS;
+}
+
+// read every id once more after the run, the corrupt ones
+static long verify_ids(struct test_ctx *ctx, struct stress_run *r,
+                       char *buf) {
+    const struct stress_options *o = r->o;
+    char id[MAX_NAME_LEN];
+    TEEC_Result res;
+    long corrupt = 0;
+    size_t len;
+
+    for (size_t k = 0; k < o->shared_ids; k++) {
+        shared_id(id, k);
+        len = 2 * o->size;
+        res = read_secure_object(ctx, id, buf, &len);
+        if (res == TEEC_SUCCESS)
+            corrupt += check_read(r, buf, len, 0, NULL);
+        else if (res != TEEC_ERROR_ITEM_NOT_FOUND)
+            corrupt++;
+    }
+    for (unsigned int w = 0; w < r->workers; w++) {
+        for (size_t k = 0; k < o->own_ids; k++) {
+            int64_t expected = r->slots[w].own_seq[k];
+
+            own_id(id, w, k);
+            len = 2 * o->size;
+            res = read_secure_object(ctx, id, buf, &len);
+            if (res == TEEC_SUCCESS)
+                corrupt += check_read(r, buf, len, w, &expected);
+            else if (res != TEEC_ERROR_ITEM_NOT_FOUND || expected >= 0)
+                corrupt++;
+        }
+    }
+    return corrupt;
+}
+
+static void remove_ids(struct test_ctx *ctx, struct stress_run *r) {
+    char id[MAX_NAME_LEN];
+
+    for (size_t k = 0; k < r->o->shared_ids; k++) {
+        shared_id(id, k);
+        delete_secure_object(ctx, id);
+    }
+    for (unsigned int w = 0; w < r->workers; w++) {
+        for (size_t k = 0; k < r->o->own_ids; k++) {
+            own_id(id, w, k);
+            delete_secure_object(ctx, id);
+        }
+    }
+}
+
+// the calls of the mix the TA has counted and the time it took for them
+static void ta_time(struct test_ctx *ctx, uint64_t *calls, uint64_t *ms) {
+    static const uint32_t cmds[] = {
+        TA_SEAL_KEY_CMD_READ_RAW,
+        TA_SEAL_KEY_CMD_WRITE_RAW,
+        TA_SEAL_KEY_CMD_DELETE,
+    };
+    struct ta_seal_key_stats stats;
+
+    *calls = 0;
+    *ms = 0;
+    if (stats_secure_session(ctx, &stats, 0) != TEEC_SUCCESS)
+        return;
+    for (size_t i = 0; i < sizeof(cmds) / sizeof(*cmds); i++) {
+        if (cmds[i] >= stats.commands)
+            continue;
+        *calls += stats.command[cmds[i]].calls;
+        *ms += stats.command[cmds[i]].time_ms;
+    }
+}
+
+// add up the slots of a run, the latency over the calls of all workers
+static int sum_slots(struct stress_run *r, struct stress_row *row) {
+    const struct stress_options *o = r->o;
+    double *all, end = r->shared->start;
+    long count = 0;
+
+    memset(row, 0, sizeof(*row));
+    row->workers = r->workers;
+    all = malloc((r->workers * o->ops > 0 ? r->workers * o->ops : 1) *
+                 sizeof(*all));
+    if (all == NULL)
+        return -1;
+    for (unsigned int i = 0; i < r->workers; i++) {
+        struct stress_slot *s = r->slots + i;
+
+        for (int op = 0; op < WORKLOAD_MIX_OPS; op++) {
+            row->calls += s->calls[op];
+            row->errors += s->errors[op];
+            row->misses += s->misses[op];
+        }
+        row->conflicts += s->conflicts;
+        row->retries += s->retries;
+        row->gave_up += s->gave_up;
+        row->corrupt += s->corrupt;
+        if (row->error == TEEC_SUCCESS)
+            row->error = s->error;
+        memcpy(all + count, r->samples + (size_t)i * o->ops,
+               s->samples * sizeof(*all));
+        count += s->samples;
+        if (s->end > end)
+            end = s->end;
+    }
+    suite_summarize(all, count, &row->l);
+    free(all);
+    row->ops = end > r->shared->start ? row->calls / (end - r->shared->start)
+                                      : 0;
+    return 0;
+}
+
+// a time in us, unknown when negative
+static void put_time(FILE *out, int format, double us) {
+    if (us >= 0)
+        fprintf(out, format == SUITE_FORMAT_TEXT ? "%9.1f" : "%.2f", us);
+    else if (format == SUITE_FORMAT_TEXT)
+        fprintf(out, "%9s", "-");
+    else if (format == SUITE_FORMAT_JSON)
+        fputs("null", out);
+}
+
+static void print_header(const struct stress_options *o) {
+    const char *mode = o->processes ? "processes" : "threads";
+
+    switch (o->format) {
+    case SUITE_FORMAT_CSV:
+        fprintf(o->out, "label,mode,workers,calls,errors,misses,error,"
+                        "ops_per_s,speedup,mean_us,p50_us,p99_us,max_us,"
+                        "service_us,wait_us,conflicts,retries,gave_up,"
+                        "corrupt\n");
+        break;
+    case SUITE_FORMAT_JSON:
+        suite_print_meta(o->out, o->format, o->label);
+        fprintf(o->out,
+                ",\n  \"stress\": {\"mode\": \"%s\", \"shared_ids\": %zu, "
+                "\"own_ids\": %zu, \"read\": %g, \"write\": %g, "
+                "\"delete\": %g, \"ops\": %ld, \"size\": %zu, "
+                "\"retries\": %d},\n  \"results\": [",
+                mode, o->shared_ids, o->own_ids, o->mix[0], o->mix[1],
+                o->mix[2], o->ops, o->size, STRESS_RETRIES);
+        break;
+    default:
+        suite_print_meta(o->out, o->format, o->label);
+        fprintf(o->out,
+                ", %s, %zu shared and %zu own ids, %s %g %s %g %s %g, %ld "
+                "calls of %zu bytes per worker\n",
+                mode, o->shared_ids, o->own_ids, op_names[0], o->mix[0],
+                op_names[1], o->mix[1], op_names[2], o->mix[2], o->ops,
+                o->size);
+        fprintf(o->out,
+                "%7s %10s %7s %9s %9s %9s %9s %9s %9s %9s %7s %7s %7s %7s "
+                "%7s\n",
+                "workers", "ops/s", "speedup", "mean us", "p50 us", "p99 us",
+                "max us", "TA us", "wait us", "conflict", "retries",
+                "gave up", "misses", "errors", "corrupt");
+    }
+}
+
+static void print_row(const struct stress_options *o,
+                      const struct stress_row *row, int *first) {
+    FILE *out = o->out;
+
+    switch (o->format) {
+    case SUITE_FORMAT_CSV:
+        suite_put_string(out, o->format, o->label);
+        fprintf(out, ",%s,%u,%ld,%ld,%ld,0x%x,%.0f,%.2f,%.2f,%.2f,%.2f,%.2f,",
+                o->processes ? "processes" : "threads", row->workers,
+                row->calls, row->errors, row->misses, row->error, row->ops,
+                row->speedup, row->l.mean, row->l.p50, row->l.p99,
+                row->l.max);
+        put_time(out, o->format, row->service);
+        fputc(',', out);
+        put_time(out, o->format, row->wait);
+        fprintf(out, ",%ld,%ld,%ld,%ld\n", row->conflicts, row->retries,
+                row->gave_up, row->corrupt);
+        break;
+    case SUITE_FORMAT_JSON:
+        fprintf(out,
+                "%s\n    {\"workers\": %u, \"calls\": %ld, \"errors\": %ld, "
+                "\"misses\": %ld, \"error\": \"0x%x\", \"ops_per_s\": %.0f, "
+                "\"speedup\": %.2f, \"mean_us\": %.2f, \"p50_us\": %.2f, "
+                "\"p99_us\": %.2f, \"max_us\": %.2f, \"service_us\": ",
+                *first ? "" : ",", row->workers, row->calls, row->errors,
+                row->misses, row->error, row->ops, row->speedup, row->l.mean,
+                row->l.p50, row->l.p99, row->l.max);
+        put_time(out, o->format, row->service);
+        fputs(", \"wait_us\": ", out);
+        put_time(out, o->format, row->wait);
+        fprintf(out,
+                ", \"conflicts\": %ld, \"retries\": %ld, \"gave_up\": %ld, "
+                "\"corrupt\": %ld}",
+                row->conflicts, row->retries, row->gave_up, row->corrupt);
+        break;
+    default:
+        fprintf(out, "%7u %10.0f %7.2f %9.1f %9.1f %9.1f %9.1f ",
+                row->workers, row->ops, row->speedup, row->l.mean,
+                row->l.p50, row->l.p99, row->l.max);
+        put_time(out, o->format, row->service);
+        fputc(' ', out);
+        put_time(out, o->format, row->wait);
+        fprintf(out, " %8.2f%% %7ld %7ld %7ld %7ld %7ld",
+                row->calls ? 100.0 * row->conflicts / row->calls : 0,
+                row->retries, row->gave_up, row->misses, row->errors,
+                row->corrupt);
+        if (row->errors)
+            fprintf(out, "  0x%x", row->error);
+        fputc('\n', out);
+    }
+    *first = 0;
+}
+
+/*
+ * Run the mix of o with every number of workers of o->workers, each worker
+ * on its own session, and write a row per run: the throughput and how it
+ * scales, the latency, how much of it the TA spent on a call and how much
+ * was waiting for the TA and the world switch, and the conflicts and
+ * retries. The TA time comes from its STATS when they count the calls of
+ * the workers, else the mean latency of a first run with one worker stands
+ * in for it. Every value read, and every id after the run, is checked
+ * against what the workers wrote, a run with corrupt values fails.
+ */
+TEEC_Result stress_run(struct test_ctx *ctx, const struct stress_options *o) {
+    double sum = o->mix[0] + o->mix[1] + o->mix[2], unloaded = -1;
+    double base = 0;
+    unsigned int most = 0;
+    struct stress_worker *wk;
+    struct stress_run r;
+    TEEC_Result res = TEEC_SUCCESS;
+    long corrupt = 0;
+    int first = 1;
+    void *map;
+    char *buf;
+
+    for (size_t i = 0; i < o->nsteps; i++)
+        if (o->workers[i] > most)
+            most = o->workers[i];
+
+    memset(&r, 0, sizeof(r));
+    r.o = o;
+    r.cdf[0] = o->mix[0] / sum;
+    r.cdf[1] = (o->mix[0] + o->mix[1]) / sum;
+    r.cdf[2] = 1;
+    r.map_size = sizeof(*r.shared) + most * sizeof(*r.slots) +
+                 (size_t)most * o->ops * sizeof(*r.samples);
+    map = mmap(NULL, r.map_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    r.shared = map;
+    r.slots = (struct stress_slot *)(r.shared + 1);
+    r.samples = (double *)(r.slots + most);
+
+    wk = calloc(most, sizeof(*wk));
+    buf = malloc(2 * o->size);
+    if (wk == NULL || buf == NULL) {
+        res = TEEC_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
+
+    print_header(o);
+    for (size_t step = 0; step < o->nsteps; step++) {
+        struct stress_row row;
+        uint64_t calls, ms, calls_after, ms_after;
+
+        memset(map, 0, r.map_size);
+        memset(wk, 0, most * sizeof(*wk));
+        r.workers = o->workers[step];
+        res = load_ids(ctx, &r, buf);
+        if (res != TEEC_SUCCESS) {
+            ERRO("Failed to store the ids of the run: 0x%x", res);
+            remove_ids(ctx, &r);
+            break;
+        }
+
+        ta_time(ctx, &calls, &ms);
+        res = run_workers(&r, wk);
+        ta_time(ctx, &calls_after, &ms_after);
+
+        if (sum_slots(&r, &row) < 0) {
+            res = TEEC_ERROR_OUT_OF_MEMORY;
+            remove_ids(ctx, &r);
+            break;
+        }
+        row.corrupt += verify_ids(ctx, &r, buf);
+        remove_ids(ctx, &r);
+
+        if (step == 0)
+            base = row.ops;
+        row.speedup = base > 0 ? row.ops / base : 0;
+        if (step == 0 && r.workers == 1)
+            unloaded = row.l.mean;
+        if (calls_after > calls)
+            row.service = 1e3 * (ms_after - ms) / (calls_after - calls);
+        else
+            row.service = unloaded;
+        row.wait = row.service >= 0 && row.l.mean > row.service
+                       ? row.l.mean - row.service
+                       : row.service >= 0 ? 0 : -1;
+        print_row(o, &row, &first);
+        fflush(o->out);
+        corrupt += row.corrupt;
+        if (res != TEEC_SUCCESS)
+            break;
+    }
+    if (o->format == SUITE_FORMAT_JSON)
+        fprintf(o->out, "\n  ]\n}\n");
+
+    if (res == TEEC_SUCCESS && corrupt) {
+        ERRO("%ld values did not match what was written", corrupt);
+        res = TEEC_ERROR_GENERIC;
+    }
+out:
+    free(buf);
+    free(wk);
+    munmap(map, r.map_size);
+    return res;
+}
@@ -0,0 +1,37 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include "storage.h"
+#include "workload.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// storage ids of the stress test, shared ones and those of a single worker
+#define STRESS_PREFIX "stress#"
+#define STRESS_MAX_STEPS 16
+#define STRESS_MAX_WORKERS 256
+#define STRESS_MAX_IDS 64 // shared ids, and own ids of each worker
+// a value starts with its writer and sequence number so it can be checked
+#define STRESS_MIN_SIZE 16
+#define STRESS_SIZE 64
+// calls made again after TEEC_ERROR_ACCESS_CONFLICT before giving up
+#define STRESS_RETRIES 8
+
+struct stress_options {
+    unsigned int workers[STRESS_MAX_STEPS]; // a run for every entry
+    size_t nsteps;
+    int processes; // fork the workers instead of starting threads
+    double mix[WORKLOAD_MIX_OPS]; // proportions of read, write and delete
+    size_t shared_ids;            // written and read by every worker
+    size_t own_ids;               // per worker, no one else touches them
+    long ops;                     // calls of each worker in a run
+    size_t size;
+    int format;
+    const char *label;
+    FILE *out;
+};
+
+void stress_defaults(struct stress_options *o);
+TEEC_Result stress_run(struct test_ctx *ctx, const struct stress_options *o);
+
+#endif // !STRESS_H
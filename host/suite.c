@@ -0,0 +1,378 @@
+#include "suite.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <seal-key_ta.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#define OP(op) (1u << (op))
+// the ops that work on stored objects and are swept over sizes and counts
+#define OBJECT_OPS                                                             \
+    (OP(SUITE_OP_WRITE) | OP(SUITE_OP_READ) | OP(SUITE_OP_STAT) |             \
+     OP(SUITE_OP_DELETE))
+
+static const char *op_names[SUITE_OPS] = {
+    "open", "close", "ping", "write", "read", "stat", "delete",
+};
+
+// the measurements of one op, size and object count
+struct suite_row {
+    int op;
+    size_t size;
+    size_t objects;
+    long calls;
+    long errors;
+    TEEC_Result error; // the first error
+    double *samples;   // seconds per successful call
+    long count;
+};
+
+int suite_parse_op(const char *name) {
+    for (int op = 0; op < SUITE_OPS; op++)
+        if (strcmp(name, op_names[op]) == 0)
+            return op;
+    return -1;
+}
+
+const char *suite_op_name(int op) {
+    return op >= 0 && op < SUITE_OPS ? op_names[op] : "unknown";
+}
+
+static void object_id(char *id, size_t i) {
+    snprintf(id, MAX_NAME_LEN, "%s%zu", SUITE_PREFIX, i);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// nearest rank of the sorted samples, in microseconds
+static double percentile(const double *samples, long count, double p) {
+    long rank = (long)(p / 100 * count + 0.5);
+
+    if (rank < 1)
+        rank = 1;
+    if (rank > count)
+        rank = count;
+    return samples[rank - 1] * 1e6;
+}
+
+/*
+ * Sort the samples, in seconds, and sum them up in l, in microseconds. ops
+ * is the rate of back to back calls taking that long, all is 0 without
+ * samples.
+ */
+void suite_summarize(double *samples, long count, struct suite_latency *l) {
+    double sum = 0;
+
+    memset(l, 0, sizeof(*l));
+    if (count == 0)
+        return;
+    qsort(samples, count, sizeof(*samples), cmp_double);
+    for (long i = 0; i < count; i++)
+        sum += samples[i];
+    l->ops = count / sum;
+    l->mean = sum / count * 1e6;
+    l->min = samples[0] * 1e6;
+    l->max = samples[count - 1] * 1e6;
+    l->p50 = percentile(samples, count, 50);
+    l->p90 = percentile(samples, count, 90);
+    l->p99 = percentile(samples, count, 99);
+    l->p999 = percentile(samples, count, 99.9);
+}
+
+// text as a CSV field or a JSON string
+void suite_put_string(FILE *out, int format, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"')
+            fputs(format == SUITE_FORMAT_CSV ? "\"\"" : "\\\"", out);
+        else if (format == SUITE_FORMAT_JSON && *s == '\\')
+            fputs("\\\\", out);
+        else if (format == SUITE_FORMAT_JSON && (unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+/*
+ * Open the results with what tells runs apart: the label, the kernel, the
+ * machine and the date. JSON gets the fields of the outer object, text a
+ * comment line, the caller adds to both.
+ */
+void suite_print_meta(FILE *out, int format, const char *label) {
+    struct utsname u;
+    char date[32];
+    time_t t = time(NULL);
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+    if (uname(&u) < 0)
+        memset(&u, 0, sizeof(u));
+    if (format == SUITE_FORMAT_JSON) {
+        fprintf(out, "{\n  \"tool\": \"seal-key-bench\",\n  \"label\": ");
+        suite_put_string(out, format, label);
+        fprintf(out, ",\n  \"system\": ");
+        suite_put_string(out, format, u.sysname);
+        fprintf(out, ",\n  \"release\": ");
+        suite_put_string(out, format, u.release);
+        fprintf(out, ",\n  \"machine\": ");
+        suite_put_string(out, format, u.machine);
+        fprintf(out, ",\n  \"date\": \"%s\"", date);
+    } else {
+        fprintf(out, "# %s %s %s %s %s", label, u.sysname, u.release,
+                u.machine, date);
+    }
+}
+
+static void print_header(const struct suite_options *o) {
+    switch (o->format) {
+    case SUITE_FORMAT_CSV:
+        fprintf(o->out, "label,op,size,objects,calls,errors,error,min_us,"
+                        "mean_us,p50_us,p90_us,p99_us,p999_us,max_us,"
+                        "ops_per_s,mb_per_s\n");
+        break;
+    case SUITE_FORMAT_JSON:
+        suite_print_meta(o->out, o->format, o->label);
+        fprintf(o->out, ",\n  \"warmup\": %ld,\n  \"iterations\": %ld,\n"
+                        "  \"results\": [",
+                o->warmup, o->iterations);
+        break;
+    default:
+        suite_print_meta(o->out, o->format, o->label);
+        fprintf(o->out, ", %ld calls after %ld warmup\n", o->iterations,
+                o->warmup);
+        fprintf(o->out, "%-7s %8s %8s %6s %10s %10s %10s %10s %10s %10s "
+                        "%10s %10s\n",
+                "op", "size", "objects", "errors", "min us", "mean us",
+                "p50 us", "p99 us", "p99.9 us", "max us", "ops/s", "MB/s");
+    }
+}
+
+static void print_row(const struct suite_options *o, struct suite_row *r,
+                      int *first) {
+    struct suite_latency l;
+    double mb;
+
+    suite_summarize(r->samples, r->count, &l);
+    // only read and write move the payload across
+    mb = r->op == SUITE_OP_READ || r->op == SUITE_OP_WRITE
+             ? l.ops * r->size / 1e6
+             : 0;
+
+    switch (o->format) {
+    case SUITE_FORMAT_CSV:
+        suite_put_string(o->out, o->format, o->label);
+        fprintf(o->out,
+                ",%s,%zu,%zu,%ld,%ld,0x%x,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,"
+                "%.2f,%.0f,%.2f\n",
+                op_names[r->op], r->size, r->objects, r->calls, r->errors,
+                r->error, l.min, l.mean, l.p50, l.p90, l.p99, l.p999, l.max,
+                l.ops, mb);
+        break;
+    case SUITE_FORMAT_JSON:
+        fprintf(o->out,
+                "%s\n    {\"op\": \"%s\", \"size\": %zu, \"objects\": %zu, "
+                "\"calls\": %ld, \"errors\": %ld, \"error\": \"0x%x\", "
+                "\"min_us\": %.2f, \"mean_us\": %.2f, \"p50_us\": %.2f, "
+                "\"p90_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, "
+                "\"max_us\": %.2f, \"ops_per_s\": %.0f, \"mb_per_s\": %.2f}",
+                *first ? "" : ",", op_names[r->op], r->size, r->objects,
+                r->calls, r->errors, r->error, l.min, l.mean, l.p50, l.p90,
+                l.p99, l.p999, l.max, l.ops, mb);
+        break;
+    default:
+        fprintf(o->out,
+                "%-7s %8zu %8zu %6ld %10.1f %10.1f %10.1f %10.1f %10.1f "
+                "%10.1f %10.0f %10.2f",
+                op_names[r->op], r->size, r->objects, r->errors, l.min,
+                l.mean, l.p50, l.p99, l.p999, l.max, l.ops, mb);
+        if (r->errors)
+            fprintf(o->out, "  0x%x", r->error);
+        fputc('\n', o->out);
+    }
+    *first = 0;
+    fflush(o->out);
+}
+
+static void record(struct suite_row *r, TEEC_Result res, double seconds,
+                   int timed) {
+    if (!timed)
+        return;
+    r->calls++;
+    if (res == TEEC_SUCCESS) {
+        r->samples[r->count++] = seconds;
+    } else if (r->errors++ == 0) {
+        r->error = res;
+    }
+}
+
+// open and close a session on a context of its own, both timed on their own
+static void measure_session(const struct suite_options *o,
+                            struct suite_row *open_row,
+                            struct suite_row *close_row) {
+    TEEC_UUID uuid = TA_SEAL_KEY_UUID;
+    struct test_ctx s;
+    TEEC_Result res;
+    uint32_t origin;
+    double start;
+
+    for (long i = -o->warmup; i < o->iterations; i++) {
+        start = now_seconds();
+        res = TEEC_InitializeContext(NULL, &s.ctx);
+        if (res == TEEC_SUCCESS) {
+            res = TEEC_OpenSession(&s.ctx, &s.sess, &uuid, TEEC_LOGIN_PUBLIC,
+                                   NULL, NULL, &origin);
+            if (res != TEEC_SUCCESS)
+                TEEC_FinalizeContext(&s.ctx);
+        }
+        record(open_row, res, now_seconds() - start, i >= 0);
+        if (res != TEEC_SUCCESS)
+            continue;
+        start = now_seconds();
+        TEEC_CloseSession(&s.sess);
+        TEEC_FinalizeContext(&s.ctx);
+        record(close_row, TEEC_SUCCESS, now_seconds() - start, i >= 0);
+    }
+}
+
+static TEEC_Result call(struct test_ctx *ctx, int op, char *id, char *buf,
+                        size_t size) {
+    size_t len = size;
+
+    switch (op) {
+    case SUITE_OP_PING:
+        return ping_secure_session(ctx);
+    case SUITE_OP_WRITE:
+        return write_secure_object(ctx, id, buf, size);
+    case SUITE_OP_READ:
+        return read_secure_object(ctx, id, buf, &len);
+    case SUITE_OP_STAT:
+        return stat_secure_object(ctx, id, &len);
+    default:
+        return delete_secure_object(ctx, id);
+    }
+}
+
+/*
+ * Call op on the objects in turn, warmup times and then iterations times
+ * measured. A deleted object is written again before the next call, outside
+ * of the measurement, so the store keeps its size.
+ */
+static void measure(struct test_ctx *ctx, const struct suite_options *o,
+                    struct suite_row *r, char *buf) {
+    char id[MAX_NAME_LEN];
+    TEEC_Result res;
+    double start;
+
+    for (long i = -o->warmup; i < o->iterations; i++) {
+        object_id(id, (size_t)(i + o->warmup) % (r->objects ? r->objects : 1));
+        start = now_seconds();
+        res = call(ctx, r->op, id, buf, r->size);
+        record(r, res, now_seconds() - start, i >= 0);
+        if (r->op == SUITE_OP_DELETE && res == TEEC_SUCCESS)
+            write_secure_object(ctx, id, buf, r->size);
+    }
+}
+
+static void remove_objects(struct test_ctx *ctx, size_t count) {
+    char id[MAX_NAME_LEN];
+
+    for (size_t i = 0; i < count; i++) {
+        object_id(id, i);
+        delete_secure_object(ctx, id);
+    }
+}
+
+/*
+ * Measure the selected ops and write a row for each to o->out as soon as it
+ * is done. Open, close and ping are measured once, the object ops for every
+ * object count and payload size, on that many objects of that size stored
+ * under SUITE_PREFIX. Failed calls are counted per row and do not stop the
+ * run, sizes the TA cannot hold show up as errors.
+ */
+TEEC_Result suite_run(struct test_ctx *ctx, const struct suite_options *o) {
+    struct suite_row rows[SUITE_OPS];
+    size_t max_size = 1;
+    double *samples = NULL;
+    char *buf = NULL;
+    char id[MAX_NAME_LEN];
+    TEEC_Result res = TEEC_SUCCESS;
+    int first = 1;
+
+    for (size_t i = 0; i < o->nsizes; i++)
+        if (o->sizes[i] > max_size)
+            max_size = o->sizes[i];
+    buf = malloc(max_size);
+    samples = calloc(SUITE_OPS * o->iterations, sizeof(*samples));
+    if (buf == NULL || samples == NULL) {
+        res = TEEC_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
+    for (size_t i = 0; i < max_size; i++)
+        buf[i] = rand();
+
+    print_header(o);
+    memset(rows, 0, sizeof(rows));
+    for (int op = 0; op < SUITE_OPS; op++) {
+        rows[op].op = op;
+        rows[op].samples = samples + op * o->iterations;
+    }
+
+    if (o->ops & (OP(SUITE_OP_OPEN) | OP(SUITE_OP_CLOSE))) {
+        measure_session(o, rows + SUITE_OP_OPEN, rows + SUITE_OP_CLOSE);
+        if (o->ops & OP(SUITE_OP_OPEN))
+            print_row(o, rows + SUITE_OP_OPEN, &first);
+        if (o->ops & OP(SUITE_OP_CLOSE))
+            print_row(o, rows + SUITE_OP_CLOSE, &first);
+    }
+    if (o->ops & OP(SUITE_OP_PING)) {
+        measure(ctx, o, rows + SUITE_OP_PING, buf);
+        print_row(o, rows + SUITE_OP_PING, &first);
+    }
+
+    for (size_t c = 0; c < o->ncounts && (o->ops & OBJECT_OPS); c++) {
+        for (size_t s = 0; s < o->nsizes; s++) {
+            TEEC_Result stored = TEEC_SUCCESS;
+            size_t n;
+
+            // fill the store, a size the TA does not take fails every op
+            for (n = 0; n < o->counts[c]; n++) {
+                object_id(id, n);
+                stored = write_secure_object(ctx, id, buf, o->sizes[s]);
+                if (stored != TEEC_SUCCESS)
+                    break;
+            }
+            for (int op = SUITE_OP_WRITE; op < SUITE_OPS; op++) {
+                struct suite_row *r = rows + op;
+
+                if (!(o->ops & OP(op)))
+                    continue;
+                r->size = o->sizes[s];
+                r->objects = o->counts[c];
+                r->calls = r->errors = r->count = 0;
+                r->error = TEEC_SUCCESS;
+                if (stored == TEEC_SUCCESS) {
+                    measure(ctx, o, r, buf);
+                } else {
+                    r->calls = r->errors = o->iterations;
+                    r->error = stored;
+                }
+                print_row(o, r, &first);
+            }
+            remove_objects(ctx, n);
+        }
+    }
+    if (o->format == SUITE_FORMAT_JSON)
+        fprintf(o->out, "\n  ]\n}\n");
+out:
+    free(samples);
+    free(buf);
+    return res;
+}
@@ -0,0 +1,63 @@
+#ifndef SUITE_H
+#define SUITE_H
+
+#include "storage.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// what seal-key-bench measures, open and close are timed in the same loop
+#define SUITE_OP_OPEN 0 // TEEC_InitializeContext and TEEC_OpenSession
+#define SUITE_OP_CLOSE 1
+#define SUITE_OP_PING 2 // a call into the TA that does nothing there
+#define SUITE_OP_WRITE 3
+#define SUITE_OP_READ 4
+#define SUITE_OP_STAT 5
+#define SUITE_OP_DELETE 6
+#define SUITE_OPS 7
+#define SUITE_ALL_OPS ((1u << SUITE_OPS) - 1)
+
+#define SUITE_FORMAT_TEXT 0
+#define SUITE_FORMAT_CSV 1
+#define SUITE_FORMAT_JSON 2
+
+// storage ids of the objects created for the measurements, apart from keys
+#define SUITE_PREFIX "bench#"
+#define SUITE_MAX_SIZES 32
+#define SUITE_MAX_COUNTS 16
+// calls made before and while measuring each row by default
+#define SUITE_WARMUP 100
+#define SUITE_ITERATIONS 1000
+
+struct suite_options {
+    unsigned int ops; // a bit per SUITE_OP_*
+    size_t sizes[SUITE_MAX_SIZES];
+    size_t nsizes;
+    size_t counts[SUITE_MAX_COUNTS]; // objects in the store while measuring
+    size_t ncounts;
+    long warmup;
+    long iterations;
+    int format;
+    const char *label; // goes into every row, to tell runs apart
+    FILE *out;
+};
+
+// latencies in microseconds and the calls per second they allow
+struct suite_latency {
+    double min;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+    double max;
+    double ops;
+};
+
+int suite_parse_op(const char *name);
+const char *suite_op_name(int op);
+void suite_summarize(double *samples, long count, struct suite_latency *l);
+void suite_put_string(FILE *out, int format, const char *s);
+void suite_print_meta(FILE *out, int format, const char *label);
+TEEC_Result suite_run(struct test_ctx *ctx, const struct suite_options *o);
+
+#endif // !SUITE_H
@@ -0,0 +1,618 @@
+#include "sync.h"
+#include "archive.h"
+#include "debugmacros.h"
+#include "util.h"
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* TA API: UUID and command IDs */
+#include <seal-key_ta.h>
+
+#define HASH_SIZE TA_SEAL_KEY_SYNC_HASH_SIZE
+#define FANOUT TA_SEAL_KEY_SYNC_FANOUT
+// longest storage id of the TA
+#define ID_MAX_LEN 64
+// shared buffer SYNC_LIST fills per call
+#define LIST_BUFFER_SIZE (64 * 1024)
+// walks over stores that change under them before the sync gives up
+#define SYNC_ATTEMPTS 3
+
+struct sync_entry {
+    uint8_t id_len;
+    char id[ID_MAX_LEN];
+    uint8_t hash[HASH_SIZE];
+};
+
+// depth and generation of the summary of one side during a walk
+struct sync_view {
+    uint32_t depth;
+    uint32_t generation;
+    int seen;
+    int changed;
+};
+
+// a growing buffer for lists of records and ids
+struct sync_buf {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+};
+
+static int buf_append(struct sync_buf *b, const void *data, size_t len) {
+    if (b->len + len > b->size) {
+        size_t size = b->size ? b->size : 4096;
+        uint8_t *p;
+
+        while (size < b->len + len)
+            size *= 2;
+        p = realloc(b->data, size);
+        if (p == NULL)
+            return -1;
+        b->data = p;
+        b->size = size;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+int sync_spawn_peer(const char *command, struct sync_peer *peer) {
+    int to[2], from[2];
+
+    memset(peer, 0, sizeof(*peer));
+    if (pipe(to) < 0)
+        return -1;
+    if (pipe(from) < 0) {
+        close(to[0]);
+        close(to[1]);
+        return -1;
+    }
+    peer->pid = fork();
+    if (peer->pid < 0)
+        return -1;
+    if (peer->pid == 0) {
+        dup2(to[0], STDIN_FILENO);
+        dup2(from[1], STDOUT_FILENO);
+        close(to[0]);
+        close(to[1]);
+        close(from[0]);
+        close(from[1]);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+    close(to[0]);
+    close(from[1]);
+    peer->in_fd = from[0];
+    peer->out_fd = to[1];
+    return 0;
+}
+
+// end the session, a spawned peer exits at the end of its input
+int sync_close_peer(struct sync_peer *peer) {
+    int status;
+
+    close(peer->out_fd);
+    close(peer->in_fd);
+    if (peer->pid <= 0)
+        return 0;
+    if (waitpid(peer->pid, &status, 0) < 0 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+static TEEC_Result send_request(struct sync_peer *peer, uint8_t type,
+                                const void *payload, size_t len) {
+    uint8_t hdr[5];
+
+    hdr[0] = type;
+    put_be32(hdr + 1, len);
+    if (write_full(peer->out_fd, hdr, sizeof(hdr)) < 0 ||
+        write_full(peer->out_fd, payload, len) < 0) {
+        ERRO("Failed to send a request to the peer");
+        return TEEC_ERROR_COMMUNICATION;
+    }
+    peer->sent += sizeof(hdr) + len;
+    return TEEC_SUCCESS;
+}
+
+static int send_answer(int fd, TEEC_Result status, const void *data,
+                       size_t len) {
+    uint8_t hdr[8];
+
+    put_be32(hdr, status);
+    put_be32(hdr + 4, status == TEEC_SUCCESS ? len : 0);
+    if (write_full(fd, hdr, sizeof(hdr)) < 0)
+        return -1;
+    if (status == TEEC_SUCCESS && write_full(fd, data, len) < 0)
+        return -1;
+    return 0;
+}
+
+// read an answer of the peer into b, the status is the one of the peer
+static TEEC_Result read_answer(struct sync_peer *peer, struct sync_buf *b) {
+    uint8_t hdr[8];
+    TEEC_Result res;
+    size_t len;
+
+    if (read_full(peer->in_fd, hdr, sizeof(hdr)) != sizeof(hdr)) {
+        ERRO("The peer closed the connection");
+        return TEEC_ERROR_COMMUNICATION;
+    }
+    res = get_be32(hdr);
+    len = get_be32(hdr + 4);
+    if (res != TEEC_SUCCESS) {
+        ERRO("The peer failed with 0x%x", res);
+        return res;
+    }
+    if (len > SYNC_MAX_REQUEST)
+        return TEEC_ERROR_BAD_FORMAT;
+    if (len > b->size) {
+        uint8_t *p = realloc(b->data, len);
+
+        if (p == NULL)
+            return TEEC_ERROR_OUT_OF_MEMORY;
+        b->data = p;
+        b->size = len;
+    }
+    if (read_full(peer->in_fd, b->data, len) != (ssize_t)len) {
+        ERRO("The peer closed the connection");
+        return TEEC_ERROR_COMMUNICATION;
+    }
+    b->len = len;
+    peer->received += sizeof(hdr) + len;
+    return TEEC_SUCCESS;
+}
+
+// check that the summary did not change since the walk first read it
+static void view_seen(struct sync_view *v, uint32_t depth,
+                      uint32_t generation) {
+    if (!v->seen)
+        v->generation = generation;
+    else if (generation != v->generation)
+        v->changed = 1;
+    v->seen = 1;
+    v->depth = depth;
+}
+
+static TEEC_Result local_tree(struct test_ctx *ctx, struct sync_view *v,
+                              uint32_t level, uint32_t first, uint32_t count,
+                              uint8_t *out) {
+    size_t len = count * HASH_SIZE;
+    uint32_t depth = v->depth;
+    uint32_t generation;
+    TEEC_Result res;
+
+    res = tree_secure_nodes(ctx, level, first, &depth, &generation, out,
+                            &len);
+    if (res == TEEC_SUCCESS && len != count * HASH_SIZE)
+        res = TEEC_ERROR_BAD_FORMAT;
+    if (res == TEEC_SUCCESS)
+        view_seen(v, depth, generation);
+    return res;
+}
+
+static TEEC_Result remote_tree(struct sync_peer *peer, struct sync_view *v,
+                               uint32_t level, uint32_t first, uint32_t count,
+                               uint8_t *out) {
+    uint8_t req[10];
+    struct sync_buf b = {0};
+    TEEC_Result res;
+
+    req[0] = level;
+    req[1] = v->depth;
+    put_be32(req + 2, first);
+    put_be32(req + 6, count);
+    res = send_request(peer, SYNC_REQ_TREE, req, sizeof(req));
+    if (res == TEEC_SUCCESS)
+        res = read_answer(peer, &b);
+    if (res == TEEC_SUCCESS && (b.len != 5 + count * HASH_SIZE ||
+                                b.data[0] < TA_SEAL_KEY_SYNC_MIN_LEVELS ||
+                                b.data[0] > TA_SEAL_KEY_SYNC_MAX_LEVELS))
+        res = TEEC_ERROR_BAD_FORMAT;
+    if (res == TEEC_SUCCESS) {
+        view_seen(v, b.data[0], get_be32(b.data + 1));
+        memcpy(out, b.data + 5, count * HASH_SIZE);
+    }
+    free(b.data);
+    return res;
+}
+
+// append the records of all objects in the leaves to b
+static TEEC_Result local_list(struct test_ctx *ctx, struct sync_view *v,
+                              uint8_t *leaves, size_t leaves_len,
+                              struct sync_buf *b) {
+    TEEC_SharedMemory out;
+    TEEC_Result res;
+    uint32_t count = leaves_len / 4;
+    uint32_t leaf = 0, done = 0;
+
+    if (count == 0)
+        return TEEC_SUCCESS;
+    res = alloc_shared_memory(ctx, &out, LIST_BUFFER_SIZE, TEEC_MEM_OUTPUT);
+    if (res != TEEC_SUCCESS)
+        return res;
+    while (leaf < count && res == TEEC_SUCCESS) {
+        uint32_t generation;
+        size_t len;
+
+        res = list_secure_objects(ctx, leaves, leaves_len, v->depth, &leaf,
+                                  &done, &generation, &out, &len);
+        if (res != TEEC_SUCCESS)
+            break;
+        view_seen(v, v->depth, generation);
+        if (buf_append(b, out.buffer, len) < 0)
+            res = TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    TEEC_ReleaseSharedMemory(&out);
+    return res;
+}
+
+// the records of the objects in the leaves at the peer
+static TEEC_Result remote_list(struct sync_peer *peer, struct sync_view *v,
+                               struct sync_buf *leaves, struct sync_buf *b) {
+    struct sync_buf req = {0};
+    uint8_t depth = v->depth;
+    TEEC_Result res = TEEC_SUCCESS;
+
+    if (buf_append(&req, &depth, 1) < 0 ||
+        buf_append(&req, leaves->data, leaves->len) < 0)
+        res = TEEC_ERROR_OUT_OF_MEMORY;
+    if (res == TEEC_SUCCESS)
+        res = send_request(peer, SYNC_REQ_LIST, req.data, req.len);
+    if (res == TEEC_SUCCESS)
+        res = read_answer(peer, b);
+    if (res == TEEC_SUCCESS && b->len < 4)
+        res = TEEC_ERROR_BAD_FORMAT;
+    if (res == TEEC_SUCCESS) {
+        view_seen(v, v->depth, get_be32(b->data));
+        memmove(b->data, b->data + 4, b->len - 4);
+        b->len -= 4;
+    }
+    free(req.data);
+    return res;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    const struct sync_entry *x = a, *y = b;
+    size_t len = x->id_len < y->id_len ? x->id_len : y->id_len;
+    int c = memcmp(x->id, y->id, len);
+
+    return c ? c : x->id_len - y->id_len;
+}
+
+// parse and sort the records of SYNC_LIST
+static TEEC_Result parse_list(struct sync_buf *b, struct sync_entry **entries,
+                              size_t *count) {
+    size_t n = 0;
+
+    *entries = NULL;
+    for (size_t pos = 0; pos < b->len; pos += 1 + b->data[pos] + HASH_SIZE)
+        n++;
+    *entries = calloc(n ? n : 1, sizeof(**entries));
+    if (*entries == NULL)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    n = 0;
+    for (size_t pos = 0; pos < b->len;) {
+        struct sync_entry *e = *entries + n++;
+
+        e->id_len = b->data[pos];
+        if (e->id_len == 0 || e->id_len > ID_MAX_LEN ||
+            pos + 1 + e->id_len + HASH_SIZE > b->len)
+            return TEEC_ERROR_BAD_FORMAT;
+        memcpy(e->id, b->data + pos + 1, e->id_len);
+        memcpy(e->hash, b->data + pos + 1 + e->id_len, HASH_SIZE);
+        pos += 1 + e->id_len + HASH_SIZE;
+    }
+    qsort(*entries, n, sizeof(**entries), entry_cmp);
+    *count = n;
+    return TEEC_SUCCESS;
+}
+
+/*
+ * The leaves in which the two summaries differ as 4 byte leaf numbers,
+ * walked from the root down one level at a time. Only the children of
+ * nodes that differ are read.
+ */
+static TEEC_Result diff_leaves(struct test_ctx *ctx, struct sync_peer *peer,
+                               struct sync_view *lv, struct sync_view *rv,
+                               struct sync_buf *leaves,
+                               struct sync_stats *stats) {
+    uint8_t local[FANOUT * HASH_SIZE], remote[FANOUT * HASH_SIZE];
+    struct sync_buf next = {0};
+    uint8_t node[4] = {0};
+    TEEC_Result res = TEEC_SUCCESS;
+
+    leaves->len = 0;
+    if (buf_append(leaves, node, sizeof(node)) < 0)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    for (uint32_t level = 1; level < lv->depth && res == TEEC_SUCCESS;
+         level++) {
+        struct sync_buf parents = *leaves;
+
+        next.len = 0;
+        for (size_t pos = 0; pos < parents.len && res == TEEC_SUCCESS;
+             pos += 4) {
+            uint32_t first = get_be32(parents.data + pos) * FANOUT;
+
+            res = local_tree(ctx, lv, level, first, FANOUT, local);
+            if (res == TEEC_SUCCESS)
+                res = remote_tree(peer, rv, level, first, FANOUT, remote);
+            for (int i = 0; i < FANOUT && res == TEEC_SUCCESS; i++) {
+                if (memcmp(local + i * HASH_SIZE, remote + i * HASH_SIZE,
+                           HASH_SIZE) == 0)
+                    continue;
+                put_be32(node, first + i);
+                if (buf_append(&next, node, sizeof(node)) < 0)
+                    res = TEEC_ERROR_OUT_OF_MEMORY;
+            }
+        }
+        *leaves = next;
+        next = parents;
+    }
+    free(next.data);
+    stats->leaves = leaves->len / 4;
+    return res;
+}
+
+// compare the roots, at the depth of the views or the one of each side
+static TEEC_Result same_roots(struct test_ctx *ctx, struct sync_peer *peer,
+                              struct sync_view *lv, struct sync_view *rv,
+                              int *same) {
+    uint8_t local[HASH_SIZE], remote[HASH_SIZE];
+    TEEC_Result res;
+
+    res = local_tree(ctx, lv, 0, 0, 1, local);
+    if (res == TEEC_SUCCESS)
+        res = remote_tree(peer, rv, 0, 0, 1, remote);
+    if (res == TEEC_SUCCESS)
+        *same = lv->depth == rv->depth &&
+                memcmp(local, remote, HASH_SIZE) == 0;
+    return res;
+}
+
+/*
+ * Read both roots at the depth the larger store picks, a smaller store
+ * hashes the same objects into that many levels as well
+ */
+static TEEC_Result start_walk(struct test_ctx *ctx, struct sync_peer *peer,
+                              uint32_t depth, struct sync_view *lv,
+                              struct sync_view *rv, int *same) {
+    TEEC_Result res;
+
+    memset(lv, 0, sizeof(*lv));
+    memset(rv, 0, sizeof(*rv));
+    lv->depth = rv->depth = depth;
+    res = same_roots(ctx, peer, lv, rv, same);
+    if (res != TEEC_SUCCESS || lv->depth == rv->depth)
+        return res;
+    depth = lv->depth > rv->depth ? lv->depth : rv->depth;
+    return start_walk(ctx, peer, depth, lv, rv, same);
+}
+
+static int is_id(const struct sync_entry *e, const char *id) {
+    return e->id_len == strlen(id) && memcmp(e->id, id, e->id_len) == 0;
+}
+
+/*
+ * Make the local store a copy of the one of the peer. Only the leaves of
+ * the summaries that differ are listed, only the objects that differ are
+ * copied, sealed with the AES key stored under id on both sides, and local
+ * objects the peer does not have are deleted. When a summary changes while
+ * it is walked, the walk starts over.
+ */
+TEEC_Result sync_pull(struct test_ctx *ctx, char *id, struct sync_peer *peer,
+                      struct sync_stats *stats) {
+    struct sync_buf leaves = {0}, local_buf = {0}, remote_buf = {0};
+    struct sync_buf fetch = {0};
+    struct sync_entry *local = NULL, *remote = NULL;
+    size_t local_count = 0, remote_count = 0;
+    size_t l = 0, r = 0;
+    struct sync_view lv, rv;
+    struct archive_stats archive_stats;
+    double start = now_seconds();
+    TEEC_Result res;
+
+    memset(stats, 0, sizeof(*stats));
+    signal(SIGPIPE, SIG_IGN);
+    for (int attempt = 1;; attempt++) {
+        res = start_walk(ctx, peer, 0, &lv, &rv, &stats->in_sync);
+        if (res != TEEC_SUCCESS || stats->in_sync)
+            goto exit;
+
+        local_buf.len = 0;
+        res = diff_leaves(ctx, peer, &lv, &rv, &leaves, stats);
+        if (res == TEEC_SUCCESS)
+            res = local_list(ctx, &lv, leaves.data, leaves.len, &local_buf);
+        if (res == TEEC_SUCCESS)
+            res = remote_list(peer, &rv, &leaves, &remote_buf);
+        if (res != TEEC_SUCCESS)
+            goto exit;
+        if (!lv.changed && !rv.changed)
+            break;
+        if (attempt == SYNC_ATTEMPTS) {
+            ERRO("The stores kept changing during the sync");
+            res = TEEC_ERROR_BUSY;
+            goto exit;
+        }
+        WARN("A store changed during the sync, comparing them again");
+    }
+    res = parse_list(&local_buf, &local, &local_count);
+    if (res == TEEC_SUCCESS)
+        res = parse_list(&remote_buf, &remote, &remote_count);
+    if (res != TEEC_SUCCESS)
+        goto exit;
+    stats->listed = local_count + remote_count;
+
+    // merge the sorted lists, fetch what is new or changed at the peer
+    while (r < remote_count) {
+        int c = l < local_count ? entry_cmp(local + l, remote + r) : 1;
+
+        if (c < 0) {
+            l++;
+            continue;
+        }
+        if ((c > 0 || memcmp(local[l].hash, remote[r].hash, HASH_SIZE)) &&
+            !is_id(remote + r, id) &&
+            (buf_append(&fetch, &remote[r].id_len, 1) < 0 ||
+             buf_append(&fetch, remote[r].id, remote[r].id_len) < 0)) {
+            res = TEEC_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+        if (c == 0)
+            l++;
+        r++;
+    }
+    if (fetch.len > 0) {
+        res = send_request(peer, SYNC_REQ_FETCH, fetch.data, fetch.len);
+        if (res == TEEC_SUCCESS)
+            res = import_archive(ctx, id, peer->in_fd, 1, &archive_stats);
+        if (res != TEEC_SUCCESS)
+            goto exit;
+        stats->copied = archive_stats.objects;
+        peer->received += archive_stats.bytes;
+    }
+
+    // delete what the peer does not have
+    l = r = 0;
+    while (l < local_count) {
+        int c = r < remote_count ? entry_cmp(local + l, remote + r) : -1;
+
+        if (c > 0) {
+            r++;
+            continue;
+        }
+        if (c < 0 && !is_id(local + l, id)) {
+            char name[ID_MAX_LEN + 1];
+
+            memcpy(name, local[l].id, local[l].id_len);
+            name[local[l].id_len] = '\0';
+            res = delete_secure_object(ctx, name);
+            if (res != TEEC_SUCCESS)
+                goto exit;
+            stats->deleted++;
+        }
+        if (c == 0)
+            r++;
+        l++;
+    }
+
+    res = start_walk(ctx, peer, lv.depth, &lv, &rv, &stats->in_sync);
+exit:
+    stats->sent = peer->sent;
+    stats->received = peer->received;
+    stats->seconds = now_seconds() - start;
+    free(local);
+    free(remote);
+    free(leaves.data);
+    free(local_buf.data);
+    free(remote_buf.data);
+    free(fetch.data);
+    return res;
+}
+
+/*
+ * Answer the requests of sync_pull on in_fd until it ends. Failures of the
+ * summary commands are passed on to the peer, a failed fetch ends the
+ * session as the archive cannot be completed.
+ */
+TEEC_Result sync_serve(struct test_ctx *ctx, char *id, int in_fd,
+                       int out_fd) {
+    struct sync_buf payload = {0}, list = {0};
+    TEEC_Result res = TEEC_SUCCESS;
+
+    signal(SIGPIPE, SIG_IGN);
+    for (;;) {
+        struct archive_stats archive_stats;
+        uint8_t nodes[5 + FANOUT * HASH_SIZE];
+        struct sync_view view = {0};
+        uint8_t hdr[5];
+        ssize_t n;
+        size_t len;
+        int sent;
+
+        n = read_full(in_fd, hdr, sizeof(hdr));
+        if (n == 0)
+            break;
+        len = get_be32(hdr + 1);
+        if (n != sizeof(hdr) || len > SYNC_MAX_REQUEST) {
+            ERRO("Bad request from the peer");
+            res = TEEC_ERROR_BAD_FORMAT;
+            break;
+        }
+        payload.len = 0;
+        if (len > payload.size) {
+            uint8_t *p = realloc(payload.data, len);
+
+            if (p == NULL) {
+                res = TEEC_ERROR_OUT_OF_MEMORY;
+                break;
+            }
+            payload.data = p;
+            payload.size = len;
+        }
+        if (read_full(in_fd, payload.data, len) != (ssize_t)len) {
+            ERRO("Truncated request from the peer");
+            res = TEEC_ERROR_BAD_FORMAT;
+            break;
+        }
+
+        switch (hdr[0]) {
+        case SYNC_REQ_TREE: {
+            uint32_t first = len == 10 ? get_be32(payload.data + 2) : 0;
+            uint32_t count = len == 10 ? get_be32(payload.data + 6) : 0;
+
+            if (len != 10 || count > FANOUT) {
+                res = TEEC_ERROR_BAD_PARAMETERS;
+            } else {
+                view.depth = payload.data[1];
+                res = local_tree(ctx, &view, payload.data[0], first, count,
+                                 nodes + 5);
+            }
+            nodes[0] = view.depth;
+            put_be32(nodes + 1, view.generation);
+            sent = send_answer(out_fd, res, nodes, 5 + count * HASH_SIZE);
+            break;
+        }
+        case SYNC_REQ_LIST:
+            list.len = 0;
+            view.depth = len ? payload.data[0] : 0;
+            if (len == 0 || (len - 1) % 4)
+                res = TEEC_ERROR_BAD_PARAMETERS;
+            else if (buf_append(&list, nodes, 4) < 0)
+                res = TEEC_ERROR_OUT_OF_MEMORY;
+            else
+                res = local_list(ctx, &view, payload.data + 1, len - 1,
+                                 &list);
+            if (res == TEEC_SUCCESS)
+                put_be32(list.data, view.generation);
+            sent = send_answer(out_fd, res, list.data, list.len);
+            break;
+        case SYNC_REQ_FETCH:
+            res = export_ids(ctx, id, payload.data, len, out_fd,
+                             &archive_stats);
+            if (res != TEEC_SUCCESS)
+                goto exit;
+            sent = 0;
+            break;
+        default:
+            ERRO("Unknown request 0x%x from the peer", hdr[0]);
+            res = TEEC_ERROR_BAD_FORMAT;
+            goto exit;
+        }
+        if (sent < 0) {
+            ERRO("Failed to answer the peer");
+            res = TEEC_ERROR_COMMUNICATION;
+            break;
+        }
+        res = TEEC_SUCCESS;
+    }
+exit:
+    free(payload.data);
+    free(list.data);
+    return res;
+}
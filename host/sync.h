@@ -0,0 +1,56 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "storage.h"
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Sync protocol between sync and sync-serve, all integers are big endian.
+ * A request is a type byte, a 4 byte length and the payload:
+ *
+ * SYNC_REQ_TREE  level byte, depth byte, 4 byte first node, 4 byte node
+ *                count, see TA_SEAL_KEY_CMD_SYNC_TREE
+ *                answer: 4 byte status, 4 byte length, depth byte, 4 byte
+ *                generation, the node hashes
+ * SYNC_REQ_LIST  depth byte, leaf numbers of TA_SEAL_KEY_CMD_SYNC_LIST
+ *                answer: 4 byte status, 4 byte length, 4 byte generation,
+ *                the records
+ * SYNC_REQ_FETCH list of ids, each a length byte and the id
+ *                answer: an archive of these objects, see archive.h
+ *
+ * The peer answers until its input ends.
+ */
+#define SYNC_REQ_TREE 'T'
+#define SYNC_REQ_LIST 'L'
+#define SYNC_REQ_FETCH 'F'
+// largest request sync-serve accepts
+#define SYNC_MAX_REQUEST (16 * 1024 * 1024)
+
+struct sync_peer {
+    int in_fd;
+    int out_fd;
+    pid_t pid;
+    size_t sent;
+    size_t received;
+};
+
+struct sync_stats {
+    size_t leaves;
+    size_t listed;
+    size_t copied;
+    size_t deleted;
+    size_t sent;
+    size_t received;
+    int in_sync;
+    double seconds;
+};
+
+int sync_spawn_peer(const char *command, struct sync_peer *peer);
+int sync_close_peer(struct sync_peer *peer);
+TEEC_Result sync_pull(struct test_ctx *ctx, char *id, struct sync_peer *peer,
+                      struct sync_stats *stats);
+TEEC_Result sync_serve(struct test_ctx *ctx, char *id, int in_fd,
+                       int out_fd);
+
+#endif // !SYNC_H
@@ -0,0 +1,194 @@
+#include "trace.h"
+#include "debugmacros.h"
+
+#include <err.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <seal-key_ta.h>
+
+// the tracks of the trace, host threads and the TA sessions they talk to
+#define TRACE_PID_HOST 1
+#define TRACE_PID_TA 2
+
+/*
+ * The TA clock counts whole milliseconds, a reading of n is a time between
+ * n - 1 and n + 1 ms. Below this reading it cannot be told from the switch.
+ */
+#define TRACE_RESOLVED_MS 2
+
+struct span {
+    const char *name;
+    uint64_t start; // ns on CLOCK_MONOTONIC
+    uint64_t end;
+    uint32_t tid;
+    uint32_t pid;
+    uint32_t result; // of TA commands
+};
+
+int trace_enabled;
+
+static const char *trace_file;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct span *spans;
+static size_t nspans, cap;
+static size_t dropped;
+static uint64_t epoch;
+static uint32_t threads;
+static __thread uint32_t thread_id;
+
+static const char *const phase_names[TA_SEAL_KEY_PHASES] = {
+    [TA_SEAL_KEY_PHASE_OPEN] = "open object",
+    [TA_SEAL_KEY_PHASE_IO] = "object io",
+    [TA_SEAL_KEY_PHASE_COPY] = "copy params",
+};
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// a span in microseconds since the start of the trace
+static void put_event(FILE *f, const struct span *s, int first) {
+    fprintf(f,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%" PRIu32
+            ",\"tid\":%" PRIu32 ",\"ts\":%.3f,\"dur\":%.3f",
+            first ? "" : ",", s->name, s->pid, s->tid,
+            (s->start - epoch) / 1e3, (s->end - s->start) / 1e3);
+    if (s->result != 0)
+        fprintf(f, ",\"args\":{\"result\":\"0x%08" PRIx32 "\"}", s->result);
+    fprintf(f, "}");
+}
+
+static void put_process(FILE *f, uint32_t pid, const char *name) {
+    fprintf(f,
+            ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%" PRIu32
+            ",\"args\":{\"name\":\"%s\"}}",
+            pid, name);
+}
+
+// write the Chrome trace JSON, runs at exit
+static void trace_write(void) {
+    FILE *f = fopen(trace_file, "w");
+
+    if (f == NULL) {
+        warn("Failed to open %s", trace_file);
+        return;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    pthread_mutex_lock(&trace_lock);
+    for (size_t i = 0; i < nspans; i++)
+        put_event(f, &spans[i], i == 0);
+    pthread_mutex_unlock(&trace_lock);
+    put_process(f, TRACE_PID_HOST, "host");
+    put_process(f, TRACE_PID_TA, "TA");
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0)
+        warn("Failed to write %s", trace_file);
+    if (dropped > 0)
+        WARN("%zu spans did not fit into the trace", dropped);
+    free(spans);
+}
+
+static void trace_setup(void) {
+    trace_file = getenv(TRACE_ENV);
+    if (trace_file == NULL || *trace_file == '\0')
+        return;
+    epoch = trace_now();
+    if (atexit(trace_write) != 0)
+        errx(1, "Failed to register the trace writer");
+    trace_enabled = 1;
+}
+
+// switch tracing on when TRACE_ENV names a file, only the first call counts
+void trace_init(void) { pthread_once(&trace_once, trace_setup); }
+
+static void add_span(const char *name, uint32_t pid, uint64_t start,
+                     uint64_t end, uint32_t result) {
+    struct span *s;
+
+    if (nspans == cap) {
+        size_t n = cap ? 2 * cap : 1024;
+
+        s = n <= TRACE_MAX_SPANS ? realloc(spans, n * sizeof(*s)) : NULL;
+        if (s == NULL) {
+            dropped++;
+            return;
+        }
+        spans = s;
+        cap = n;
+    }
+    s = &spans[nspans++];
+    s->name = name;
+    s->pid = pid;
+    s->tid = thread_id;
+    s->start = start;
+    s->end = end;
+    s->result = result;
+}
+
+static void claim_thread_id(void) {
+    if (thread_id == 0)
+        thread_id = ++threads;
+}
+
+void trace_span(const char *name, uint64_t start, uint64_t end) {
+    pthread_mutex_lock(&trace_lock);
+    claim_thread_id();
+    add_span(name, TRACE_PID_HOST, start, end, 0);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * A call into the TA with the trace the TA recorded of it. Only the time
+ * spent inside the TA is known, not where it starts, so it is put in the
+ * middle of the call: the world switches in and out are assumed to take the
+ * same time. The TA clock counts milliseconds, its spans are cut to the call.
+ * A TA time too short for that clock is not split into TA and switch time
+ * at all, the call only gets a span that says so.
+ */
+void trace_command(const char *name, uint64_t start, uint64_t end,
+                   const struct ta_seal_key_trace *ta) {
+    uint64_t inside, ta_start, s, e;
+
+    pthread_mutex_lock(&trace_lock);
+    claim_thread_id();
+    add_span(name, TRACE_PID_HOST, start, end, 0);
+    if (ta == NULL || ta->version != TA_SEAL_KEY_TRACE_VERSION ||
+        ta->command == TA_SEAL_KEY_TRACE_NONE)
+        goto out;
+
+    if (ta->time_ms < TRACE_RESOLVED_MS) {
+        add_span(ta->time_ms ? "TA time < 2 ms (unresolved)"
+                             : "TA time < 1 ms (unresolved)",
+                 TRACE_PID_HOST, start, end, ta->result);
+        goto out;
+    }
+    inside = (uint64_t)ta->time_ms * 1000000;
+    if (inside > end - start)
+        inside = end - start;
+    ta_start = start + (end - start - inside) / 2;
+    add_span("switch in", TRACE_PID_HOST, start, ta_start, 0);
+    add_span(name, TRACE_PID_TA, ta_start, ta_start + inside, ta->result);
+    for (uint32_t i = 0; i < ta->spans && i < TA_SEAL_KEY_TRACE_SPANS; i++) {
+        const struct ta_seal_key_span *p = &ta->span[i];
+
+        if (p->phase >= TA_SEAL_KEY_PHASES)
+            continue;
+        s = ta_start + (uint64_t)p->start_ms * 1000000;
+        e = ta_start + (uint64_t)p->end_ms * 1000000;
+        if (e > ta_start + inside)
+            e = ta_start + inside;
+        if (s < e)
+            add_span(phase_names[p->phase], TRACE_PID_TA, s, e, 0);
+    }
+    add_span("switch out", TRACE_PID_HOST, ta_start + inside, end, 0);
+out:
+    pthread_mutex_unlock(&trace_lock);
+}
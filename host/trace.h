@@ -0,0 +1,32 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// file the trace is written to at exit, tracing is off when it is not set
+#define TRACE_ENV "SEAL_KEY_TRACE"
+// spans kept in memory, later ones are dropped
+#define TRACE_MAX_SPANS (1024 * 1024)
+
+struct ta_seal_key_trace;
+
+extern int trace_enabled;
+
+void trace_init(void);
+uint64_t trace_now(void);
+void trace_span(const char *name, uint64_t start, uint64_t end);
+void trace_command(const char *name, uint64_t start, uint64_t end,
+                   const struct ta_seal_key_trace *ta);
+
+// the start of a span, 0 and no clock read when tracing is off
+static inline uint64_t trace_start(void) {
+    return trace_enabled ? trace_now() : 0;
+}
+
+// close the span opened with trace_start
+static inline void trace_end(const char *name, uint64_t start) {
+    if (trace_enabled)
+        trace_span(name, start, trace_now());
+}
+
+#endif // !TRACE_H
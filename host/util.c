@@ -0,0 +1,74 @@
+#include "util.h"
+#include "codec.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// read until len bytes are read or the input ends, pipes return short reads
+ssize_t read_full(int fd, void *buf, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = read(fd, (char *)buf + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+int write_full(int fd, const void *buf, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = write(fd, (const char *)buf + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+uint32_t get_be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+}
+
+// out has to hold 2 * len characters, it is not terminated
+void hex_encode(const uint8_t *in, size_t len, char *out) {
+    codec_encode(CODEC_HEX, in, len, out);
+}
+
+// returns the number of bytes decoded or -1 if in is not valid hex
+ssize_t hex_decode(const char *in, size_t len, uint8_t *out, size_t out_len) {
+    if (len % 2 || len / 2 > out_len)
+        return -1;
+    return codec_decode(CODEC_HEX, in, len, out);
+}
+
+// memset() through a volatile pointer so the compiler cannot drop it
+static void *(*const volatile wipe_memset)(void *, int, size_t) = memset;
+
+// clear secrets before the memory is released or reused
+void wipe(void *buf, size_t len) { wipe_memset(buf, 0, len); }
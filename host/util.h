@@ -0,0 +1,17 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+double now_seconds(void);
+ssize_t read_full(int fd, void *buf, size_t len);
+int write_full(int fd, const void *buf, size_t len);
+void put_be32(uint8_t *p, uint32_t v);
+uint32_t get_be32(const uint8_t *p);
+void hex_encode(const uint8_t *in, size_t len, char *out);
+ssize_t hex_decode(const char *in, size_t len, uint8_t *out, size_t out_len);
+void wipe(void *buf, size_t len);
+
+#endif // !UTIL_H
@@ -0,0 +1,649 @@
+#include "workload.h"
+#include "constants.h"
+#include "debugmacros.h"
+#include "suite.h"
+#include "util.h"
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// longest line of a workload spec
+#define SPEC_LINE_SIZE 256
+
+#define ROLE_MIX 0
+#define ROLE_ROTATE 1
+#define ROLE_IMPORT 2
+
+static const char *op_names[WORKLOAD_OPS] = {
+    "read", "write", "delete", "rotate", "import",
+};
+
+static const char *distributions[] = {"uniform", "zipfian", "latest"};
+
+/*
+ * Zipfian ranks after Gray et al., "Quickly generating billion-record
+ * synthetic databases", as YCSB draws them: rank 0 is the most popular one
+ * and theta sets how much more popular it is than the others.
+ */
+struct zipf {
+    double n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double half_pow; // 0.5^theta, the share of rank 1
+};
+
+struct samples {
+    double *v; // seconds
+    long count;
+    long size;
+};
+
+struct load_run {
+    const struct workload *w;
+    pthread_mutex_t lock;
+    size_t keys; // records and the keys imported so far
+    size_t next; // the next key loaded or removed
+    int removing;
+    double cdf[WORKLOAD_MIX_OPS];
+    struct zipf zipf;
+    double start;
+    double end;
+};
+
+struct load_worker {
+    struct load_run *r;
+    struct test_ctx *ctx;
+    struct test_ctx own_ctx;
+    pthread_t thread;
+    int role;
+    unsigned int index; // among the workers of the mix
+    uint64_t random;
+    char *buf;
+    struct samples samples[WORKLOAD_OPS];
+    long errors[WORKLOAD_OPS];
+    long misses[WORKLOAD_OPS];
+    TEEC_Result error[WORKLOAD_OPS];
+};
+
+void workload_defaults(struct workload *w) {
+    memset(w, 0, sizeof(*w));
+    w->records = 1000;
+    w->mix[WORKLOAD_READ] = 0.95;
+    w->mix[WORKLOAD_WRITE] = 0.05;
+    w->distribution = WORKLOAD_ZIPFIAN;
+    w->zipf = 0.99;
+    w->min_size = w->max_size = 32;
+    w->threads = 1;
+    w->duration = 10;
+    w->load = 1;
+}
+
+static int parse_number(const char *value, double min, double max,
+                        double *out) {
+    char *end;
+
+    errno = 0;
+    *out = strtod(value, &end);
+    return errno || end == value || *end || *out < min || *out > max ? -1 : 0;
+}
+
+// one key = value line of a spec
+static int parse_setting(struct workload *w, const char *key,
+                         const char *value) {
+    double d;
+    char *end;
+
+    if (strcmp(key, "distribution") == 0) {
+        for (int i = 0; i < 3; i++) {
+            if (strcmp(value, distributions[i]) == 0) {
+                w->distribution = i;
+                return 0;
+            }
+        }
+        return -1;
+    }
+    if (strcmp(key, "size") == 0) {
+        w->min_size = w->max_size = strtoul(value, &end, 10);
+        if (*end == '-')
+            w->max_size = strtoul(end + 1, &end, 10);
+        return *end || w->min_size < 1 || w->max_size < w->min_size ||
+                       w->max_size > WORKLOAD_MAX_SIZE
+                   ? -1
+                   : 0;
+    }
+    for (int op = 0; op < WORKLOAD_MIX_OPS; op++)
+        if (strcmp(key, op_names[op]) == 0)
+            return parse_number(value, 0, 1e9, w->mix + op);
+    if (strcmp(key, "zipf") == 0)
+        return parse_number(value, 0.01, 0.999, &w->zipf);
+    if (strcmp(key, "rate") == 0)
+        return parse_number(value, 0, 1e9, &w->rate);
+    if (strcmp(key, "duration") == 0)
+        return parse_number(value, 0.001, 1e9, &w->duration);
+    if (strcmp(key, "rotate_every") == 0)
+        return parse_number(value, 0, 1e9, &w->rotate_every);
+    if (strcmp(key, "import_rate") == 0)
+        return parse_number(value, 0, 1e9, &w->import_rate);
+    if (parse_number(value, 0, 1e12, &d) < 0 || d != (size_t)d)
+        return -1;
+    if (strcmp(key, "records") == 0 && d >= 1)
+        w->records = d;
+    else if (strcmp(key, "threads") == 0 && d >= 1 && d <= MAX_WORKERS)
+        w->threads = d;
+    else if (strcmp(key, "rotate_keys") == 0)
+        w->rotate_keys = d;
+    else if (strcmp(key, "load") == 0 && d <= 1)
+        w->load = d;
+    else if (strcmp(key, "keep") == 0 && d <= 1)
+        w->keep = d;
+    else
+        return -1;
+    return 0;
+}
+
+/*
+ * Read a workload spec, a key = value setting per line, # starts a comment.
+ * Settings that are not given keep the values of workload_defaults.
+ */
+int workload_parse(const char *file, struct workload *w) {
+    char line[SPEC_LINE_SIZE];
+    FILE *f = fopen(file, "r");
+    int n = 0;
+
+    if (f == NULL) {
+        ERRO("Failed to open %s", file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *key, *value, *end;
+
+        n++;
+        line[strcspn(line, "#\n")] = '\0';
+        key = line + strspn(line, " \t");
+        if (*key == '\0')
+            continue;
+        value = strchr(key, '=');
+        if (value == NULL) {
+            ERRO("%s:%d: expected key = value", file, n);
+            fclose(f);
+            return -1;
+        }
+        // trim both sides of the key and the value
+        for (end = value; end > key && (end[-1] == ' ' || end[-1] == '\t');)
+            end--;
+        *end = '\0';
+        value += 1 + strspn(value + 1, " \t");
+        for (end = value + strlen(value);
+             end > value && (end[-1] == ' ' || end[-1] == '\t');)
+            end--;
+        *end = '\0';
+        if (parse_setting(w, key, value) < 0) {
+            ERRO("%s:%d: bad setting %s = %s", file, n, key, value);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    if (w->mix[0] + w->mix[1] + w->mix[2] <= 0) {
+        ERRO("%s: read, write and delete are all 0", file);
+        return -1;
+    }
+    return 0;
+}
+
+// xorshift64*, a generator per worker
+static uint64_t next_random(uint64_t *s) {
+    uint64_t x = *s;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static double random_unit(uint64_t *s) {
+    return (next_random(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void zipf_init(struct zipf *z, size_t n, double theta) {
+    double zeta2 = 1 + pow(0.5, theta);
+
+    z->n = n;
+    z->theta = theta;
+    z->zetan = 0;
+    for (size_t i = 1; i <= n; i++)
+        z->zetan += 1 / pow(i, theta);
+    z->alpha = 1 / (1 - theta);
+    z->eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / z->zetan);
+    z->half_pow = pow(0.5, theta);
+}
+
+static size_t zipf_next(const struct zipf *z, uint64_t *s) {
+    double u = random_unit(s);
+    double uz = u * z->zetan;
+    size_t rank;
+
+    if (uz < 1)
+        return 0;
+    if (uz < 1 + z->half_pow)
+        return 1;
+    rank = z->n * pow(z->eta * u - z->eta + 1, z->alpha);
+    return rank < z->n ? rank : z->n - 1;
+}
+
+// FNV-1a of the rank, spreads the hot keys over the store as YCSB does
+static size_t scramble(size_t rank, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (int i = 0; i < 8; i++) {
+        h ^= (rank >> (8 * i)) & 0xff;
+        h *= 0x100000001b3ULL;
+    }
+    return h % n;
+}
+
+static size_t current_keys(struct load_run *r) {
+    size_t keys;
+
+    pthread_mutex_lock(&r->lock);
+    keys = r->keys;
+    pthread_mutex_unlock(&r->lock);
+    return keys;
+}
+
+static size_t pick_key(struct load_worker *wk) {
+    struct load_run *r = wk->r;
+    size_t keys = current_keys(r);
+
+    switch (r->w->distribution) {
+    case WORKLOAD_ZIPFIAN:
+        return scramble(zipf_next(&r->zipf, &wk->random), r->w->records);
+    case WORKLOAD_LATEST:
+        return keys - 1 - zipf_next(&r->zipf, &wk->random);
+    default:
+        return next_random(&wk->random) % keys;
+    }
+}
+
+static void key_id(char *id, size_t key) {
+    snprintf(id, MAX_NAME_LEN, "%s%zu", WORKLOAD_PREFIX, key);
+}
+
+static size_t pick_size(struct load_worker *wk) {
+    const struct workload *w = wk->r->w;
+
+    return w->min_size +
+           next_random(&wk->random) % (w->max_size - w->min_size + 1);
+}
+
+static void sleep_until(double t) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR)
+        ;
+}
+
+static void record(struct load_worker *wk, int op, TEEC_Result res,
+                   double seconds) {
+    struct samples *s = wk->samples + op;
+
+    if (res == TEEC_ERROR_ITEM_NOT_FOUND) {
+        wk->misses[op]++;
+    } else if (res != TEEC_SUCCESS) {
+        if (wk->errors[op]++ == 0)
+            wk->error[op] = res;
+        return;
+    }
+    if (s->count == s->size) {
+        long size = s->size ? 2 * s->size : 4096;
+        double *v = realloc(s->v, size * sizeof(*v));
+
+        // out of memory, the latency is lost but the call still counts
+        if (v == NULL)
+            return;
+        s->v = v;
+        s->size = size;
+    }
+    s->v[s->count++] = seconds;
+}
+
+static TEEC_Result call(struct load_worker *wk, int op, size_t key) {
+    const struct workload *w = wk->r->w;
+    char id[MAX_NAME_LEN];
+    size_t len = w->max_size;
+
+    key_id(id, key);
+    switch (op) {
+    case WORKLOAD_READ:
+        return read_secure_object(wk->ctx, id, wk->buf + w->max_size, &len);
+    case WORKLOAD_DELETE:
+        return delete_secure_object(wk->ctx, id);
+    default:
+        return write_secure_object(wk->ctx, id, wk->buf, pick_size(wk));
+    }
+}
+
+/*
+ * The mix, open loop when a rate is given: the calls of a worker are planned
+ * at fixed intervals and the latency is taken from the planned start, so a
+ * slow call delays the ones behind it and they show as slow as well instead
+ * of not being sent. Closed loop each call starts when the last one is done.
+ */
+static void run_mix(struct load_worker *wk) {
+    struct load_run *r = wk->r;
+    const struct workload *w = r->w;
+    double interval = w->rate > 0 ? w->threads / w->rate : 0;
+
+    for (long k = 0;; k++) {
+        double u = random_unit(&wk->random), planned, begin;
+        double now = now_seconds();
+        int op = u < r->cdf[0]   ? WORKLOAD_READ
+                 : u < r->cdf[1] ? WORKLOAD_WRITE
+                                 : WORKLOAD_DELETE;
+        TEEC_Result res;
+
+        if (interval > 0) {
+            planned = r->start + wk->index / w->rate + k * interval;
+            if (planned >= r->end)
+                break;
+            if (planned > now)
+                sleep_until(planned);
+            begin = planned;
+        } else {
+            if (now >= r->end)
+                break;
+            begin = now;
+        }
+        res = call(wk, op, pick_key(wk));
+        record(wk, op, res, now_seconds() - begin);
+    }
+}
+
+// every rotate_every seconds rewrite the next rotate_keys keys at once
+static void run_rotate(struct load_worker *wk) {
+    struct load_run *r = wk->r;
+    const struct workload *w = r->w;
+    size_t cursor = 0;
+
+    for (long k = 1; r->start + k * w->rotate_every < r->end; k++) {
+        sleep_until(r->start + k * w->rotate_every);
+        for (size_t i = 0; i < w->rotate_keys; i++) {
+            double begin = now_seconds();
+            TEEC_Result res =
+                call(wk, WORKLOAD_ROTATE, cursor++ % current_keys(r));
+
+            record(wk, WORKLOAD_ROTATE, res, now_seconds() - begin);
+        }
+    }
+}
+
+// add new keys at import_rate, open loop like the mix
+static void run_import(struct load_worker *wk) {
+    struct load_run *r = wk->r;
+    double interval = 1 / r->w->import_rate;
+
+    for (long k = 0; r->start + k * interval < r->end; k++) {
+        double planned = r->start + k * interval;
+        size_t key = current_keys(r);
+        TEEC_Result res;
+
+        if (planned > now_seconds())
+            sleep_until(planned);
+        res = call(wk, WORKLOAD_IMPORT, key);
+        record(wk, WORKLOAD_IMPORT, res, now_seconds() - planned);
+        if (res == TEEC_SUCCESS) {
+            pthread_mutex_lock(&r->lock);
+            r->keys++;
+            pthread_mutex_unlock(&r->lock);
+        }
+    }
+}
+
+static void *worker_run(void *arg) {
+    struct load_worker *wk = arg;
+
+    if (wk->role == ROLE_ROTATE)
+        run_rotate(wk);
+    else if (wk->role == ROLE_IMPORT)
+        run_import(wk);
+    else
+        run_mix(wk);
+    return NULL;
+}
+
+// store the records, or remove every key, spread over the mix workers
+static void *worker_fill(void *arg) {
+    struct load_worker *wk = arg;
+    struct load_run *r = wk->r;
+    char id[MAX_NAME_LEN];
+
+    for (;;) {
+        size_t key;
+
+        pthread_mutex_lock(&r->lock);
+        key = r->next++;
+        pthread_mutex_unlock(&r->lock);
+        if (key >= r->keys)
+            break;
+        key_id(id, key);
+        if (r->removing)
+            delete_secure_object(wk->ctx, id);
+        else
+            write_secure_object(wk->ctx, id, wk->buf, pick_size(wk));
+    }
+    return NULL;
+}
+
+// run fn on the first n workers, the caller is worker 0
+static void run_workers(struct load_worker *w, unsigned int n,
+                        void *(*fn)(void *)) {
+    unsigned int started;
+
+    for (started = 1; started < n; started++) {
+        if (pthread_create(&w[started].thread, NULL, fn, w + started)) {
+            ERRO("Failed to start worker %u", started);
+            break;
+        }
+    }
+    fn(w);
+    for (unsigned int i = 1; i < started; i++)
+        pthread_join(w[i].thread, NULL);
+}
+
+static void print_results(const struct workload *w, struct load_worker *wk,
+                          unsigned int workers, double elapsed, FILE *out,
+                          int format, const char *label) {
+    long done = 0;
+    int first = 1;
+
+    if (format == SUITE_FORMAT_CSV) {
+        fprintf(out, "label,op,calls,errors,misses,error,ops_per_s,mean_us,"
+                     "p50_us,p90_us,p99_us,p999_us,max_us\n");
+    } else if (format == SUITE_FORMAT_JSON) {
+        suite_print_meta(out, format, label);
+        fprintf(out,
+                ",\n  \"workload\": {\"records\": %zu, \"read\": %g, "
+                "\"write\": %g, \"delete\": %g, \"distribution\": \"%s\", "
+                "\"zipf\": %g, \"min_size\": %zu, \"max_size\": %zu, "
+                "\"threads\": %u, \"rate\": %g, \"duration\": %g, "
+                "\"rotate_every\": %g, \"rotate_keys\": %zu, "
+                "\"import_rate\": %g},\n  \"results\": [",
+                w->records, w->mix[0], w->mix[1], w->mix[2],
+                distributions[w->distribution], w->zipf, w->min_size,
+                w->max_size, w->threads, w->rate, w->duration,
+                w->rotate_every, w->rotate_keys, w->import_rate);
+    } else {
+        suite_print_meta(out, format, label);
+        fprintf(out, ", %zu records, %s, %u threads, %s for %g s\n",
+                w->records, distributions[w->distribution], w->threads,
+                w->rate > 0 ? "open loop" : "closed loop", w->duration);
+        fprintf(out, "%-7s %9s %7s %7s %10s %10s %10s %10s %10s %10s\n",
+                "op", "calls", "errors", "misses", "ops/s", "mean us",
+                "p50 us", "p99 us", "p99.9 us", "max us");
+    }
+
+    for (int op = 0; op < WORKLOAD_OPS; op++) {
+        struct suite_latency l;
+        struct samples all = {NULL, 0, 0};
+        long errors = 0, misses = 0, calls;
+        TEEC_Result error = TEEC_SUCCESS;
+
+        for (unsigned int i = 0; i < workers; i++) {
+            all.size += wk[i].samples[op].count;
+            errors += wk[i].errors[op];
+            misses += wk[i].misses[op];
+            if (error == TEEC_SUCCESS)
+                error = wk[i].error[op];
+        }
+        calls = all.size + errors;
+        if (calls == 0)
+            continue;
+        all.v = malloc((all.size ? all.size : 1) * sizeof(*all.v));
+        for (unsigned int i = 0; i < workers && all.v != NULL; i++) {
+            memcpy(all.v + all.count, wk[i].samples[op].v,
+                   wk[i].samples[op].count * sizeof(*all.v));
+            all.count += wk[i].samples[op].count;
+        }
+        suite_summarize(all.v, all.count, &l);
+        free(all.v);
+        if (op < WORKLOAD_MIX_OPS)
+            done += all.size;
+
+        if (format == SUITE_FORMAT_CSV) {
+            suite_put_string(out, format, label);
+            fprintf(out,
+                    ",%s,%ld,%ld,%ld,0x%x,%.0f,%.2f,%.2f,%.2f,%.2f,%.2f,"
+                    "%.2f\n",
+                    op_names[op], calls, errors, misses, error,
+                    all.size / elapsed, l.mean, l.p50, l.p90, l.p99, l.p999,
+                    l.max);
+        } else if (format == SUITE_FORMAT_JSON) {
+            fprintf(out,
+                    "%s\n    {\"op\": \"%s\", \"calls\": %ld, \"errors\": "
+                    "%ld, \"misses\": %ld, \"error\": \"0x%x\", "
+                    "\"ops_per_s\": %.0f, \"mean_us\": %.2f, \"p50_us\": "
+                    "%.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, "
+                    "\"p999_us\": %.2f, \"max_us\": %.2f}",
+                    first ? "" : ",", op_names[op], calls, errors, misses,
+                    error, all.size / elapsed, l.mean, l.p50, l.p90, l.p99,
+                    l.p999, l.max);
+        } else {
+            fprintf(out,
+                    "%-7s %9ld %7ld %7ld %10.0f %10.1f %10.1f %10.1f %10.1f "
+                    "%10.1f",
+                    op_names[op], calls, errors, misses, all.size / elapsed,
+                    l.mean, l.p50, l.p99, l.p999, l.max);
+            if (errors)
+                fprintf(out, "  0x%x", error);
+            fputc('\n', out);
+        }
+        first = 0;
+    }
+
+    if (format == SUITE_FORMAT_JSON)
+        fprintf(out,
+                "\n  ],\n  \"target_ops_per_s\": %.0f,\n"
+                "  \"achieved_ops_per_s\": %.0f\n}\n",
+                w->rate, done / elapsed);
+    else if (format == SUITE_FORMAT_TEXT)
+        fprintf(out, "# mix: %.0f ops/s, target %.0f ops/s\n", done / elapsed,
+                w->rate);
+}
+
+/*
+ * Run the workload w on a TA session per thread of the mix and one each for
+ * the rotation bursts and the import, and write the throughput and latency
+ * of every op to out. Reads and deletes of keys that are not there, after a
+ * delete of the mix, count as misses and not as errors.
+ */
+TEEC_Result workload_run(struct test_ctx *ctx, const struct workload *w,
+                         FILE *out, int format, const char *label) {
+    int rotate = w->rotate_every > 0 && w->rotate_keys > 0;
+    unsigned int workers = w->threads + rotate + (w->import_rate > 0);
+    struct load_worker *wk;
+    struct load_run r;
+    double sum = w->mix[0] + w->mix[1] + w->mix[2];
+    TEEC_Result res = TEEC_SUCCESS;
+    double elapsed;
+
+    wk = calloc(workers, sizeof(*wk));
+    if (wk == NULL)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+
+    memset(&r, 0, sizeof(r));
+    r.w = w;
+    r.keys = w->records;
+    r.cdf[0] = w->mix[0] / sum;
+    r.cdf[1] = (w->mix[0] + w->mix[1]) / sum;
+    r.cdf[2] = 1;
+    if (w->distribution != WORKLOAD_UNIFORM)
+        zipf_init(&r.zipf, w->records, w->zipf);
+    pthread_mutex_init(&r.lock, NULL);
+
+    for (unsigned int i = 0; i < workers; i++) {
+        wk[i].r = &r;
+        wk[i].index = i;
+        wk[i].role = i < w->threads                ? ROLE_MIX
+                     : i == w->threads && rotate ? ROLE_ROTATE
+                                                 : ROLE_IMPORT;
+        wk[i].random = 0x9e3779b97f4a7c15ULL * (i + 1) ^ (uint64_t)time(NULL);
+        wk[i].buf = malloc(2 * w->max_size);
+        if (wk[i].buf == NULL) {
+            ERRO("Failed to allocate the buffers of worker %u", i);
+            res = TEEC_ERROR_OUT_OF_MEMORY;
+            workers = i;
+            break;
+        }
+        for (size_t j = 0; j < w->max_size; j++)
+            wk[i].buf[j] = next_random(&wk[i].random);
+        if (i == 0) {
+            wk[i].ctx = ctx;
+        } else {
+            prepare_tee_session(&wk[i].own_ctx);
+            wk[i].ctx = &wk[i].own_ctx;
+        }
+    }
+
+    if (res != TEEC_SUCCESS)
+        goto out;
+
+    if (w->load) {
+        INFO("Store %zu records", w->records);
+        run_workers(wk, w->threads, worker_fill);
+    }
+    // start together a little later, after all threads are up
+    r.start = now_seconds() + 0.01;
+    r.end = r.start + w->duration;
+    run_workers(wk, workers, worker_run);
+    elapsed = now_seconds() - r.start;
+
+    print_results(w, wk, workers, elapsed, out, format, label);
+    fflush(out);
+
+    if (!w->keep) {
+        r.next = 0;
+        r.removing = 1;
+        run_workers(wk, w->threads, worker_fill);
+    }
+out:
+    for (unsigned int i = 0; i < workers; i++) {
+        for (int op = 0; op < WORKLOAD_OPS; op++)
+            free(wk[i].samples[op].v);
+        free(wk[i].buf);
+        if (wk[i].ctx == &wk[i].own_ctx)
+            terminate_tee_session(&wk[i].own_ctx);
+    }
+    pthread_mutex_destroy(&r.lock);
+    free(wk);
+    return res;
+}
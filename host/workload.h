@@ -0,0 +1,48 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "storage.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// the ops of a workload, rotate and import run beside the mix
+#define WORKLOAD_READ 0
+#define WORKLOAD_WRITE 1
+#define WORKLOAD_DELETE 2
+#define WORKLOAD_ROTATE 3 // the keys rewritten by a rotation burst
+#define WORKLOAD_IMPORT 4 // the keys added by the background import
+#define WORKLOAD_OPS 5
+#define WORKLOAD_MIX_OPS 3
+
+// how the keys of the mix are picked
+#define WORKLOAD_UNIFORM 0
+#define WORKLOAD_ZIPFIAN 1 // a few keys are hot, spread over the store
+#define WORKLOAD_LATEST 2  // the most recently imported keys are hot
+
+// storage ids of the keys of a workload
+#define WORKLOAD_PREFIX "load#"
+#define WORKLOAD_MAX_SIZE (64 * 1024)
+
+struct workload {
+    size_t records; // keys in the store when the run starts
+    double mix[WORKLOAD_MIX_OPS]; // proportions of read, write and delete
+    int distribution;
+    double zipf; // the skew of zipfian and latest, between 0 and 1
+    size_t min_size;
+    size_t max_size;
+    unsigned int threads;
+    double rate; // ops per second over all threads, 0 runs closed loop
+    double duration;
+    double rotate_every; // seconds between rotation bursts, 0 for none
+    size_t rotate_keys;  // keys rewritten by a burst
+    double import_rate;  // keys per second added in the background
+    int load;            // write the records before the run
+    int keep;            // leave the keys in the store after the run
+};
+
+void workload_defaults(struct workload *w);
+int workload_parse(const char *file, struct workload *w);
+TEEC_Result workload_run(struct test_ctx *ctx, const struct workload *w,
+                         FILE *out, int format, const char *label);
+
+#endif // !WORKLOAD_H
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Measure how fast export and import stream the whole store.
+#
+# usage: archive-bench.sh <first id> [counts...]
+#
+# <first> - 1 is generated as the archive key and deleted again, keys
+# <first> onwards are generated as needed. The archive holds every key in
+# the store and import overwrites them, so run this against a scratch store.
+set -e
+
+FIRST=${1:?usage: $0 <first id> [counts...]}
+shift
+[ $# -gt 0 ] || set -- 10000 100000
+SEAL_KEY=${SEAL_KEY:-seal-key}
+KEY=$((FIRST - 1))
+ARCHIVE=${ARCHIVE:-/tmp/seal-key-bench.skar}
+HAVE=0
+
+keys() {
+    sed -n 's/.*(\([0-9]*\) keys\/s.*/\1/p'
+}
+
+mbs() {
+    sed -n 's/.* \([0-9.]*\) MB\/s).*/\1/p'
+}
+
+"$SEAL_KEY" generate "$KEY" -n 1 >/dev/null 2>&1
+printf "%-8s %14s %14s %14s %14s\n" keys "export keys/s" "export MB/s" \
+    "import keys/s" "import MB/s"
+for n in "$@"; do
+    if [ "$n" -gt "$HAVE" ]; then
+        "$SEAL_KEY" generate $((FIRST + HAVE)) -n $((n - HAVE)) -r 4096 \
+            >/dev/null 2>&1
+        HAVE=$n
+    fi
+    e=$("$SEAL_KEY" export "$KEY" -o "$ARCHIVE" 2>&1)
+    i=$("$SEAL_KEY" import "$KEY" -i "$ARCHIVE" -w 2>&1)
+    printf "%-8s %14s %14s %14s %14s\n" "$n" "$(echo "$e" | keys)" \
+        "$(echo "$e" | mbs)" "$(echo "$i" | keys)" "$(echo "$i" | mbs)"
+done
+"$SEAL_KEY" del-key "$KEY" >/dev/null 2>&1
+rm -f "$ARCHIVE"
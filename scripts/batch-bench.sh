@@ -0,0 +1,34 @@
+#!/bin/sh
+# Compare sealing records one call at a time with sealing them in batches.
+#
+# usage: batch-bench.sh <key id> [records] [record size]
+#
+# The key has to exist already (seal-key set-key <key id> -k ...). A batch
+# of 1 costs one world switch per record, which is what sealing records one
+# at a time costs.
+set -e
+
+ID=${1:?usage: $0 <key id> [records] [record size]}
+COUNT=${2:-20000}
+SIZE=${3:-300}
+SEAL_KEY=${SEAL_KEY:-seal-key}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# printable records of SIZE bytes, one per line
+head -c $((COUNT * SIZE * 3 / 4)) /dev/urandom | base64 -w "$SIZE" |
+    head -n "$COUNT" > "$TMP/in"
+
+rate() {
+    sed -n 's/.*(\(.*\) records\/s).*/\1/p'
+}
+
+printf "%-8s %14s %14s\n" batch "seal rec/s" "unseal rec/s"
+for b in 1 8 64 256 1024 4096; do
+    s=$("$SEAL_KEY" encrypt-seal "$ID" -i "$TMP/in" -o "$TMP/sealed" -r "$b" \
+        2>&1 | rate)
+    u=$("$SEAL_KEY" decrypt-unseal "$ID" -i "$TMP/sealed" -o "$TMP/out" \
+        -r "$b" 2>&1 | rate)
+    cmp -s "$TMP/in" "$TMP/out"
+    printf "%-8s %14s %14s\n" "$b" "$s" "$u"
+done
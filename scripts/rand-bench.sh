@@ -0,0 +1,24 @@
+#!/bin/sh
+# Measure TEE randomness served through the buffered reader.
+#
+# usage: rand-bench.sh [bytes]
+#
+# A block of 32 bytes costs one world switch per request, which is what
+# fetching randomness from the TA for every request costs. With larger
+# blocks the requests are served from the host buffer and should not wait.
+set -e
+
+BYTES=${1:-16000000}
+SEAL_KEY=${SEAL_KEY:-seal-key}
+
+printf "%-8s %-8s %10s %12s %8s\n" request block "MB/s" "latency us" waits
+for s in 32 4096; do
+    for b in 32 4096 262144 1048576; do
+        [ "$b" -lt "$s" ] && continue
+        out=$("$SEAL_KEY" rand "$BYTES" -s "$s" -b "$b" -o /dev/null 2>&1)
+        mbs=$(echo "$out" | sed -n 's/.*(\(.*\) MB\/s).*/\1/p')
+        lat=$(echo "$out" | sed -n 's/.*latency \(.*\) us average.*/\1/p')
+        waits=$(echo "$out" | sed -n 's/.* \([0-9]*\) requests waited.*/\1/p')
+        printf "%-8s %-8s %10s %12s %8s\n" "$s" "$b" "$mbs" "$lat" "$waits"
+    done
+done
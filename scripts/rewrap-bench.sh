@@ -0,0 +1,40 @@
+#!/bin/sh
+# Measure how fast rewrap moves the stored keys between wrapping keys.
+#
+# usage: rewrap-bench.sh <first id> [counts...]
+#
+# Keys <first> onwards are generated as needed, <first> - 1 and <first> - 2
+# are used as key encryption keys and deleted again. Every other key in the
+# store is rewrapped as well, so run this against a scratch store.
+set -e
+
+FIRST=${1:?usage: $0 <first id> [counts...]}
+shift
+[ $# -gt 0 ] || set -- 10000 100000
+SEAL_KEY=${SEAL_KEY:-seal-key}
+KEK_A=$((FIRST - 1))
+KEK_B=$((FIRST - 2))
+HAVE=0
+
+rate() {
+    sed -n 's/.*(\(.*\) keys\/s).*/\1/p'
+}
+
+printf "%-8s %12s %12s %12s\n" keys "wrap keys/s" "rotate keys/s" \
+    "unwrap keys/s"
+for n in "$@"; do
+    if [ "$n" -gt "$HAVE" ]; then
+        "$SEAL_KEY" generate $((FIRST + HAVE)) -n $((n - HAVE)) -r 4096 \
+            >/dev/null 2>&1
+        HAVE=$n
+    fi
+    # a new key encryption key has to be plain, create it right before use
+    "$SEAL_KEY" generate "$KEK_A" -n 1 >/dev/null 2>&1
+    w=$("$SEAL_KEY" rewrap "$KEK_A" -r 1024 2>&1 | rate)
+    "$SEAL_KEY" generate "$KEK_B" -n 1 >/dev/null 2>&1
+    r=$("$SEAL_KEY" rewrap "$KEK_B" -f "$KEK_A" -r 1024 2>&1 | rate)
+    u=$("$SEAL_KEY" rewrap plain -f "$KEK_B" -r 1024 2>&1 | rate)
+    "$SEAL_KEY" del-key "$KEK_A" >/dev/null 2>&1
+    "$SEAL_KEY" del-key "$KEK_B" >/dev/null 2>&1
+    printf "%-8s %12s %12s %12s\n" "$n" "$w" "$r" "$u"
+done
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Measure how encrypt-seal/decrypt-unseal scale with the number of sessions.
+#
+# usage: seal-scaling.sh <key id> [size in MiB] [max sessions]
+#
+# The key has to exist already (seal-key set-key <key id> -k ...). The
+# numbers are the ones printed by seal-key, the first line is the single
+# session streaming format for reference.
+set -e
+
+ID=${1:?usage: $0 <key id> [size in MiB] [max sessions]}
+SIZE=${2:-256}
+MAX=${3:-$(nproc)}
+SEAL_KEY=${SEAL_KEY:-seal-key}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+head -c $((SIZE * 1024 * 1024)) /dev/urandom > "$TMP/in"
+
+rate() {
+    sed -n 's/.*(\(.*\) MB\/s).*/\1/p'
+}
+
+printf "%-8s %12s %12s\n" sessions "seal MB/s" "unseal MB/s"
+s=$("$SEAL_KEY" encrypt-seal "$ID" -i "$TMP/in" -o "$TMP/sealed" 2>&1 | rate)
+u=$("$SEAL_KEY" decrypt-unseal "$ID" -i "$TMP/sealed" -o "$TMP/out" 2>&1 |
+    rate)
+cmp -s "$TMP/in" "$TMP/out"
+printf "%-8s %12s %12s\n" stream "$s" "$u"
+
+j=1
+while [ "$j" -le "$MAX" ]; do
+    s=$("$SEAL_KEY" encrypt-seal "$ID" -i "$TMP/in" -o "$TMP/sealed" -j "$j" \
+        2>&1 | rate)
+    u=$("$SEAL_KEY" decrypt-unseal "$ID" -i "$TMP/sealed" -o "$TMP/out" \
+        -j "$j" 2>&1 | rate)
+    cmp -s "$TMP/in" "$TMP/out"
+    printf "%-8s %12s %12s\n" "$j" "$s" "$u"
+    j=$((j * 2))
+done
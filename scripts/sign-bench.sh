@@ -0,0 +1,37 @@
+#!/bin/sh
+# Compare MACs and signatures computed one call at a time with batches.
+#
+# usage: sign-bench.sh <hmac key id> <ecdsa key id> [messages] [size]
+#
+# Both keys have to exist already. A batch of 1 costs one world switch per
+# message, which is what MACing messages one at a time costs.
+set -e
+
+HMAC_ID=${1:?usage: $0 <hmac key id> <ecdsa key id> [messages] [size]}
+ECDSA_ID=${2:?usage: $0 <hmac key id> <ecdsa key id> [messages] [size]}
+COUNT=${3:-5000}
+SIZE=${4:-64}
+SEAL_KEY=${SEAL_KEY:-seal-key}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+head -c $((COUNT * SIZE * 3 / 4)) /dev/urandom | base64 -w "$SIZE" |
+    head -n "$COUNT" > "$TMP/in"
+
+rate() {
+    sed -n 's/.*(\(.*\) messages\/s).*/\1/p'
+}
+
+printf "%-6s %-8s %12s %12s\n" alg batch "mac msg/s" "verify msg/s"
+for alg in hmac ecdsa; do
+    id=$HMAC_ID
+    [ "$alg" = ecdsa ] && id=$ECDSA_ID
+    for b in 1 16 256 4096; do
+        m=$("$SEAL_KEY" mac "$id" -a "$alg" -r "$b" -i "$TMP/in" \
+            -o "$TMP/macs" 2>&1 | rate)
+        paste -d ' ' "$TMP/macs" "$TMP/in" > "$TMP/check"
+        v=$("$SEAL_KEY" verify "$id" -a "$alg" -r "$b" -i "$TMP/check" \
+            -o "$TMP/results" 2>&1 | rate)
+        printf "%-6s %-8s %12s %12s\n" "$alg" "$b" "$m" "$v"
+    done
+done
@@ -0,0 +1,306 @@
+/*
+ * Minimal GlobalPlatform TEE Internal Core API (v1.1 flavour, as selected by
+ * CFG_TA_OPTEE_CORE_API_COMPAT_1_1) used by the seal-key simulator. Only the
+ * subset of the API that the seal-key TA uses is provided.
+ */
+#ifndef TEE_INTERNAL_API_H
+#define TEE_INTERNAL_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#define EMSG(fmt, ...)                                                         \
+    fprintf(stderr, "E/TA: %s:%d " fmt "\n", __func__, __LINE__,               \
+            ##__VA_ARGS__)
+#define IMSG(fmt, ...)                                                         \
+    fprintf(stderr, "I/TA: %s:%d " fmt "\n", __func__, __LINE__,               \
+            ##__VA_ARGS__)
+#define DMSG(fmt, ...)                                                         \
+    do {                                                                       \
+    } while (0)
+
+typedef uint32_t TEE_Result;
+
+#define TEE_SUCCESS 0x00000000
+#define TEE_ERROR_CORRUPT_OBJECT 0xF0100001
+#define TEE_ERROR_STORAGE_NOT_AVAILABLE 0xF0100003
+#define TEE_ERROR_GENERIC 0xFFFF0000
+#define TEE_ERROR_ACCESS_DENIED 0xFFFF0001
+#define TEE_ERROR_CANCEL 0xFFFF0002
+#define TEE_ERROR_ACCESS_CONFLICT 0xFFFF0003
+#define TEE_ERROR_EXCESS_DATA 0xFFFF0004
+#define TEE_ERROR_BAD_FORMAT 0xFFFF0005
+#define TEE_ERROR_BAD_PARAMETERS 0xFFFF0006
+#define TEE_ERROR_BAD_STATE 0xFFFF0007
+#define TEE_ERROR_ITEM_NOT_FOUND 0xFFFF0008
+#define TEE_ERROR_NOT_IMPLEMENTED 0xFFFF0009
+#define TEE_ERROR_NOT_SUPPORTED 0xFFFF000A
+#define TEE_ERROR_NO_DATA 0xFFFF000B
+#define TEE_ERROR_OUT_OF_MEMORY 0xFFFF000C
+#define TEE_ERROR_BUSY 0xFFFF000D
+#define TEE_ERROR_COMMUNICATION 0xFFFF000E
+#define TEE_ERROR_SECURITY 0xFFFF000F
+#define TEE_ERROR_SHORT_BUFFER 0xFFFF0010
+#define TEE_ERROR_OVERFLOW 0xFFFF300F
+#define TEE_ERROR_TARGET_DEAD 0xFFFF3024
+#define TEE_ERROR_STORAGE_NO_SPACE 0xFFFF3041
+#define TEE_ERROR_MAC_INVALID 0xFFFF3071
+#define TEE_ERROR_SIGNATURE_INVALID 0xFFFF3072
+
+#define TEE_PARAM_TYPE_NONE 0
+#define TEE_PARAM_TYPE_VALUE_INPUT 1
+#define TEE_PARAM_TYPE_VALUE_OUTPUT 2
+#define TEE_PARAM_TYPE_VALUE_INOUT 3
+#define TEE_PARAM_TYPE_MEMREF_INPUT 5
+#define TEE_PARAM_TYPE_MEMREF_OUTPUT 6
+#define TEE_PARAM_TYPE_MEMREF_INOUT 7
+
+#define TEE_PARAM_TYPES(t0, t1, t2, t3)                                        \
+    ((t0) | ((t1) << 4) | ((t2) << 8) | ((t3) << 12))
+#define TEE_PARAM_TYPE_GET(t, i) ((((uint32_t)t) >> ((i) * 4)) & 0xF)
+
+typedef union {
+    struct {
+        void *buffer;
+        uint32_t size;
+    } memref;
+    struct {
+        uint32_t a;
+        uint32_t b;
+    } value;
+} TEE_Param;
+
+typedef struct {
+    uint32_t seconds;
+    uint32_t millis;
+} TEE_Time;
+
+typedef struct {
+    uint32_t attributeID;
+    union {
+        struct {
+            void *buffer;
+            uint32_t length;
+        } ref;
+        struct {
+            uint32_t a;
+            uint32_t b;
+        } value;
+    } content;
+} TEE_Attribute;
+
+typedef struct {
+    uint32_t objectType;
+    uint32_t objectSize;
+    uint32_t maxObjectSize;
+    uint32_t objectUsage;
+    uint32_t dataSize;
+    uint32_t dataPosition;
+    uint32_t handleFlags;
+} TEE_ObjectInfo;
+
+typedef enum {
+    TEE_DATA_SEEK_SET = 0,
+    TEE_DATA_SEEK_CUR = 1,
+    TEE_DATA_SEEK_END = 2
+} TEE_Whence;
+
+typedef uint32_t TEE_ObjectType;
+typedef struct __TEE_ObjectHandle *TEE_ObjectHandle;
+typedef struct __TEE_OperationHandle *TEE_OperationHandle;
+typedef struct __TEE_ObjectEnumHandle *TEE_ObjectEnumHandle;
+
+#define TEE_HANDLE_NULL 0
+
+#define TEE_MALLOC_FILL_ZERO 0x00000000
+#define TEE_USER_MEM_HINT_NO_FILL_ZERO 0x80000000
+
+#define TEE_STORAGE_PRIVATE 0x00000001
+
+#define TEE_DATA_FLAG_ACCESS_READ 0x00000001
+#define TEE_DATA_FLAG_ACCESS_WRITE 0x00000002
+#define TEE_DATA_FLAG_ACCESS_WRITE_META 0x00000004
+#define TEE_DATA_FLAG_SHARE_READ 0x00000010
+#define TEE_DATA_FLAG_SHARE_WRITE 0x00000020
+#define TEE_DATA_FLAG_OVERWRITE 0x00000400
+
+#define TEE_OBJECT_ID_MAX_LEN 64
+#define TEE_DATA_MAX_POSITION 0xFFFFFFFF
+
+#define TEE_MODE_ENCRYPT 0
+#define TEE_MODE_DECRYPT 1
+#define TEE_MODE_SIGN 2
+#define TEE_MODE_VERIFY 3
+#define TEE_MODE_MAC 4
+#define TEE_MODE_DIGEST 5
+#define TEE_MODE_DERIVE 6
+
+#define TEE_ALG_AES_ECB_NOPAD 0x10000010
+#define TEE_ALG_AES_CTR 0x10000210
+#define TEE_ALG_AES_GCM 0x40000810
+#define TEE_ALG_HMAC_SHA256 0x30000004
+#define TEE_ALG_SHA256 0x50000004
+#define TEE_ALG_ECDSA_P256 0x70003041
+
+#define TEE_TYPE_AES 0xA0000010
+#define TEE_TYPE_HMAC_SHA256 0xA0000004
+#define TEE_TYPE_GENERIC_SECRET 0xA0000000
+#define TEE_TYPE_ECDSA_PUBLIC_KEY 0xA0000041
+#define TEE_TYPE_ECDSA_KEYPAIR 0xA1000041
+#define TEE_TYPE_DATA 0xA00000BF
+
+#define TEE_ATTR_SECRET_VALUE 0xC0000000
+#define TEE_ATTR_ECC_PUBLIC_VALUE_X 0xD0000141
+#define TEE_ATTR_ECC_PUBLIC_VALUE_Y 0xD0000241
+#define TEE_ATTR_ECC_PRIVATE_VALUE 0xC0000341
+#define TEE_ATTR_ECC_CURVE 0xF0000441
+
+#define TEE_ECC_CURVE_NIST_P256 0x00000003
+
+/* Entry points implemented by the TA */
+TEE_Result TA_CreateEntryPoint(void);
+void TA_DestroyEntryPoint(void);
+TEE_Result TA_OpenSessionEntryPoint(uint32_t paramTypes, TEE_Param params[4],
+                                    void **sessionContext);
+void TA_CloseSessionEntryPoint(void *sessionContext);
+TEE_Result TA_InvokeCommandEntryPoint(void *sessionContext,
+                                      uint32_t commandID, uint32_t paramTypes,
+                                      TEE_Param params[4]);
+
+/* Memory */
+void *TEE_Malloc(uint32_t size, uint32_t hint);
+void *TEE_Realloc(void *buffer, uint32_t newSize);
+void TEE_Free(void *buffer);
+void *TEE_MemMove(void *dest, const void *src, uint32_t size);
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2,
+                       uint32_t size);
+void *TEE_MemFill(void *buff, uint32_t x, uint32_t size);
+
+/* Time */
+void TEE_GetSystemTime(TEE_Time *time);
+void TEE_GetREETime(TEE_Time *time);
+
+/* Objects */
+TEE_Result TEE_GetObjectInfo1(TEE_ObjectHandle object,
+                              TEE_ObjectInfo *objectInfo);
+void TEE_CloseObject(TEE_ObjectHandle object);
+TEE_Result TEE_GetObjectBufferAttribute(TEE_ObjectHandle object,
+                                        uint32_t attributeID, void *buffer,
+                                        uint32_t *size);
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+                                       uint32_t maxObjectSize,
+                                       TEE_ObjectHandle *object);
+void TEE_FreeTransientObject(TEE_ObjectHandle object);
+void TEE_ResetTransientObject(TEE_ObjectHandle object);
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+                                       const TEE_Attribute *attrs,
+                                       uint32_t attrCount);
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+                          const void *buffer, uint32_t length);
+void TEE_InitValueAttribute(TEE_Attribute *attr, uint32_t attributeID,
+                            uint32_t a, uint32_t b);
+TEE_Result TEE_GenerateKey(TEE_ObjectHandle object, uint32_t keySize,
+                           const TEE_Attribute *params, uint32_t paramCount);
+
+/* Persistent objects */
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+                                    uint32_t objectIDLen, uint32_t flags,
+                                    TEE_ObjectHandle *object);
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID, const void *objectID,
+                                      uint32_t objectIDLen, uint32_t flags,
+                                      TEE_ObjectHandle attributes,
+                                      const void *initialData,
+                                      uint32_t initialDataLen,
+                                      TEE_ObjectHandle *object);
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object);
+TEE_Result TEE_RenamePersistentObject(TEE_ObjectHandle object,
+                                      const void *newObjectID,
+                                      uint32_t newObjectIDLen);
+TEE_Result TEE_AllocatePersistentObjectEnumerator(
+    TEE_ObjectEnumHandle *objectEnumerator);
+void TEE_FreePersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator);
+void TEE_ResetPersistentObjectEnumerator(
+    TEE_ObjectEnumHandle objectEnumerator);
+TEE_Result TEE_StartPersistentObjectEnumerator(
+    TEE_ObjectEnumHandle objectEnumerator, uint32_t storageID);
+TEE_Result TEE_GetNextPersistentObject(TEE_ObjectEnumHandle objectEnumerator,
+                                       TEE_ObjectInfo *objectInfo,
+                                       void *objectID, uint32_t *objectIDLen);
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+                              uint32_t size, uint32_t *count);
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+                               uint32_t size);
+TEE_Result TEE_TruncateObjectData(TEE_ObjectHandle object, uint32_t size);
+TEE_Result TEE_SeekObjectData(TEE_ObjectHandle object, int32_t offset,
+                              TEE_Whence whence);
+
+/* Operations */
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+                                 uint32_t algorithm, uint32_t mode,
+                                 uint32_t maxKeySize);
+void TEE_FreeOperation(TEE_OperationHandle operation);
+void TEE_ResetOperation(TEE_OperationHandle operation);
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+                               TEE_ObjectHandle key);
+
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+                      uint32_t chunkSize);
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation, const void *chunk,
+                             uint32_t chunkLen, void *hash, uint32_t *hashLen);
+
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+                    uint32_t IVLen);
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation, const void *srcData,
+                            uint32_t srcLen, void *destData,
+                            uint32_t *destLen);
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+                             const void *srcData, uint32_t srcLen,
+                             void *destData, uint32_t *destLen);
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV,
+                 uint32_t IVLen);
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+                   uint32_t chunkSize);
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+                               const void *message, uint32_t messageLen,
+                               void *mac, uint32_t *macLen);
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+                               const void *message, uint32_t messageLen,
+                               const void *mac, uint32_t macLen);
+
+TEE_Result TEE_AEInit(TEE_OperationHandle operation, const void *nonce,
+                      uint32_t nonceLen, uint32_t tagLen, uint32_t AADLen,
+                      uint32_t payloadLen);
+void TEE_AEUpdateAAD(TEE_OperationHandle operation, const void *AADdata,
+                     uint32_t AADdataLen);
+TEE_Result TEE_AEUpdate(TEE_OperationHandle operation, const void *srcData,
+                        uint32_t srcLen, void *destData, uint32_t *destLen);
+TEE_Result TEE_AEEncryptFinal(TEE_OperationHandle operation,
+                              const void *srcData, uint32_t srcLen,
+                              void *destData, uint32_t *destLen, void *tag,
+                              uint32_t *tagLen);
+TEE_Result TEE_AEDecryptFinal(TEE_OperationHandle operation,
+                              const void *srcData, uint32_t srcLen,
+                              void *destData, uint32_t *destLen,
+                              const void *tag, uint32_t tagLen);
+
+TEE_Result TEE_AsymmetricSignDigest(TEE_OperationHandle operation,
+                                    const TEE_Attribute *params,
+                                    uint32_t paramCount, const void *digest,
+                                    uint32_t digestLen, void *signature,
+                                    uint32_t *signatureLen);
+TEE_Result TEE_AsymmetricVerifyDigest(TEE_OperationHandle operation,
+                                      const TEE_Attribute *params,
+                                      uint32_t paramCount, const void *digest,
+                                      uint32_t digestLen,
+                                      const void *signature,
+                                      uint32_t signatureLen);
+
+void TEE_GenerateRandom(void *randomBuffer, uint32_t randomBufferLen);
+
+#endif /* TEE_INTERNAL_API_H */
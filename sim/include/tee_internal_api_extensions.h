@@ -0,0 +1,9 @@
+/*
+ * OP-TEE specific extensions; nothing in here is needed by the simulator.
+ */
+#ifndef TEE_INTERNAL_API_EXTENSIONS_H
+#define TEE_INTERNAL_API_EXTENSIONS_H
+
+#include <tee_internal_api.h>
+
+#endif /* TEE_INTERNAL_API_EXTENSIONS_H */
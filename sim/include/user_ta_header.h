@@ -0,0 +1,14 @@
+/*
+ * The TA flags of OP-TEE, with the values of its user_ta_header.h, so the
+ * simulator can follow the TA_FLAGS of user_ta_header_defines.h.
+ */
+#ifndef USER_TA_HEADER_H
+#define USER_TA_HEADER_H
+
+#define TA_FLAG_USER_MODE 0
+#define TA_FLAG_EXEC_DDR 0
+#define TA_FLAG_SINGLE_INSTANCE (1 << 2)
+#define TA_FLAG_MULTI_SESSION (1 << 3)
+#define TA_FLAG_INSTANCE_KEEP_ALIVE (1 << 4)
+
+#endif /* USER_TA_HEADER_H */
@@ -0,0 +1,1236 @@
+/*
+ * Native implementation of the TEE Internal Core API subset used by the
+ * seal-key TA. Persistent objects are plain files below the directory named
+ * by SEAL_KEY_SIM_STORE (default "sim-store"), crypto is done with OpenSSL.
+ *
+ * This is a development aid to run and profile the TA on a Linux host: it
+ * offers none of the isolation or storage protection of a real TEE.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/core_names.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/param_build.h>
+#include <openssl/rand.h>
+
+#include <tee_internal_api.h>
+
+
+#define SIM_MAX_SECRET 128
+#define SIM_ECC_LEN 32
+
+struct __TEE_ObjectHandle {
+    /* persistent part */
+    int persistent;
+    int fd;
+    char path[PATH_MAX];
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t id_len;
+    uint32_t flags;
+    uint32_t pos;
+    /* transient part */
+    uint32_t type;
+    uint32_t max_size;
+    uint32_t key_size;
+    int initialized;
+    uint8_t secret[SIM_MAX_SECRET];
+    uint32_t secret_len;
+    uint8_t ecc_d[SIM_ECC_LEN];
+    uint8_t ecc_x[SIM_ECC_LEN];
+    uint8_t ecc_y[SIM_ECC_LEN];
+    struct __TEE_ObjectHandle *next_open;
+};
+
+struct __TEE_OperationHandle {
+    uint32_t algorithm;
+    uint32_t mode;
+    uint32_t max_key_size;
+    int key_set;
+    struct __TEE_ObjectHandle key;
+    EVP_CIPHER_CTX *cipher;
+    EVP_MAC_CTX *mac;
+    EVP_MD_CTX *md;
+    uint32_t tag_len;
+};
+
+struct __TEE_ObjectEnumHandle {
+    DIR *dir;
+};
+
+/* all currently open persistent objects, used for access conflicts */
+static struct __TEE_ObjectHandle *open_objects;
+static pthread_mutex_t open_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sim_panic(const char *what) {
+    fprintf(stderr, "TEE simulator panic: %s\n", what);
+    abort();
+}
+
+/*
+ * Memory. SEAL_KEY_SIM_HEAP caps the bytes the TA may have allocated at
+ * once, like TA_DATA_SIZE does for the real TA, 0 or unset leaves the heap
+ * unlimited.
+ */
+static size_t heap_limit(void) {
+    static long limit = -1;
+
+    if (limit < 0) {
+        const char *env = getenv("SEAL_KEY_SIM_HEAP");
+
+        limit = env ? atol(env) : 0;
+    }
+    return limit;
+}
+
+static size_t heap_used;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Resize old, or allocate when it is NULL. A request that does not fit
+ * under the limit fails and leaves old as it was, like realloc does.
+ */
+static void *heap_alloc(void *old, size_t size) {
+    size_t had = old && heap_limit() ? malloc_usable_size(old) : 0;
+    int fits = 1;
+    void *p;
+
+    if (heap_limit()) {
+        pthread_mutex_lock(&heap_lock);
+        fits = heap_used - had + size <= heap_limit();
+        pthread_mutex_unlock(&heap_lock);
+    }
+    if (!fits)
+        return NULL;
+    p = realloc(old, size ? size : 1);
+    if (p && heap_limit()) {
+        pthread_mutex_lock(&heap_lock);
+        heap_used = heap_used - had + malloc_usable_size(p);
+        pthread_mutex_unlock(&heap_lock);
+    }
+    return p;
+}
+
+void *TEE_Malloc(uint32_t size, uint32_t hint) {
+    void *p = heap_alloc(NULL, size);
+
+    if (p && hint == TEE_MALLOC_FILL_ZERO)
+        memset(p, 0, size);
+    return p;
+}
+
+void *TEE_Realloc(void *buffer, uint32_t newSize) {
+    return heap_alloc(buffer, newSize);
+}
+
+void TEE_Free(void *buffer) {
+    if (buffer && heap_limit()) {
+        pthread_mutex_lock(&heap_lock);
+        heap_used -= malloc_usable_size(buffer);
+        pthread_mutex_unlock(&heap_lock);
+    }
+    free(buffer);
+}
+
+void *TEE_MemMove(void *dest, const void *src, uint32_t size) {
+    return memmove(dest, src, size);
+}
+
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2,
+                       uint32_t size) {
+    int r = memcmp(buffer1, buffer2, size);
+
+    return r < 0 ? -1 : r > 0;
+}
+
+void *TEE_MemFill(void *buff, uint32_t x, uint32_t size) {
+    return memset(buff, (int)x, size);
+}
+
+/*
+ * Time
+ */
+void TEE_GetSystemTime(TEE_Time *time) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    time->seconds = ts.tv_sec;
+    time->millis = ts.tv_nsec / 1000000;
+}
+
+void TEE_GetREETime(TEE_Time *time) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    time->seconds = ts.tv_sec;
+    time->millis = ts.tv_nsec / 1000000;
+}
+
+void TEE_GenerateRandom(void *randomBuffer, uint32_t randomBufferLen) {
+    if (RAND_bytes(randomBuffer, randomBufferLen) != 1)
+        sim_panic("RAND_bytes");
+}
+
+/*
+ * Persistent objects
+ */
+static const char *store_dir(void) {
+    static char dir[PATH_MAX];
+
+    if (!dir[0]) {
+        const char *env = getenv("SEAL_KEY_SIM_STORE");
+
+        snprintf(dir, sizeof(dir), "%s", env ? env : "sim-store");
+        mkdir(dir, 0700);
+    }
+    return dir;
+}
+
+static void object_path(const void *id, uint32_t id_len, char *path) {
+    const uint8_t *p = id;
+    int n = snprintf(path, PATH_MAX, "%s/", store_dir());
+
+    for (uint32_t i = 0; i < id_len; i++)
+        n += snprintf(path + n, PATH_MAX - n, "%02x", p[i]);
+}
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/*
+ * Mirror the GP sharing rules: a second handle on the same object is only
+ * allowed when both the existing and the new handle share every access right
+ * the other one asks for.
+ */
+static TEE_Result check_conflict(const char *path, uint32_t flags) {
+    for (struct __TEE_ObjectHandle *o = open_objects; o; o = o->next_open) {
+        if (strcmp(o->path, path))
+            continue;
+        if ((flags & TEE_DATA_FLAG_ACCESS_WRITE_META) ||
+            (o->flags & TEE_DATA_FLAG_ACCESS_WRITE_META))
+            return TEE_ERROR_ACCESS_CONFLICT;
+        if ((flags & TEE_DATA_FLAG_ACCESS_READ) &&
+            !(o->flags & TEE_DATA_FLAG_SHARE_READ))
+            return TEE_ERROR_ACCESS_CONFLICT;
+        if ((flags & TEE_DATA_FLAG_ACCESS_WRITE) &&
+            !(o->flags & TEE_DATA_FLAG_SHARE_WRITE))
+            return TEE_ERROR_ACCESS_CONFLICT;
+        if ((o->flags & TEE_DATA_FLAG_ACCESS_READ) &&
+            !(flags & TEE_DATA_FLAG_SHARE_READ))
+            return TEE_ERROR_ACCESS_CONFLICT;
+        if ((o->flags & TEE_DATA_FLAG_ACCESS_WRITE) &&
+            !(flags & TEE_DATA_FLAG_SHARE_WRITE))
+            return TEE_ERROR_ACCESS_CONFLICT;
+    }
+    return TEE_SUCCESS;
+}
+
+static void track_open(struct __TEE_ObjectHandle *o) {
+    o->next_open = open_objects;
+    open_objects = o;
+}
+
+static void untrack_open(struct __TEE_ObjectHandle *o) {
+    struct __TEE_ObjectHandle **pp;
+
+    for (pp = &open_objects; *pp; pp = &(*pp)->next_open) {
+        if (*pp == o) {
+            *pp = o->next_open;
+            return;
+        }
+    }
+}
+
+static TEE_Result check_id(uint32_t storageID, uint32_t objectIDLen) {
+    if (storageID != TEE_STORAGE_PRIVATE)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    if (objectIDLen == 0 || objectIDLen > TEE_OBJECT_ID_MAX_LEN)
+        return TEE_ERROR_BAD_PARAMETERS;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+                                    uint32_t objectIDLen, uint32_t flags,
+                                    TEE_ObjectHandle *object) {
+    struct __TEE_ObjectHandle *o;
+    TEE_Result res;
+    int fd;
+
+    *object = TEE_HANDLE_NULL;
+    res = check_id(storageID, objectIDLen);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    o = calloc(1, sizeof(*o));
+    if (!o)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    object_path(objectID, objectIDLen, o->path);
+
+    pthread_mutex_lock(&open_lock);
+    fd = open(o->path,
+              (flags & TEE_DATA_FLAG_ACCESS_WRITE) ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        pthread_mutex_unlock(&open_lock);
+        free(o);
+        return errno == ENOENT ? TEE_ERROR_ITEM_NOT_FOUND
+                               : TEE_ERROR_STORAGE_NOT_AVAILABLE;
+    }
+    res = check_conflict(o->path, flags);
+    if (res != TEE_SUCCESS) {
+        pthread_mutex_unlock(&open_lock);
+        close(fd);
+        free(o);
+        return res;
+    }
+    o->persistent = 1;
+    o->fd = fd;
+    o->flags = flags;
+    o->type = TEE_TYPE_DATA;
+    memcpy(o->id, objectID, objectIDLen);
+    o->id_len = objectIDLen;
+    track_open(o);
+    pthread_mutex_unlock(&open_lock);
+
+    *object = o;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID, const void *objectID,
+                                      uint32_t objectIDLen, uint32_t flags,
+                                      TEE_ObjectHandle attributes,
+                                      const void *initialData,
+                                      uint32_t initialDataLen,
+                                      TEE_ObjectHandle *object) {
+    struct __TEE_ObjectHandle *o;
+    char tmp[PATH_MAX + 8];
+    TEE_Result res;
+    int fd;
+
+    if (object)
+        *object = TEE_HANDLE_NULL;
+    if (attributes != TEE_HANDLE_NULL)
+        return TEE_ERROR_NOT_SUPPORTED;
+    res = check_id(storageID, objectIDLen);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    o = calloc(1, sizeof(*o));
+    if (!o)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    object_path(objectID, objectIDLen, o->path);
+
+    pthread_mutex_lock(&open_lock);
+    if (!(flags & TEE_DATA_FLAG_OVERWRITE) && access(o->path, F_OK) == 0) {
+        res = TEE_ERROR_ACCESS_CONFLICT;
+        goto err;
+    }
+    res = check_conflict(o->path, flags | TEE_DATA_FLAG_ACCESS_WRITE_META);
+    if (res != TEE_SUCCESS)
+        goto err;
+
+    /* like the REE FS, a create is atomic: write aside, then rename */
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", o->path, (int)gettid());
+    fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        res = TEE_ERROR_STORAGE_NOT_AVAILABLE;
+        goto err;
+    }
+    if (initialDataLen &&
+        write(fd, initialData, initialDataLen) != (ssize_t)initialDataLen) {
+        close(fd);
+        unlink(tmp);
+        res = TEE_ERROR_STORAGE_NO_SPACE;
+        goto err;
+    }
+    if (rename(tmp, o->path)) {
+        close(fd);
+        unlink(tmp);
+        res = TEE_ERROR_STORAGE_NOT_AVAILABLE;
+        goto err;
+    }
+
+    o->persistent = 1;
+    o->fd = fd;
+    o->flags = flags & ~TEE_DATA_FLAG_OVERWRITE;
+    o->type = TEE_TYPE_DATA;
+    memcpy(o->id, objectID, objectIDLen);
+    o->id_len = objectIDLen;
+    if (object) {
+        track_open(o);
+        *object = o;
+    } else {
+        close(fd);
+        free(o);
+    }
+    pthread_mutex_unlock(&open_lock);
+    return TEE_SUCCESS;
+err:
+    pthread_mutex_unlock(&open_lock);
+    free(o);
+    return res;
+}
+
+void TEE_CloseObject(TEE_ObjectHandle object) {
+    if (object == TEE_HANDLE_NULL)
+        return;
+    if (!object->persistent) {
+        TEE_FreeTransientObject(object);
+        return;
+    }
+    pthread_mutex_lock(&open_lock);
+    untrack_open(object);
+    pthread_mutex_unlock(&open_lock);
+    close(object->fd);
+    free(object);
+}
+
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object) {
+    if (object == TEE_HANDLE_NULL)
+        return TEE_SUCCESS;
+    if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE_META))
+        sim_panic("delete without TEE_DATA_FLAG_ACCESS_WRITE_META");
+    pthread_mutex_lock(&open_lock);
+    untrack_open(object);
+    unlink(object->path);
+    pthread_mutex_unlock(&open_lock);
+    close(object->fd);
+    free(object);
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_RenamePersistentObject(TEE_ObjectHandle object,
+                                      const void *newObjectID,
+                                      uint32_t newObjectIDLen) {
+    char path[PATH_MAX];
+    TEE_Result res = TEE_SUCCESS;
+
+    if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE_META))
+        sim_panic("rename without TEE_DATA_FLAG_ACCESS_WRITE_META");
+    if (newObjectIDLen == 0 || newObjectIDLen > TEE_OBJECT_ID_MAX_LEN)
+        return TEE_ERROR_BAD_PARAMETERS;
+    object_path(newObjectID, newObjectIDLen, path);
+
+    pthread_mutex_lock(&open_lock);
+    if (access(path, F_OK) == 0)
+        res = TEE_ERROR_ACCESS_CONFLICT;
+    else if (rename(object->path, path))
+        res = TEE_ERROR_STORAGE_NOT_AVAILABLE;
+    if (res == TEE_SUCCESS) {
+        strcpy(object->path, path);
+        memcpy(object->id, newObjectID, newObjectIDLen);
+        object->id_len = newObjectIDLen;
+    }
+    pthread_mutex_unlock(&open_lock);
+    return res;
+}
+
+TEE_Result TEE_GetObjectInfo1(TEE_ObjectHandle object,
+                              TEE_ObjectInfo *objectInfo) {
+    struct stat st;
+
+    memset(objectInfo, 0, sizeof(*objectInfo));
+    objectInfo->objectType = object->type;
+    objectInfo->handleFlags = object->flags;
+    if (!object->persistent) {
+        objectInfo->objectSize = object->key_size;
+        objectInfo->maxObjectSize = object->max_size;
+        return TEE_SUCCESS;
+    }
+    if (fstat(object->fd, &st))
+        return TEE_ERROR_CORRUPT_OBJECT;
+    objectInfo->dataSize = st.st_size;
+    objectInfo->dataPosition = object->pos;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+                              uint32_t size, uint32_t *count) {
+    ssize_t n;
+
+    if (!(object->flags & TEE_DATA_FLAG_ACCESS_READ))
+        sim_panic("read without TEE_DATA_FLAG_ACCESS_READ");
+    n = pread(object->fd, buffer, size, object->pos);
+    if (n < 0)
+        return TEE_ERROR_CORRUPT_OBJECT;
+    object->pos += n;
+    *count = n;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+                               uint32_t size) {
+    if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE))
+        sim_panic("write without TEE_DATA_FLAG_ACCESS_WRITE");
+    if (pwrite(object->fd, buffer, size, object->pos) != (ssize_t)size)
+        return TEE_ERROR_STORAGE_NO_SPACE;
+    object->pos += size;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_TruncateObjectData(TEE_ObjectHandle object, uint32_t size) {
+    if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE))
+        sim_panic("truncate without TEE_DATA_FLAG_ACCESS_WRITE");
+    if (ftruncate(object->fd, size))
+        return TEE_ERROR_STORAGE_NO_SPACE;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_SeekObjectData(TEE_ObjectHandle object, int32_t offset,
+                              TEE_Whence whence) {
+    struct stat st;
+    int64_t base;
+
+    switch (whence) {
+    case TEE_DATA_SEEK_SET:
+        base = 0;
+        break;
+    case TEE_DATA_SEEK_CUR:
+        base = object->pos;
+        break;
+    case TEE_DATA_SEEK_END:
+        if (fstat(object->fd, &st))
+            return TEE_ERROR_CORRUPT_OBJECT;
+        base = st.st_size;
+        break;
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    if (base + offset < 0 || base + offset > TEE_DATA_MAX_POSITION)
+        return TEE_ERROR_OVERFLOW;
+    object->pos = base + offset;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AllocatePersistentObjectEnumerator(
+    TEE_ObjectEnumHandle *objectEnumerator) {
+    *objectEnumerator = calloc(1, sizeof(**objectEnumerator));
+    return *objectEnumerator ? TEE_SUCCESS : TEE_ERROR_OUT_OF_MEMORY;
+}
+
+void TEE_FreePersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator) {
+    if (!objectEnumerator)
+        return;
+    if (objectEnumerator->dir)
+        closedir(objectEnumerator->dir);
+    free(objectEnumerator);
+}
+
+void TEE_ResetPersistentObjectEnumerator(
+    TEE_ObjectEnumHandle objectEnumerator) {
+    if (objectEnumerator->dir)
+        closedir(objectEnumerator->dir);
+    objectEnumerator->dir = NULL;
+}
+
+TEE_Result TEE_StartPersistentObjectEnumerator(
+    TEE_ObjectEnumHandle objectEnumerator, uint32_t storageID) {
+    if (storageID != TEE_STORAGE_PRIVATE)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    TEE_ResetPersistentObjectEnumerator(objectEnumerator);
+    objectEnumerator->dir = opendir(store_dir());
+    return objectEnumerator->dir ? TEE_SUCCESS : TEE_ERROR_ITEM_NOT_FOUND;
+}
+
+TEE_Result TEE_GetNextPersistentObject(TEE_ObjectEnumHandle objectEnumerator,
+                                       TEE_ObjectInfo *objectInfo,
+                                       void *objectID, uint32_t *objectIDLen) {
+    struct dirent *de;
+
+    if (!objectEnumerator->dir)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    while ((de = readdir(objectEnumerator->dir))) {
+        size_t n = strlen(de->d_name);
+        uint8_t *id = objectID;
+        char path[PATH_MAX + 256];
+        struct stat st;
+        size_t i;
+
+        if (n == 0 || n % 2 || n / 2 > TEE_OBJECT_ID_MAX_LEN)
+            continue;
+        for (i = 0; i < n; i += 2) {
+            int hi = hexval(de->d_name[i]);
+            int lo = hexval(de->d_name[i + 1]);
+
+            if (hi < 0 || lo < 0)
+                break;
+            id[i / 2] = hi << 4 | lo;
+        }
+        if (i != n)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", store_dir(), de->d_name);
+        if (stat(path, &st))
+            continue;
+        *objectIDLen = n / 2;
+        if (objectInfo) {
+            memset(objectInfo, 0, sizeof(*objectInfo));
+            objectInfo->objectType = TEE_TYPE_DATA;
+            objectInfo->dataSize = st.st_size;
+        }
+        return TEE_SUCCESS;
+    }
+    return TEE_ERROR_ITEM_NOT_FOUND;
+}
+
+/*
+ * Transient objects
+ */
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+                                       uint32_t maxObjectSize,
+                                       TEE_ObjectHandle *object) {
+    struct __TEE_ObjectHandle *o;
+
+    switch (objectType) {
+    case TEE_TYPE_AES:
+    case TEE_TYPE_HMAC_SHA256:
+    case TEE_TYPE_GENERIC_SECRET:
+        if (maxObjectSize > SIM_MAX_SECRET * 8)
+            return TEE_ERROR_NOT_SUPPORTED;
+        break;
+    case TEE_TYPE_ECDSA_KEYPAIR:
+    case TEE_TYPE_ECDSA_PUBLIC_KEY:
+        if (maxObjectSize != 256)
+            return TEE_ERROR_NOT_SUPPORTED;
+        break;
+    default:
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+    o = calloc(1, sizeof(*o));
+    if (!o)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    o->type = objectType;
+    o->max_size = maxObjectSize;
+    *object = o;
+    return TEE_SUCCESS;
+}
+
+void TEE_FreeTransientObject(TEE_ObjectHandle object) {
+    if (object == TEE_HANDLE_NULL)
+        return;
+    OPENSSL_cleanse(object, sizeof(*object));
+    free(object);
+}
+
+void TEE_ResetTransientObject(TEE_ObjectHandle object) {
+    if (object == TEE_HANDLE_NULL)
+        return;
+    object->initialized = 0;
+    object->key_size = 0;
+    object->secret_len = 0;
+    OPENSSL_cleanse(object->secret, sizeof(object->secret));
+    OPENSSL_cleanse(object->ecc_d, sizeof(object->ecc_d));
+}
+
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+                          const void *buffer, uint32_t length) {
+    attr->attributeID = attributeID;
+    attr->content.ref.buffer = (void *)buffer;
+    attr->content.ref.length = length;
+}
+
+void TEE_InitValueAttribute(TEE_Attribute *attr, uint32_t attributeID,
+                            uint32_t a, uint32_t b) {
+    attr->attributeID = attributeID;
+    attr->content.value.a = a;
+    attr->content.value.b = b;
+}
+
+static int copy_ecc(uint8_t *dst, const TEE_Attribute *a) {
+    uint32_t len = a->content.ref.length;
+
+    if (len > SIM_ECC_LEN)
+        return -1;
+    memset(dst, 0, SIM_ECC_LEN);
+    memcpy(dst + SIM_ECC_LEN - len, a->content.ref.buffer, len);
+    return 0;
+}
+
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+                                       const TEE_Attribute *attrs,
+                                       uint32_t attrCount) {
+    int have = 0;
+
+    if (object->initialized)
+        sim_panic("populate on initialized object");
+    for (uint32_t i = 0; i < attrCount; i++) {
+        const TEE_Attribute *a = attrs + i;
+
+        switch (a->attributeID) {
+        case TEE_ATTR_SECRET_VALUE:
+            if (a->content.ref.length > SIM_MAX_SECRET ||
+                a->content.ref.length * 8 > object->max_size)
+                return TEE_ERROR_BAD_PARAMETERS;
+            memcpy(object->secret, a->content.ref.buffer,
+                   a->content.ref.length);
+            object->secret_len = a->content.ref.length;
+            object->key_size = object->secret_len * 8;
+            have |= 1;
+            break;
+        case TEE_ATTR_ECC_PRIVATE_VALUE:
+            if (copy_ecc(object->ecc_d, a))
+                return TEE_ERROR_BAD_PARAMETERS;
+            have |= 2;
+            break;
+        case TEE_ATTR_ECC_PUBLIC_VALUE_X:
+            if (copy_ecc(object->ecc_x, a))
+                return TEE_ERROR_BAD_PARAMETERS;
+            have |= 4;
+            break;
+        case TEE_ATTR_ECC_PUBLIC_VALUE_Y:
+            if (copy_ecc(object->ecc_y, a))
+                return TEE_ERROR_BAD_PARAMETERS;
+            have |= 8;
+            break;
+        case TEE_ATTR_ECC_CURVE:
+            if (a->content.value.a != TEE_ECC_CURVE_NIST_P256)
+                return TEE_ERROR_NOT_SUPPORTED;
+            have |= 16;
+            break;
+        default:
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+    }
+    switch (object->type) {
+    case TEE_TYPE_ECDSA_KEYPAIR:
+        if (have != (2 | 4 | 8 | 16))
+            return TEE_ERROR_BAD_PARAMETERS;
+        object->key_size = 256;
+        break;
+    case TEE_TYPE_ECDSA_PUBLIC_KEY:
+        if (have != (4 | 8 | 16))
+            return TEE_ERROR_BAD_PARAMETERS;
+        object->key_size = 256;
+        break;
+    case TEE_TYPE_AES:
+        if (have != 1 || (object->secret_len != 16 &&
+                          object->secret_len != 24 && object->secret_len != 32))
+            return TEE_ERROR_BAD_PARAMETERS;
+        break;
+    default:
+        if (have != 1)
+            return TEE_ERROR_BAD_PARAMETERS;
+    }
+    object->initialized = 1;
+    return TEE_SUCCESS;
+}
+
+static int bn_to_bin32(const BIGNUM *bn, uint8_t *out) {
+    return BN_bn2binpad(bn, out, SIM_ECC_LEN) == SIM_ECC_LEN ? 0 : -1;
+}
+
+static TEE_Result generate_ecc(TEE_ObjectHandle object) {
+    EVP_PKEY *pkey = EVP_PKEY_Q_keygen(NULL, NULL, "EC", "P-256");
+    BIGNUM *d = NULL, *x = NULL, *y = NULL;
+    TEE_Result res = TEE_ERROR_GENERIC;
+
+    if (!pkey)
+        return TEE_ERROR_GENERIC;
+    if (EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_PRIV_KEY, &d) &&
+        EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_EC_PUB_X, &x) &&
+        EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_EC_PUB_Y, &y) &&
+        !bn_to_bin32(d, object->ecc_d) && !bn_to_bin32(x, object->ecc_x) &&
+        !bn_to_bin32(y, object->ecc_y))
+        res = TEE_SUCCESS;
+    BN_clear_free(d);
+    BN_free(x);
+    BN_free(y);
+    EVP_PKEY_free(pkey);
+    return res;
+}
+
+TEE_Result TEE_GenerateKey(TEE_ObjectHandle object, uint32_t keySize,
+                           const TEE_Attribute *params __unused,
+                           uint32_t paramCount __unused) {
+    TEE_Result res;
+
+    if (object->initialized)
+        sim_panic("generate on initialized object");
+    if (keySize > object->max_size)
+        return TEE_ERROR_BAD_PARAMETERS;
+    switch (object->type) {
+    case TEE_TYPE_ECDSA_KEYPAIR:
+        res = generate_ecc(object);
+        if (res != TEE_SUCCESS)
+            return res;
+        break;
+    case TEE_TYPE_AES:
+        if (keySize != 128 && keySize != 192 && keySize != 256)
+            return TEE_ERROR_NOT_SUPPORTED;
+        /* fall through */
+    default:
+        if (keySize % 8)
+            return TEE_ERROR_NOT_SUPPORTED;
+        TEE_GenerateRandom(object->secret, keySize / 8);
+        object->secret_len = keySize / 8;
+    }
+    object->key_size = keySize;
+    object->initialized = 1;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_GetObjectBufferAttribute(TEE_ObjectHandle object,
+                                        uint32_t attributeID, void *buffer,
+                                        uint32_t *size) {
+    const void *src;
+    uint32_t len;
+
+    if (!object->initialized)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    switch (attributeID) {
+    case TEE_ATTR_SECRET_VALUE:
+        src = object->secret;
+        len = object->secret_len;
+        break;
+    case TEE_ATTR_ECC_PRIVATE_VALUE:
+        src = object->ecc_d;
+        len = SIM_ECC_LEN;
+        break;
+    case TEE_ATTR_ECC_PUBLIC_VALUE_X:
+        src = object->ecc_x;
+        len = SIM_ECC_LEN;
+        break;
+    case TEE_ATTR_ECC_PUBLIC_VALUE_Y:
+        src = object->ecc_y;
+        len = SIM_ECC_LEN;
+        break;
+    default:
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+    if (*size < len) {
+        *size = len;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    memcpy(buffer, src, len);
+    *size = len;
+    return TEE_SUCCESS;
+}
+
+/*
+ * Operations
+ */
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+                                 uint32_t algorithm, uint32_t mode,
+                                 uint32_t maxKeySize) {
+    struct __TEE_OperationHandle *op;
+
+    switch (algorithm) {
+    case TEE_ALG_AES_GCM:
+    case TEE_ALG_AES_CTR:
+    case TEE_ALG_AES_ECB_NOPAD:
+        if (mode != TEE_MODE_ENCRYPT && mode != TEE_MODE_DECRYPT)
+            return TEE_ERROR_NOT_SUPPORTED;
+        break;
+    case TEE_ALG_HMAC_SHA256:
+        if (mode != TEE_MODE_MAC)
+            return TEE_ERROR_NOT_SUPPORTED;
+        break;
+    case TEE_ALG_SHA256:
+        if (mode != TEE_MODE_DIGEST)
+            return TEE_ERROR_NOT_SUPPORTED;
+        break;
+    case TEE_ALG_ECDSA_P256:
+        if (mode != TEE_MODE_SIGN && mode != TEE_MODE_VERIFY)
+            return TEE_ERROR_NOT_SUPPORTED;
+        break;
+    default:
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+    op = calloc(1, sizeof(*op));
+    if (!op)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    op->algorithm = algorithm;
+    op->mode = mode;
+    op->max_key_size = maxKeySize;
+    if (algorithm == TEE_ALG_SHA256) {
+        op->md = EVP_MD_CTX_new();
+        EVP_DigestInit_ex(op->md, EVP_sha256(), NULL);
+    }
+    *operation = op;
+    return TEE_SUCCESS;
+}
+
+static void free_ctx(TEE_OperationHandle op) {
+    EVP_CIPHER_CTX_free(op->cipher);
+    op->cipher = NULL;
+    EVP_MAC_CTX_free(op->mac);
+    op->mac = NULL;
+}
+
+void TEE_FreeOperation(TEE_OperationHandle operation) {
+    if (!operation)
+        return;
+    free_ctx(operation);
+    EVP_MD_CTX_free(operation->md);
+    OPENSSL_cleanse(operation, sizeof(*operation));
+    free(operation);
+}
+
+void TEE_ResetOperation(TEE_OperationHandle operation) {
+    free_ctx(operation);
+    if (operation->md)
+        EVP_DigestInit_ex(operation->md, EVP_sha256(), NULL);
+}
+
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+                               TEE_ObjectHandle key) {
+    free_ctx(operation);
+    if (key == TEE_HANDLE_NULL) {
+        OPENSSL_cleanse(&operation->key, sizeof(operation->key));
+        operation->key_set = 0;
+        return TEE_SUCCESS;
+    }
+    if (!key->initialized || key->key_size > operation->max_key_size)
+        return TEE_ERROR_BAD_PARAMETERS;
+    memcpy(&operation->key, key, sizeof(*key));
+    operation->key.persistent = 0;
+    operation->key_set = 1;
+    return TEE_SUCCESS;
+}
+
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+                      uint32_t chunkSize) {
+    EVP_DigestUpdate(operation->md, chunk, chunkSize);
+}
+
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation, const void *chunk,
+                             uint32_t chunkLen, void *hash,
+                             uint32_t *hashLen) {
+    unsigned int len;
+
+    if (*hashLen < 32) {
+        *hashLen = 32;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    if (chunkLen)
+        EVP_DigestUpdate(operation->md, chunk, chunkLen);
+    EVP_DigestFinal_ex(operation->md, hash, &len);
+    *hashLen = len;
+    EVP_DigestInit_ex(operation->md, EVP_sha256(), NULL);
+    return TEE_SUCCESS;
+}
+
+static const EVP_CIPHER *aes_cipher(TEE_OperationHandle op) {
+    uint32_t bits = op->key.secret_len * 8;
+
+    switch (op->algorithm) {
+    case TEE_ALG_AES_GCM:
+        return bits == 128   ? EVP_aes_128_gcm()
+               : bits == 192 ? EVP_aes_192_gcm()
+                             : EVP_aes_256_gcm();
+    case TEE_ALG_AES_CTR:
+        return bits == 128   ? EVP_aes_128_ctr()
+               : bits == 192 ? EVP_aes_192_ctr()
+                             : EVP_aes_256_ctr();
+    default:
+        return bits == 128   ? EVP_aes_128_ecb()
+               : bits == 192 ? EVP_aes_192_ecb()
+                             : EVP_aes_256_ecb();
+    }
+}
+
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+                    uint32_t IVLen __unused) {
+    if (!operation->key_set)
+        sim_panic("cipher init without key");
+    free_ctx(operation);
+    operation->cipher = EVP_CIPHER_CTX_new();
+    EVP_CipherInit_ex(operation->cipher, aes_cipher(operation), NULL,
+                      operation->key.secret, IV,
+                      operation->mode == TEE_MODE_ENCRYPT);
+    EVP_CIPHER_CTX_set_padding(operation->cipher, 0);
+}
+
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation, const void *srcData,
+                            uint32_t srcLen, void *destData,
+                            uint32_t *destLen) {
+    int outl;
+
+    if (!operation->cipher)
+        sim_panic("cipher update before init");
+    if (*destLen < srcLen) {
+        *destLen = srcLen;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    if (!EVP_CipherUpdate(operation->cipher, destData, &outl, srcData, srcLen))
+        return TEE_ERROR_BAD_PARAMETERS;
+    *destLen = outl;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+                             const void *srcData, uint32_t srcLen,
+                             void *destData, uint32_t *destLen) {
+    TEE_Result res = TEE_CipherUpdate(operation, srcData, srcLen, destData,
+                                      destLen);
+
+    free_ctx(operation);
+    return res;
+}
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV __unused,
+                 uint32_t IVLen __unused) {
+    OSSL_PARAM params[2];
+    EVP_MAC *mac;
+
+    if (!operation->key_set)
+        sim_panic("MAC init without key");
+    free_ctx(operation);
+    mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    operation->mac = EVP_MAC_CTX_new(mac);
+    EVP_MAC_free(mac);
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                 "SHA256", 0);
+    params[1] = OSSL_PARAM_construct_end();
+    if (!EVP_MAC_init(operation->mac, operation->key.secret,
+                      operation->key.secret_len, params))
+        sim_panic("EVP_MAC_init");
+}
+
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+                   uint32_t chunkSize) {
+    if (!operation->mac)
+        sim_panic("MAC update before init");
+    EVP_MAC_update(operation->mac, chunk, chunkSize);
+}
+
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+                               const void *message, uint32_t messageLen,
+                               void *mac, uint32_t *macLen) {
+    size_t len;
+
+    if (!operation->mac)
+        sim_panic("MAC final before init");
+    if (*macLen < 32) {
+        *macLen = 32;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    if (messageLen)
+        EVP_MAC_update(operation->mac, message, messageLen);
+    EVP_MAC_final(operation->mac, mac, &len, *macLen);
+    *macLen = len;
+    free_ctx(operation);
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+                               const void *message, uint32_t messageLen,
+                               const void *mac, uint32_t macLen) {
+    uint8_t computed[32];
+    uint32_t len = sizeof(computed);
+    TEE_Result res;
+
+    res = TEE_MACComputeFinal(operation, message, messageLen, computed, &len);
+    if (res != TEE_SUCCESS)
+        return res;
+    if (macLen != len || CRYPTO_memcmp(computed, mac, len))
+        return TEE_ERROR_MAC_INVALID;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AEInit(TEE_OperationHandle operation, const void *nonce,
+                      uint32_t nonceLen, uint32_t tagLen,
+                      uint32_t AADLen __unused, uint32_t payloadLen __unused) {
+    EVP_CIPHER_CTX *c;
+
+    if (!operation->key_set)
+        sim_panic("AE init without key");
+    if (tagLen % 8 || tagLen < 96 || tagLen > 128)
+        return TEE_ERROR_NOT_SUPPORTED;
+    free_ctx(operation);
+    c = EVP_CIPHER_CTX_new();
+    EVP_CipherInit_ex(c, aes_cipher(operation), NULL, NULL, NULL,
+                      operation->mode == TEE_MODE_ENCRYPT);
+    EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_GCM_SET_IVLEN, nonceLen, NULL);
+    EVP_CipherInit_ex(c, NULL, NULL, operation->key.secret, nonce, -1);
+    operation->cipher = c;
+    operation->tag_len = tagLen / 8;
+    return TEE_SUCCESS;
+}
+
+void TEE_AEUpdateAAD(TEE_OperationHandle operation, const void *AADdata,
+                     uint32_t AADdataLen) {
+    int outl;
+
+    if (!operation->cipher)
+        sim_panic("AE AAD before init");
+    EVP_CipherUpdate(operation->cipher, NULL, &outl, AADdata, AADdataLen);
+}
+
+TEE_Result TEE_AEUpdate(TEE_OperationHandle operation, const void *srcData,
+                        uint32_t srcLen, void *destData, uint32_t *destLen) {
+    int outl;
+
+    if (!operation->cipher)
+        sim_panic("AE update before init");
+    if (*destLen < srcLen) {
+        *destLen = srcLen;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    if (!EVP_CipherUpdate(operation->cipher, destData, &outl, srcData, srcLen))
+        return TEE_ERROR_BAD_STATE;
+    *destLen = outl;
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AEEncryptFinal(TEE_OperationHandle operation,
+                              const void *srcData, uint32_t srcLen,
+                              void *destData, uint32_t *destLen, void *tag,
+                              uint32_t *tagLen) {
+    TEE_Result res;
+    int outl;
+
+    if (*tagLen < operation->tag_len) {
+        *tagLen = operation->tag_len;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    res = TEE_AEUpdate(operation, srcData, srcLen, destData, destLen);
+    if (res != TEE_SUCCESS)
+        return res;
+    EVP_CipherFinal_ex(operation->cipher, NULL, &outl);
+    EVP_CIPHER_CTX_ctrl(operation->cipher, EVP_CTRL_GCM_GET_TAG,
+                        operation->tag_len, tag);
+    *tagLen = operation->tag_len;
+    free_ctx(operation);
+    return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AEDecryptFinal(TEE_OperationHandle operation,
+                              const void *srcData, uint32_t srcLen,
+                              void *destData, uint32_t *destLen,
+                              const void *tag, uint32_t tagLen) {
+    TEE_Result res;
+    int outl;
+
+    if (tagLen != operation->tag_len)
+        return TEE_ERROR_MAC_INVALID;
+    res = TEE_AEUpdate(operation, srcData, srcLen, destData, destLen);
+    if (res != TEE_SUCCESS)
+        return res;
+    EVP_CIPHER_CTX_ctrl(operation->cipher, EVP_CTRL_GCM_SET_TAG, tagLen,
+                        (void *)tag);
+    if (EVP_CipherFinal_ex(operation->cipher, NULL, &outl) <= 0) {
+        /* never hand out unauthenticated plaintext */
+        OPENSSL_cleanse(destData, *destLen);
+        res = TEE_ERROR_MAC_INVALID;
+    }
+    free_ctx(operation);
+    return res;
+}
+
+static EVP_PKEY *ecc_pkey(TEE_OperationHandle op) {
+    uint8_t pub[1 + 2 * SIM_ECC_LEN];
+    OSSL_PARAM_BLD *bld = OSSL_PARAM_BLD_new();
+    EVP_PKEY_CTX *ctx = NULL;
+    EVP_PKEY *pkey = NULL;
+    OSSL_PARAM *params;
+    BIGNUM *d = NULL;
+
+    pub[0] = 0x04;
+    memcpy(pub + 1, op->key.ecc_x, SIM_ECC_LEN);
+    memcpy(pub + 1 + SIM_ECC_LEN, op->key.ecc_y, SIM_ECC_LEN);
+    OSSL_PARAM_BLD_push_utf8_string(bld, OSSL_PKEY_PARAM_GROUP_NAME,
+                                    "prime256v1", 0);
+    OSSL_PARAM_BLD_push_octet_string(bld, OSSL_PKEY_PARAM_PUB_KEY, pub,
+                                     sizeof(pub));
+    if (op->key.type == TEE_TYPE_ECDSA_KEYPAIR) {
+        d = BN_bin2bn(op->key.ecc_d, SIM_ECC_LEN, NULL);
+        OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_PRIV_KEY, d);
+    }
+    params = OSSL_PARAM_BLD_to_param(bld);
+    ctx = EVP_PKEY_CTX_new_from_name(NULL, "EC", NULL);
+    if (ctx && params && EVP_PKEY_fromdata_init(ctx) > 0)
+        EVP_PKEY_fromdata(ctx, &pkey,
+                          d ? EVP_PKEY_KEYPAIR : EVP_PKEY_PUBLIC_KEY, params);
+    EVP_PKEY_CTX_free(ctx);
+    OSSL_PARAM_free(params);
+    OSSL_PARAM_BLD_free(bld);
+    BN_clear_free(d);
+    return pkey;
+}
+
+TEE_Result TEE_AsymmetricSignDigest(TEE_OperationHandle operation,
+                                    const TEE_Attribute *params __unused,
+                                    uint32_t paramCount __unused,
+                                    const void *digest, uint32_t digestLen,
+                                    void *signature, uint32_t *signatureLen) {
+    uint8_t der[80];
+    size_t der_len = sizeof(der);
+    const unsigned char *p = der;
+    TEE_Result res = TEE_ERROR_GENERIC;
+    EVP_PKEY_CTX *ctx = NULL;
+    ECDSA_SIG *sig = NULL;
+    EVP_PKEY *pkey;
+
+    if (!operation->key_set || operation->mode != TEE_MODE_SIGN)
+        sim_panic("sign without key");
+    if (*signatureLen < 2 * SIM_ECC_LEN) {
+        *signatureLen = 2 * SIM_ECC_LEN;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    pkey = ecc_pkey(operation);
+    if (!pkey)
+        return TEE_ERROR_BAD_PARAMETERS;
+    ctx = EVP_PKEY_CTX_new(pkey, NULL);
+    if (ctx && EVP_PKEY_sign_init(ctx) > 0 &&
+        EVP_PKEY_sign(ctx, der, &der_len, digest, digestLen) > 0 &&
+        (sig = d2i_ECDSA_SIG(NULL, &p, der_len)) &&
+        !bn_to_bin32(ECDSA_SIG_get0_r(sig), signature) &&
+        !bn_to_bin32(ECDSA_SIG_get0_s(sig), (uint8_t *)signature + 32)) {
+        *signatureLen = 2 * SIM_ECC_LEN;
+        res = TEE_SUCCESS;
+    }
+    ECDSA_SIG_free(sig);
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+    return res;
+}
+
+TEE_Result TEE_AsymmetricVerifyDigest(TEE_OperationHandle operation,
+                                      const TEE_Attribute *params __unused,
+                                      uint32_t paramCount __unused,
+                                      const void *digest, uint32_t digestLen,
+                                      const void *signature,
+                                      uint32_t signatureLen) {
+    const uint8_t *s = signature;
+    TEE_Result res = TEE_ERROR_SIGNATURE_INVALID;
+    unsigned char *der = NULL;
+    EVP_PKEY_CTX *ctx = NULL;
+    ECDSA_SIG *sig;
+    EVP_PKEY *pkey;
+    int der_len;
+
+    if (!operation->key_set || operation->mode != TEE_MODE_VERIFY)
+        sim_panic("verify without key");
+    if (signatureLen != 2 * SIM_ECC_LEN)
+        return TEE_ERROR_SIGNATURE_INVALID;
+    pkey = ecc_pkey(operation);
+    if (!pkey)
+        return TEE_ERROR_BAD_PARAMETERS;
+    sig = ECDSA_SIG_new();
+    ECDSA_SIG_set0(sig, BN_bin2bn(s, 32, NULL), BN_bin2bn(s + 32, 32, NULL));
+    der_len = i2d_ECDSA_SIG(sig, &der);
+    ctx = EVP_PKEY_CTX_new(pkey, NULL);
+    if (der_len > 0 && ctx && EVP_PKEY_verify_init(ctx) > 0 &&
+        EVP_PKEY_verify(ctx, der, der_len, digest, digestLen) == 1)
+        res = TEE_SUCCESS;
+    OPENSSL_free(der);
+    ECDSA_SIG_free(sig);
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+    return res;
+}
@@ -0,0 +1,287 @@
+/*
+ * In-process stand-in for libteec: sessions and commands are dispatched
+ * straight into the TA entry points linked into the same binary.
+ *
+ * There is only one copy of the globals of the TA, so the sessions of a
+ * process share one instance even when the TA_FLAGS of the TA give every
+ * session its own, and all entry point calls are serialized on one lock.
+ * The instance is created with the first session and destroyed with the
+ * last one, or at exit when it is single instance and kept alive.
+ *
+ * The entry points run on the stack of the caller, which also runs OpenSSL
+ * for the TEE Internal API, so TA_STACK_SIZE is not enforced. The TA
+ * sources are built with a limit on their frame size instead.
+ *
+ * SEAL_KEY_SIM_SWITCH_NS adds a busy wait to every open/invoke/close to
+ * model the cost of a world switch.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <tee_client_api.h>
+#include <tee_internal_api.h>
+#include <user_ta_header.h>
+#include <user_ta_header_defines.h>
+
+#define TA_KEEP_ALIVE                                                          \
+    ((TA_FLAGS & TA_FLAG_SINGLE_INSTANCE) &&                                   \
+     (TA_FLAGS & TA_FLAG_INSTANCE_KEEP_ALIVE))
+
+static pthread_mutex_t ta_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int ta_sessions;
+static int ta_alive;
+static uint32_t next_session_id = 1;
+
+static void ta_destroy(void) {
+    pthread_mutex_lock(&ta_lock);
+    if (ta_alive)
+        TA_DestroyEntryPoint();
+    ta_alive = 0;
+    pthread_mutex_unlock(&ta_lock);
+}
+
+static void world_switch(void) {
+    static long delay_ns = -1;
+    struct timespec start, now;
+
+    if (delay_ns < 0) {
+        const char *env = getenv("SEAL_KEY_SIM_SWITCH_NS");
+
+        delay_ns = env ? atol(env) : 0;
+    }
+    if (delay_ns <= 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000000L +
+                 (now.tv_nsec - start.tv_nsec) <
+             delay_ns);
+}
+
+TEEC_Result TEEC_InitializeContext(const char *name __unused,
+                                   TEEC_Context *context) {
+    if (!context)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    memset(context, 0, sizeof(*context));
+    return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context *context __unused) {}
+
+/*
+ * Translate the client parameters into TA parameters. Memory references are
+ * passed through without a bounce buffer since both sides share one address
+ * space.
+ */
+static TEEC_Result to_ta_params(TEEC_Operation *op, uint32_t *types,
+                                TEE_Param params[4]) {
+    *types = 0;
+    memset(params, 0, sizeof(TEE_Param) * 4);
+    if (!op)
+        return TEEC_SUCCESS;
+
+    for (int i = 0; i < 4; i++) {
+        uint32_t t = TEEC_PARAM_TYPE_GET(op->paramTypes, i);
+        TEEC_Parameter *p = op->params + i;
+        uint32_t ta_type;
+
+        switch (t) {
+        case TEEC_NONE:
+            ta_type = TEE_PARAM_TYPE_NONE;
+            break;
+        case TEEC_VALUE_INPUT:
+        case TEEC_VALUE_OUTPUT:
+        case TEEC_VALUE_INOUT:
+            ta_type = t;
+            params[i].value.a = p->value.a;
+            params[i].value.b = p->value.b;
+            break;
+        case TEEC_MEMREF_TEMP_INPUT:
+        case TEEC_MEMREF_TEMP_OUTPUT:
+        case TEEC_MEMREF_TEMP_INOUT:
+            ta_type = t;
+            params[i].memref.buffer = p->tmpref.buffer;
+            params[i].memref.size = p->tmpref.size;
+            break;
+        case TEEC_MEMREF_WHOLE:
+            if (!p->memref.parent)
+                return TEEC_ERROR_BAD_PARAMETERS;
+            ta_type = TEE_PARAM_TYPE_MEMREF_INPUT - 1 +
+                      (p->memref.parent->flags &
+                       (TEEC_MEM_INPUT | TEEC_MEM_OUTPUT));
+            params[i].memref.buffer = p->memref.parent->buffer;
+            params[i].memref.size = p->memref.parent->size;
+            break;
+        case TEEC_MEMREF_PARTIAL_INPUT:
+        case TEEC_MEMREF_PARTIAL_OUTPUT:
+        case TEEC_MEMREF_PARTIAL_INOUT:
+            if (!p->memref.parent ||
+                p->memref.offset + p->memref.size > p->memref.parent->size)
+                return TEEC_ERROR_BAD_PARAMETERS;
+            ta_type = t - TEEC_MEMREF_PARTIAL_INPUT +
+                      TEE_PARAM_TYPE_MEMREF_INPUT;
+            params[i].memref.buffer =
+                (uint8_t *)p->memref.parent->buffer + p->memref.offset;
+            params[i].memref.size = p->memref.size;
+            break;
+        default:
+            return TEEC_ERROR_BAD_PARAMETERS;
+        }
+        *types |= ta_type << (i * 4);
+    }
+    return TEEC_SUCCESS;
+}
+
+static void from_ta_params(TEEC_Operation *op, TEE_Param params[4]) {
+    if (!op)
+        return;
+
+    for (int i = 0; i < 4; i++) {
+        uint32_t t = TEEC_PARAM_TYPE_GET(op->paramTypes, i);
+        TEEC_Parameter *p = op->params + i;
+
+        switch (t) {
+        case TEEC_VALUE_OUTPUT:
+        case TEEC_VALUE_INOUT:
+            p->value.a = params[i].value.a;
+            p->value.b = params[i].value.b;
+            break;
+        case TEEC_MEMREF_TEMP_OUTPUT:
+        case TEEC_MEMREF_TEMP_INOUT:
+            p->tmpref.size = params[i].memref.size;
+            break;
+        case TEEC_MEMREF_WHOLE:
+        case TEEC_MEMREF_PARTIAL_OUTPUT:
+        case TEEC_MEMREF_PARTIAL_INOUT:
+            p->memref.size = params[i].memref.size;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context *context, TEEC_Session *session,
+                             const TEEC_UUID *destination __unused,
+                             uint32_t connectionMethod,
+                             const void *connectionData __unused,
+                             TEEC_Operation *operation,
+                             uint32_t *returnOrigin) {
+    TEE_Param params[4];
+    TEEC_Result res;
+    uint32_t types;
+
+    if (returnOrigin)
+        *returnOrigin = TEEC_ORIGIN_API;
+    if (!context || !session || connectionMethod != TEEC_LOGIN_PUBLIC)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    res = to_ta_params(operation, &types, params);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    world_switch();
+    pthread_mutex_lock(&ta_lock);
+    if (!ta_alive) {
+        res = TA_CreateEntryPoint();
+        if (res != TEE_SUCCESS) {
+            pthread_mutex_unlock(&ta_lock);
+            if (returnOrigin)
+                *returnOrigin = TEEC_ORIGIN_TRUSTED_APP;
+            return res;
+        }
+        /* A kept alive instance lasts until the TEE, here the process, ends */
+        if (TA_KEEP_ALIVE)
+            atexit(ta_destroy);
+        ta_alive = 1;
+    }
+    res = TA_OpenSessionEntryPoint(types, params, &session->ta_session);
+    if (res == TEE_SUCCESS) {
+        ta_sessions++;
+        session->session_id = next_session_id++;
+    } else if (!ta_sessions && !TA_KEEP_ALIVE) {
+        TA_DestroyEntryPoint();
+        ta_alive = 0;
+    }
+    pthread_mutex_unlock(&ta_lock);
+
+    from_ta_params(operation, params);
+    session->ctx = context;
+    if (returnOrigin)
+        *returnOrigin = TEEC_ORIGIN_TRUSTED_APP;
+    return res;
+}
+
+void TEEC_CloseSession(TEEC_Session *session) {
+    if (!session || !session->ctx)
+        return;
+    world_switch();
+    pthread_mutex_lock(&ta_lock);
+    TA_CloseSessionEntryPoint(session->ta_session);
+    if (!--ta_sessions && !TA_KEEP_ALIVE) {
+        TA_DestroyEntryPoint();
+        ta_alive = 0;
+    }
+    pthread_mutex_unlock(&ta_lock);
+    session->ctx = NULL;
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session *session, uint32_t commandID,
+                               TEEC_Operation *operation,
+                               uint32_t *returnOrigin) {
+    TEE_Param params[4];
+    TEEC_Result res;
+    uint32_t types;
+
+    if (returnOrigin)
+        *returnOrigin = TEEC_ORIGIN_API;
+    if (!session || !session->ctx)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    res = to_ta_params(operation, &types, params);
+    if (res != TEEC_SUCCESS)
+        return res;
+
+    world_switch();
+    pthread_mutex_lock(&ta_lock);
+    res = TA_InvokeCommandEntryPoint(session->ta_session, commandID, types,
+                                     params);
+    pthread_mutex_unlock(&ta_lock);
+
+    from_ta_params(operation, params);
+    if (returnOrigin)
+        *returnOrigin = TEEC_ORIGIN_TRUSTED_APP;
+    return res;
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *context,
+                                      TEEC_SharedMemory *sharedMem) {
+    if (!context || !sharedMem)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    sharedMem->allocated = 0;
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context *context,
+                                      TEEC_SharedMemory *sharedMem) {
+    if (!context || !sharedMem)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    sharedMem->buffer = calloc(1, sharedMem->size ? sharedMem->size : 1);
+    if (!sharedMem->buffer)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    sharedMem->allocated = 1;
+    return TEEC_SUCCESS;
+}
+
+void TEEC_ReleaseSharedMemory(TEEC_SharedMemory *sharedMemory) {
+    if (!sharedMemory)
+        return;
+    if (sharedMemory->allocated)
+        free(sharedMemory->buffer);
+    sharedMemory->buffer = NULL;
+    sharedMemory->allocated = 0;
+}
+
+void TEEC_RequestCancellation(TEEC_Operation *operation __unused) {}
@@ -0,0 +1,388 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <string.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "archive.h"
+#include "batch.h"
+#include "key.h"
+
+#define ARCHIVE_HDR_SIZE TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE
+
+static bool archive_is_key(struct archive *a, const void *id, uint32_t id_sz) {
+    return id_sz == a->key_id_sz && !TEE_MemCompare(id, a->key_id, id_sz);
+}
+
+/* Nonce of chunk @index, the last chunk is flagged to detect truncation */
+static void archive_nonce(struct archive *a, bool last, uint8_t *nonce) {
+    TEE_MemMove(nonce, a->prefix, sizeof(a->prefix));
+    nonce[7] = a->index >> 24;
+    nonce[8] = a->index >> 16;
+    nonce[9] = a->index >> 8;
+    nonce[10] = a->index;
+    nonce[11] = last ? 1 : 0;
+}
+
+void archive_release(struct archive *a) {
+    key_put_operation(a->op);
+    a->op = TEE_HANDLE_NULL;
+    if (a->e != TEE_HANDLE_NULL)
+        TEE_FreePersistentObjectEnumerator(a->e);
+    a->e = TEE_HANDLE_NULL;
+    a->index = 0;
+    a->done = false;
+    a->pending_sz = 0;
+}
+
+TEE_Result archive_init(struct archive *a, uint32_t param_types,
+                        TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INOUT, TEE_PARAM_TYPE_NONE);
+    uint32_t mode;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (!params[0].memref.size ||
+        params[0].memref.size > TEE_OBJECT_ID_MAX_LEN ||
+        params[2].memref.size != TA_SEAL_KEY_CHUNK_PREFIX_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    switch (params[1].value.a) {
+    case TA_SEAL_KEY_MODE_ENCRYPT:
+        mode = TEE_MODE_ENCRYPT;
+        break;
+    case TA_SEAL_KEY_MODE_DECRYPT:
+        mode = TEE_MODE_DECRYPT;
+        break;
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    archive_release(a);
+    a->key_id_sz = params[0].memref.size;
+    TEE_MemMove(a->key_id, params[0].memref.buffer, a->key_id_sz);
+    res = key_get_operation(a->key_id, a->key_id_sz, TEE_ALG_AES_GCM, mode,
+                            &a->op);
+    if (res != TEE_SUCCESS)
+        return res;
+    a->mode = mode;
+    a->flags = params[1].value.b;
+
+    if (mode == TEE_MODE_ENCRYPT) {
+        res = TEE_AllocatePersistentObjectEnumerator(&a->e);
+        if (res == TEE_SUCCESS)
+            res = TEE_StartPersistentObjectEnumerator(a->e,
+                                                      TEE_STORAGE_PRIVATE);
+        if (res != TEE_SUCCESS) {
+            archive_release(a);
+            return res;
+        }
+        TEE_GenerateRandom(a->prefix, sizeof(a->prefix));
+        TEE_MemMove(params[2].memref.buffer, a->prefix, sizeof(a->prefix));
+    } else {
+        TEE_MemMove(a->prefix, params[2].memref.buffer, sizeof(a->prefix));
+    }
+    return TEE_SUCCESS;
+}
+
+/*
+ * Append the pending object to the chunk @buf at @pos. Returns
+ * TEE_ERROR_SHORT_BUFFER when it has to go into the next chunk.
+ */
+static TEE_Result archive_put(struct archive *a, uint8_t *buf, uint32_t *pos) {
+    uint32_t data_pos = *pos + ARCHIVE_HDR_SIZE + a->pending_sz;
+    uint32_t data_sz;
+    TEE_Result res;
+
+    if (data_pos >= TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE)
+        return TEE_ERROR_SHORT_BUFFER;
+    data_sz = TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE - data_pos;
+    res = key_read_raw(a->pending, a->pending_sz, buf + data_pos, &data_sz);
+    /* key_read_raw tells an object too large for the buffer this way */
+    if (res == TEE_ERROR_BAD_FORMAT)
+        return TEE_ERROR_SHORT_BUFFER;
+    if (res != TEE_SUCCESS)
+        return res;
+
+    put_be32(buf + *pos, a->pending_sz);
+    put_be32(buf + *pos + 4, data_sz);
+    TEE_MemMove(buf + *pos + ARCHIVE_HDR_SIZE, a->pending, a->pending_sz);
+    *pos = data_pos + data_sz;
+    return TEE_SUCCESS;
+}
+
+/* Seal the @pos bytes of plaintext in @buf as the next chunk into @params */
+static TEE_Result archive_seal(struct archive *a, uint8_t *buf, uint32_t pos,
+                               bool last, TEE_Param params[4]) {
+    uint8_t nonce[TA_SEAL_KEY_AE_NONCE_SIZE];
+    uint8_t tag[TA_SEAL_KEY_AE_TAG_SIZE];
+    uint32_t tag_sz = sizeof(tag);
+    uint8_t *dst = params[0].memref.buffer;
+    uint32_t dst_sz = TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE;
+    TEE_Result res;
+
+    archive_nonce(a, last, nonce);
+    res = TEE_AEInit(a->op, nonce, sizeof(nonce), sizeof(tag) * 8, 0, 0);
+    if (res != TEE_SUCCESS)
+        return res;
+    res = TEE_AEEncryptFinal(a->op, buf, pos, dst, &dst_sz, tag, &tag_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_MemMove(dst + dst_sz, tag, tag_sz);
+
+    params[0].memref.size = dst_sz + tag_sz;
+    params[1].value.a = last;
+    a->index++;
+    a->done = last;
+    return TEE_SUCCESS;
+}
+
+/* Check that an export can go on and @params can take a whole chunk */
+static TEE_Result archive_export_check(struct archive *a, TEE_Param params[4]) {
+    if (a->op == TEE_HANDLE_NULL || a->mode != TEE_MODE_ENCRYPT || a->done)
+        return TEE_ERROR_BAD_STATE;
+    if (params[0].memref.size <
+        TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE + TA_SEAL_KEY_AE_TAG_SIZE) {
+        params[0].memref.size =
+            TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE + TA_SEAL_KEY_AE_TAG_SIZE;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    return TEE_SUCCESS;
+}
+
+TEE_Result archive_export(struct archive *a, uint32_t param_types,
+                          TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
+        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t count = 0;
+    uint32_t pos = 0;
+    bool last = false;
+    uint8_t *buf;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    res = archive_export_check(a, params);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    /* The plaintext is only ever held in TA memory */
+    buf = TEE_Malloc(TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE, TEE_MALLOC_FILL_ZERO);
+    if (!buf)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    while (true) {
+        if (!a->pending_sz) {
+            uint32_t id_sz = sizeof(a->pending);
+
+            res = TEE_GetNextPersistentObject(a->e, NULL, a->pending, &id_sz);
+            if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+                last = true;
+                break;
+            }
+            if (res != TEE_SUCCESS)
+                goto exit;
+            if (archive_is_key(a, a->pending, id_sz))
+                continue;
+            a->pending_sz = id_sz;
+        }
+
+        res = archive_put(a, buf, &pos);
+        if (res == TEE_ERROR_SHORT_BUFFER && pos)
+            break;
+        if (res != TEE_SUCCESS) {
+            EMSG("Failed to export object %" PRIu32 " of chunk %" PRIu32
+                 ", res=0x%08x",
+                 count, a->index, res);
+            goto exit;
+        }
+        a->pending_sz = 0;
+        count++;
+    }
+
+    res = archive_seal(a, buf, pos, last, params);
+    if (res == TEE_SUCCESS)
+        params[1].value.b = count;
+exit:
+    TEE_MemFill(buf, 0, TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE);
+    TEE_Free(buf);
+    return res;
+}
+
+TEE_Result archive_export_ids(struct archive *a, uint32_t param_types,
+                              TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE);
+    const uint8_t *ids = params[2].memref.buffer;
+    uint32_t ids_sz = params[2].memref.size;
+    bool last_ids = params[1].value.a;
+    uint32_t off = 0;
+    uint32_t pos = 0;
+    uint8_t *buf;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    res = archive_export_check(a, params);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    buf = TEE_Malloc(TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE, TEE_MALLOC_FILL_ZERO);
+    if (!buf)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    while (off < ids_sz) {
+        /* Read the length once, the list lives in shared memory */
+        uint32_t id_sz = ids[off];
+
+        if (!id_sz || id_sz > sizeof(a->pending) || id_sz >= ids_sz - off) {
+            res = TEE_ERROR_BAD_PARAMETERS;
+            goto exit;
+        }
+        TEE_MemMove(a->pending, ids + off + 1, id_sz);
+        a->pending_sz = id_sz;
+        if (!archive_is_key(a, a->pending, id_sz)) {
+            res = archive_put(a, buf, &pos);
+            if (res == TEE_ERROR_SHORT_BUFFER && pos)
+                break;
+            /* Deleted since it was listed */
+            if (res != TEE_SUCCESS && res != TEE_ERROR_ITEM_NOT_FOUND) {
+                EMSG("Failed to export an object of chunk %" PRIu32
+                     ", res=0x%08x",
+                     a->index, res);
+                goto exit;
+            }
+        }
+        off += 1 + id_sz;
+    }
+
+    res = archive_seal(a, buf, pos, last_ids && off == ids_sz, params);
+    if (res == TEE_SUCCESS)
+        params[1].value.b = off;
+exit:
+    a->pending_sz = 0;
+    TEE_MemFill(buf, 0, TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE);
+    TEE_Free(buf);
+    return res;
+}
+
+/* Store the object of the record at @pos, @stored tells whether it existed */
+static TEE_Result archive_store(struct archive *a, const uint8_t *buf,
+                                uint32_t buf_sz, uint32_t *pos,
+                                bool *stored) {
+    uint32_t flags = TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE |
+                     TEE_DATA_FLAG_ACCESS_WRITE_META;
+    const uint8_t *id;
+    uint32_t id_sz;
+    uint32_t data_sz;
+    TEE_ObjectHandle object;
+    TEE_Result res;
+
+    *stored = false;
+    if (buf_sz - *pos < ARCHIVE_HDR_SIZE)
+        return TEE_ERROR_BAD_FORMAT;
+    id_sz = get_be32(buf + *pos);
+    data_sz = get_be32(buf + *pos + 4);
+    id = buf + *pos + ARCHIVE_HDR_SIZE;
+    if (!id_sz || id_sz > TEE_OBJECT_ID_MAX_LEN ||
+        data_sz > buf_sz - *pos - ARCHIVE_HDR_SIZE - id_sz ||
+        memchr(id, '/', id_sz))
+        return TEE_ERROR_BAD_FORMAT;
+    *pos += ARCHIVE_HDR_SIZE + id_sz + data_sz;
+
+    if (archive_is_key(a, id, id_sz))
+        return TEE_SUCCESS;
+    if (a->flags & TA_SEAL_KEY_ARCHIVE_OVERWRITE)
+        flags |= TEE_DATA_FLAG_OVERWRITE;
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, id, id_sz, flags,
+                                     TEE_HANDLE_NULL, id + id_sz, data_sz,
+                                     &object);
+    if (res == TEE_ERROR_ACCESS_CONFLICT)
+        return TEE_SUCCESS;
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_CloseObject(object);
+    key_invalidate(id, id_sz);
+    *stored = true;
+    return TEE_SUCCESS;
+}
+
+TEE_Result archive_import(struct archive *a, uint32_t param_types,
+                          TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_NONE);
+    uint8_t nonce[TA_SEAL_KEY_AE_NONCE_SIZE];
+    uint32_t src_sz = params[0].memref.size;
+    bool last = params[1].value.a;
+    uint32_t stored = 0;
+    uint32_t skipped = 0;
+    uint32_t buf_sz;
+    uint32_t pos = 0;
+    uint8_t *buf;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (a->op == TEE_HANDLE_NULL || a->mode != TEE_MODE_DECRYPT || a->done)
+        return TEE_ERROR_BAD_STATE;
+    if (src_sz < TA_SEAL_KEY_AE_TAG_SIZE ||
+        src_sz > TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE + TA_SEAL_KEY_AE_TAG_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    /*
+     * Copy the chunk out of shared memory first so the host cannot change
+     * it between authentication and use, then open it in place.
+     */
+    buf = TEE_Malloc(src_sz, 0);
+    if (!buf)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    TEE_MemMove(buf, params[0].memref.buffer, src_sz);
+    buf_sz = src_sz - TA_SEAL_KEY_AE_TAG_SIZE;
+
+    archive_nonce(a, last, nonce);
+    res = TEE_AEInit(a->op, nonce, sizeof(nonce),
+                     TA_SEAL_KEY_AE_TAG_SIZE * 8, 0, 0);
+    if (res != TEE_SUCCESS)
+        goto exit;
+    res = TEE_AEDecryptFinal(a->op, buf, buf_sz, buf, &buf_sz, buf + buf_sz,
+                             TA_SEAL_KEY_AE_TAG_SIZE);
+    if (res != TEE_SUCCESS) {
+        EMSG("Chunk %" PRIu32 " of the archive failed 0x%08x", a->index, res);
+        goto exit;
+    }
+
+    while (pos < buf_sz) {
+        bool done;
+
+        res = archive_store(a, buf, buf_sz, &pos, &done);
+        if (res != TEE_SUCCESS) {
+            EMSG("Failed to import a record of chunk %" PRIu32
+                 ", res=0x%08x",
+                 a->index, res);
+            goto exit;
+        }
+        if (done)
+            stored++;
+        else
+            skipped++;
+    }
+
+    params[2].value.a = stored;
+    params[2].value.b = skipped;
+    a->index++;
+    a->done = last;
+exit:
+    /* A broken archive cannot be continued */
+    if (res != TEE_SUCCESS)
+        archive_release(a);
+    TEE_MemFill(buf, 0, src_sz);
+    TEE_Free(buf);
+    return res;
+}
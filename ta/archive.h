@@ -0,0 +1,34 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <tee_internal_api.h>
+
+/* Export or import of the whole store kept per session */
+struct archive {
+    TEE_OperationHandle op;
+    uint32_t mode;
+    uint32_t flags;
+    TEE_ObjectEnumHandle e;
+    uint8_t prefix[TA_SEAL_KEY_CHUNK_PREFIX_SIZE];
+    uint32_t index;
+    bool done;
+    uint8_t key_id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t key_id_sz;
+    /* Object that did not fit into the previous chunk */
+    uint8_t pending[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t pending_sz;
+};
+
+TEE_Result archive_init(struct archive *a, uint32_t param_types,
+                        TEE_Param params[4]);
+TEE_Result archive_export(struct archive *a, uint32_t param_types,
+                          TEE_Param params[4]);
+TEE_Result archive_export_ids(struct archive *a, uint32_t param_types,
+                              TEE_Param params[4]);
+TEE_Result archive_import(struct archive *a, uint32_t param_types,
+                          TEE_Param params[4]);
+void archive_release(struct archive *a);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,189 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "batch.h"
+#include "key.h"
+
+/*
+ * Parse the header of the record at @pos and check that it lies within the
+ * input. @dst_max is the size of its output data.
+ */
+static TEE_Result batch_record(uint32_t mode, const uint8_t *in,
+                               uint32_t in_sz, uint32_t pos, uint32_t *aad_sz,
+                               uint32_t *data_sz, uint32_t *dst_max) {
+    if (in_sz - pos < TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+    *aad_sz = get_be32(in + pos);
+    *data_sz = get_be32(in + pos + 4);
+    pos += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE;
+    if (*aad_sz > in_sz - pos || *data_sz > in_sz - pos - *aad_sz)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (mode == TEE_MODE_ENCRYPT) {
+        if (*data_sz > UINT32_MAX - TA_SEAL_KEY_BATCH_OVERHEAD)
+            return TEE_ERROR_BAD_PARAMETERS;
+        *dst_max = *data_sz + TA_SEAL_KEY_BATCH_OVERHEAD;
+    } else if (*data_sz >= TA_SEAL_KEY_BATCH_OVERHEAD) {
+        *dst_max = *data_sz - TA_SEAL_KEY_BATCH_OVERHEAD;
+    } else {
+        *dst_max = 0;
+    }
+    return TEE_SUCCESS;
+}
+
+/*
+ * Walk the input records once to check that they are well formed and to
+ * compute the size of the output. Only the record headers are read.
+ */
+static TEE_Result batch_measure(uint32_t mode, const uint8_t *in,
+                                uint32_t in_sz, uint32_t count,
+                                uint32_t *out_sz) {
+    uint32_t pos = 0;
+    uint32_t need = 0;
+    uint32_t aad_sz, data_sz, dst_max, n;
+    TEE_Result res;
+
+    for (n = 0; n < count; n++) {
+        res = batch_record(mode, in, in_sz, pos, &aad_sz, &data_sz, &dst_max);
+        if (res != TEE_SUCCESS)
+            return res;
+        pos += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + aad_sz + data_sz;
+        if (dst_max > UINT32_MAX - TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE - need)
+            return TEE_ERROR_BAD_PARAMETERS;
+        need += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + dst_max;
+    }
+    *out_sz = need;
+    return TEE_SUCCESS;
+}
+
+static TEE_Result batch_seal_record(TEE_OperationHandle op, const uint8_t *aad,
+                                    uint32_t aad_sz, const uint8_t *src,
+                                    uint32_t src_sz, uint8_t *dst,
+                                    uint32_t *dst_sz) {
+    uint8_t *nonce = dst;
+    uint8_t *ct = dst + TA_SEAL_KEY_AE_NONCE_SIZE;
+    uint32_t ct_sz = src_sz;
+    uint32_t tag_sz = TA_SEAL_KEY_AE_TAG_SIZE;
+    TEE_Result res;
+
+    TEE_GenerateRandom(nonce, TA_SEAL_KEY_AE_NONCE_SIZE);
+    res = TEE_AEInit(op, nonce, TA_SEAL_KEY_AE_NONCE_SIZE,
+                     TA_SEAL_KEY_AE_TAG_SIZE * 8, 0, 0);
+    if (res != TEE_SUCCESS)
+        return res;
+    if (aad_sz)
+        TEE_AEUpdateAAD(op, aad, aad_sz);
+    res = TEE_AEEncryptFinal(op, src, src_sz, ct, &ct_sz, ct + src_sz,
+                             &tag_sz);
+    if (res == TEE_SUCCESS)
+        *dst_sz = TA_SEAL_KEY_AE_NONCE_SIZE + ct_sz + tag_sz;
+    return res;
+}
+
+static TEE_Result batch_unseal_record(TEE_OperationHandle op,
+                                      const uint8_t *aad, uint32_t aad_sz,
+                                      const uint8_t *src, uint32_t src_sz,
+                                      uint8_t *dst, uint32_t *dst_sz) {
+    uint8_t tag[TA_SEAL_KEY_AE_TAG_SIZE];
+    uint32_t ct_sz;
+    TEE_Result res;
+
+    if (src_sz < TA_SEAL_KEY_BATCH_OVERHEAD)
+        return TEE_ERROR_BAD_FORMAT;
+    ct_sz = src_sz - TA_SEAL_KEY_BATCH_OVERHEAD;
+    *dst_sz = ct_sz;
+
+    res = TEE_AEInit(op, src, TA_SEAL_KEY_AE_NONCE_SIZE,
+                     TA_SEAL_KEY_AE_TAG_SIZE * 8, 0, 0);
+    if (res != TEE_SUCCESS)
+        return res;
+    if (aad_sz)
+        TEE_AEUpdateAAD(op, aad, aad_sz);
+    TEE_MemMove(tag, src + src_sz - sizeof(tag), sizeof(tag));
+    return TEE_AEDecryptFinal(op, src + TA_SEAL_KEY_AE_NONCE_SIZE, ct_sz, dst,
+                              dst_sz, tag, sizeof(tag));
+}
+
+/*
+ * Seal or unseal a vector of records with one pooled operation, so the
+ * cost of the world switch and of the key setup is shared by the whole
+ * batch. A record that fails gets its status in the output and the batch
+ * goes on with the next one.
+ */
+TEE_Result batch_process(uint32_t mode, uint32_t param_types,
+                         TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_VALUE_INOUT);
+    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    const uint8_t *in = params[1].memref.buffer;
+    uint32_t in_sz = params[1].memref.size;
+    uint8_t *out = params[2].memref.buffer;
+    uint32_t count = params[3].value.a;
+    uint32_t in_pos = 0;
+    uint32_t out_pos = 0;
+    uint32_t failed = 0;
+    uint32_t out_sz, aad_sz, data_sz, dst_max, n;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = batch_measure(mode, in, in_sz, count, &out_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    if (out_sz > params[2].memref.size) {
+        params[2].memref.size = out_sz;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    res = key_get_operation(params[0].memref.buffer, params[0].memref.size,
+                            TEE_ALG_AES_GCM, mode, &op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    for (n = 0; n < count; n++) {
+        const uint8_t *aad = in + in_pos + TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE;
+        uint8_t *dst = out + out_pos + TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE;
+        uint32_t dst_sz = 0;
+
+        /*
+         * The input is shared memory and may have changed since it was
+         * measured, so the bounds are checked again.
+         */
+        res = batch_record(mode, in, in_sz, in_pos, &aad_sz, &data_sz,
+                           &dst_max);
+        if (res == TEE_SUCCESS &&
+            (out_sz - out_pos < TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE ||
+             dst_max > out_sz - out_pos - TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE))
+            res = TEE_ERROR_BAD_PARAMETERS;
+        if (res != TEE_SUCCESS)
+            break;
+        if (mode == TEE_MODE_ENCRYPT)
+            res = batch_seal_record(op, aad, aad_sz, aad + aad_sz, data_sz,
+                                    dst, &dst_sz);
+        else
+            res = batch_unseal_record(op, aad, aad_sz, aad + aad_sz, data_sz,
+                                      dst, &dst_sz);
+        if (res != TEE_SUCCESS) {
+            /* Never hand out the plaintext of a record that failed */
+            TEE_MemFill(dst, 0, dst_sz);
+            dst_sz = 0;
+            failed++;
+        }
+        put_be32(out + out_pos, res);
+        put_be32(out + out_pos + 4, dst_sz);
+        in_pos += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + aad_sz + data_sz;
+        out_pos += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + dst_sz;
+        res = TEE_SUCCESS;
+    }
+    key_put_operation(op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    params[2].memref.size = out_pos;
+    params[3].value.b = failed;
+    return TEE_SUCCESS;
+}
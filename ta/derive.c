@@ -0,0 +1,226 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <string.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "derive.h"
+#include "key.h"
+
+#define DERIVE_HASH_SIZE 32
+
+/*
+ * Derived keys are cached by their full ID, root '/' label, so a repeated
+ * derivation does not have to read the root from secure storage and run
+ * HKDF again. The cache is shared by the sessions of the instance.
+ */
+struct derive_entry {
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t id_sz;
+    uint32_t root_sz;
+    uint8_t key[TA_SEAL_KEY_DERIVE_MAX_SIZE];
+    uint32_t last_use;
+};
+
+static struct derive_entry derive_cache[DERIVE_CACHE_SIZE];
+static uint32_t derive_clock;
+
+/* HMAC-SHA256 of the concatenation of up to three buffers */
+static TEE_Result derive_hmac(const void *key, uint32_t key_sz, const void *a,
+                              uint32_t a_sz, const void *b, uint32_t b_sz,
+                              const void *c, uint32_t c_sz, void *mac) {
+    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    TEE_ObjectHandle obj = TEE_HANDLE_NULL;
+    TEE_Attribute attr;
+    TEE_Result res;
+    uint32_t mac_sz = DERIVE_HASH_SIZE;
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_HMAC_SHA256, key_sz * 8, &obj);
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, (void *)key, key_sz);
+    res = TEE_PopulateTransientObject(obj, &attr, 1);
+    if (res != TEE_SUCCESS)
+        goto exit;
+    res = TEE_AllocateOperation(&op, TEE_ALG_HMAC_SHA256, TEE_MODE_MAC,
+                                key_sz * 8);
+    if (res != TEE_SUCCESS)
+        goto exit;
+    res = TEE_SetOperationKey(op, obj);
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    TEE_MACInit(op, NULL, 0);
+    if (a_sz)
+        TEE_MACUpdate(op, a, a_sz);
+    if (b_sz)
+        TEE_MACUpdate(op, b, b_sz);
+    res = TEE_MACComputeFinal(op, c, c_sz, mac, &mac_sz);
+exit:
+    if (op != TEE_HANDLE_NULL)
+        TEE_FreeOperation(op);
+    TEE_FreeTransientObject(obj);
+    return res;
+}
+
+/*
+ * HKDF-SHA256 (RFC 5869) with an empty salt. The GP API has no HKDF
+ * algorithm, both steps are built from HMAC-SHA256. The salt is a hash
+ * length of zeros so it also satisfies the minimum HMAC key size.
+ */
+static TEE_Result derive_hkdf(const void *ikm, uint32_t ikm_sz,
+                              const void *info, uint32_t info_sz, uint8_t *okm,
+                              uint32_t okm_sz) {
+    uint8_t salt[DERIVE_HASH_SIZE] = {0};
+    uint8_t prk[DERIVE_HASH_SIZE];
+    uint8_t t[DERIVE_HASH_SIZE];
+    uint32_t t_sz = 0;
+    uint32_t done = 0;
+    uint8_t counter = 0;
+    TEE_Result res;
+
+    res = derive_hmac(salt, sizeof(salt), ikm, ikm_sz, NULL, 0, NULL, 0, prk);
+    while (res == TEE_SUCCESS && done < okm_sz) {
+        uint32_t n = okm_sz - done;
+
+        if (n > DERIVE_HASH_SIZE)
+            n = DERIVE_HASH_SIZE;
+        counter++;
+        res = derive_hmac(prk, sizeof(prk), t, t_sz, info, info_sz, &counter,
+                          1, t);
+        t_sz = sizeof(t);
+        if (res == TEE_SUCCESS)
+            TEE_MemMove(okm + done, t, n);
+        done += n;
+    }
+    TEE_MemFill(prk, 0, sizeof(prk));
+    TEE_MemFill(t, 0, sizeof(t));
+    return res;
+}
+
+/* A free slot, or the least recently used one, wiped */
+static struct derive_entry *derive_victim(void) {
+    struct derive_entry *victim = NULL;
+    size_t n;
+
+    for (n = 0; n < DERIVE_CACHE_SIZE; n++) {
+        struct derive_entry *e = derive_cache + n;
+
+        if (!e->id_sz) {
+            victim = e;
+            break;
+        }
+        if (!victim || e->last_use < victim->last_use)
+            victim = e;
+    }
+    TEE_MemFill(victim, 0, sizeof(*victim));
+    return victim;
+}
+
+/*
+ * Derive the key @id, root '/' label, into @key, at most
+ * TA_SEAL_KEY_DERIVE_MAX_SIZE bytes. @hit tells whether it was cached.
+ */
+TEE_Result derive_key(const void *id, uint32_t id_sz, void *key,
+                      uint32_t key_sz, bool *hit) {
+    const uint8_t *slash = memchr(id, '/', id_sz);
+    struct derive_entry *e;
+    uint32_t root_sz;
+    uint32_t ikm_sz = KEY_MAX_SIZE;
+    uint8_t *ikm;
+    TEE_Result res;
+    size_t n;
+
+    if (!slash || id_sz > TEE_OBJECT_ID_MAX_LEN ||
+        key_sz > TA_SEAL_KEY_DERIVE_MAX_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+    root_sz = slash - (const uint8_t *)id;
+    if (!root_sz || root_sz + 1 == id_sz)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    for (n = 0; n < DERIVE_CACHE_SIZE; n++) {
+        e = derive_cache + n;
+        if (e->id_sz == id_sz && !TEE_MemCompare(e->id, id, id_sz)) {
+            e->last_use = ++derive_clock;
+            TEE_MemMove(key, e->key, key_sz);
+            *hit = true;
+            return TEE_SUCCESS;
+        }
+    }
+    *hit = false;
+
+    ikm = TEE_Malloc(KEY_MAX_SIZE, 0);
+    if (!ikm)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    res = key_read(id, root_sz, ikm, &ikm_sz);
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    e = derive_victim();
+    res = derive_hkdf(ikm, ikm_sz, slash + 1, id_sz - root_sz - 1, e->key,
+                      sizeof(e->key));
+    if (res != TEE_SUCCESS) {
+        TEE_MemFill(e, 0, sizeof(*e));
+        goto exit;
+    }
+    TEE_MemMove(e->id, id, id_sz);
+    e->id_sz = id_sz;
+    e->root_sz = root_sz;
+    e->last_use = ++derive_clock;
+    TEE_MemMove(key, e->key, key_sz);
+exit:
+    TEE_MemFill(ikm, 0, KEY_MAX_SIZE);
+    TEE_Free(ikm);
+    return res;
+}
+
+/* Forget the keys derived from @root, it was written or deleted */
+void derive_invalidate(const void *root, uint32_t root_sz) {
+    size_t n;
+
+    for (n = 0; n < DERIVE_CACHE_SIZE; n++) {
+        struct derive_entry *e = derive_cache + n;
+
+        if (e->id_sz && e->root_sz == root_sz &&
+            !TEE_MemCompare(e->id, root, root_sz))
+            TEE_MemFill(e, 0, sizeof(*e));
+    }
+}
+
+TEE_Result derive_command(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE);
+    uint8_t key[TA_SEAL_KEY_DERIVE_MAX_SIZE];
+    uint32_t flags;
+    uint32_t key_sz;
+    TEE_Result res;
+    bool hit;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    flags = params[1].value.a;
+    key_sz = params[1].value.b;
+    if (flags & TA_SEAL_KEY_DERIVE_PERSIST) {
+        if (key_sz < TA_SEAL_KEY_DERIVE_MIN_SIZE ||
+            key_sz > TA_SEAL_KEY_DERIVE_MAX_SIZE ||
+            !params[2].memref.size ||
+            params[2].memref.size > TEE_OBJECT_ID_MAX_LEN ||
+            memchr(params[2].memref.buffer, '/', params[2].memref.size))
+            return TEE_ERROR_BAD_PARAMETERS;
+    } else {
+        key_sz = TA_SEAL_KEY_DERIVE_KEY_SIZE;
+    }
+
+    res = derive_key(params[0].memref.buffer, params[0].memref.size, key,
+                     key_sz, &hit);
+    if (res == TEE_SUCCESS && (flags & TA_SEAL_KEY_DERIVE_PERSIST))
+        res = key_write(params[2].memref.buffer, params[2].memref.size, key,
+                        key_sz, true);
+    TEE_MemFill(key, 0, sizeof(key));
+
+    params[1].value.a = hit;
+    return res;
+}
@@ -0,0 +1,15 @@
+#ifndef DERIVE_H
+#define DERIVE_H
+
+#include <stdbool.h>
+#include <tee_internal_api.h>
+
+/* Number of derived keys kept by the derived key cache */
+#define DERIVE_CACHE_SIZE 16
+
+TEE_Result derive_key(const void *id, uint32_t id_sz, void *key,
+                      uint32_t key_sz, bool *hit);
+void derive_invalidate(const void *root, uint32_t root_sz);
+TEE_Result derive_command(uint32_t param_types, TEE_Param params[4]);
+
+#endif /* DERIVE_H */
@@ -0,0 +1,163 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <string.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "generate.h"
+#include "key.h"
+#include "wrap.h"
+
+/* Longest decimal representation of a uint32_t */
+#define GENERATE_NUMBER_SIZE 10
+
+/* Append @n in decimal to the @id_sz bytes of @id */
+static uint32_t generate_id(uint8_t *id, uint32_t id_sz, uint32_t n) {
+    uint8_t digits[GENERATE_NUMBER_SIZE];
+    uint32_t count = 0;
+
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (count)
+        id[id_sz++] = digits[--count];
+    return id_sz;
+}
+
+/* Read an ECC value left padded to KEY_ECC_P256_SIZE bytes */
+static TEE_Result generate_ecc_value(TEE_ObjectHandle obj, uint32_t attr,
+                                     uint8_t *out) {
+    uint8_t buf[KEY_ECC_P256_SIZE];
+    uint32_t sz = sizeof(buf);
+    TEE_Result res;
+
+    res = TEE_GetObjectBufferAttribute(obj, attr, buf, &sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_MemFill(out, 0, KEY_ECC_P256_SIZE - sz);
+    TEE_MemMove(out + KEY_ECC_P256_SIZE - sz, buf, sz);
+    TEE_MemFill(buf, 0, sizeof(buf));
+    return TEE_SUCCESS;
+}
+
+/*
+ * Generate an ECDSA P-256 key pair into @key in the layout key.c expects,
+ * the private value followed by the X and Y coordinates.
+ */
+static TEE_Result generate_ecdsa(uint8_t *key) {
+    TEE_ObjectHandle obj;
+    TEE_Attribute attr;
+    TEE_Result res;
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_ECDSA_KEYPAIR, 256, &obj);
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_InitValueAttribute(&attr, TEE_ATTR_ECC_CURVE, TEE_ECC_CURVE_NIST_P256,
+                           0);
+    res = TEE_GenerateKey(obj, 256, &attr, 1);
+    if (res == TEE_SUCCESS)
+        res = generate_ecc_value(obj, TEE_ATTR_ECC_PRIVATE_VALUE, key);
+    if (res == TEE_SUCCESS)
+        res = generate_ecc_value(obj, TEE_ATTR_ECC_PUBLIC_VALUE_X,
+                                 key + KEY_ECC_P256_SIZE);
+    if (res == TEE_SUCCESS)
+        res = generate_ecc_value(obj, TEE_ATTR_ECC_PUBLIC_VALUE_Y,
+                                 key + 2 * KEY_ECC_P256_SIZE);
+    TEE_FreeTransientObject(obj);
+    return res;
+}
+
+TEE_Result generate_command(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT);
+    uint8_t key[KEY_MAX_SIZE];
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t prefix_sz = params[0].memref.size;
+    uint32_t first = params[1].value.a;
+    uint32_t count = params[1].value.b;
+    uint32_t type = params[2].value.a;
+    uint32_t key_sz = params[2].value.b;
+    uint8_t *pub = params[3].memref.buffer;
+    uint32_t pub_sz = 0;
+    TEE_Result res = TEE_SUCCESS;
+    uint32_t n;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    params[1].value.b = 0;
+    if (!count || count > TA_SEAL_KEY_GENERATE_MAX_KEYS ||
+        first > UINT32_MAX - (count - 1) ||
+        prefix_sz + GENERATE_NUMBER_SIZE > TEE_OBJECT_ID_MAX_LEN ||
+        memchr(params[0].memref.buffer, '/', prefix_sz))
+        return TEE_ERROR_BAD_PARAMETERS;
+    TEE_MemMove(id, params[0].memref.buffer, prefix_sz);
+
+    switch (type) {
+    case TA_SEAL_KEY_TYPE_AES:
+        if (key_sz != 16 && key_sz != 24 && key_sz != 32)
+            return TEE_ERROR_BAD_PARAMETERS;
+        break;
+    case TA_SEAL_KEY_TYPE_HMAC_SHA256:
+        if (key_sz < KEY_HMAC_MIN_SIZE || key_sz > KEY_MAX_SIZE)
+            return TEE_ERROR_BAD_PARAMETERS;
+        break;
+    case TA_SEAL_KEY_TYPE_ECDSA_P256:
+        key_sz = 3 * KEY_ECC_P256_SIZE;
+        pub_sz = TA_SEAL_KEY_ECDSA_P256_SIZE;
+        break;
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    /* Check the room for the public parts before creating any key */
+    if (params[3].memref.size < count * pub_sz) {
+        params[3].memref.size = count * pub_sz;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    for (n = 0; n < count && res == TEE_SUCCESS; n++) {
+        uint32_t id_sz = generate_id(id, prefix_sz, first + n);
+
+        /* A key that would read as a wrapped one is drawn again */
+        do {
+            if (type == TA_SEAL_KEY_TYPE_ECDSA_P256)
+                res = generate_ecdsa(key);
+            else
+                TEE_GenerateRandom(key, key_sz);
+        } while (res == TEE_SUCCESS &&
+                 wrap_check_plain(key, key_sz) != TEE_SUCCESS);
+        if (res == TEE_SUCCESS)
+            res = key_write(id, id_sz, key, key_sz, false);
+        if (res == TEE_SUCCESS && pub_sz)
+            TEE_MemMove(pub + n * pub_sz, key + KEY_ECC_P256_SIZE, pub_sz);
+        if (res != TEE_SUCCESS)
+            EMSG("Failed to generate key %" PRIu32 ", res=0x%08x", first + n,
+                 res);
+    }
+    TEE_MemFill(key, 0, sizeof(key));
+
+    params[1].value.b = res == TEE_SUCCESS ? n : n - 1;
+    params[3].memref.size = params[1].value.b * pub_sz;
+    return res;
+}
+
+/*
+ * Random bytes go straight into the shared output buffer, so a host can
+ * fetch a large block in one invocation and serve small requests from it.
+ */
+TEE_Result generate_random(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types =
+        TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_NONE,
+                        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[0].memref.size > TA_SEAL_KEY_RANDOM_MAX_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    TEE_GenerateRandom(params[0].memref.buffer, params[0].memref.size);
+    return TEE_SUCCESS;
+}
@@ -0,0 +1,9 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include <tee_internal_api.h>
+
+TEE_Result generate_command(uint32_t param_types, TEE_Param params[4]);
+TEE_Result generate_random(uint32_t param_types, TEE_Param params[4]);
+
+#endif /* GENERATE_H */
@@ -0,0 +1,179 @@
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "hotkeys.h"
+#include "user_ta_header_defines.h"
+
+/* Kept out of the heap like the operation pool, but budgeted against it */
+#if HOTKEYS_BYTES > TA_DATA_SIZE / 4
+#error "The hot key sketch takes more than a quarter of TA_DATA_SIZE"
+#endif
+#if HOTKEYS_WIDTH & (HOTKEYS_WIDTH - 1)
+#error "HOTKEYS_WIDTH must be a power of two"
+#endif
+
+static uint32_t sketch[HOTKEYS_DEPTH][HOTKEYS_WIDTH];
+static struct ta_seal_key_hot_key top[HOTKEYS_TOP];
+static uint32_t top_used;
+static uint32_t accesses;
+/* TEE_GetSystemTime seconds of the last halving */
+static uint32_t decayed_at;
+
+static uint32_t now_seconds(void) {
+    TEE_Time t;
+
+    TEE_GetSystemTime(&t);
+    return t.seconds;
+}
+
+void hotkeys_reset(void) {
+    TEE_MemFill(sketch, 0, sizeof(sketch));
+    TEE_MemFill(top, 0, sizeof(top));
+    top_used = 0;
+    accesses = 0;
+    decayed_at = now_seconds();
+}
+
+/* FNV-1a */
+static uint64_t hash(const uint8_t *id, uint32_t id_sz) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (uint32_t i = 0; i < id_sz; i++) {
+        h ^= id[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint32_t halve(uint32_t v, uint32_t times) {
+    return times < 32 ? v >> times : 0;
+}
+
+/* Halve every count once per half life passed since the last time */
+static void decay(void) {
+    uint32_t times = (now_seconds() - decayed_at) / HOTKEYS_HALF_LIFE;
+    uint32_t n = 0;
+
+    if (!times)
+        return;
+    decayed_at += times * HOTKEYS_HALF_LIFE;
+
+    for (size_t r = 0; r < HOTKEYS_DEPTH; r++)
+        for (size_t c = 0; c < HOTKEYS_WIDTH; c++)
+            sketch[r][c] = halve(sketch[r][c], times);
+    accesses = halve(accesses, times);
+
+    /* Ids counted down to nothing make room for others */
+    for (uint32_t i = 0; i < top_used; i++) {
+        top[i].count = halve(top[i].count, times);
+        if (top[i].count)
+            top[n++] = top[i];
+    }
+    top_used = n;
+}
+
+/* Keep id if it is now counted more often than the least of the top */
+static void update_top(const void *id, uint32_t id_sz, uint32_t count) {
+    struct ta_seal_key_hot_key *e, *least = NULL;
+
+    for (uint32_t i = 0; i < top_used; i++) {
+        e = &top[i];
+        if (e->id_size == id_sz && !TEE_MemCompare(e->id, id, id_sz)) {
+            e->count = count;
+            return;
+        }
+        if (!least || e->count < least->count)
+            least = e;
+    }
+    if (top_used < HOTKEYS_TOP)
+        e = &top[top_used++];
+    else if (count > least->count)
+        e = least;
+    else
+        return;
+    e->count = count;
+    e->id_size = id_sz;
+    TEE_MemMove(e->id, id, id_sz);
+}
+
+/* Count a read or write of the object id */
+void hotkeys_access(const void *id, uint32_t id_sz) {
+    uint32_t col[HOTKEYS_DEPTH];
+    uint32_t count = UINT32_MAX;
+    uint64_t h;
+    uint32_t h1, h2;
+
+    if (id_sz > TA_SEAL_KEY_HOT_KEYS_ID_SIZE)
+        return;
+    decay();
+
+    /* Double hashing, h2 is odd so the rows differ for every width */
+    h = hash(id, id_sz);
+    h1 = h;
+    h2 = (h >> 32) | 1;
+    for (uint32_t r = 0; r < HOTKEYS_DEPTH; r++) {
+        col[r] = (h1 + r * h2) & (HOTKEYS_WIDTH - 1);
+        if (sketch[r][col[r]] < count)
+            count = sketch[r][col[r]];
+    }
+    if (count < UINT32_MAX)
+        count++;
+
+    /* Conservative update, only the counters below the estimate grow */
+    for (uint32_t r = 0; r < HOTKEYS_DEPTH; r++)
+        if (sketch[r][col[r]] < count)
+            sketch[r][col[r]] = count;
+    if (accesses < UINT32_MAX)
+        accesses++;
+    update_top(id, id_sz, count);
+}
+
+static void sort_top(void) {
+    struct ta_seal_key_hot_key e;
+    uint32_t j;
+
+    for (uint32_t i = 1; i < top_used; i++) {
+        e = top[i];
+        for (j = i; j > 0 && top[j - 1].count < e.count; j--)
+            top[j] = top[j - 1];
+        top[j] = e;
+    }
+}
+
+TEE_Result hotkeys_command(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    struct ta_seal_key_hot_keys hdr;
+    uint32_t size;
+    uint8_t *out;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[1].value.a & ~(uint32_t)TA_SEAL_KEY_HOT_KEYS_RESET)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    decay();
+    size = sizeof(hdr) + top_used * sizeof(top[0]);
+    if (params[0].memref.size < size) {
+        params[0].memref.size = size;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    sort_top();
+    hdr.version = TA_SEAL_KEY_HOT_KEYS_VERSION;
+    hdr.entries = top_used;
+    hdr.accesses = accesses;
+    hdr.half_life = HOTKEYS_HALF_LIFE;
+    hdr.depth = HOTKEYS_DEPTH;
+    hdr.width = HOTKEYS_WIDTH;
+    out = params[0].memref.buffer;
+    TEE_MemMove(out, &hdr, sizeof(hdr));
+    TEE_MemMove(out + sizeof(hdr), top, top_used * sizeof(top[0]));
+    params[0].memref.size = size;
+
+    if (params[1].value.a & TA_SEAL_KEY_HOT_KEYS_RESET)
+        hotkeys_reset();
+    return TEE_SUCCESS;
+}
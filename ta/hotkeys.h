@@ -0,0 +1,36 @@
+#ifndef HOTKEYS_H
+#define HOTKEYS_H
+
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+
+/*
+ * Size of the sketch counting the accesses per id, set the CFG_SEAL_KEY_*
+ * variables of sub.mk to change it. A count is too high by at most
+ * e / HOTKEYS_WIDTH of all accesses, unless all HOTKEYS_DEPTH rows collide.
+ */
+#ifndef HOTKEYS_DEPTH
+#define HOTKEYS_DEPTH 4
+#endif
+/* A power of two */
+#ifndef HOTKEYS_WIDTH
+#define HOTKEYS_WIDTH 256
+#endif
+/* Number of the most accessed ids kept */
+#ifndef HOTKEYS_TOP
+#define HOTKEYS_TOP 16
+#endif
+/* Seconds after which all counts are halved */
+#ifndef HOTKEYS_HALF_LIFE
+#define HOTKEYS_HALF_LIFE 600
+#endif
+
+#define HOTKEYS_BYTES                                                          \
+    (HOTKEYS_DEPTH * HOTKEYS_WIDTH * 4 +                                       \
+     HOTKEYS_TOP * (8 + TA_SEAL_KEY_HOT_KEYS_ID_SIZE))
+
+void hotkeys_reset(void);
+void hotkeys_access(const void *id, uint32_t id_sz);
+TEE_Result hotkeys_command(uint32_t param_types, TEE_Param params[4]);
+
+#endif /* HOTKEYS_H */
@@ -27,6 +27,8 @@
 #ifndef __SEAL_KEY_H__
 #define __SEAL_KEY_H__
 
+#include <stdint.h>
+
 /* UUID of the trusted application */
 #define TA_SEAL_KEY_UUID                                                       \
   {                                                                            \
@@ -61,4 +63,474 @@
  */
 #define TA_SEAL_KEY_CMD_DELETE 2
 
+/*
+ * TA_SEAL_KEY_CMD_AE_INIT - Start a streaming AES-GCM operation on the session
+ * param[0] (memref) ID of the persistent object holding the AES key
+ * param[1] (value) a: TA_SEAL_KEY_MODE_ENCRYPT or TA_SEAL_KEY_MODE_DECRYPT
+ * param[2] (memref) Nonce, generated by the TA when encrypting
+ * param[3] (memref) Additional authenticated data, may be empty
+ */
+#define TA_SEAL_KEY_CMD_AE_INIT 3
+
+/*
+ * TA_SEAL_KEY_CMD_AE_UPDATE - Process one chunk of the stream
+ * param[0] (memref) Input chunk
+ * param[1] (memref) Output, should be TA_SEAL_KEY_AE_TAG_SIZE larger than
+ *                   the input chunk
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_SEAL_KEY_CMD_AE_UPDATE 4
+
+/*
+ * TA_SEAL_KEY_CMD_AE_FINAL - Process the last chunk and finish the stream
+ * param[0] (memref) Last input chunk, may be empty
+ * param[1] (memref) Output
+ * param[2] (memref) Tag, output when encrypting, input when decrypting
+ * param[3] unused
+ */
+#define TA_SEAL_KEY_CMD_AE_FINAL 5
+
+/*
+ * TA_SEAL_KEY_CMD_CHUNK_INIT - Prepare the session for chunk sealing
+ * param[0] (memref) ID of the persistent object holding the AES key
+ * param[1] (value) a: TA_SEAL_KEY_MODE_ENCRYPT or TA_SEAL_KEY_MODE_DECRYPT
+ *                  b: when encrypting, the number of sessions sealing the
+ *                     file in the upper 16 bits, at most
+ *                     TA_SEAL_KEY_CHUNK_MAX_SESSIONS, and the index of this
+ *                     one in the lower 16 bits
+ * param[2] (memref) Nonce prefix of the session, returned by the TA when
+ *                   encrypting, unused when decrypting
+ * param[3] (memref) Additional authenticated data bound to every chunk
+ *
+ * Every session sealing a file picks its own nonce prefix and only seals the
+ * chunks whose index modulo the number of sessions is its own index, each of
+ * them once. The sessions need no state in common, so they may run in
+ * different instances of the TA at the same time.
+ */
+#define TA_SEAL_KEY_CMD_CHUNK_INIT 6
+
+/*
+ * TA_SEAL_KEY_CMD_CHUNK - Seal or unseal one chunk
+ * param[0] (value) a: chunk index, b: 1 for the last chunk of the file
+ * param[1] (memref) Input, the ciphertext is followed by its tag
+ * param[2] (memref) Output, the ciphertext is followed by its tag
+ * param[3] (memref) When decrypting, the nonce prefix of the session that
+ *                   sealed the chunk, else unused
+ *
+ * The nonce is the prefix followed by the big endian chunk index and the
+ * last chunk flag byte, so chunks can neither be reordered nor dropped.
+ */
+#define TA_SEAL_KEY_CMD_CHUNK 7
+
+/*
+ * TA_SEAL_KEY_CMD_SEAL_BATCH - Seal many small records in one invocation
+ * param[0] (memref) ID of the persistent object holding the AES key
+ * param[1] (memref) Input records
+ * param[2] (memref) Output records, the required size is returned together
+ *                   with TEE_ERROR_SHORT_BUFFER
+ * param[3] (value) a: number of records, b: number of failed records
+ *
+ * An input record is a big endian 32 bit AAD length, a big endian 32 bit
+ * data length, the AAD and the data. An output record is a big endian 32 bit
+ * status, a big endian 32 bit length and the data, which is the nonce
+ * picked by the TA, the ciphertext and the tag. A failed record keeps its
+ * status and has no data, the other records are still processed.
+ */
+#define TA_SEAL_KEY_CMD_SEAL_BATCH 8
+
+/*
+ * TA_SEAL_KEY_CMD_UNSEAL_BATCH - Unseal many small records in one invocation
+ * param[0] (memref) ID of the persistent object holding the AES key
+ * param[1] (memref) Input records, the data being nonce, ciphertext and tag
+ * param[2] (memref) Output records, the data being the plaintext
+ * param[3] (value) a: number of records, b: number of failed records
+ *
+ * Same record layout as TA_SEAL_KEY_CMD_SEAL_BATCH.
+ */
+#define TA_SEAL_KEY_CMD_UNSEAL_BATCH 9
+
+/*
+ * TA_SEAL_KEY_CMD_MAC - MAC or sign a message with a stored key
+ * param[0] (memref) ID of the persistent object holding the key
+ * param[1] (value) a: TA_SEAL_KEY_ALG_*
+ * param[2] (memref) Message
+ * param[3] (memref) MAC or signature
+ *
+ * ECDSA signs the SHA-256 digest of the message, the signature is r || s.
+ */
+#define TA_SEAL_KEY_CMD_MAC 10
+
+/*
+ * TA_SEAL_KEY_CMD_VERIFY - Check the MAC or signature of a message
+ * param[0] (memref) ID of the persistent object holding the key
+ * param[1] (value) a: TA_SEAL_KEY_ALG_*
+ * param[2] (memref) Message
+ * param[3] (memref) MAC or signature to check
+ *
+ * Returns TEE_ERROR_MAC_INVALID or TEE_ERROR_SIGNATURE_INVALID on mismatch.
+ */
+#define TA_SEAL_KEY_CMD_VERIFY 11
+
+/*
+ * TA_SEAL_KEY_CMD_MAC_BATCH - MAC or sign many messages in one invocation
+ * param[0] (memref) ID of the persistent object holding the key
+ * param[1] (value) a: TA_SEAL_KEY_ALG_*, b: number of messages, returns
+ *                  the number of failed messages
+ * param[2] (memref) Messages, each a big endian 32 bit length and the data
+ * param[3] (memref) Results, each a big endian 32 bit status, a big endian
+ *                   32 bit length and the MAC or signature
+ */
+#define TA_SEAL_KEY_CMD_MAC_BATCH 12
+
+/*
+ * TA_SEAL_KEY_CMD_VERIFY_BATCH - Check many MACs or signatures at once
+ * param[0] (memref) ID of the persistent object holding the key
+ * param[1] (value) a: TA_SEAL_KEY_ALG_*, b: number of messages, returns
+ *                  the number of messages that did not verify
+ * param[2] (memref) Messages, each a big endian 32 bit message length, a
+ *                   big endian 32 bit MAC length, the message and the MAC
+ * param[3] (memref) Results, a big endian 32 bit status per message
+ */
+#define TA_SEAL_KEY_CMD_VERIFY_BATCH 13
+
+/*
+ * TA_SEAL_KEY_CMD_DERIVE - Derive a key with HKDF-SHA256 from a stored key
+ * param[0] (memref) ID of the derived key, the root ID, '/' and the label
+ * param[1] (value) a: TA_SEAL_KEY_DERIVE_* flags, returns 1 when the key
+ *                     came from the derived key cache
+ *                  b: size of the key to persist
+ * param[2] (memref) ID of the object to store the derived key in, used
+ *                   with TA_SEAL_KEY_DERIVE_PERSIST
+ * param[3] unused
+ *
+ * The stored root key is the HKDF input key material and the label the
+ * info. Derived IDs can be passed to every command taking a key ID, the TA
+ * then uses the first TA_SEAL_KEY_DERIVE_KEY_SIZE bytes of the output.
+ */
+#define TA_SEAL_KEY_CMD_DERIVE 14
+
+/*
+ * TA_SEAL_KEY_CMD_GENERATE - Generate a range of keys inside the TA
+ * param[0] (memref) ID prefix, key n is stored as the prefix followed by n
+ *                   in decimal
+ * param[1] (value) a: number of the first key
+ *                  b: number of keys, returns the number of keys generated
+ * param[2] (value) a: TA_SEAL_KEY_TYPE_*, b: key size in bytes, ignored for
+ *                     ECDSA P-256
+ * param[3] (memref) Public parts, TA_SEAL_KEY_ECDSA_P256_SIZE bytes of X
+ *                   and Y per ECDSA key, empty for secret keys
+ *
+ * Existing keys are never overwritten, generation stops at the first key
+ * that cannot be created. The secret key material never leaves the TA.
+ */
+#define TA_SEAL_KEY_CMD_GENERATE 15
+
+/*
+ * TA_SEAL_KEY_CMD_RANDOM - Fill a buffer with random bytes from the TEE
+ * param[0] (memref) Output, at most TA_SEAL_KEY_RANDOM_MAX_SIZE bytes
+ * param[1] unused
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_SEAL_KEY_CMD_RANDOM 16
+
+/*
+ * TA_SEAL_KEY_CMD_REWRAP_ALL - Move the stored keys to another wrapping key
+ * param[0] (memref) ID of the old key encryption key, empty for keys that
+ *                   are not wrapped
+ * param[1] (memref) ID of the new key encryption key, empty to store the
+ *                   keys unwrapped
+ * param[2] (value) a: cursor, the number of objects of the store already
+ *                     visited, returns the cursor for the next invocation
+ *                  b: number of objects to visit, returns 1 when the whole
+ *                     store has been visited
+ * param[3] (value) a: number of keys rewrapped, b: number of keys that
+ *                  could not be rewrapped
+ *
+ * Every object under the old key encryption key is unwrapped and wrapped
+ * again with the new one inside the TA and replaced atomically. Objects
+ * under other keys, and the key encryption keys themselves, are skipped,
+ * so a job can be resumed from its cursor or simply run again.
+ */
+#define TA_SEAL_KEY_CMD_REWRAP_ALL 17
+
+/*
+ * TA_SEAL_KEY_CMD_ARCHIVE_INIT - Start exporting or importing the store
+ * param[0] (memref) ID of the AES key the archive is encrypted with
+ * param[1] (value) a: TA_SEAL_KEY_MODE_ENCRYPT to export,
+ *                     TA_SEAL_KEY_MODE_DECRYPT to import
+ *                  b: TA_SEAL_KEY_ARCHIVE_* flags
+ * param[2] (memref) Nonce prefix of TA_SEAL_KEY_CHUNK_PREFIX_SIZE bytes,
+ *                   returned on export, passed in on import
+ * param[3] unused
+ *
+ * The archive is a sequence of chunks of at most
+ * TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE bytes, each sealed like
+ * TA_SEAL_KEY_CMD_CHUNK with its index and a last chunk flag in the nonce.
+ * The plaintext of a chunk is a list of records, a big endian 32 bit ID
+ * length, a big endian 32 bit data length, the ID and the object data as
+ * stored, so wrapped keys stay wrapped. The archive key itself is skipped.
+ */
+#define TA_SEAL_KEY_CMD_ARCHIVE_INIT 18
+
+/*
+ * TA_SEAL_KEY_CMD_ARCHIVE_EXPORT - Serialize and seal the next chunk
+ * param[0] (memref) Sealed chunk, at least TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE +
+ *                   TA_SEAL_KEY_AE_TAG_SIZE bytes
+ * param[1] (value) a: 1 for the last chunk of the archive, b: number of
+ *                  objects in the chunk
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_SEAL_KEY_CMD_ARCHIVE_EXPORT 19
+
+/*
+ * TA_SEAL_KEY_CMD_ARCHIVE_IMPORT - Open the next chunk and store its objects
+ * param[0] (memref) Sealed chunk
+ * param[1] (value) a: 1 for the last chunk of the archive
+ * param[2] (value) a: number of objects stored, b: number of objects
+ *                  skipped because they exist
+ * param[3] unused
+ *
+ * Chunks must come in order. Nothing of a chunk is stored before the whole
+ * chunk has been authenticated.
+ */
+#define TA_SEAL_KEY_CMD_ARCHIVE_IMPORT 20
+
+/*
+ * TA_SEAL_KEY_CMD_SYNC_TREE - Read node hashes of the store summary
+ * param[0] (value) a: level, 0 is the root and the depth - 1 the leaves,
+ *                  b: index of the first node
+ * param[1] (memref) Node hashes, TA_SEAL_KEY_SYNC_HASH_SIZE bytes each
+ * param[2] (value) a: depth of the tree, 0 for the one the TA picks for the
+ *                     size of its store, returns the depth used
+ *                  b: returns the generation of the summary
+ * param[3] unused
+ *
+ * The summary is a Merkle tree with TA_SEAL_KEY_SYNC_FANOUT children per
+ * node and between TA_SEAL_KEY_SYNC_MIN_LEVELS and
+ * TA_SEAL_KEY_SYNC_MAX_LEVELS levels, the TA adds levels as its store
+ * grows. Every object falls into one leaf by its ID, the leaf hash covers
+ * TA_SEAL_KEY_SYNC_VERSION, the ID and the stored data of its objects. Two
+ * stores with the same root at the same depth hold the same objects. The
+ * TA keeps an index of the objects and applies writes to it, so reading
+ * the summary only rehashes the objects written since. The generation
+ * changes whenever the summary does.
+ */
+#define TA_SEAL_KEY_CMD_SYNC_TREE 21
+
+/*
+ * TA_SEAL_KEY_CMD_SYNC_LIST - List the objects of some leaves
+ * param[0] (memref) Leaf numbers, 4 bytes each, big endian
+ * param[1] (value) a: position in param[0] of the leaf to continue with,
+ *                  b: number of objects of that leaf already listed,
+ *                  returns where the next invocation continues, a is the
+ *                  number of leaves once all have been listed
+ * param[2] (memref) Records, a byte with the ID length, the ID and the
+ *                   TA_SEAL_KEY_SYNC_HASH_SIZE byte hash of the object
+ * param[3] (value) a: depth of the tree, b: returns the generation of the
+ *                  summary
+ */
+#define TA_SEAL_KEY_CMD_SYNC_LIST 22
+
+/*
+ * TA_SEAL_KEY_CMD_ARCHIVE_EXPORT_IDS - Seal the next chunk of given objects
+ * param[0] (memref) Sealed chunk, as for TA_SEAL_KEY_CMD_ARCHIVE_EXPORT
+ * param[1] (value) a: 1 when param[2] holds the last IDs of the archive,
+ *                     returns 1 for the last chunk
+ *                  b: returns the number of bytes of param[2] consumed
+ * param[2] (memref) IDs, each a byte with the length and the ID
+ * param[3] unused
+ *
+ * Like TA_SEAL_KEY_CMD_ARCHIVE_EXPORT, but the objects are taken from the
+ * list instead of the whole store. IDs that do not exist are skipped.
+ */
+#define TA_SEAL_KEY_CMD_ARCHIVE_EXPORT_IDS 23
+
+/*
+ * TA_SEAL_KEY_CMD_PING - Do nothing, the cost of a call into the TA
+ * param[0] unused
+ * param[1] unused
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_SEAL_KEY_CMD_PING 24
+
+/*
+ * TA_SEAL_KEY_CMD_STAT - Tell the size of a persistent object
+ * param[0] (memref) ID used the identify the persistent object
+ * param[1] (value) a: returns the size of the object as stored
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_SEAL_KEY_CMD_STAT 25
+
+/*
+ * TA_SEAL_KEY_CMD_STATS - Read the counters the TA keeps per command
+ * param[0] (memref) struct ta_seal_key_stats, returns the size used
+ * param[1] (value) a: TA_SEAL_KEY_STATS_RESET to zero the counters after
+ *                     reading them
+ * param[2] unused
+ * param[3] unused
+ *
+ * The counters cover every command since the TA instance was loaded or last
+ * reset, except STATS itself. Times are taken with TEE_GetSystemTime, in
+ * milliseconds, so a single call is mostly rounded to 0 or 1 but the sums
+ * over many calls hold.
+ */
+#define TA_SEAL_KEY_CMD_STATS 26
+
+/*
+ * TA_SEAL_KEY_CMD_TRACE - Trace the commands of the session
+ * param[0] (memref) struct ta_seal_key_trace of the last command before
+ * param[1] (value) a: TA_SEAL_KEY_TRACE_ON to trace the following commands,
+ *                     0 to stop
+ * param[2] unused
+ * param[3] unused
+ *
+ * A traced command records when it entered each phase of
+ * TA_SEAL_KEY_PHASE_*, relative to its start in the TA. TRACE itself is not
+ * traced.
+ */
+#define TA_SEAL_KEY_CMD_TRACE 27
+
+/*
+ * TA_SEAL_KEY_CMD_HOT_KEYS - Read the ids read and written the most
+ * param[0] (memref) struct ta_seal_key_hot_keys followed by its entries, the
+ *                   most accessed first, returns the size used
+ * param[1] (value) a: TA_SEAL_KEY_HOT_KEYS_RESET to forget all accesses after
+ *                     reading them
+ * param[2] unused
+ * param[3] unused
+ *
+ * The accesses are counted in a count-min sketch of fixed size, which never
+ * counts too few but may count too many, and every count is halved once per
+ * half life.
+ */
+#define TA_SEAL_KEY_CMD_HOT_KEYS 28
+
+#define TA_SEAL_KEY_MODE_ENCRYPT 0
+#define TA_SEAL_KEY_MODE_DECRYPT 1
+
+#define TA_SEAL_KEY_ALG_HMAC_SHA256 0
+#define TA_SEAL_KEY_ALG_ECDSA_P256 1
+
+#define TA_SEAL_KEY_TYPE_AES 0
+#define TA_SEAL_KEY_TYPE_HMAC_SHA256 1
+#define TA_SEAL_KEY_TYPE_ECDSA_P256 2
+
+#define TA_SEAL_KEY_AE_NONCE_SIZE 12
+#define TA_SEAL_KEY_AE_TAG_SIZE 16
+#define TA_SEAL_KEY_CHUNK_PREFIX_SIZE 7
+#define TA_SEAL_KEY_CHUNK_MAX_SESSIONS 64
+#define TA_SEAL_KEY_CHUNK_MAX_AAD 96
+#define TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE 8
+#define TA_SEAL_KEY_HMAC_SHA256_SIZE 32
+#define TA_SEAL_KEY_ECDSA_P256_SIZE 64
+#define TA_SEAL_KEY_MAX_MAC_SIZE 64
+#define TA_SEAL_KEY_DERIVE_PERSIST 1
+#define TA_SEAL_KEY_DERIVE_KEY_SIZE 32
+#define TA_SEAL_KEY_DERIVE_MIN_SIZE 16
+#define TA_SEAL_KEY_DERIVE_MAX_SIZE 64
+#define TA_SEAL_KEY_GENERATE_MAX_KEYS 4096
+#define TA_SEAL_KEY_RANDOM_MAX_SIZE (1024 * 1024)
+#define TA_SEAL_KEY_REWRAP_MAX_BATCH 1024
+#define TA_SEAL_KEY_ARCHIVE_OVERWRITE 1
+#define TA_SEAL_KEY_ARCHIVE_CHUNK_SIZE (8 * 1024)
+#define TA_SEAL_KEY_SYNC_HASH_SIZE 16
+#define TA_SEAL_KEY_SYNC_FANOUT 16
+#define TA_SEAL_KEY_SYNC_MIN_LEVELS 3
+#define TA_SEAL_KEY_SYNC_MAX_LEVELS 5
+#define TA_SEAL_KEY_SYNC_VERSION 2
+/* A record of TA_SEAL_KEY_CMD_SYNC_LIST, object IDs are at most 64 bytes */
+#define TA_SEAL_KEY_SYNC_MAX_RECORD (1 + 64 + TA_SEAL_KEY_SYNC_HASH_SIZE)
+#define TA_SEAL_KEY_BATCH_OVERHEAD                                             \
+  (TA_SEAL_KEY_AE_NONCE_SIZE + TA_SEAL_KEY_AE_TAG_SIZE)
+#define TA_SEAL_KEY_STATS_RESET 1
+#define TA_SEAL_KEY_STATS_VERSION 1
+#define TA_SEAL_KEY_STATS_COMMANDS 32
+/* Error codes counted on their own per command, the rest are summed up */
+#define TA_SEAL_KEY_STATS_CODES 4
+
+/* Where the time of the storage commands goes */
+#define TA_SEAL_KEY_PHASE_OPEN 0 /* opening and creating objects */
+#define TA_SEAL_KEY_PHASE_IO 1   /* reading, writing and deleting them */
+#define TA_SEAL_KEY_PHASE_COPY 2 /* copying from and to the parameters */
+#define TA_SEAL_KEY_PHASES 3
+#define TA_SEAL_KEY_TRACE_ON 1
+#define TA_SEAL_KEY_TRACE_VERSION 2
+/* Phases recorded per traced command, later ones are only counted */
+#define TA_SEAL_KEY_TRACE_SPANS 16
+/* The command of a trace when nothing was traced yet */
+#define TA_SEAL_KEY_TRACE_NONE 0xffffffff
+#define TA_SEAL_KEY_HOT_KEYS_RESET 1
+#define TA_SEAL_KEY_HOT_KEYS_VERSION 1
+#define TA_SEAL_KEY_HOT_KEYS_ID_SIZE 64
+
+/*
+ * The reply of TA_SEAL_KEY_CMD_STATS, in the byte order of the TA. All
+ * fields are naturally aligned so both worlds lay it out the same.
+ */
+struct ta_seal_key_error_count {
+  uint32_t code;
+  uint32_t count;
+};
+
+struct ta_seal_key_command_stats {
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t bytes_in;  /* input memrefs */
+  uint64_t bytes_out; /* output memrefs of successful calls */
+  uint64_t time_ms;
+  uint64_t phase_ms[TA_SEAL_KEY_PHASES];
+  uint32_t max_ms;
+  uint32_t other_errors; /* errors whose code did not fit into codes */
+  struct ta_seal_key_error_count codes[TA_SEAL_KEY_STATS_CODES];
+};
+
+struct ta_seal_key_stats {
+  uint32_t version;
+  uint32_t commands; /* entries of command, indexed by command ID */
+  uint32_t since;    /* TEE_GetSystemTime seconds of the last reset */
+  uint32_t now;
+  struct ta_seal_key_command_stats command[TA_SEAL_KEY_STATS_COMMANDS];
+};
+
+/*
+ * The reply of TA_SEAL_KEY_CMD_TRACE. The times are whole milliseconds of
+ * TEE_GetSystemTime, a command that took less than one mostly reads 0.
+ */
+struct ta_seal_key_span {
+  uint32_t phase;
+  uint32_t start_ms; /* since the command started in the TA */
+  uint32_t end_ms;
+};
+
+struct ta_seal_key_trace {
+  uint32_t version;
+  uint32_t command; /* TA_SEAL_KEY_TRACE_NONE when nothing was traced yet */
+  uint32_t result;
+  uint32_t time_ms; /* of the whole command in the TA */
+  uint32_t spans;
+  uint32_t dropped; /* phases that did not fit into span */
+  struct ta_seal_key_span span[TA_SEAL_KEY_TRACE_SPANS];
+};
+
+/* The reply of TA_SEAL_KEY_CMD_HOT_KEYS, entries of it follow */
+struct ta_seal_key_hot_keys {
+  uint32_t version;
+  uint32_t entries;
+  uint32_t accesses;  /* all reads and writes, decayed like the counts */
+  uint32_t half_life; /* seconds */
+  uint32_t depth;     /* rows and columns of the sketch */
+  uint32_t width;
+};
+
+struct ta_seal_key_hot_key {
+  uint32_t count; /* estimated accesses */
+  uint32_t id_size;
+  uint8_t id[TA_SEAL_KEY_HOT_KEYS_ID_SIZE];
+};
+
 #endif /* __SEAL_KEY_H__ */
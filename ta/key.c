@@ -0,0 +1,404 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <string.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "derive.h"
+#include "key.h"
+#include "stats.h"
+#include "sync.h"
+#include "wrap.h"
+
+/*
+ * Read the data of the persistent object @id as it is stored, without
+ * unwrapping it, see wrap.c.
+ */
+TEE_Result key_read_raw(const void *id, uint32_t id_sz, void *buf,
+                        uint32_t *buf_sz) {
+    TEE_ObjectHandle object;
+    TEE_ObjectInfo object_info;
+    TEE_Result res;
+    uint32_t read_bytes;
+    uint32_t clock = stats_clock();
+
+    res = TEE_OpenPersistentObject(
+        TEE_STORAGE_PRIVATE, id, id_sz,
+        TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_SHARE_READ, &object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_OPEN);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to open key object, res=0x%08x", res);
+        return res;
+    }
+
+    res = TEE_GetObjectInfo1(object, &object_info);
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    if (object_info.dataSize > *buf_sz) {
+        res = TEE_ERROR_BAD_FORMAT;
+        goto exit;
+    }
+
+    res = TEE_ReadObjectData(object, buf, object_info.dataSize, &read_bytes);
+    if (res == TEE_SUCCESS && read_bytes != object_info.dataSize)
+        res = TEE_ERROR_CORRUPT_OBJECT;
+    if (res == TEE_SUCCESS)
+        *buf_sz = read_bytes;
+exit:
+    TEE_CloseObject(object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_IO);
+    return res;
+}
+
+/* Read the key stored in @id, unwrapping it when it is wrapped */
+static TEE_Result key_read_object(const void *id, uint32_t id_sz, void *buf,
+                                  uint32_t *buf_sz) {
+    uint32_t data_sz = KEY_MAX_SIZE + WRAP_MAX_OVERHEAD;
+    uint8_t *data;
+    TEE_Result res;
+
+    data = TEE_Malloc(data_sz, 0);
+    if (!data)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    res = key_read_raw(id, id_sz, data, &data_sz);
+    if (res != TEE_SUCCESS)
+        goto exit;
+    if (wrap_is_wrapped(data, data_sz)) {
+        res = wrap_unwrap(id, id_sz, data, data_sz, buf, buf_sz);
+    } else if (data_sz > *buf_sz) {
+        res = TEE_ERROR_BAD_FORMAT;
+    } else {
+        TEE_MemMove(buf, data, data_sz);
+        *buf_sz = data_sz;
+    }
+exit:
+    TEE_MemFill(data, 0, KEY_MAX_SIZE + WRAP_MAX_OVERHEAD);
+    TEE_Free(data);
+    return res;
+}
+
+/*
+ * Read the key material of @id into a TA buffer. An id of the form
+ * root/label names a key derived from the stored key root, see derive.c.
+ * The material never leaves the TA, callers must wipe the buffer after use.
+ */
+TEE_Result key_read(const void *id, uint32_t id_sz, void *buf,
+                    uint32_t *buf_sz) {
+    bool hit;
+
+    if (!memchr(id, '/', id_sz))
+        return key_read_object(id, id_sz, buf, buf_sz);
+
+    if (*buf_sz < TA_SEAL_KEY_DERIVE_KEY_SIZE)
+        return TEE_ERROR_SHORT_BUFFER;
+    *buf_sz = TA_SEAL_KEY_DERIVE_KEY_SIZE;
+    return derive_key(id, id_sz, buf, *buf_sz, &hit);
+}
+
+/*
+ * Store @data as the key @id. An existing key of the same id is replaced
+ * with @overwrite, otherwise TEE_ERROR_ACCESS_CONFLICT is returned.
+ */
+TEE_Result key_write(const void *id, uint32_t id_sz, const void *data,
+                     uint32_t data_sz, bool overwrite) {
+    TEE_ObjectHandle object;
+    TEE_Result res;
+    uint32_t flags = TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE |
+                     TEE_DATA_FLAG_ACCESS_WRITE_META;
+    uint32_t clock = stats_clock();
+
+    res = wrap_check_plain(data, data_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    if (overwrite)
+        flags |= TEE_DATA_FLAG_OVERWRITE;
+    /* created with its data at once, never seen empty or half written */
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, id, id_sz, flags,
+                                     TEE_HANDLE_NULL, data, data_sz, &object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_IO);
+    if (res != TEE_SUCCESS) {
+        EMSG("TEE_CreatePersistentObject failed 0x%08x", res);
+        return res;
+    }
+    TEE_CloseObject(object);
+    key_invalidate(id, id_sz);
+    return res;
+}
+
+/*
+ * Turn the raw object data into key attributes. AES and HMAC keys are the
+ * secret itself, an ECDSA P-256 key is stored as the private value followed
+ * by the X and Y coordinates of the public key.
+ */
+static TEE_Result key_attributes(uint32_t key_type, uint8_t *key_data,
+                                 uint32_t key_sz, TEE_Attribute *attrs,
+                                 uint32_t *attr_count, uint32_t *key_bits) {
+    switch (key_type) {
+    case TEE_TYPE_AES:
+        if (key_sz != 16 && key_sz != 24 && key_sz != 32)
+            break;
+        TEE_InitRefAttribute(attrs, TEE_ATTR_SECRET_VALUE, key_data, key_sz);
+        *attr_count = 1;
+        *key_bits = key_sz * 8;
+        return TEE_SUCCESS;
+    case TEE_TYPE_HMAC_SHA256:
+        if (key_sz < KEY_HMAC_MIN_SIZE || key_sz > KEY_MAX_SIZE)
+            break;
+        TEE_InitRefAttribute(attrs, TEE_ATTR_SECRET_VALUE, key_data, key_sz);
+        *attr_count = 1;
+        *key_bits = key_sz * 8;
+        return TEE_SUCCESS;
+    case TEE_TYPE_ECDSA_KEYPAIR:
+        if (key_sz != 3 * KEY_ECC_P256_SIZE)
+            break;
+        TEE_InitRefAttribute(attrs, TEE_ATTR_ECC_PRIVATE_VALUE, key_data,
+                             KEY_ECC_P256_SIZE);
+        TEE_InitRefAttribute(attrs + 1, TEE_ATTR_ECC_PUBLIC_VALUE_X,
+                             key_data + KEY_ECC_P256_SIZE, KEY_ECC_P256_SIZE);
+        TEE_InitRefAttribute(attrs + 2, TEE_ATTR_ECC_PUBLIC_VALUE_Y,
+                             key_data + 2 * KEY_ECC_P256_SIZE,
+                             KEY_ECC_P256_SIZE);
+        TEE_InitValueAttribute(attrs + 3, TEE_ATTR_ECC_CURVE,
+                               TEE_ECC_CURVE_NIST_P256, 0);
+        *attr_count = 4;
+        *key_bits = 256;
+        return TEE_SUCCESS;
+    default:
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+
+    EMSG("Object does not hold a key of type 0x%" PRIx32 " (%" PRIu32
+         " bytes)",
+         key_type, key_sz);
+    return TEE_ERROR_BAD_FORMAT;
+}
+
+/*
+ * Allocate an operation for @algorithm/@mode keyed with the persistent
+ * object @id. The key schedule is set up from the raw object data, which is
+ * wiped again before returning. With @plain the object has to hold the key
+ * itself, a wrapped key is refused.
+ */
+static TEE_Result key_alloc(const void *id, uint32_t id_sz,
+                            uint32_t algorithm, uint32_t mode, bool plain,
+                            TEE_OperationHandle *op) {
+    TEE_ObjectHandle key = TEE_HANDLE_NULL;
+    TEE_Attribute attrs[4];
+    TEE_Result res;
+    uint32_t key_type;
+    uint32_t attr_count;
+    uint32_t key_bits;
+    uint32_t key_sz = KEY_MAX_SIZE;
+    uint8_t *key_data;
+
+    switch (algorithm) {
+    case TEE_ALG_AES_GCM:
+        key_type = TEE_TYPE_AES;
+        break;
+    case TEE_ALG_HMAC_SHA256:
+        key_type = TEE_TYPE_HMAC_SHA256;
+        break;
+    case TEE_ALG_ECDSA_P256:
+        key_type = TEE_TYPE_ECDSA_KEYPAIR;
+        break;
+    default:
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+
+    key_data = TEE_Malloc(key_sz, 0);
+    if (!key_data)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    if (plain)
+        res = key_read_raw(id, id_sz, key_data, &key_sz);
+    else
+        res = key_read(id, id_sz, key_data, &key_sz);
+    if (res != TEE_SUCCESS)
+        goto exit;
+    if (plain && wrap_is_wrapped(key_data, key_sz)) {
+        EMSG("Key encryption keys must not be wrapped themselves");
+        res = TEE_ERROR_BAD_STATE;
+        goto exit;
+    }
+
+    res = key_attributes(key_type, key_data, key_sz, attrs, &attr_count,
+                         &key_bits);
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    res = TEE_AllocateTransientObject(key_type, key_bits, &key);
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    res = TEE_PopulateTransientObject(key, attrs, attr_count);
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    res = TEE_AllocateOperation(op, algorithm, mode, key_bits);
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    res = TEE_SetOperationKey(*op, key);
+    if (res != TEE_SUCCESS) {
+        TEE_FreeOperation(*op);
+        *op = TEE_HANDLE_NULL;
+    }
+exit:
+    TEE_FreeTransientObject(key);
+    TEE_MemFill(key_data, 0, KEY_MAX_SIZE);
+    TEE_Free(key_data);
+    return res;
+}
+
+TEE_Result key_alloc_operation(const void *id, uint32_t id_sz,
+                               uint32_t algorithm, uint32_t mode,
+                               TEE_OperationHandle *op) {
+    return key_alloc(id, id_sz, algorithm, mode, false, op);
+}
+
+TEE_Result key_alloc_plain_operation(const void *id, uint32_t id_sz,
+                                     uint32_t algorithm, uint32_t mode,
+                                     TEE_OperationHandle *op) {
+    return key_alloc(id, id_sz, algorithm, mode, true, op);
+}
+
+/*
+ * Operations are expensive to set up: the key has to be read from secure
+ * storage and the key schedule computed. Keep a few keyed operations around
+ * per (key id, algorithm, mode) and hand them out again after a
+ * TEE_ResetOperation(). The pool is shared by the sessions of the instance.
+ */
+struct key_pool_entry {
+    TEE_OperationHandle op;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t id_sz;
+    uint32_t algorithm;
+    uint32_t mode;
+    bool in_use;
+    bool stale;
+    uint32_t last_use;
+};
+
+static struct key_pool_entry key_pool[KEY_POOL_SIZE];
+static uint32_t key_pool_clock;
+
+static bool key_pool_match(struct key_pool_entry *e, const void *id,
+                           uint32_t id_sz) {
+    return e->op != TEE_HANDLE_NULL && e->id_sz == id_sz &&
+           !TEE_MemCompare(e->id, id, id_sz);
+}
+
+static void key_pool_drop(struct key_pool_entry *e) {
+    TEE_FreeOperation(e->op);
+    TEE_MemFill(e, 0, sizeof(*e));
+}
+
+/* A free slot, or the least recently used idle one */
+static struct key_pool_entry *key_pool_victim(void) {
+    struct key_pool_entry *victim = NULL;
+    size_t n;
+
+    for (n = 0; n < KEY_POOL_SIZE; n++) {
+        struct key_pool_entry *e = key_pool + n;
+
+        if (e->op == TEE_HANDLE_NULL)
+            return e;
+        if (!e->in_use && (!victim || e->last_use < victim->last_use))
+            victim = e;
+    }
+    if (victim)
+        key_pool_drop(victim);
+    return victim;
+}
+
+/*
+ * Get an operation for @algorithm/@mode keyed with the persistent object
+ * @id, from the pool if one is idle. Give it back with key_put_operation().
+ */
+TEE_Result key_get_operation(const void *id, uint32_t id_sz,
+                             uint32_t algorithm, uint32_t mode,
+                             TEE_OperationHandle *op) {
+    struct key_pool_entry *e;
+    TEE_Result res;
+    size_t n;
+
+    if (id_sz > TEE_OBJECT_ID_MAX_LEN)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    for (n = 0; n < KEY_POOL_SIZE; n++) {
+        e = key_pool + n;
+        if (!e->in_use && !e->stale && e->algorithm == algorithm &&
+            e->mode == mode && key_pool_match(e, id, id_sz)) {
+            e->in_use = true;
+            *op = e->op;
+            return TEE_SUCCESS;
+        }
+    }
+
+    res = key_alloc_operation(id, id_sz, algorithm, mode, op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    /* When every slot is busy the operation is simply not pooled */
+    e = key_pool_victim();
+    if (e) {
+        e->op = *op;
+        TEE_MemMove(e->id, id, id_sz);
+        e->id_sz = id_sz;
+        e->algorithm = algorithm;
+        e->mode = mode;
+        e->in_use = true;
+    }
+    return TEE_SUCCESS;
+}
+
+void key_put_operation(TEE_OperationHandle op) {
+    size_t n;
+
+    if (op == TEE_HANDLE_NULL)
+        return;
+
+    for (n = 0; n < KEY_POOL_SIZE; n++) {
+        struct key_pool_entry *e = key_pool + n;
+
+        if (e->op != op)
+            continue;
+        if (e->stale) {
+            key_pool_drop(e);
+        } else {
+            TEE_ResetOperation(op);
+            e->in_use = false;
+            e->last_use = ++key_pool_clock;
+        }
+        return;
+    }
+    TEE_FreeOperation(op);
+}
+
+/*
+ * Forget everything cached for the key @id, called whenever the key object
+ * is written or deleted. This covers the pooled operations, the keys
+ * derived from @id and its leaf of the sync summary. Operations still in use
+ * are freed when put back.
+ */
+void key_invalidate(const void *id, uint32_t id_sz) {
+    size_t n;
+
+    for (n = 0; n < KEY_POOL_SIZE; n++) {
+        struct key_pool_entry *e = key_pool + n;
+
+        if (!key_pool_match(e, id, id_sz) &&
+            !(e->op != TEE_HANDLE_NULL && e->id_sz > id_sz &&
+              e->id[id_sz] == '/' && !TEE_MemCompare(e->id, id, id_sz)))
+            continue;
+        if (e->in_use)
+            e->stale = true;
+        else
+            key_pool_drop(e);
+    }
+    derive_invalidate(id, id_sz);
+    sync_invalidate(id, id_sz);
+}
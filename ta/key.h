@@ -0,0 +1,35 @@
+#ifndef KEY_H
+#define KEY_H
+
+#include <stdbool.h>
+#include <tee_internal_api.h>
+
+/* Largest key material we are willing to load from a persistent object */
+#define KEY_MAX_SIZE 128
+/* Shortest HMAC-SHA256 key accepted by the GP API */
+#define KEY_HMAC_MIN_SIZE 24
+/* Size of each of the private value, X and Y of an ECDSA P-256 key */
+#define KEY_ECC_P256_SIZE 32
+
+/* Number of keyed operations kept ready by the operation pool */
+#define KEY_POOL_SIZE 8
+
+TEE_Result key_read_raw(const void *id, uint32_t id_sz, void *buf,
+                        uint32_t *buf_sz);
+TEE_Result key_read(const void *id, uint32_t id_sz, void *buf,
+                    uint32_t *buf_sz);
+TEE_Result key_alloc_operation(const void *id, uint32_t id_sz,
+                               uint32_t algorithm, uint32_t mode,
+                               TEE_OperationHandle *op);
+TEE_Result key_alloc_plain_operation(const void *id, uint32_t id_sz,
+                                     uint32_t algorithm, uint32_t mode,
+                                     TEE_OperationHandle *op);
+TEE_Result key_get_operation(const void *id, uint32_t id_sz,
+                             uint32_t algorithm, uint32_t mode,
+                             TEE_OperationHandle *op);
+void key_put_operation(TEE_OperationHandle op);
+TEE_Result key_write(const void *id, uint32_t id_sz, const void *data,
+                     uint32_t data_sz, bool overwrite);
+void key_invalidate(const void *id, uint32_t id_sz);
+
+#endif /* KEY_H */
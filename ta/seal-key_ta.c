@@ -27,9 +27,31 @@
 
 #include <inttypes.h>
 #include <seal-key_ta.h>
+#include <string.h>
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
 
+#include "archive.h"
+#include "batch.h"
+#include "derive.h"
+#include "generate.h"
+#include "hotkeys.h"
+#include "key.h"
+#include "seal.h"
+#include "sign.h"
+#include "stats.h"
+#include "sync.h"
+#include "wrap.h"
+
+/* Per session state */
+struct sess_ctx {
+    struct ae_stream ae;
+    struct chunk_stream chunk;
+    struct rewrap_job rewrap;
+    struct archive archive;
+    struct ta_seal_key_trace *trace; /* NULL unless the session is traced */
+};
+
 static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4]) {
     const uint32_t exp_param_types =
         TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE,
@@ -38,6 +60,7 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4]) {
     TEE_Result res;
     char *obj_id;
     size_t obj_id_sz;
+    uint32_t clock = stats_clock();
 
     /*
      * Safely get the invocation parameters
@@ -51,6 +74,7 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4]) {
         return TEE_ERROR_OUT_OF_MEMORY;
 
     TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_COPY);
 
     /*
      * Check object exists and delete it
@@ -61,6 +85,7 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4]) {
             TEE_DATA_FLAG_ACCESS_WRITE_META, /* we must be allowed to delete it
                                               */
         &object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_OPEN);
     if (res != TEE_SUCCESS) {
         EMSG("Failed to open persistent object, res=0x%08x", res);
         TEE_Free(obj_id);
@@ -68,6 +93,8 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4]) {
     }
 
     TEE_CloseAndDeletePersistentObject1(object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_IO);
+    key_invalidate(obj_id, obj_id_sz);
     TEE_Free(obj_id);
 
     return res;
@@ -84,6 +111,7 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4]) {
     char *data;
     size_t data_sz;
     uint32_t obj_data_flag;
+    uint32_t clock = stats_clock();
 
     /*
      * Safely get the invocation parameters
@@ -91,6 +119,10 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4]) {
     if (param_types != exp_param_types)
         return TEE_ERROR_BAD_PARAMETERS;
 
+    /* '/' separates the root from the label of derived keys */
+    if (memchr(params[0].memref.buffer, '/', params[0].memref.size))
+        return TEE_ERROR_BAD_PARAMETERS;
+
     obj_id_sz = params[0].memref.size;
     obj_id = TEE_Malloc(obj_id_sz, 0);
     if (!obj_id)
@@ -103,9 +135,19 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4]) {
     if (!data)
         return TEE_ERROR_OUT_OF_MEMORY;
     TEE_MemMove(data, params[1].memref.buffer, data_sz);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_COPY);
+
+    /* Checked on the copy, the caller may still change the shared memory */
+    res = wrap_check_plain(data, data_sz);
+    if (res != TEE_SUCCESS) {
+        TEE_Free(obj_id);
+        TEE_Free(data);
+        return res;
+    }
 
     /*
-     * Create object in secure storage and fill with data
+     * Create object in secure storage with the data as its initial data, so
+     * that no one ever sees it empty or half written
      */
     obj_data_flag =
         TEE_DATA_FLAG_ACCESS_READ |  /* we can later read the oject */
@@ -115,23 +157,17 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4]) {
         TEE_DATA_FLAG_OVERWRITE; /* destroy existing object of same ID */
 
     res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, obj_id, obj_id_sz,
-                                     obj_data_flag, TEE_HANDLE_NULL, NULL,
-                                     0, /* we may not fill it right now */
-                                     &object);
-    if (res != TEE_SUCCESS) {
+                                     obj_data_flag, TEE_HANDLE_NULL, data,
+                                     data_sz, &object);
+    if (res != TEE_SUCCESS)
         EMSG("TEE_CreatePersistentObject failed 0x%08x", res);
-        TEE_Free(obj_id);
-        TEE_Free(data);
-        return res;
-    }
-
-    res = TEE_WriteObjectData(object, data, data_sz);
-    if (res != TEE_SUCCESS) {
-        EMSG("TEE_WriteObjectData failed 0x%08x", res);
-        TEE_CloseAndDeletePersistentObject1(object);
-    } else {
+    else
         TEE_CloseObject(object);
-    }
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_IO);
+    if (res == TEE_SUCCESS)
+        hotkeys_access(obj_id, obj_id_sz);
+    /* The old key is gone either way, drop operations keyed with it */
+    key_invalidate(obj_id, obj_id_sz);
     TEE_Free(obj_id);
     TEE_Free(data);
     return res;
@@ -149,6 +185,9 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4]) {
     size_t obj_id_sz;
     char *data;
     size_t data_sz;
+    char *key = NULL;
+    uint32_t key_sz = 0;
+    uint32_t clock = stats_clock();
 
     /*
      * Safely get the invocation parameters
@@ -167,6 +206,7 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4]) {
     data = TEE_Malloc(data_sz, 0);
     if (!data)
         return TEE_ERROR_OUT_OF_MEMORY;
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_COPY);
 
     /*
      * Check the object exist and can be dumped into output buffer
@@ -175,6 +215,7 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4]) {
     res = TEE_OpenPersistentObject(
         TEE_STORAGE_PRIVATE, obj_id, obj_id_sz,
         TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_SHARE_READ, &object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_OPEN);
     if (res != TEE_SUCCESS) {
         EMSG("Failed to open persistent object, res=0x%08x", res);
         TEE_Free(obj_id);
@@ -199,25 +240,87 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4]) {
     }
 
     res = TEE_ReadObjectData(object, data, object_info.dataSize, &read_bytes);
-    if (res == TEE_SUCCESS)
-        TEE_MemMove(params[1].memref.buffer, data, read_bytes);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_IO);
     if (res != TEE_SUCCESS || read_bytes != object_info.dataSize) {
         EMSG("TEE_ReadObjectData failed 0x%08x, read %" PRIu32 " over %u", res,
              read_bytes, object_info.dataSize);
         goto exit;
     }
 
+    /* Hand out the key, not the object wrapping it */
+    if (wrap_is_wrapped(data, read_bytes)) {
+        key = TEE_Malloc(read_bytes, 0);
+        if (!key) {
+            res = TEE_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+        key_sz = read_bytes;
+        res = wrap_unwrap(obj_id, obj_id_sz, data, read_bytes, key, &key_sz);
+        if (res != TEE_SUCCESS)
+            goto exit;
+        TEE_MemMove(data, key, key_sz);
+        read_bytes = key_sz;
+        /* The unwrapping is neither of the phases */
+        clock = stats_clock();
+    }
+    TEE_MemMove(params[1].memref.buffer, data, read_bytes);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_COPY);
+
     /* Return the number of byte effectively filled */
     params[1].memref.size = read_bytes;
+    hotkeys_access(obj_id, obj_id_sz);
 exit:
     TEE_CloseObject(object);
     TEE_Free(obj_id);
     TEE_Free(data);
+    if (key) {
+        TEE_MemFill(key, 0, key_sz);
+        TEE_Free(key);
+    }
+    return res;
+}
+
+static TEE_Result stat_object(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
+        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    TEE_ObjectHandle object;
+    TEE_ObjectInfo object_info;
+    TEE_Result res;
+    char *obj_id;
+    size_t obj_id_sz;
+    uint32_t clock = stats_clock();
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    obj_id_sz = params[0].memref.size;
+    obj_id = TEE_Malloc(obj_id_sz, 0);
+    if (!obj_id)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_COPY);
+
+    res = TEE_OpenPersistentObject(
+        TEE_STORAGE_PRIVATE, obj_id, obj_id_sz,
+        TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_SHARE_READ, &object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_OPEN);
+    TEE_Free(obj_id);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    /* Only the metadata is looked at, the data is neither read nor unwrapped */
+    res = TEE_GetObjectInfo1(object, &object_info);
+    if (res == TEE_SUCCESS)
+        params[1].value.a = object_info.dataSize;
+    TEE_CloseObject(object);
+    stats_phase(&clock, TA_SEAL_KEY_PHASE_IO);
     return res;
 }
 
 TEE_Result TA_CreateEntryPoint(void) {
-    /* Nothing to do */
+    stats_reset();
+    hotkeys_reset();
     return TEE_SUCCESS;
 }
 
@@ -226,17 +329,30 @@ void TA_DestroyEntryPoint(void) { /* Nothing to do */
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
                                     TEE_Param __unused params[4],
-                                    void __unused **session) {
-    /* Nothing to do */
+                                    void **session) {
+    struct sess_ctx *sess;
+
+    sess = TEE_Malloc(sizeof(*sess), TEE_MALLOC_FILL_ZERO);
+    if (!sess)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    *session = sess;
     return TEE_SUCCESS;
 }
 
-void TA_CloseSessionEntryPoint(void __unused *session) { /* Nothing to do */
+void TA_CloseSessionEntryPoint(void *session) {
+    struct sess_ctx *sess = session;
+
+    ae_stream_release(&sess->ae);
+    chunk_stream_release(&sess->chunk);
+    rewrap_release(&sess->rewrap);
+    archive_release(&sess->archive);
+    TEE_Free(sess->trace);
+    TEE_Free(sess);
 }
 
-TEE_Result TA_InvokeCommandEntryPoint(void __unused *session, uint32_t command,
-                                      uint32_t param_types,
-                                      TEE_Param params[4]) {
+static TEE_Result dispatch(struct sess_ctx *sess, uint32_t command,
+                           uint32_t param_types, TEE_Param params[4]) {
     switch (command) {
     case TA_SEAL_KEY_CMD_WRITE_RAW:
         return create_raw_object(param_types, params);
@@ -244,8 +360,77 @@ TEE_Result TA_InvokeCommandEntryPoint(void __unused *session, uint32_t command,
         return read_raw_object(param_types, params);
     case TA_SEAL_KEY_CMD_DELETE:
         return delete_object(param_types, params);
+    case TA_SEAL_KEY_CMD_AE_INIT:
+        return ae_stream_init(&sess->ae, param_types, params);
+    case TA_SEAL_KEY_CMD_AE_UPDATE:
+        return ae_stream_update(&sess->ae, param_types, params);
+    case TA_SEAL_KEY_CMD_AE_FINAL:
+        return ae_stream_final(&sess->ae, param_types, params);
+    case TA_SEAL_KEY_CMD_CHUNK_INIT:
+        return chunk_stream_init(&sess->chunk, param_types, params);
+    case TA_SEAL_KEY_CMD_CHUNK:
+        return chunk_stream_process(&sess->chunk, param_types, params);
+    case TA_SEAL_KEY_CMD_SEAL_BATCH:
+        return batch_process(TEE_MODE_ENCRYPT, param_types, params);
+    case TA_SEAL_KEY_CMD_UNSEAL_BATCH:
+        return batch_process(TEE_MODE_DECRYPT, param_types, params);
+    case TA_SEAL_KEY_CMD_MAC:
+        return sign_mac(param_types, params);
+    case TA_SEAL_KEY_CMD_VERIFY:
+        return sign_verify(param_types, params);
+    case TA_SEAL_KEY_CMD_MAC_BATCH:
+        return sign_mac_batch(param_types, params);
+    case TA_SEAL_KEY_CMD_VERIFY_BATCH:
+        return sign_verify_batch(param_types, params);
+    case TA_SEAL_KEY_CMD_DERIVE:
+        return derive_command(param_types, params);
+    case TA_SEAL_KEY_CMD_GENERATE:
+        return generate_command(param_types, params);
+    case TA_SEAL_KEY_CMD_RANDOM:
+        return generate_random(param_types, params);
+    case TA_SEAL_KEY_CMD_REWRAP_ALL:
+        return rewrap_batch(&sess->rewrap, param_types, params);
+    case TA_SEAL_KEY_CMD_ARCHIVE_INIT:
+        return archive_init(&sess->archive, param_types, params);
+    case TA_SEAL_KEY_CMD_ARCHIVE_EXPORT:
+        return archive_export(&sess->archive, param_types, params);
+    case TA_SEAL_KEY_CMD_ARCHIVE_IMPORT:
+        return archive_import(&sess->archive, param_types, params);
+    case TA_SEAL_KEY_CMD_SYNC_TREE:
+        return sync_tree(param_types, params);
+    case TA_SEAL_KEY_CMD_SYNC_LIST:
+        return sync_list(param_types, params);
+    case TA_SEAL_KEY_CMD_ARCHIVE_EXPORT_IDS:
+        return archive_export_ids(&sess->archive, param_types, params);
+    case TA_SEAL_KEY_CMD_PING:
+        if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+                                           TEE_PARAM_TYPE_NONE,
+                                           TEE_PARAM_TYPE_NONE,
+                                           TEE_PARAM_TYPE_NONE))
+            return TEE_ERROR_BAD_PARAMETERS;
+        return TEE_SUCCESS;
+    case TA_SEAL_KEY_CMD_STAT:
+        return stat_object(param_types, params);
+    case TA_SEAL_KEY_CMD_STATS:
+        return stats_command(param_types, params);
+    case TA_SEAL_KEY_CMD_TRACE:
+        return stats_trace(&sess->trace, param_types, params);
+    case TA_SEAL_KEY_CMD_HOT_KEYS:
+        return hotkeys_command(param_types, params);
     default:
         EMSG("Command ID 0x%x is not supported", command);
         return TEE_ERROR_NOT_SUPPORTED;
     }
 }
+
+TEE_Result TA_InvokeCommandEntryPoint(void *session, uint32_t command,
+                                      uint32_t param_types,
+                                      TEE_Param params[4]) {
+    struct sess_ctx *sess = session;
+    TEE_Result res;
+
+    stats_begin(command, param_types, params, sess->trace);
+    res = dispatch(sess, command, param_types, params);
+    stats_end(res, param_types, params);
+    return res;
+}
@@ -0,0 +1,343 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "key.h"
+#include "seal.h"
+
+void ae_stream_release(struct ae_stream *ae) {
+    key_put_operation(ae->op);
+    ae->op = TEE_HANDLE_NULL;
+}
+
+TEE_Result ae_stream_init(struct ae_stream *ae, uint32_t param_types,
+                          TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INOUT, TEE_PARAM_TYPE_MEMREF_INPUT);
+    char obj_id[TEE_OBJECT_ID_MAX_LEN];
+    size_t obj_id_sz;
+    uint8_t nonce[TA_SEAL_KEY_AE_NONCE_SIZE];
+    uint32_t mode;
+    TEE_Result res;
+
+    /*
+     * Safely get the invocation parameters
+     */
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    obj_id_sz = params[0].memref.size;
+    if (obj_id_sz > sizeof(obj_id))
+        return TEE_ERROR_BAD_PARAMETERS;
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
+
+    switch (params[1].value.a) {
+    case TA_SEAL_KEY_MODE_ENCRYPT:
+        mode = TEE_MODE_ENCRYPT;
+        break;
+    case TA_SEAL_KEY_MODE_DECRYPT:
+        mode = TEE_MODE_DECRYPT;
+        break;
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (params[2].memref.size != sizeof(nonce))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    /*
+     * The nonce is always picked inside the TA when sealing, so the
+     * normal world cannot force a nonce reuse under a sealed key.
+     */
+    if (mode == TEE_MODE_ENCRYPT) {
+        TEE_GenerateRandom(nonce, sizeof(nonce));
+        TEE_MemMove(params[2].memref.buffer, nonce, sizeof(nonce));
+    } else {
+        TEE_MemMove(nonce, params[2].memref.buffer, sizeof(nonce));
+    }
+
+    ae_stream_release(ae);
+    res = key_get_operation(obj_id, obj_id_sz, TEE_ALG_AES_GCM, mode, &ae->op);
+    if (res != TEE_SUCCESS)
+        return res;
+    ae->mode = mode;
+
+    res = TEE_AEInit(ae->op, nonce, sizeof(nonce),
+                     TA_SEAL_KEY_AE_TAG_SIZE * 8, 0, 0);
+    if (res != TEE_SUCCESS) {
+        EMSG("TEE_AEInit failed 0x%08x", res);
+        ae_stream_release(ae);
+        return res;
+    }
+    if (params[3].memref.size)
+        TEE_AEUpdateAAD(ae->op, params[3].memref.buffer,
+                        params[3].memref.size);
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * Chunks are processed straight from and into the shared buffers, the TA
+ * keeps no copy of the stream so its memory use does not depend on the
+ * size of the data being sealed.
+ */
+TEE_Result ae_stream_update(struct ae_stream *ae, uint32_t param_types,
+                            TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t out_sz;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (ae->op == TEE_HANDLE_NULL)
+        return TEE_ERROR_BAD_STATE;
+
+    out_sz = params[1].memref.size;
+    res = TEE_AEUpdate(ae->op, params[0].memref.buffer, params[0].memref.size,
+                       params[1].memref.buffer, &out_sz);
+    if (res != TEE_SUCCESS) {
+        EMSG("TEE_AEUpdate failed 0x%08x", res);
+        if (res != TEE_ERROR_SHORT_BUFFER)
+            ae_stream_release(ae);
+    }
+    params[1].memref.size = out_sz;
+    return res;
+}
+
+TEE_Result ae_stream_final(struct ae_stream *ae, uint32_t param_types,
+                           TEE_Param params[4]) {
+    const uint32_t exp_encrypt_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_NONE);
+    const uint32_t exp_decrypt_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE);
+    uint8_t tag[TA_SEAL_KEY_AE_TAG_SIZE];
+    uint32_t tag_sz = sizeof(tag);
+    uint32_t out_sz;
+    TEE_Result res;
+
+    if (ae->op == TEE_HANDLE_NULL)
+        return TEE_ERROR_BAD_STATE;
+
+    out_sz = params[1].memref.size;
+    if (ae->mode == TEE_MODE_ENCRYPT) {
+        if (param_types != exp_encrypt_types ||
+            params[2].memref.size < sizeof(tag))
+            return TEE_ERROR_BAD_PARAMETERS;
+
+        res = TEE_AEEncryptFinal(ae->op, params[0].memref.buffer,
+                                 params[0].memref.size,
+                                 params[1].memref.buffer, &out_sz, tag,
+                                 &tag_sz);
+        if (res == TEE_SUCCESS) {
+            TEE_MemMove(params[2].memref.buffer, tag, tag_sz);
+            params[2].memref.size = tag_sz;
+        }
+    } else {
+        if (param_types != exp_decrypt_types ||
+            params[2].memref.size != sizeof(tag))
+            return TEE_ERROR_BAD_PARAMETERS;
+
+        TEE_MemMove(tag, params[2].memref.buffer, sizeof(tag));
+        res = TEE_AEDecryptFinal(ae->op, params[0].memref.buffer,
+                                 params[0].memref.size,
+                                 params[1].memref.buffer, &out_sz, tag,
+                                 sizeof(tag));
+    }
+    if (res == TEE_ERROR_SHORT_BUFFER) {
+        params[1].memref.size = out_sz;
+        return res;
+    }
+    if (res != TEE_SUCCESS)
+        EMSG("AE final failed 0x%08x", res);
+    params[1].memref.size = out_sz;
+    ae_stream_release(ae);
+    return res;
+}
+
+/*
+ * Sessions of a file seal interleaved chunks, so a session may be asked for
+ * a chunk up to a few times the number of sessions ahead of one it has not
+ * sealed yet. The window has to cover that with room to spare.
+ */
+#if CHUNK_WINDOW < 2 * TA_SEAL_KEY_CHUNK_MAX_SESSIONS
+#error "CHUNK_WINDOW must cover twice TA_SEAL_KEY_CHUNK_MAX_SESSIONS"
+#endif
+#if CHUNK_WINDOW % 64
+#error "CHUNK_WINDOW must be a multiple of 64"
+#endif
+
+/*
+ * Claim a chunk index for the session, every index can be sealed only once
+ * under its prefix. The window slides by whole words with the highest index
+ * seen, indices that fall out of it are refused.
+ */
+static TEE_Result chunk_claim(struct chunk_stream *cs, uint32_t index) {
+    const uint32_t words = CHUNK_WINDOW / 64;
+    uint32_t off;
+    size_t n;
+
+    if (index % cs->sessions != cs->lane || index < cs->base)
+        return TEE_ERROR_SECURITY;
+    if (index - cs->base >= CHUNK_WINDOW) {
+        uint32_t shift = (index - cs->base - CHUNK_WINDOW) / 64 + 1;
+
+        for (n = 0; n < words; n++)
+            cs->used[n] = n + shift < words ? cs->used[n + shift] : 0;
+        cs->base += shift * 64;
+    }
+    off = index - cs->base;
+    if (cs->used[off / 64] & (1ULL << (off % 64)))
+        return TEE_ERROR_SECURITY;
+    cs->used[off / 64] |= 1ULL << (off % 64);
+    return TEE_SUCCESS;
+}
+
+void chunk_stream_release(struct chunk_stream *cs) {
+    key_put_operation(cs->op);
+    cs->op = TEE_HANDLE_NULL;
+}
+
+TEE_Result chunk_stream_init(struct chunk_stream *cs, uint32_t param_types,
+                             TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_MEMREF_INOUT, TEE_PARAM_TYPE_MEMREF_INPUT);
+    char obj_id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t obj_id_sz;
+    uint32_t sessions = params[1].value.b >> 16;
+    uint32_t lane = params[1].value.b & 0xffff;
+    uint32_t mode;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    obj_id_sz = params[0].memref.size;
+    if (obj_id_sz > sizeof(obj_id) ||
+        params[3].memref.size > TA_SEAL_KEY_CHUNK_MAX_AAD)
+        return TEE_ERROR_BAD_PARAMETERS;
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
+
+    switch (params[1].value.a) {
+    case TA_SEAL_KEY_MODE_ENCRYPT:
+        mode = TEE_MODE_ENCRYPT;
+        if (params[2].memref.size != TA_SEAL_KEY_CHUNK_PREFIX_SIZE ||
+            !sessions || sessions > TA_SEAL_KEY_CHUNK_MAX_SESSIONS ||
+            lane >= sessions)
+            return TEE_ERROR_BAD_PARAMETERS;
+        break;
+    case TA_SEAL_KEY_MODE_DECRYPT:
+        mode = TEE_MODE_DECRYPT;
+        break;
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    chunk_stream_release(cs);
+    res = key_get_operation(obj_id, obj_id_sz, TEE_ALG_AES_GCM, mode, &cs->op);
+    if (res != TEE_SUCCESS)
+        return res;
+    cs->mode = mode;
+
+    /*
+     * A fresh prefix for every session and every file, so the session only
+     * has to make sure it uses each of its chunk indices once.
+     */
+    if (mode == TEE_MODE_ENCRYPT) {
+        cs->sessions = sessions;
+        cs->lane = lane;
+        cs->base = 0;
+        TEE_MemFill(cs->used, 0, sizeof(cs->used));
+        TEE_GenerateRandom(cs->prefix, sizeof(cs->prefix));
+        TEE_MemMove(params[2].memref.buffer, cs->prefix, sizeof(cs->prefix));
+    }
+
+    cs->aad_sz = params[3].memref.size;
+    TEE_MemMove(cs->aad, params[3].memref.buffer, cs->aad_sz);
+    return TEE_SUCCESS;
+}
+
+TEE_Result chunk_stream_process(struct chunk_stream *cs, uint32_t param_types,
+                                TEE_Param params[4]) {
+    const uint32_t exp_encrypt_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_NONE);
+    const uint32_t exp_decrypt_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_MEMREF_INPUT);
+    uint8_t nonce[TA_SEAL_KEY_AE_NONCE_SIZE];
+    uint8_t tag[TA_SEAL_KEY_AE_TAG_SIZE];
+    uint32_t tag_sz = sizeof(tag);
+    uint32_t index = params[0].value.a;
+    uint8_t *src = params[1].memref.buffer;
+    uint32_t src_sz = params[1].memref.size;
+    uint8_t *dst = params[2].memref.buffer;
+    uint32_t dst_sz;
+    TEE_Result res;
+
+    if (cs->op == TEE_HANDLE_NULL)
+        return TEE_ERROR_BAD_STATE;
+    if (cs->mode == TEE_MODE_ENCRYPT
+            ? param_types != exp_encrypt_types
+            : param_types != exp_decrypt_types ||
+                  params[3].memref.size != TA_SEAL_KEY_CHUNK_PREFIX_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (cs->mode == TEE_MODE_ENCRYPT)
+        dst_sz = src_sz + sizeof(tag);
+    else if (src_sz >= sizeof(tag))
+        dst_sz = src_sz - sizeof(tag);
+    else
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[2].memref.size < dst_sz) {
+        params[2].memref.size = dst_sz;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    if (cs->mode == TEE_MODE_ENCRYPT) {
+        res = chunk_claim(cs, index);
+        if (res != TEE_SUCCESS) {
+            EMSG("Chunk %" PRIu32 " is not for this session to seal", index);
+            return res;
+        }
+        TEE_MemMove(nonce, cs->prefix, sizeof(cs->prefix));
+    } else {
+        TEE_MemMove(nonce, params[3].memref.buffer, sizeof(cs->prefix));
+    }
+    nonce[7] = index >> 24;
+    nonce[8] = index >> 16;
+    nonce[9] = index >> 8;
+    nonce[10] = index;
+    nonce[11] = params[0].value.b ? 1 : 0;
+
+    res = TEE_AEInit(cs->op, nonce, sizeof(nonce), sizeof(tag) * 8, 0, 0);
+    if (res != TEE_SUCCESS)
+        return res;
+    if (cs->aad_sz)
+        TEE_AEUpdateAAD(cs->op, cs->aad, cs->aad_sz);
+
+    if (cs->mode == TEE_MODE_ENCRYPT) {
+        res = TEE_AEEncryptFinal(cs->op, src, src_sz, dst, &dst_sz, tag,
+                                 &tag_sz);
+        if (res == TEE_SUCCESS) {
+            TEE_MemMove(dst + dst_sz, tag, tag_sz);
+            dst_sz += tag_sz;
+        }
+    } else {
+        TEE_MemMove(tag, src + dst_sz, sizeof(tag));
+        res = TEE_AEDecryptFinal(cs->op, src, dst_sz, dst, &dst_sz, tag,
+                                 sizeof(tag));
+    }
+    if (res != TEE_SUCCESS) {
+        EMSG("Chunk %" PRIu32 " failed 0x%08x", index, res);
+        return res;
+    }
+    params[2].memref.size = dst_sz;
+    return TEE_SUCCESS;
+}
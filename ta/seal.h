@@ -0,0 +1,47 @@
+#ifndef SEAL_H
+#define SEAL_H
+
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+
+/* Streaming AES-GCM state kept per session */
+struct ae_stream {
+    TEE_OperationHandle op;
+    uint32_t mode;
+};
+
+TEE_Result ae_stream_init(struct ae_stream *ae, uint32_t param_types,
+                          TEE_Param params[4]);
+TEE_Result ae_stream_update(struct ae_stream *ae, uint32_t param_types,
+                            TEE_Param params[4]);
+TEE_Result ae_stream_final(struct ae_stream *ae, uint32_t param_types,
+                           TEE_Param params[4]);
+void ae_stream_release(struct ae_stream *ae);
+
+/*
+ * Chunk indices a session keeps track of to seal each one only once, enough
+ * for every session of a file to be a few chunks ahead of the others.
+ */
+#define CHUNK_WINDOW (4 * TA_SEAL_KEY_CHUNK_MAX_SESSIONS)
+
+/* Independently authenticated chunks, see TA_SEAL_KEY_CMD_CHUNK_INIT */
+struct chunk_stream {
+    TEE_OperationHandle op;
+    uint32_t mode;
+    uint32_t sessions;
+    uint32_t lane;
+    uint8_t prefix[TA_SEAL_KEY_CHUNK_PREFIX_SIZE];
+    uint8_t aad[TA_SEAL_KEY_CHUNK_MAX_AAD];
+    uint32_t aad_sz;
+    /* chunk base + n was sealed when bit n of used is set */
+    uint32_t base;
+    uint64_t used[CHUNK_WINDOW / 64];
+};
+
+TEE_Result chunk_stream_init(struct chunk_stream *cs, uint32_t param_types,
+                             TEE_Param params[4]);
+TEE_Result chunk_stream_process(struct chunk_stream *cs, uint32_t param_types,
+                                TEE_Param params[4]);
+void chunk_stream_release(struct chunk_stream *cs);
+
+#endif /* SEAL_H */
@@ -0,0 +1,293 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "batch.h"
+#include "key.h"
+#include "sign.h"
+
+#define SIGN_DIGEST_SIZE 32
+
+/*
+ * A keyed operation for one of the TA_SEAL_KEY_ALG_* algorithms. ECDSA signs
+ * a SHA-256 digest of the message, so it needs a digest operation as well.
+ */
+struct mac_ctx {
+    uint32_t alg;
+    uint32_t mac_sz;
+    TEE_OperationHandle op;
+    TEE_OperationHandle digest;
+};
+
+static void mac_close(struct mac_ctx *m) {
+    key_put_operation(m->op);
+    m->op = TEE_HANDLE_NULL;
+    if (m->digest != TEE_HANDLE_NULL)
+        TEE_FreeOperation(m->digest);
+    m->digest = TEE_HANDLE_NULL;
+}
+
+static TEE_Result mac_open(struct mac_ctx *m, const void *id, uint32_t id_sz,
+                           uint32_t alg, bool verify) {
+    uint32_t algorithm, mode;
+    TEE_Result res;
+
+    TEE_MemFill(m, 0, sizeof(*m));
+    m->alg = alg;
+    switch (alg) {
+    case TA_SEAL_KEY_ALG_HMAC_SHA256:
+        algorithm = TEE_ALG_HMAC_SHA256;
+        mode = TEE_MODE_MAC;
+        m->mac_sz = TA_SEAL_KEY_HMAC_SHA256_SIZE;
+        break;
+    case TA_SEAL_KEY_ALG_ECDSA_P256:
+        algorithm = TEE_ALG_ECDSA_P256;
+        mode = verify ? TEE_MODE_VERIFY : TEE_MODE_SIGN;
+        m->mac_sz = TA_SEAL_KEY_ECDSA_P256_SIZE;
+        break;
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = key_get_operation(id, id_sz, algorithm, mode, &m->op);
+    if (res != TEE_SUCCESS)
+        return res;
+    if (alg == TA_SEAL_KEY_ALG_ECDSA_P256) {
+        res = TEE_AllocateOperation(&m->digest, TEE_ALG_SHA256,
+                                    TEE_MODE_DIGEST, 0);
+        if (res != TEE_SUCCESS)
+            mac_close(m);
+    }
+    return res;
+}
+
+static TEE_Result mac_digest(struct mac_ctx *m, const void *msg,
+                             uint32_t msg_sz, uint8_t *hash) {
+    uint32_t hash_sz = SIGN_DIGEST_SIZE;
+
+    return TEE_DigestDoFinal(m->digest, msg, msg_sz, hash, &hash_sz);
+}
+
+static TEE_Result mac_compute(struct mac_ctx *m, const void *msg,
+                              uint32_t msg_sz, void *mac, uint32_t *mac_sz) {
+    uint8_t hash[SIGN_DIGEST_SIZE];
+    TEE_Result res;
+
+    if (m->alg == TA_SEAL_KEY_ALG_HMAC_SHA256) {
+        TEE_MACInit(m->op, NULL, 0);
+        return TEE_MACComputeFinal(m->op, msg, msg_sz, mac, mac_sz);
+    }
+
+    res = mac_digest(m, msg, msg_sz, hash);
+    if (res != TEE_SUCCESS)
+        return res;
+    return TEE_AsymmetricSignDigest(m->op, NULL, 0, hash, sizeof(hash), mac,
+                                    mac_sz);
+}
+
+static TEE_Result mac_check(struct mac_ctx *m, const void *msg,
+                            uint32_t msg_sz, const void *mac,
+                            uint32_t mac_sz) {
+    uint8_t hash[SIGN_DIGEST_SIZE];
+    TEE_Result res;
+
+    if (m->alg == TA_SEAL_KEY_ALG_HMAC_SHA256) {
+        TEE_MACInit(m->op, NULL, 0);
+        return TEE_MACCompareFinal(m->op, msg, msg_sz, mac, mac_sz);
+    }
+
+    res = mac_digest(m, msg, msg_sz, hash);
+    if (res != TEE_SUCCESS)
+        return res;
+    return TEE_AsymmetricVerifyDigest(m->op, NULL, 0, hash, sizeof(hash), mac,
+                                      mac_sz);
+}
+
+TEE_Result sign_mac(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT);
+    struct mac_ctx m;
+    uint32_t mac_sz;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = mac_open(&m, params[0].memref.buffer, params[0].memref.size,
+                   params[1].value.a, false);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (params[3].memref.size < m.mac_sz) {
+        params[3].memref.size = m.mac_sz;
+        mac_close(&m);
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    mac_sz = params[3].memref.size;
+    res = mac_compute(&m, params[2].memref.buffer, params[2].memref.size,
+                      params[3].memref.buffer, &mac_sz);
+    if (res == TEE_SUCCESS)
+        params[3].memref.size = mac_sz;
+    else
+        EMSG("MAC failed 0x%08x", res);
+    mac_close(&m);
+    return res;
+}
+
+TEE_Result sign_verify(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT);
+    struct mac_ctx m;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = mac_open(&m, params[0].memref.buffer, params[0].memref.size,
+                   params[1].value.a, true);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = mac_check(&m, params[2].memref.buffer, params[2].memref.size,
+                    params[3].memref.buffer, params[3].memref.size);
+    mac_close(&m);
+    return res;
+}
+
+/*
+ * The batch commands walk the message buffer while processing it. Lengths
+ * are checked against the buffer before every message, a malformed buffer
+ * fails the whole batch while a message that does not verify only fails
+ * its own entry.
+ */
+TEE_Result sign_mac_batch(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT);
+    const uint8_t *in = params[2].memref.buffer;
+    uint32_t in_sz = params[2].memref.size;
+    uint8_t *out = params[3].memref.buffer;
+    uint32_t count = params[1].value.b;
+    uint32_t in_pos = 0;
+    uint32_t out_pos = 0;
+    uint32_t failed = 0;
+    uint32_t msg_sz, mac_sz, n;
+    struct mac_ctx m;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = mac_open(&m, params[0].memref.buffer, params[0].memref.size,
+                   params[1].value.a, false);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (count > (UINT32_MAX - TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE) /
+                    (TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + m.mac_sz)) {
+        res = TEE_ERROR_BAD_PARAMETERS;
+        goto exit;
+    }
+    if (params[3].memref.size <
+        count * (TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + m.mac_sz)) {
+        params[3].memref.size =
+            count * (TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + m.mac_sz);
+        res = TEE_ERROR_SHORT_BUFFER;
+        goto exit;
+    }
+
+    for (n = 0; n < count; n++) {
+        uint8_t *mac = out + out_pos + TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE;
+
+        if (in_sz - in_pos < 4) {
+            res = TEE_ERROR_BAD_PARAMETERS;
+            goto exit;
+        }
+        msg_sz = get_be32(in + in_pos);
+        in_pos += 4;
+        if (msg_sz > in_sz - in_pos) {
+            res = TEE_ERROR_BAD_PARAMETERS;
+            goto exit;
+        }
+
+        mac_sz = m.mac_sz;
+        res = mac_compute(&m, in + in_pos, msg_sz, mac, &mac_sz);
+        if (res != TEE_SUCCESS) {
+            mac_sz = 0;
+            failed++;
+        }
+        put_be32(out + out_pos, res);
+        put_be32(out + out_pos + 4, mac_sz);
+        in_pos += msg_sz;
+        out_pos += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE + mac_sz;
+    }
+
+    res = TEE_SUCCESS;
+    params[1].value.b = failed;
+    params[3].memref.size = out_pos;
+exit:
+    mac_close(&m);
+    return res;
+}
+
+TEE_Result sign_verify_batch(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT);
+    const uint8_t *in = params[2].memref.buffer;
+    uint32_t in_sz = params[2].memref.size;
+    uint8_t *out = params[3].memref.buffer;
+    uint32_t count = params[1].value.b;
+    uint32_t pos = 0;
+    uint32_t failed = 0;
+    uint32_t msg_sz, mac_sz, n;
+    struct mac_ctx m;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (count > UINT32_MAX / 4)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[3].memref.size < count * 4) {
+        params[3].memref.size = count * 4;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    res = mac_open(&m, params[0].memref.buffer, params[0].memref.size,
+                   params[1].value.a, true);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    for (n = 0; n < count; n++) {
+        if (in_sz - pos < TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE) {
+            res = TEE_ERROR_BAD_PARAMETERS;
+            goto exit;
+        }
+        msg_sz = get_be32(in + pos);
+        mac_sz = get_be32(in + pos + 4);
+        pos += TA_SEAL_KEY_BATCH_RECORD_HDR_SIZE;
+        if (msg_sz > in_sz - pos || mac_sz > in_sz - pos - msg_sz) {
+            res = TEE_ERROR_BAD_PARAMETERS;
+            goto exit;
+        }
+
+        res = mac_check(&m, in + pos, msg_sz, in + pos + msg_sz, mac_sz);
+        if (res != TEE_SUCCESS)
+            failed++;
+        put_be32(out + n * 4, res);
+        pos += msg_sz + mac_sz;
+    }
+
+    res = TEE_SUCCESS;
+    params[1].value.b = failed;
+    params[3].memref.size = count * 4;
+exit:
+    mac_close(&m);
+    return res;
+}
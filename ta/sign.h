@@ -0,0 +1,11 @@
+#ifndef SIGN_H
+#define SIGN_H
+
+#include <tee_internal_api.h>
+
+TEE_Result sign_mac(uint32_t param_types, TEE_Param params[4]);
+TEE_Result sign_verify(uint32_t param_types, TEE_Param params[4]);
+TEE_Result sign_mac_batch(uint32_t param_types, TEE_Param params[4]);
+TEE_Result sign_verify_batch(uint32_t param_types, TEE_Param params[4]);
+
+#endif /* SIGN_H */
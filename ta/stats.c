@@ -0,0 +1,194 @@
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "stats.h"
+
+static struct ta_seal_key_stats stats;
+/* The entry of the running command, NULL when it is not counted */
+static struct ta_seal_key_command_stats *current;
+/* The trace of the running command, NULL when it is not traced */
+static struct ta_seal_key_trace *trace;
+static uint32_t started;
+
+/*
+ * Milliseconds on a clock that wraps after 49 days, only the difference of
+ * two readings is meaningful.
+ */
+uint32_t stats_clock(void) {
+    TEE_Time t;
+
+    TEE_GetSystemTime(&t);
+    return t.seconds * 1000 + t.millis;
+}
+
+void stats_reset(void) {
+    TEE_Time t;
+
+    TEE_GetSystemTime(&t);
+    TEE_MemFill(&stats, 0, sizeof(stats));
+    stats.since = t.seconds;
+}
+
+/* The bytes passed in the memrefs of the given direction */
+static uint64_t memref_bytes(uint32_t param_types, TEE_Param params[4],
+                             uint32_t type) {
+    uint64_t bytes = 0;
+    uint32_t t;
+
+    for (size_t i = 0; i < 4; i++) {
+        t = TEE_PARAM_TYPE_GET(param_types, i);
+        if (t == type || t == TEE_PARAM_TYPE_MEMREF_INOUT)
+            bytes += params[i].memref.size;
+    }
+    return bytes;
+}
+
+/* Start counting and, if the session asked for it, tracing a command */
+void stats_begin(uint32_t command, uint32_t param_types, TEE_Param params[4],
+                 struct ta_seal_key_trace *t) {
+    current = NULL;
+    trace = NULL;
+    if (command == TA_SEAL_KEY_CMD_TRACE)
+        return;
+
+    if (command < TA_SEAL_KEY_STATS_COMMANDS &&
+        command != TA_SEAL_KEY_CMD_STATS) {
+        current = &stats.command[command];
+        current->calls++;
+        current->bytes_in +=
+            memref_bytes(param_types, params, TEE_PARAM_TYPE_MEMREF_INPUT);
+    }
+    if (t) {
+        trace = t;
+        trace->command = command;
+        trace->spans = 0;
+        trace->dropped = 0;
+    }
+    started = stats_clock();
+}
+
+static void count_error(TEE_Result res) {
+    struct ta_seal_key_error_count *c = current->codes;
+    size_t i;
+
+    current->errors++;
+    /* Slots are taken in order, the first empty one ends the used ones */
+    for (i = 0; i < TA_SEAL_KEY_STATS_CODES; i++)
+        if (c[i].count == 0 || c[i].code == res)
+            break;
+    if (i == TA_SEAL_KEY_STATS_CODES) {
+        current->other_errors++;
+        return;
+    }
+    c[i].code = res;
+    c[i].count++;
+}
+
+void stats_end(TEE_Result res, uint32_t param_types, TEE_Param params[4]) {
+    uint32_t ms = stats_clock() - started;
+
+    if (trace) {
+        trace->result = res;
+        trace->time_ms = ms;
+        trace = NULL;
+    }
+    if (!current)
+        return;
+
+    current->time_ms += ms;
+    if (ms > current->max_ms)
+        current->max_ms = ms;
+    if (res == TEE_SUCCESS)
+        current->bytes_out +=
+            memref_bytes(param_types, params, TEE_PARAM_TYPE_MEMREF_OUTPUT);
+    else
+        count_error(res);
+    current = NULL;
+}
+
+/*
+ * Charge the time since *clock to the phase of the running command and
+ * restart the clock for the next phase.
+ */
+void stats_phase(uint32_t *clock, unsigned int phase) {
+    uint32_t now = stats_clock();
+    struct ta_seal_key_span *s;
+
+    if (current && phase < TA_SEAL_KEY_PHASES)
+        current->phase_ms[phase] += now - *clock;
+    if (trace && trace->spans == TA_SEAL_KEY_TRACE_SPANS) {
+        trace->dropped++;
+    } else if (trace) {
+        s = &trace->span[trace->spans++];
+        s->phase = phase;
+        s->start_ms = *clock - started;
+        s->end_ms = now - started;
+    }
+    *clock = now;
+}
+
+TEE_Result stats_command(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    TEE_Time t;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[1].value.a & ~(uint32_t)TA_SEAL_KEY_STATS_RESET)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (params[0].memref.size < sizeof(stats)) {
+        params[0].memref.size = sizeof(stats);
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    TEE_GetSystemTime(&t);
+    stats.version = TA_SEAL_KEY_STATS_VERSION;
+    stats.commands = TA_SEAL_KEY_STATS_COMMANDS;
+    stats.now = t.seconds;
+    TEE_MemMove(params[0].memref.buffer, &stats, sizeof(stats));
+    params[0].memref.size = sizeof(stats);
+
+    if (params[1].value.a & TA_SEAL_KEY_STATS_RESET)
+        stats_reset();
+    return TEE_SUCCESS;
+}
+
+/*
+ * Hand out the trace of the last command of the session and switch tracing
+ * of its following commands on or off.
+ */
+TEE_Result stats_trace(struct ta_seal_key_trace **t, uint32_t param_types,
+                       TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[1].value.a & ~(uint32_t)TA_SEAL_KEY_TRACE_ON)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (params[0].memref.size < sizeof(**t)) {
+        params[0].memref.size = sizeof(**t);
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    if (!*t) {
+        *t = TEE_Malloc(sizeof(**t), TEE_MALLOC_FILL_ZERO);
+        if (!*t)
+            return TEE_ERROR_OUT_OF_MEMORY;
+        (*t)->version = TA_SEAL_KEY_TRACE_VERSION;
+        (*t)->command = TA_SEAL_KEY_TRACE_NONE;
+    }
+    TEE_MemMove(params[0].memref.buffer, *t, sizeof(**t));
+    params[0].memref.size = sizeof(**t);
+
+    if (!(params[1].value.a & TA_SEAL_KEY_TRACE_ON)) {
+        TEE_Free(*t);
+        *t = NULL;
+    }
+    return TEE_SUCCESS;
+}
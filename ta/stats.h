@@ -0,0 +1,23 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+
+/*
+ * Counters of the commands the TA ran, see TA_SEAL_KEY_CMD_STATS, and the
+ * trace of the running one, see TA_SEAL_KEY_CMD_TRACE. They are plain
+ * globals: an instance of the TA runs one command at a time.
+ */
+
+void stats_reset(void);
+void stats_begin(uint32_t command, uint32_t param_types, TEE_Param params[4],
+                 struct ta_seal_key_trace *trace);
+void stats_end(TEE_Result res, uint32_t param_types, TEE_Param params[4]);
+uint32_t stats_clock(void);
+void stats_phase(uint32_t *clock, unsigned int phase);
+TEE_Result stats_command(uint32_t param_types, TEE_Param params[4]);
+TEE_Result stats_trace(struct ta_seal_key_trace **trace, uint32_t param_types,
+                       TEE_Param params[4]);
+
+#endif /* STATS_H */
@@ -1,2 +1,19 @@
 global-incdirs-y += include
 srcs-y += seal-key_ta.c
+srcs-y += key.c
+srcs-y += seal.c
+srcs-y += batch.c
+srcs-y += sign.c
+srcs-y += derive.c
+srcs-y += generate.c
+srcs-y += wrap.c
+srcs-y += archive.c
+srcs-y += sync.c
+srcs-y += stats.c
+srcs-y += hotkeys.c
+
+# size of the hot key sketch and its half life, see hotkeys.h
+cflags-y += $(if $(CFG_SEAL_KEY_HOTKEYS_DEPTH),-DHOTKEYS_DEPTH=$(CFG_SEAL_KEY_HOTKEYS_DEPTH))
+cflags-y += $(if $(CFG_SEAL_KEY_HOTKEYS_WIDTH),-DHOTKEYS_WIDTH=$(CFG_SEAL_KEY_HOTKEYS_WIDTH))
+cflags-y += $(if $(CFG_SEAL_KEY_HOTKEYS_TOP),-DHOTKEYS_TOP=$(CFG_SEAL_KEY_HOTKEYS_TOP))
+cflags-y += $(if $(CFG_SEAL_KEY_HOTKEYS_HALF_LIFE),-DHOTKEYS_HALF_LIFE=$(CFG_SEAL_KEY_HOTKEYS_HALF_LIFE))
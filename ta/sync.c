@@ -0,0 +1,574 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <string.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "batch.h"
+#include "sync.h"
+
+#define SYNC_DIGEST_SIZE 32
+/* Object data is hashed in pieces of this size */
+#define SYNC_READ_SIZE 256
+#define SYNC_HASH TA_SEAL_KEY_SYNC_HASH_SIZE
+#define SYNC_FANOUT TA_SEAL_KEY_SYNC_FANOUT
+/* Bits of the object key per level */
+#define SYNC_BITS 4
+/* Nodes of the third level, the deepest one kept up to date */
+#define SYNC_KEPT (SYNC_FANOUT * SYNC_FANOUT)
+/* Objects per leaf on average before the tree gets another level */
+#define SYNC_LEAF_OBJECTS 4
+/* Writes remembered before they are applied to the index */
+#define SYNC_LOG_SIZE 16
+/* Child hashes of every level hashed below a kept node */
+#define SYNC_SCRATCH_SIZE                                                      \
+    ((TA_SEAL_KEY_SYNC_MAX_LEVELS - 1) * SYNC_FANOUT * SYNC_HASH)
+
+#if (1 << SYNC_BITS) != TA_SEAL_KEY_SYNC_FANOUT
+#error "TA_SEAL_KEY_SYNC_FANOUT must be 1 << SYNC_BITS"
+#endif
+#if TA_SEAL_KEY_SYNC_MIN_LEVELS != 3
+#error "The leaves must not be above the kept nodes"
+#endif
+#if TA_SEAL_KEY_SYNC_MAX_LEVELS > 32 / SYNC_BITS
+#error "The leaves of TA_SEAL_KEY_SYNC_MAX_LEVELS do not fit the object key"
+#endif
+
+/* An object of the store, the index is sorted by key and then by ID */
+struct sync_entry {
+    uint32_t key;
+    uint8_t hash[SYNC_HASH];
+    uint8_t id_sz;
+    uint8_t id[];
+};
+
+struct sync_logged {
+    uint8_t id_sz;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+};
+
+/* What hashing objects and nodes needs, allocated per command */
+struct sync_work {
+    TEE_OperationHandle op;
+    uint8_t *buf;
+    uint8_t *scratch;
+};
+
+/*
+ * Summary of the store shared by the sessions of the instance. The index
+ * holds the key, ID and hash of every object, so the objects of a node are
+ * next to each other and neither the summary nor a listing has to walk the
+ * store. Writes only log the ID, the next read of the summary hashes the
+ * logged objects and rehashes the nodes above them. The first three levels
+ * are kept, deeper nodes are hashed from the index when they are read.
+ */
+static struct sync_entry **sync_index;
+static uint32_t sync_count;
+static uint32_t sync_size;
+static struct sync_logged sync_log[SYNC_LOG_SIZE];
+static uint32_t sync_logged;
+static uint8_t sync_level2[SYNC_KEPT][SYNC_HASH];
+static uint8_t sync_level1[SYNC_FANOUT][SYNC_HASH];
+static uint8_t sync_root[SYNC_HASH];
+static uint8_t sync_dirty[SYNC_KEPT / 8];
+static uint32_t sync_depth;
+static uint32_t sync_generation;
+static bool sync_valid;
+
+/*
+ * FNV-1a of the ID with the finalizer of murmur3, both ends of a sync have
+ * to agree on it. The node of an object at level n is its top n * SYNC_BITS
+ * bits.
+ */
+static uint32_t sync_key_of(const void *id, uint32_t id_sz) {
+    const uint8_t *p = id;
+    uint32_t h = 2166136261u;
+    uint32_t n;
+
+    for (n = 0; n < id_sz; n++)
+        h = (h ^ p[n]) * 16777619u;
+    h = (h ^ (h >> 16)) * 0x85ebca6bu;
+    h = (h ^ (h >> 13)) * 0xc2b2ae35u;
+    return h ^ (h >> 16);
+}
+
+static uint32_t sync_node_of(uint32_t key, uint32_t level) {
+    return level ? key >> (32 - SYNC_BITS * level) : 0;
+}
+
+static bool sync_bit(const uint8_t *bitmap, uint32_t n) {
+    return bitmap[n / 8] & (1 << (n % 8));
+}
+
+static int sync_cmp(const struct sync_entry *e, uint32_t key, const void *id,
+                    uint32_t id_sz) {
+    if (e->key != key)
+        return e->key < key ? -1 : 1;
+    if (e->id_sz != id_sz)
+        return e->id_sz < id_sz ? -1 : 1;
+    return TEE_MemCompare(e->id, id, id_sz);
+}
+
+/* Position of the first entry not before @key and @id, no ID sorts first */
+static uint32_t sync_find(uint32_t key, const void *id, uint32_t id_sz) {
+    uint32_t lo = 0;
+    uint32_t hi = sync_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (sync_cmp(sync_index[mid], key, id, id_sz) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Position of the first entry of the node @index of @level */
+static uint32_t sync_first(uint32_t level, uint32_t index) {
+    return level ? sync_find(index << (32 - SYNC_BITS * level), NULL, 0) : 0;
+}
+
+/* Forget the index, it is rebuilt from the store when it is read again */
+static void sync_drop(void) {
+    uint32_t n;
+
+    for (n = 0; n < sync_count; n++)
+        TEE_Free(sync_index[n]);
+    TEE_Free(sync_index);
+    sync_index = NULL;
+    sync_count = 0;
+    sync_size = 0;
+    sync_logged = 0;
+    sync_valid = false;
+}
+
+/*
+ * Put the hash of the object @id into the index, remove the object when
+ * @hash is NULL. The kept node above it is marked for rehashing.
+ */
+static TEE_Result sync_set(const void *id, uint32_t id_sz,
+                           const uint8_t *hash) {
+    uint32_t key = sync_key_of(id, id_sz);
+    uint32_t pos = sync_find(key, id, id_sz);
+    bool found =
+        pos < sync_count && !sync_cmp(sync_index[pos], key, id, id_sz);
+    struct sync_entry *e;
+    uint32_t node;
+
+    if (!found && !hash)
+        return TEE_SUCCESS;
+    if (found && hash) {
+        if (!TEE_MemCompare(sync_index[pos]->hash, hash, SYNC_HASH))
+            return TEE_SUCCESS;
+        TEE_MemMove(sync_index[pos]->hash, hash, SYNC_HASH);
+    } else if (found) {
+        TEE_Free(sync_index[pos]);
+        TEE_MemMove(sync_index + pos, sync_index + pos + 1,
+                    (sync_count - pos - 1) * sizeof(*sync_index));
+        sync_count--;
+    } else {
+        if (sync_count == sync_size) {
+            uint32_t size = sync_size ? 2 * sync_size : 64;
+            void *p = TEE_Realloc(sync_index, size * sizeof(*sync_index));
+
+            if (!p)
+                return TEE_ERROR_OUT_OF_MEMORY;
+            sync_index = p;
+            sync_size = size;
+        }
+        e = TEE_Malloc(sizeof(*e) + id_sz, 0);
+        if (!e)
+            return TEE_ERROR_OUT_OF_MEMORY;
+        e->key = key;
+        TEE_MemMove(e->hash, hash, SYNC_HASH);
+        e->id_sz = id_sz;
+        TEE_MemMove(e->id, id, id_sz);
+        TEE_MemMove(sync_index + pos + 1, sync_index + pos,
+                    (sync_count - pos) * sizeof(*sync_index));
+        sync_index[pos] = e;
+        sync_count++;
+    }
+    node = sync_node_of(key, 2);
+    sync_dirty[node / 8] |= 1 << (node % 8);
+    sync_generation++;
+    return TEE_SUCCESS;
+}
+
+/* @w has to be freed with sync_work_free() even when this fails */
+static TEE_Result sync_work_init(struct sync_work *w) {
+    TEE_Result res;
+
+    w->op = TEE_HANDLE_NULL;
+    w->buf = TEE_Malloc(SYNC_READ_SIZE + SYNC_SCRATCH_SIZE, 0);
+    if (!w->buf)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    w->scratch = w->buf + SYNC_READ_SIZE;
+    res = TEE_AllocateOperation(&w->op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+    if (res != TEE_SUCCESS)
+        w->op = TEE_HANDLE_NULL;
+    return res;
+}
+
+static void sync_work_free(struct sync_work *w) {
+    if (w->op != TEE_HANDLE_NULL)
+        TEE_FreeOperation(w->op);
+    TEE_Free(w->buf);
+}
+
+/*
+ * SHA-256 of TA_SEAL_KEY_SYNC_VERSION, the ID length, the ID and the
+ * stored data, truncated
+ */
+static TEE_Result sync_object_hash(struct sync_work *w, const void *id,
+                                   uint32_t id_sz, uint8_t *hash) {
+    uint8_t digest[SYNC_DIGEST_SIZE];
+    uint32_t digest_sz = sizeof(digest);
+    uint8_t version = TA_SEAL_KEY_SYNC_VERSION;
+    TEE_ObjectHandle object;
+    uint8_t len[4];
+    uint32_t n;
+    TEE_Result res;
+
+    res = TEE_OpenPersistentObject(
+        TEE_STORAGE_PRIVATE, id, id_sz,
+        TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_SHARE_READ, &object);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    TEE_ResetOperation(w->op);
+    put_be32(len, id_sz);
+    TEE_DigestUpdate(w->op, &version, sizeof(version));
+    TEE_DigestUpdate(w->op, len, sizeof(len));
+    TEE_DigestUpdate(w->op, id, id_sz);
+    do {
+        res = TEE_ReadObjectData(object, w->buf, SYNC_READ_SIZE, &n);
+        if (res == TEE_SUCCESS && n)
+            TEE_DigestUpdate(w->op, w->buf, n);
+    } while (res == TEE_SUCCESS && n == SYNC_READ_SIZE);
+    TEE_CloseObject(object);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_DigestDoFinal(w->op, NULL, 0, digest, &digest_sz);
+    if (res == TEE_SUCCESS)
+        TEE_MemMove(hash, digest, SYNC_HASH);
+    return res;
+}
+
+/* Hash the object @id again, or drop it from the index when it is gone */
+static TEE_Result sync_update(struct sync_work *w, const void *id,
+                              uint32_t id_sz) {
+    uint8_t hash[SYNC_HASH];
+    TEE_Result res;
+
+    res = sync_object_hash(w, id, id_sz, hash);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND)
+        return sync_set(id, id_sz, NULL);
+    if (res != TEE_SUCCESS)
+        return res;
+    return sync_set(id, id_sz, hash);
+}
+
+/* Index every object of the store, the only walk over the whole store */
+static TEE_Result sync_build(struct sync_work *w) {
+    TEE_ObjectEnumHandle e = TEE_HANDLE_NULL;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    TEE_Result res;
+
+    sync_drop();
+    res = TEE_AllocatePersistentObjectEnumerator(&e);
+    if (res != TEE_SUCCESS)
+        return res;
+    res = TEE_StartPersistentObjectEnumerator(e, TEE_STORAGE_PRIVATE);
+    while (res == TEE_SUCCESS) {
+        uint32_t id_sz = sizeof(id);
+
+        res = TEE_GetNextPersistentObject(e, NULL, id, &id_sz);
+        if (res == TEE_SUCCESS)
+            res = sync_update(w, id, id_sz);
+    }
+    if (res == TEE_ERROR_ITEM_NOT_FOUND)
+        res = TEE_SUCCESS;
+    TEE_FreePersistentObjectEnumerator(e);
+    TEE_MemFill(sync_dirty, 0xff, sizeof(sync_dirty));
+    return res;
+}
+
+static TEE_Result sync_apply(struct sync_work *w) {
+    TEE_Result res = TEE_SUCCESS;
+    uint32_t n;
+
+    for (n = 0; n < sync_logged && res == TEE_SUCCESS; n++)
+        res = sync_update(w, sync_log[n].id, sync_log[n].id_sz);
+    sync_logged = 0;
+    return res;
+}
+
+/*
+ * Called whenever an object is written or deleted. Before the summary has
+ * been built once there is nothing to keep up to date. A full log is
+ * applied at once, when that fails the index is rebuilt later.
+ */
+void sync_invalidate(const void *id, uint32_t id_sz) {
+    struct sync_work w;
+    uint32_t n;
+
+    if (!sync_valid)
+        return;
+    if (id_sz > TEE_OBJECT_ID_MAX_LEN) {
+        sync_drop();
+        return;
+    }
+    for (n = 0; n < sync_logged; n++)
+        if (sync_log[n].id_sz == id_sz &&
+            !TEE_MemCompare(sync_log[n].id, id, id_sz))
+            return;
+    if (sync_logged == SYNC_LOG_SIZE) {
+        if (sync_work_init(&w) != TEE_SUCCESS || sync_apply(&w) != TEE_SUCCESS)
+            sync_drop();
+        sync_work_free(&w);
+        if (!sync_valid)
+            return;
+    }
+    sync_log[sync_logged].id_sz = id_sz;
+    TEE_MemMove(sync_log[sync_logged].id, id, id_sz);
+    sync_logged++;
+}
+
+/* Hash TA_SEAL_KEY_SYNC_FANOUT child hashes into their parent */
+static TEE_Result sync_node_hash(struct sync_work *w, const void *children,
+                                 uint8_t *hash) {
+    uint8_t digest[SYNC_DIGEST_SIZE];
+    uint32_t digest_sz = sizeof(digest);
+    TEE_Result res;
+
+    TEE_ResetOperation(w->op);
+    res = TEE_DigestDoFinal(w->op, children, SYNC_FANOUT * SYNC_HASH, digest,
+                            &digest_sz);
+    if (res == TEE_SUCCESS)
+        TEE_MemMove(hash, digest, SYNC_HASH);
+    return res;
+}
+
+/*
+ * Hash the node @index of @level from the index. A leaf hash is the XOR of
+ * the hashes of its objects, an empty leaf is all zero. @scratch has room
+ * for the children of every level below @level.
+ */
+static TEE_Result sync_node(struct sync_work *w, uint32_t level,
+                            uint32_t index, uint8_t *scratch, uint8_t *hash) {
+    uint32_t pos;
+    uint32_t n;
+    TEE_Result res;
+
+    if (level == sync_depth - 1) {
+        TEE_MemFill(hash, 0, SYNC_HASH);
+        for (pos = sync_first(level, index);
+             pos < sync_count &&
+             sync_node_of(sync_index[pos]->key, level) == index;
+             pos++)
+            for (n = 0; n < SYNC_HASH; n++)
+                hash[n] ^= sync_index[pos]->hash[n];
+        return TEE_SUCCESS;
+    }
+    for (n = 0; n < SYNC_FANOUT; n++) {
+        res = sync_node(w, level + 1, index * SYNC_FANOUT + n,
+                        scratch + SYNC_FANOUT * SYNC_HASH,
+                        scratch + n * SYNC_HASH);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+    return sync_node_hash(w, scratch, hash);
+}
+
+/* Levels for a store of @count objects */
+static uint32_t sync_depth_for(uint32_t count) {
+    uint32_t depth = TA_SEAL_KEY_SYNC_MIN_LEVELS;
+    uint32_t leaves = SYNC_KEPT;
+
+    while (depth < TA_SEAL_KEY_SYNC_MAX_LEVELS &&
+           count > leaves * SYNC_LEAF_OBJECTS) {
+        depth++;
+        leaves *= SYNC_FANOUT;
+    }
+    return depth;
+}
+
+/*
+ * Bring the index and the kept nodes up to date for a tree of @depth
+ * levels, 0 picks it by the size of the store. The store is only walked
+ * the first time, after that only logged objects are hashed and only the
+ * nodes above them.
+ */
+static TEE_Result sync_refresh(struct sync_work *w, uint32_t depth) {
+    TEE_Result res = TEE_SUCCESS;
+    bool changed = false;
+    uint32_t n;
+    uint32_t c;
+
+    if (!sync_valid)
+        res = sync_build(w);
+    else if (sync_logged)
+        res = sync_apply(w);
+    if (res != TEE_SUCCESS)
+        goto exit;
+    if (!depth)
+        depth = sync_depth_for(sync_count);
+    if (depth != sync_depth) {
+        sync_depth = depth;
+        TEE_MemFill(sync_dirty, 0xff, sizeof(sync_dirty));
+        sync_generation++;
+    }
+
+    for (n = 0; n < SYNC_FANOUT; n++) {
+        bool dirty = false;
+
+        for (c = n * SYNC_FANOUT; c < (n + 1) * SYNC_FANOUT; c++) {
+            if (!sync_bit(sync_dirty, c))
+                continue;
+            res = sync_node(w, 2, c, w->scratch, sync_level2[c]);
+            if (res != TEE_SUCCESS)
+                goto exit;
+            dirty = true;
+        }
+        if (!dirty)
+            continue;
+        res = sync_node_hash(w, sync_level2 + n * SYNC_FANOUT, sync_level1[n]);
+        if (res != TEE_SUCCESS)
+            goto exit;
+        changed = true;
+    }
+    if (changed)
+        res = sync_node_hash(w, sync_level1, sync_root);
+exit:
+    if (res == TEE_SUCCESS) {
+        TEE_MemFill(sync_dirty, 0, sizeof(sync_dirty));
+        sync_valid = true;
+    } else {
+        EMSG("Failed to hash the store, res=0x%08x", res);
+        sync_drop();
+    }
+    return res;
+}
+
+TEE_Result sync_tree(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_VALUE_INOUT, TEE_PARAM_TYPE_NONE);
+    uint32_t level = params[0].value.a;
+    uint32_t first = params[0].value.b;
+    uint32_t depth = params[2].value.a;
+    uint8_t *out = params[1].memref.buffer;
+    struct sync_work w;
+    uint32_t width;
+    uint32_t count;
+    uint32_t n;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (depth && (depth < TA_SEAL_KEY_SYNC_MIN_LEVELS ||
+                  depth > TA_SEAL_KEY_SYNC_MAX_LEVELS))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = sync_work_init(&w);
+    if (res == TEE_SUCCESS)
+        res = sync_refresh(&w, depth);
+    if (res != TEE_SUCCESS)
+        goto exit;
+    if (level >= sync_depth || first >= (1u << (SYNC_BITS * level))) {
+        res = TEE_ERROR_BAD_PARAMETERS;
+        goto exit;
+    }
+    width = 1 << (SYNC_BITS * level);
+    count = params[1].memref.size / SYNC_HASH;
+    if (count > width - first)
+        count = width - first;
+
+    switch (level) {
+    case 0:
+        TEE_MemMove(out, sync_root, SYNC_HASH);
+        break;
+    case 1:
+        TEE_MemMove(out, sync_level1[first], count * SYNC_HASH);
+        break;
+    case 2:
+        TEE_MemMove(out, sync_level2[first], count * SYNC_HASH);
+        break;
+    default:
+        for (n = 0; n < count && res == TEE_SUCCESS; n++)
+            res = sync_node(&w, level, first + n, w.scratch,
+                            out + n * SYNC_HASH);
+    }
+    if (res != TEE_SUCCESS)
+        goto exit;
+    params[1].memref.size = count * SYNC_HASH;
+    params[2].value.a = sync_depth;
+    params[2].value.b = sync_generation;
+exit:
+    sync_work_free(&w);
+    return res;
+}
+
+TEE_Result sync_list(uint32_t param_types, TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_VALUE_INOUT);
+    const uint8_t *leaves = params[0].memref.buffer;
+    uint32_t count = params[0].memref.size / 4;
+    uint32_t leaf = params[1].value.a;
+    uint32_t done = params[1].value.b;
+    uint8_t *out = params[2].memref.buffer;
+    uint32_t out_sz = params[2].memref.size;
+    uint32_t depth = params[3].value.a;
+    struct sync_work w;
+    uint32_t pos = 0;
+    uint32_t n;
+    TEE_Result res;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[0].memref.size % 4 || leaf > count ||
+        depth < TA_SEAL_KEY_SYNC_MIN_LEVELS ||
+        depth > TA_SEAL_KEY_SYNC_MAX_LEVELS ||
+        out_sz < TA_SEAL_KEY_SYNC_MAX_RECORD)
+        return TEE_ERROR_BAD_PARAMETERS;
+    for (n = leaf; n < count; n++)
+        if (get_be32(leaves + 4 * n) >> (SYNC_BITS * (depth - 1)))
+            return TEE_ERROR_BAD_PARAMETERS;
+
+    res = sync_work_init(&w);
+    if (res == TEE_SUCCESS)
+        res = sync_refresh(&w, depth);
+    sync_work_free(&w);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    /* The objects of a leaf are next to each other in the index */
+    for (; leaf < count; leaf++, done = 0) {
+        uint32_t index = get_be32(leaves + 4 * leaf);
+
+        for (n = sync_first(depth - 1, index) + done;
+             n < sync_count &&
+             sync_node_of(sync_index[n]->key, depth - 1) == index;
+             n++, done++) {
+            const struct sync_entry *e = sync_index[n];
+
+            if (out_sz - pos < 1u + e->id_sz + SYNC_HASH)
+                goto full;
+            out[pos] = e->id_sz;
+            TEE_MemMove(out + pos + 1, e->id, e->id_sz);
+            TEE_MemMove(out + pos + 1 + e->id_sz, e->hash, SYNC_HASH);
+            pos += 1 + e->id_sz + SYNC_HASH;
+        }
+    }
+full:
+    params[1].value.a = leaf;
+    params[1].value.b = done;
+    params[2].memref.size = pos;
+    params[3].value.b = sync_generation;
+    return TEE_SUCCESS;
+}
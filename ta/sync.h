@@ -0,0 +1,11 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <seal-key_ta.h>
+#include <tee_internal_api.h>
+
+void sync_invalidate(const void *id, uint32_t id_sz);
+TEE_Result sync_tree(uint32_t param_types, TEE_Param params[4]);
+TEE_Result sync_list(uint32_t param_types, TEE_Param params[4]);
+
+#endif /* SYNC_H */
@@ -36,7 +36,21 @@
 
 #define TA_UUID TA_SEAL_KEY_UUID
 
-#define TA_FLAGS (TA_FLAG_EXEC_DDR | TA_FLAG_SINGLE_INSTANCE)
+/*
+ * Every session gets an instance of its own by default, so sessions run in
+ * parallel, for example the sessions sealing the chunks of one file. With
+ * CFG_SEAL_KEY_SHARED_INSTANCE=y all sessions share one instance that is
+ * kept alive, so the operation pool, the statistics and the hot keys cover
+ * every client, but OP-TEE then runs the commands of all of them one at a
+ * time.
+ */
+#ifdef CFG_SEAL_KEY_SHARED_INSTANCE
+#define TA_FLAGS                                                               \
+  (TA_FLAG_EXEC_DDR | TA_FLAG_SINGLE_INSTANCE | TA_FLAG_MULTI_SESSION |        \
+   TA_FLAG_INSTANCE_KEEP_ALIVE)
+#else
+#define TA_FLAGS TA_FLAG_EXEC_DDR
+#endif
 #define TA_STACK_SIZE (2 * 1024)
 #define TA_DATA_SIZE (32 * 1024)
 
@@ -0,0 +1,361 @@
+#include <inttypes.h>
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "key.h"
+#include "wrap.h"
+
+static const uint8_t wrap_magic[WRAP_MAGIC_SIZE] = {0, 'S', 'K', 'W'};
+
+static bool wrap_has_magic(const void *data, uint32_t data_sz) {
+    return data_sz >= WRAP_MAGIC_SIZE &&
+           !TEE_MemCompare(data, wrap_magic, WRAP_MAGIC_SIZE);
+}
+
+/* Find the KEK id in a wrapped object, @hdr_sz is the size up to the nonce */
+static TEE_Result wrap_header(const uint8_t *in, uint32_t in_sz,
+                              const uint8_t **kek, uint32_t *kek_sz,
+                              uint32_t *hdr_sz) {
+    if (!wrap_has_magic(in, in_sz) || in_sz <= WRAP_MAGIC_SIZE)
+        return TEE_ERROR_BAD_FORMAT;
+    *kek = in + WRAP_MAGIC_SIZE + 1;
+    *kek_sz = in[WRAP_MAGIC_SIZE];
+    *hdr_sz = WRAP_MAGIC_SIZE + 1 + *kek_sz;
+    if (!*kek_sz || *kek_sz > TEE_OBJECT_ID_MAX_LEN ||
+        in_sz < *hdr_sz + TA_SEAL_KEY_AE_NONCE_SIZE + TA_SEAL_KEY_AE_TAG_SIZE)
+        return TEE_ERROR_BAD_FORMAT;
+    return TEE_SUCCESS;
+}
+
+/*
+ * Only an object with the magic and a whole header counts as wrapped. Plain
+ * keys starting with the magic are refused by wrap_check_plain(), but some
+ * may have been stored before that, they are read as plain keys.
+ */
+bool wrap_is_wrapped(const void *data, uint32_t data_sz) {
+    const uint8_t *kek;
+    uint32_t kek_sz;
+    uint32_t hdr_sz;
+
+    return wrap_header(data, data_sz, &kek, &kek_sz, &hdr_sz) == TEE_SUCCESS;
+}
+
+/* A plain key must not start like a wrapped one, it could not be read back */
+TEE_Result wrap_check_plain(const void *data, uint32_t data_sz) {
+    if (wrap_has_magic(data, data_sz)) {
+        EMSG("Plain data must not start with the wrapped key magic");
+        return TEE_ERROR_BAD_FORMAT;
+    }
+    return TEE_SUCCESS;
+}
+
+/* Wrap @in, the key of object @id, with the KEK @kek keyed into @op */
+static TEE_Result wrap_seal(TEE_OperationHandle op, const void *kek,
+                            uint32_t kek_sz, const void *id, uint32_t id_sz,
+                            const void *in, uint32_t in_sz, uint8_t *out,
+                            uint32_t *out_sz) {
+    uint32_t hdr_sz = WRAP_MAGIC_SIZE + 1 + kek_sz;
+    uint8_t *nonce = out + hdr_sz;
+    uint8_t *ct = nonce + TA_SEAL_KEY_AE_NONCE_SIZE;
+    uint32_t ct_sz = in_sz;
+    uint32_t tag_sz = TA_SEAL_KEY_AE_TAG_SIZE;
+    TEE_Result res;
+
+    if (*out_sz < hdr_sz + TA_SEAL_KEY_AE_NONCE_SIZE + in_sz + tag_sz)
+        return TEE_ERROR_SHORT_BUFFER;
+
+    TEE_MemMove(out, wrap_magic, WRAP_MAGIC_SIZE);
+    out[WRAP_MAGIC_SIZE] = kek_sz;
+    TEE_MemMove(out + WRAP_MAGIC_SIZE + 1, kek, kek_sz);
+    TEE_GenerateRandom(nonce, TA_SEAL_KEY_AE_NONCE_SIZE);
+
+    res = TEE_AEInit(op, nonce, TA_SEAL_KEY_AE_NONCE_SIZE, tag_sz * 8,
+                     hdr_sz + id_sz, in_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_AEUpdateAAD(op, out, hdr_sz);
+    TEE_AEUpdateAAD(op, id, id_sz);
+    res = TEE_AEEncryptFinal(op, in, in_sz, ct, &ct_sz, ct + in_sz, &tag_sz);
+    if (res == TEE_SUCCESS)
+        *out_sz = hdr_sz + TA_SEAL_KEY_AE_NONCE_SIZE + ct_sz + tag_sz;
+    return res;
+}
+
+/* Unwrap the object @id with the KEK keyed into @op */
+static TEE_Result wrap_open(TEE_OperationHandle op, const void *id,
+                            uint32_t id_sz, const uint8_t *in, uint32_t in_sz,
+                            void *out, uint32_t *out_sz) {
+    const uint8_t *kek;
+    uint32_t kek_sz;
+    uint32_t hdr_sz;
+    uint32_t ct_sz;
+    TEE_Result res;
+
+    res = wrap_header(in, in_sz, &kek, &kek_sz, &hdr_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    ct_sz = in_sz - hdr_sz - TA_SEAL_KEY_AE_NONCE_SIZE -
+            TA_SEAL_KEY_AE_TAG_SIZE;
+    if (*out_sz < ct_sz)
+        return TEE_ERROR_SHORT_BUFFER;
+
+    res = TEE_AEInit(op, in + hdr_sz, TA_SEAL_KEY_AE_NONCE_SIZE,
+                     TA_SEAL_KEY_AE_TAG_SIZE * 8, hdr_sz + id_sz, ct_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_AEUpdateAAD(op, in, hdr_sz);
+    TEE_AEUpdateAAD(op, id, id_sz);
+    return TEE_AEDecryptFinal(
+        op, in + hdr_sz + TA_SEAL_KEY_AE_NONCE_SIZE, ct_sz, out, out_sz,
+        in + in_sz - TA_SEAL_KEY_AE_TAG_SIZE, TA_SEAL_KEY_AE_TAG_SIZE);
+}
+
+/*
+ * Unwrap the wrapped object data @in of object @id into @out, with the KEK
+ * named in its header. The KEK itself has to be a plain AES key.
+ */
+TEE_Result wrap_unwrap(const void *id, uint32_t id_sz, const void *in,
+                       uint32_t in_sz, void *out, uint32_t *out_sz) {
+    TEE_OperationHandle op;
+    const uint8_t *kek;
+    uint32_t kek_sz;
+    uint32_t hdr_sz;
+    TEE_Result res;
+
+    res = wrap_header(in, in_sz, &kek, &kek_sz, &hdr_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    res = key_alloc_plain_operation(kek, kek_sz, TEE_ALG_AES_GCM,
+                                    TEE_MODE_DECRYPT, &op);
+    if (res != TEE_SUCCESS)
+        return res;
+    res = wrap_open(op, id, id_sz, in, in_sz, out, out_sz);
+    if (res != TEE_SUCCESS)
+        EMSG("Failed to unwrap the key, res=0x%08x", res);
+    TEE_FreeOperation(op);
+    return res;
+}
+
+/* Buffers and keys of one REWRAP_ALL invocation */
+struct rewrap_ctx {
+    const void *old_kek;
+    uint32_t old_kek_sz;
+    TEE_OperationHandle old_op;
+    const void *new_kek;
+    uint32_t new_kek_sz;
+    TEE_OperationHandle new_op;
+    uint8_t data[WRAP_MAX_DATA_SIZE + WRAP_MAX_OVERHEAD];
+    uint8_t plain[WRAP_MAX_DATA_SIZE];
+    uint8_t out[WRAP_MAX_DATA_SIZE + WRAP_MAX_OVERHEAD];
+};
+
+static bool rewrap_same_id(const void *a, uint32_t a_sz, const void *b,
+                           uint32_t b_sz) {
+    return a_sz == b_sz && (!a_sz || !TEE_MemCompare(a, b, a_sz));
+}
+
+/*
+ * Move object @id from the old to the new KEK, @done tells whether it was
+ * under the old KEK at all. The object is replaced by creating it again
+ * with its new data as initial data, which GP guarantees to be atomic: a
+ * crash leaves either the old or the new object behind, and as objects
+ * already under the new KEK are skipped the job can simply be run again.
+ */
+static TEE_Result rewrap_object(struct rewrap_ctx *c, const void *id,
+                                uint32_t id_sz, bool *done) {
+    uint32_t data_sz = sizeof(c->data);
+    uint32_t plain_sz = sizeof(c->plain);
+    uint32_t out_sz = sizeof(c->out);
+    const uint8_t *plain = c->data;
+    const uint8_t *out;
+    const uint8_t *kek = NULL;
+    uint32_t kek_sz = 0;
+    uint32_t hdr_sz;
+    TEE_ObjectHandle object;
+    TEE_Result res;
+
+    *done = false;
+    /* The KEKs stay plain */
+    if (rewrap_same_id(id, id_sz, c->old_kek, c->old_kek_sz) ||
+        rewrap_same_id(id, id_sz, c->new_kek, c->new_kek_sz))
+        return TEE_SUCCESS;
+
+    res = key_read_raw(id, id_sz, c->data, &data_sz);
+    if (res != TEE_SUCCESS)
+        return res;
+    /* Without a whole header the object is a plain key, see above */
+    if (wrap_header(c->data, data_sz, &kek, &kek_sz, &hdr_sz) !=
+        TEE_SUCCESS) {
+        kek = NULL;
+        kek_sz = 0;
+    }
+    if (!rewrap_same_id(kek, kek_sz, c->old_kek, c->old_kek_sz))
+        return TEE_SUCCESS;
+
+    if (c->old_op != TEE_HANDLE_NULL) {
+        res = wrap_open(c->old_op, id, id_sz, c->data, data_sz, c->plain,
+                        &plain_sz);
+        if (res != TEE_SUCCESS)
+            return res;
+        plain = c->plain;
+    } else {
+        if (data_sz > WRAP_MAX_DATA_SIZE)
+            return TEE_ERROR_BAD_FORMAT;
+        plain_sz = data_sz;
+    }
+
+    if (c->new_op != TEE_HANDLE_NULL) {
+        res = wrap_seal(c->new_op, c->new_kek, c->new_kek_sz, id, id_sz,
+                        plain, plain_sz, c->out, &out_sz);
+        if (res != TEE_SUCCESS)
+            return res;
+        out = c->out;
+    } else {
+        /* Unwrapped for good, it has to read back as the same plain key */
+        res = wrap_check_plain(plain, plain_sz);
+        if (res != TEE_SUCCESS)
+            return res;
+        out = plain;
+        out_sz = plain_sz;
+    }
+
+    res = TEE_CreatePersistentObject(
+        TEE_STORAGE_PRIVATE, id, id_sz,
+        TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE |
+            TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_OVERWRITE,
+        TEE_HANDLE_NULL, out, out_sz, &object);
+    if (res != TEE_SUCCESS)
+        return res;
+    TEE_CloseObject(object);
+    key_invalidate(id, id_sz);
+    *done = true;
+    return TEE_SUCCESS;
+}
+
+/* Position the enumerator of @job at @cursor, @end is set when it ran out */
+static TEE_Result rewrap_seek(struct rewrap_job *job, uint32_t cursor,
+                              uint8_t *id, bool *end) {
+    uint32_t id_sz;
+    TEE_Result res;
+
+    *end = false;
+    if (job->e != TEE_HANDLE_NULL && job->pos == cursor)
+        return TEE_SUCCESS;
+
+    if (job->e == TEE_HANDLE_NULL) {
+        res = TEE_AllocatePersistentObjectEnumerator(&job->e);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+    job->pos = 0;
+    res = TEE_StartPersistentObjectEnumerator(job->e, TEE_STORAGE_PRIVATE);
+    while (res == TEE_SUCCESS && job->pos < cursor) {
+        id_sz = TEE_OBJECT_ID_MAX_LEN;
+        res = TEE_GetNextPersistentObject(job->e, NULL, id, &id_sz);
+        if (res == TEE_SUCCESS)
+            job->pos++;
+    }
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        *end = true;
+        res = TEE_SUCCESS;
+    }
+    return res;
+}
+
+TEE_Result rewrap_batch(struct rewrap_job *job, uint32_t param_types,
+                        TEE_Param params[4]) {
+    const uint32_t exp_param_types = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_VALUE_INOUT, TEE_PARAM_TYPE_VALUE_OUTPUT);
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t cursor = params[2].value.a;
+    uint32_t batch = params[2].value.b;
+    uint32_t rewrapped = 0;
+    uint32_t failed = 0;
+    struct rewrap_ctx *c;
+    TEE_Result res;
+    bool end;
+    uint32_t n;
+
+    if (param_types != exp_param_types)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (!batch || batch > TA_SEAL_KEY_REWRAP_MAX_BATCH ||
+        params[0].memref.size > TEE_OBJECT_ID_MAX_LEN ||
+        params[1].memref.size > TEE_OBJECT_ID_MAX_LEN ||
+        rewrap_same_id(params[0].memref.buffer, params[0].memref.size,
+                       params[1].memref.buffer, params[1].memref.size))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    c = TEE_Malloc(sizeof(*c), TEE_MALLOC_FILL_ZERO);
+    if (!c)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    c->old_kek = params[0].memref.buffer;
+    c->old_kek_sz = params[0].memref.size;
+    c->new_kek = params[1].memref.buffer;
+    c->new_kek_sz = params[1].memref.size;
+
+    /* The KEKs are read once per invocation, not once per object */
+    if (c->old_kek_sz) {
+        res = key_alloc_plain_operation(c->old_kek, c->old_kek_sz,
+                                        TEE_ALG_AES_GCM, TEE_MODE_DECRYPT,
+                                        &c->old_op);
+        if (res != TEE_SUCCESS)
+            goto exit;
+    }
+    if (c->new_kek_sz) {
+        res = key_alloc_plain_operation(c->new_kek, c->new_kek_sz,
+                                        TEE_ALG_AES_GCM, TEE_MODE_ENCRYPT,
+                                        &c->new_op);
+        if (res != TEE_SUCCESS)
+            goto exit;
+    }
+
+    res = rewrap_seek(job, cursor, id, &end);
+    for (n = 0; res == TEE_SUCCESS && !end && n < batch; n++) {
+        uint32_t id_sz = sizeof(id);
+        bool done;
+
+        res = TEE_GetNextPersistentObject(job->e, NULL, id, &id_sz);
+        if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+            end = true;
+            res = TEE_SUCCESS;
+            break;
+        }
+        if (res != TEE_SUCCESS)
+            break;
+        job->pos++;
+
+        if (rewrap_object(c, id, id_sz, &done) != TEE_SUCCESS) {
+            EMSG("Failed to rewrap object %" PRIu32 " of the store", job->pos);
+            failed++;
+        } else if (done) {
+            rewrapped++;
+        }
+    }
+    if (res != TEE_SUCCESS)
+        goto exit;
+
+    params[2].value.a = job->pos;
+    params[2].value.b = end;
+    params[3].value.a = rewrapped;
+    params[3].value.b = failed;
+    if (end)
+        rewrap_release(job);
+exit:
+    if (c->old_op != TEE_HANDLE_NULL)
+        TEE_FreeOperation(c->old_op);
+    if (c->new_op != TEE_HANDLE_NULL)
+        TEE_FreeOperation(c->new_op);
+    TEE_MemFill(c, 0, sizeof(*c));
+    TEE_Free(c);
+    return res;
+}
+
+void rewrap_release(struct rewrap_job *job) {
+    if (job->e != TEE_HANDLE_NULL)
+        TEE_FreePersistentObjectEnumerator(job->e);
+    job->e = TEE_HANDLE_NULL;
+    job->pos = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef WRAP_H
+#define WRAP_H
+
+#include <seal-key_ta.h>
+#include <stdbool.h>
+#include <tee_internal_api.h>
+
+/*
+ * A wrapped object holds its key encrypted with a key encryption key (KEK),
+ * an AES key stored in an object of its own:
+ *
+ * magic      4 bytes  "\0SKW"
+ * kek_id_len 1 byte
+ * kek_id     kek_id_len bytes
+ * nonce      TA_SEAL_KEY_AE_NONCE_SIZE bytes
+ * ciphertext
+ * tag        TA_SEAL_KEY_AE_TAG_SIZE bytes
+ *
+ * The header up to the nonce and the object id are the AES-GCM additional
+ * data, so a wrapped key cannot be moved to another object.
+ */
+#define WRAP_MAGIC_SIZE 4
+#define WRAP_MAX_OVERHEAD                                                      \
+  (WRAP_MAGIC_SIZE + 1 + TEE_OBJECT_ID_MAX_LEN + TA_SEAL_KEY_AE_NONCE_SIZE +  \
+   TA_SEAL_KEY_AE_TAG_SIZE)
+/* Largest object REWRAP_ALL can rewrap, the host stores keys up to 1 KiB */
+#define WRAP_MAX_DATA_SIZE 1024
+
+/* Enumeration state of a REWRAP_ALL job kept per session */
+struct rewrap_job {
+    TEE_ObjectEnumHandle e;
+    uint32_t pos;
+};
+
+bool wrap_is_wrapped(const void *data, uint32_t data_sz);
+TEE_Result wrap_check_plain(const void *data, uint32_t data_sz);
+TEE_Result wrap_unwrap(const void *id, uint32_t id_sz, const void *in,
+                       uint32_t in_sz, void *out, uint32_t *out_sz);
+TEE_Result rewrap_batch(struct rewrap_job *job, uint32_t param_types,
+                        TEE_Param params[4]);
+void rewrap_release(struct rewrap_job *job);
+
+#endif /* WRAP_H */